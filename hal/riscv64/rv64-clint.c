@@ -11,10 +11,18 @@
 #include <kern/kern-common.h>
 #include <kern/kern-cpuinfo.h>
 #include <kern/irq-if.h>
+#include <kern/sched-if.h>
 
 #include <hal/riscv64.h>
 #include <hal/hal-traps.h>
 #include <hal/rv64-clint.h>
+#include <hal/rv64-sbi.h>
+
+/** hartマスクの1要素当たりのビット数 */
+#define CLINT_HART_MASK_BITS  ( sizeof(unsigned long) * BITS_PER_BYTE )
+/** hartマスクの要素数 */
+#define CLINT_HART_MASK_NR    \
+	( ( KC_CPUS_NR + CLINT_HART_MASK_BITS - 1 ) / CLINT_HART_MASK_BITS )
 
 /**
    割込みコントローラをシャットダウンする
@@ -73,8 +81,12 @@ clint_irq_is_pending(irq_ctrlr __unused *ctrlr, irq_no irq,
 
 	sip = rv64_read_sip();  /* Supervisor Interrupt Pendingレジスタの現在値を読み込む */
 
-	/* スーパーバイザタイマ割込み, ソフトウエア割込みのいずれかが上がっていることを確認 */
-	return ( ( sip & (SIP_STIP | SIP_SSIP) ) != 0 );
+	/* プロセッサ間割込みはスーパーバイザソフトウエア割込みとして通知される */
+	if ( irq == CLINT_IPI_IRQ )
+		return ( ( sip & SIP_SSIP ) != 0 );
+
+	/* スーパーバイザタイマ割込みが上がっていることを確認 */
+	return ( ( sip & SIP_STIP ) != 0 );
 }
 
 /**
@@ -125,6 +137,13 @@ clint_eoi(irq_ctrlr __unused *ctrlr, irq_no irq){
 	if ( ( irq >= CLINT_IRQ_MAX ) || ( CLINT_IRQ_MIN > irq ) )
 		return ;
 
+	/* タイマ割込みはタイマ割込みハンドラでSTIPを落とす.
+	 * タイマ割込みと同時に到着したプロセッサ間割込みを失わないように
+	 * プロセッサ間割込みの場合のみソフトウエア割込みを落とす
+	 */
+	if ( irq != CLINT_IPI_IRQ )
+		return ;
+
 	sip = rv64_read_sip();  /* Supervisor Interrupt Pendingレジスタの現在値を読み込む */
 	sip &= ~SIP_SSIP; 	/* スーパーバイザソフトウエア割込みを落とす */
 	rv64_write_sip( sip ); /* Supervisor Interrupt Pendingレジスタを更新する */	
@@ -176,6 +195,57 @@ static irq_ctrlr clint_ctrlr={
 	.private = NULL,
 };
 
+/**
+   プロセッサ間割込みハンドラ
+   @param[in] irq     割込み番号
+   @param[in] ctx     割込みコンテキスト
+   @param[in] private 割込みプライベート情報
+   @retval    IRQ_HANDLED 割込みを処理した
+   @note 割込み完了通知でソフトウエア割込みを落としてから呼び出されるため,
+   処理中に送信されたIPIは次の割込みとして受け付ける
+ */
+static int
+rv64_ipi_handler(irq_no __unused irq, trap_context __unused *ctx,
+    void __unused *private){
+
+	/* 再スケジュールを要求する */
+	sched_resched_ipi_handler(krn_current_cpu_get());
+
+	return IRQ_HANDLED;
+}
+
+/**
+   再スケジュールIPIを送信する
+   @param[in] cinf 送信先CPUのCPU情報
+ */
+void
+hal_cpu_send_resched_ipi(cpu_info *cinf){
+	int                                  idx;
+	int                                  off;
+	unsigned long hart_mask[CLINT_HART_MASK_NR];
+
+	memset(&hart_mask[0], 0, sizeof(hart_mask));
+
+	idx = cinf->phys_id / CLINT_HART_MASK_BITS;
+	off = cinf->phys_id % CLINT_HART_MASK_BITS;
+	hart_mask[idx] |= 1UL << off;  /* 送信先hartを設定 */
+
+	ksbi_send_ipi(&hart_mask[0]);  /* マシンモードソフトウエア割込みを発行 */
+}
+
+/**
+   プロセッサ間割込みを初期化する
+ */
+void
+rv64_ipi_init(void){
+	int rc;
+
+	/* プロセッサ間割込みハンドラを登録 */
+	rc = irq_register_handler(CLINT_IPI_IRQ, IRQ_ATTR_NON_NESTABLE|IRQ_ATTR_EXCLUSIVE,
+	    CLINT_IPI_PRIO, rv64_ipi_handler, NULL);
+	kassert( rc == 0);
+}
+
 /**
    Core-Local Interrupt Controller (CLINT)の初期化
  */
@@ -49,6 +49,16 @@ hal_get_physical_cpunum(void){
 
 	return rv64_read_tp(); /* 物理プロセッサIDを返却 */
 }
+
+/**
+   自hartのサイクルカウンタを読み取る
+   @return 自hartが実行したマシン・サイクル数
+ */
+uint64_t
+hal_get_cpu_cycles(void){
+
+	return rv64_read_cycle(); /* cycleレジスタの値を返却 */
+}
 /**
    アーキ固有のCPU情報を更新する
    @param[in] cinf CPU情報
@@ -22,6 +22,7 @@
 
 static vm_paddr kernel_start_phy=(vm_paddr)&_kernel_start;  /* カーネル開始物理アドレス */
 static vm_paddr kheap_end_phy=(vm_paddr)&_kheap_end;        /* カーネル終了物理アドレス */
+static vm_paddr kheap_start_phy=(vm_paddr)&_kernel_end;     /* カーネルヒープ開始物理アドレス */
 
 static spinlock prepare_lock=__SPINLOCK_INITIALIZER;  /* 初期化用排他ロック */
 
@@ -48,6 +49,10 @@ show_memory_stat(void) {
 	kprintf("\tslab_pages: %qu\n", st.slab_pages);
 	kprintf("\tanon_pages: %qu\n", st.anon_pages);
 	kprintf("\tpcache_pages: %qu\n", st.pcache_pages);
+	kprintf("\tpcp_pages: %qu (high:%qu low:%qu batch:%qu)\n", 
+	    st.pcp_pages, st.pcp_high, st.pcp_low, st.pcp_batch);
+	kprintf("\tzero_pages: %qu (high:%qu hits:%qu misses:%qu)\n", 
+	    st.zero_pages, st.zero_high, st.zero_hits, st.zero_misses);
 #endif  /* RV64_SHOW_MEMSTAT */
 }
 void uart_rxintr_enable(void);
@@ -60,6 +65,7 @@ hal_platform_init(void){
 	rv64_clint_init();  /* CLINTを初期化する  */
 	rv64_plic_init();   /* PLICを初期化する   */
 	rv64_timer_init();  /* タイマを初期化する */
+	rv64_ipi_init();    /* プロセッサ間割込みを初期化する */
 	uart_rxintr_enable();  /* TODO: ドライバ作成後に削除 */
 }
 
@@ -92,8 +98,15 @@ prepare(uint64_t hartid){
 		    kernel_start_phy, kheap_end_phy);
 		pfdb_mark_phys_range_reserved(kernel_start_phy, kheap_end_phy);
 
+		/* 初期カーネルヒープを初期化する
+		 * 初期化完了後に未使用ページをページプールに返却する
+		 */
+		ekheap_init(kheap_start_phy, (void *)&_kheap_vaddr_start,
+		    (vm_size)(kheap_end_phy - kheap_start_phy));
+
 		slab_prepare_preallocate_cahches(); /* SLABを初期化する */
 		vm_pgtbl_cache_init();  /* ページテーブル情報のキャッシュを初期化する */
+		vm_map_init();  /* 仮想空間のマップ処理を初期化する */
 
 		show_memory_stat();  /* メモリ使用状況を表示する  */
 
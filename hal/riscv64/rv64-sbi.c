@@ -44,7 +44,7 @@ ksbi_send_ipi(const unsigned long *hart_mask){
 
 		idx = i / ( sizeof(unsigned long)*BITS_PER_BYTE );
 		off = i % ( sizeof(unsigned long)*BITS_PER_BYTE );
-		if ( hart_mask[idx] & (1 << off ) ) {
+		if ( hart_mask[idx] & (1UL << off ) ) {
 
 			reg = (volatile uint32_t *)RV64_CLINT_MSIP(i);
 			*reg = 1;  /* TODO: アクセスマクロ作成 */
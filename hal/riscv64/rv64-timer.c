@@ -12,6 +12,7 @@
 #include <kern/kern-cpuinfo.h>
 #include <kern/irq-if.h>
 #include <kern/timer.h>
+#include <kern/sched-if.h>
 
 #include <hal/riscv64.h>
 #include <hal/hal-traps.h>
@@ -66,6 +67,7 @@ rv64_timer_handler(irq_no irq, trap_context *ctx, void *private){
 	dif.tv_sec = 0;
 
 	tim_update_walltime(ctx, &dif);  /* 時刻更新 */
+	sched_timer_tick();  /* タイムスライスを更新 */
 
 	sip = rv64_read_sip();  /* Supervisor Interrupt Pendingレジスタの現在値を読み込む */
 	sip &= ~SIP_STIP; 	/* スーパーバイザタイマ割込みを落とす */
@@ -11,6 +11,13 @@
 #include <kern/kern-common.h>
 
 #include <kern/kern-cpuinfo.h>
+#include <kern/spinlock.h>
+#include <kern/sched-if.h>
+
+#include <hal/hal-cpuinfo.h>
+
+static spinlock   ipi_lock = __SPINLOCK_INITIALIZER;  /**< 擬似IPI情報のロック   */
+static cpu_bitmap ipi_pending;                       /**< 擬似IPI受信待ちCPU   */
 
 /**
    物理プロセッサIDを取得する
@@ -22,6 +29,20 @@ hal_get_physical_cpunum(void){
 	return 0; /* 物理プロセッサIDを返却 */
 }
 
+/**
+   自CPUのサイクルカウンタを読み取る
+   @return タイムスタンプカウンタの値
+ */
+uint64_t
+hal_get_cpu_cycles(void){
+	uint32_t lo;
+	uint32_t hi;
+
+	__asm__ __volatile__("rdtsc" : "=a" (lo), "=d" (hi));
+
+	return ( (uint64_t)hi << 32 ) | lo; /* タイムスタンプカウンタの値を返却 */
+}
+
 /**
    アーキ固有のCPU情報を初期化する
    @param[in] cinf CPU情報
@@ -46,3 +67,47 @@ hal_cpuinfo_fill(cpu_info *cinf){
 	md = &cinf->cinf_md;  /* アーキテクチャ依存部 */
 	md->cinf = cinf;      /* 逆リンクを設定       */
 }
+
+/**
+   再スケジュールIPIを送信する
+   @param[in] cinf 送信先CPUのCPU情報
+   @note ユーザランドテスト環境ではCPU間割込みを使用できないため,
+   送信先CPUを受信待ちに設定し, x64_deliver_pending_ipisの呼び出し時に
+   受信処理を行う
+ */
+void
+hal_cpu_send_resched_ipi(cpu_info *cinf){
+	intrflags iflags;
+
+	spinlock_lock_disable_intr(&ipi_lock, &iflags);
+	bitops_set(cinf->log_id, &ipi_pending);  /* 受信待ちに設定 */
+	spinlock_unlock_restore_intr(&ipi_lock, &iflags);
+}
+
+/**
+   受信待ちの擬似IPIを配送する
+   @return 配送したIPI数
+   @note 受信側CPUのソフトウエア割込み処理に相当する
+ */
+obj_cnt_type
+x64_deliver_pending_ipis(void){
+	cpu_id            cpu;
+	obj_cnt_type       nr;
+	intrflags      iflags;
+
+	for( nr = 0; ; ++nr) {
+
+		spinlock_lock_disable_intr(&ipi_lock, &iflags);
+		cpu = (cpu_id)bitops_ffs(&ipi_pending);  /* 受信待ちCPUを得る */
+		if ( cpu > 0 )
+			bitops_clr(cpu - 1, &ipi_pending);  /* 受信待ちを解除 */
+		spinlock_unlock_restore_intr(&ipi_lock, &iflags);
+
+		if ( cpu == 0 )
+			break;  /* 受信待ちのCPUがない */
+
+		sched_resched_ipi_handler(cpu - 1);  /* 再スケジュールIPIを処理 */
+	}
+
+	return nr;
+}
@@ -23,5 +23,7 @@ typedef struct _hal_cpuinfo{
 	struct _cpu_info          *cinf;  /**< CPU情報への逆リンク                */
 }hal_cpuinfo;
 
+obj_cnt_type x64_deliver_pending_ipis(void);
+
 #endif  /*  !ASM_FILE */
 #endif  /*  _HAL_HAL_CPUINFO_H   */
@@ -27,4 +27,9 @@
 #define KC_PHYSMEM_MB (64)
 #endif  /*  CONFIG_HAL_MEMORY_SIZE_MB  */
 #define KC_THR_MAX    (CONFIG_THR_MAX)
+#if defined(CONFIG_TIMER_TIME_SLICE)
+#define KC_TIME_SLICE (CONFIG_TIMER_TIME_SLICE)
+#else
+#define KC_TIME_SLICE (10)
+#endif  /*  CONFIG_TIMER_TIME_SLICE  */
 #endif  /* KERN_KERN_CONSTS_H */
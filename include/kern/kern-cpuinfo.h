@@ -16,6 +16,7 @@
 
 #include <kern/kern-types.h>
 #include <kern/spinlock.h>
+#include <kern/sched-queue.h>
 
 #include <klib/rbtree.h>
 
@@ -37,6 +38,7 @@ typedef struct _cpu_info{
 	size_t            l1_dcache_size;  /*< L1データキャッシュサイズ (単位:バイト)       */
 	struct _thread_info      *cur_ti;  /*< 対象のプロセッサで動作中のスレッド情報  */
 	struct _proc           *cur_proc;  /*< カレントプロセス                        */
+	struct _sched_queue          rdq;  /*< レディキュー                            */
 	struct _hal_cpuinfo      cinf_md;  /*< アーキテクチャ依存CPU情報               */
 }cpu_info;
 
@@ -77,9 +79,11 @@ int krn_cpuinfo_cpu_register(cpu_id _phys_id, cpu_id *_log_idp);
 void krn_cpuinfo_init(void);
 
 cpu_id hal_get_physical_cpunum(void);
+uint64_t hal_get_cpu_cycles(void);
 cpu_info *krn_cpuinfo_get(cpu_id _cpu_num);
 void hal_cpuinfo_fill(struct _cpu_info *_cinf);
 void hal_cpuinfo_update(struct _cpu_info *_cinf);
+void hal_cpu_send_resched_ipi(struct _cpu_info *_cinf);
 size_t krn_get_cpu_l1_dcache_linesize(void);
 obj_cnt_type krn_get_cpu_l1_dcache_color_num(void);
 size_t krn_get_cpu_dcache_size(void);
@@ -15,6 +15,7 @@
 /* BSS領域, カーネル領域, テスト用スタック算出用シンボル */
 extern uint64_t __bss_start, __bss_end;
 extern uint64_t _kernel_start, _kheap_end;
+extern uint64_t _kernel_end, _kheap_vaddr_start;
 extern uint64_t _tflib_bsp_stack;
 
 void kern_init(void);
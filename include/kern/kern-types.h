@@ -54,6 +54,7 @@ typedef uint32_t        page_state;  /*< ページ状態                    */
 typedef uint32_t     pgalloc_flags;  /*< メモリ獲得時のフラグ          */
 typedef uint32_t        slab_flags;  /*< スラブ獲得フラグ              */
 typedef uint32_t        page_usage;  /*< ページ利用用途                */
+typedef uint32_t        page_color;  /*< ページカラー                  */
 
 /*
  * 仮想メモリ管理
@@ -184,6 +184,8 @@ void tst_vmmap(void);
 void tst_irqctrlr(void);
 void tst_pcache(void);
 void tst_cpuinfo(void);
+void tst_pfdb(void);
+void tst_slab(void);
 void tst_proc(void);
 void tst_thread(void);
 #endif  /*  _KERN_KTEST_H  */
@@ -33,17 +33,29 @@
 	(KM_SFLAGS_ATOMIC)     /*< メモリ獲得を待ち合わせない */
 #define KMALLOC_NOCLR           \
 	(KM_SFLAGS_CLR_NONE)   /*< メモリをクリアしない       */
+#define KMALLOC_ZEROED          \
+	(KM_SFLAGS_ZEROED)     /*< 事前クリア済みページを優先する */
 
 #if !defined(ASM_FILE)
 
 #include <klib/freestanding.h>
 #include <kern/page-pfdb.h>
+#include <kern/page-reclaim.h>
 
 int pgif_calc_page_order(size_t _size, page_order *_res);
 
 int pgif_get_free_page_cluster(void **_addrp, page_order _order, 
     pgalloc_flags _pgflags, page_usage _usage);
 int pgif_get_free_page(void **_addrp, pgalloc_flags _pgflags, page_usage _usage);
+int pgif_get_free_page_color(void **_addrp, page_color _color, pgalloc_flags _pgflags,
+    page_usage _usage);
+page_color pgif_next_page_color(page_color *_cursorp);
 void pgif_free_page(void *_addr);
+int pgif_get_free_pages_bulk(void **_addrs, obj_cnt_type _nr, page_order _order, 
+    pgalloc_flags _pgflags, page_usage _usage);
+void pgif_free_pages_bulk(void **_addrs, obj_cnt_type _nr);
+int pgif_get_contig_pages(void **_addrp, obj_cnt_type _nr, obj_cnt_type _align,
+    pgalloc_flags _pgflags, page_usage _usage);
+void pgif_free_contig_pages(void *_addr, obj_cnt_type _nr);
 #endif  /*  !ASM_FILE  */
 #endif  /*  _KERN_PAGE_IF_H   */
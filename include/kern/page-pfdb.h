@@ -12,11 +12,78 @@
 #include <klib/freestanding.h>
 #include <klib/queue.h>
 
+#include <klib/statcnt.h>
+
 #include <kern/kern-types.h>
+#include <kern/kern-consts.h>
 #include <kern/spinlock.h>
 
 #include <kern/page-macros.h>
 
+/** CPU単位ページキャッシュのパラメタ
+ */
+#define PFDB_PCP_BATCH  (16)  /**< バディプールとの一括補充/返却ページ数 (単位:ページ) */
+#define PFDB_PCP_HIGH   (64)  /**< 高水位 (超過時にbatch分をバディに返却, 単位:ページ) */
+#define PFDB_PCP_LOW    (4)   /**< 低水位 (以下になるとbatch分を補充, 単位:ページ)     */
+
+/** 事前クリア済みページプールのパラメタ
+ */
+#define PFDB_ZERO_POOL_HIGH   (128) /**< プールに保持するページ数の上限 (単位:ページ) */
+#define PFDB_ZERO_POOL_BATCH  (8)   /**< アイドル時に一度に補充するページ数 (単位:ページ) */
+
+/** メモリコンパクションのパラメタ
+ */
+#define PFDB_COMPACT_MAX_MIGRATE (64)  /**< 1ブロック当たりの最大移動ページ数 (単位:ページ) */
+
+/** ページカラーリングのパラメタ
+    2次キャッシュの1ウエイに収まるページ数をカラー数とし,
+    ページフレーム番号の下位ビットをカラーとする
+ */
+#define PFDB_COLOR_SHIFT  (4)  /**< カラー数のシフト数 (単位:ページオーダ) */
+#define PFDB_COLOR_NR     (1 << PFDB_COLOR_SHIFT)  /**< カラー数 */
+#define PFDB_COLOR_HIGH   (PFDB_COLOR_NR * 8)  /**< プールに保持するページ数の上限 (単位:ページ) */
+
+/**
+   ページフレーム番号に対応するページカラーを算出する
+   @param[in] _pfn ページフレーム番号
+ */
+#define PFDB_PFN_TO_COLOR(_pfn) \
+	( (page_color)( (_pfn) & ( PFDB_COLOR_NR - 1 ) ) )
+
+/** 連続メモリ領域のパラメタ
+ */
+#define PFDB_CMA_PAGES  (ULONG_C(512))  /**< 起動時に確保する連続メモリ領域のページ数 */
+
+/** 空きページ数の水位のパラメタ
+ */
+#define PFDB_WMARK_MIN_DIV   (256)  /**< 利用可能ページ数に対する最低水位の比 (1/256) */
+#define PFDB_WMARK_MIN_PAGES (16)   /**< 最低水位の下限 (単位:ページ) */
+
+/** 空きページ数の水位
+    全てのページフレームDBエントリのうち, 最も空きページの多いエントリの水位を
+    システム全体の水位とする
+ */
+#define PFDB_WMARK_OK         (0)  /**< 高水位以上の空きページがある       */
+#define PFDB_WMARK_UNDER_HIGH (1)  /**< 空きページが高水位未満             */
+#define PFDB_WMARK_UNDER_LOW  (2)  /**< 空きページが低水位未満 (回収スレッドを起床する) */
+#define PFDB_WMARK_UNDER_MIN  (3)  /**< 空きページが最低水位未満 (獲得時に直接回収する) */
+
+/** 物理メモリセクションのパラメタ
+    物理アドレス空間を最大オーダのページ単位(セクション)に分割し,
+    セクション番号をインデクスとしてページフレームDBエントリを直接参照する
+ */
+#define PFDB_SECTION_SHIFT      \
+	( PAGE_SHIFT + PAGE_POOL_MAX_ORDER - 1 )  /**< セクションサイズのシフト数 */
+#define PFDB_SECTION_PFN_SHIFT  \
+	( PFDB_SECTION_SHIFT - PAGE_SHIFT )  /**< セクション内のページ数のシフト数 */
+#define PFDB_SECTIONS_NR        (4096)  /**< セクション表のエントリ数 */
+
+/**
+   ページフレーム番号に対応するセクション番号を算出する
+   @param[in] _pfn ページフレーム番号
+ */
+#define PFDB_PFN_TO_SECTION(_pfn) ( (_pfn) >> PFDB_SECTION_PFN_SHIFT )
+
 struct _page_frame;
 struct   _pfdb_ent;
 
@@ -29,12 +96,50 @@ typedef struct _pfdb_stat{
 					       (空きページと利用可能ページ数から算出)  */
 	obj_cnt_type   available_pages; /**< 利用可能ページ数 */
 	obj_cnt_type free_nr[PAGE_POOL_MAX_ORDER];  /**< ページオーダ単位でのフリーページ数 */
+	page_order_mask   free_order_mask;  /**< 空きページがあるオーダのビットマスク */
 	obj_cnt_type       kdata_pages;  /**<  カーネルデータページ    */
 	obj_cnt_type      kstack_pages;  /**<  カーネルスタックページ  */
 	obj_cnt_type       pgtbl_pages;  /**<  ページテーブル          */
 	obj_cnt_type        slab_pages;  /**<  SLABページ              */
 	obj_cnt_type        anon_pages;  /**<  アノニマスページ        */
 	obj_cnt_type      pcache_pages;  /**<  ページキャッシュ        */
+	obj_cnt_type         pcp_pages;  /**<  CPU単位ページキャッシュ中のページ数
+					       (nr_free_pagesに含まれる)  */
+	obj_cnt_type          pcp_high;  /**<  CPU単位ページキャッシュの高水位      */
+	obj_cnt_type           pcp_low;  /**<  CPU単位ページキャッシュの低水位      */
+	obj_cnt_type         pcp_batch;  /**<  CPU単位ページキャッシュの一括処理数  */
+	obj_cnt_type          pcp_hits;  /**<  CPU単位ページキャッシュからの獲得回数 */
+	obj_cnt_type       pcp_refills;  /**<  バディプールからの補充回数          */
+	obj_cnt_type        pcp_drains;  /**<  バディプールへの返却回数            */
+	obj_cnt_type        zero_pages;  /**<  事前クリア済みページプール中のページ数
+					       (nr_free_pagesに含まれる)  */
+	obj_cnt_type         zero_high;  /**<  事前クリア済みページプールの上限     */
+	obj_cnt_type         zero_hits;  /**<  事前クリア済みページの獲得回数       */
+	obj_cnt_type       zero_misses;  /**<  事前クリア済みページの獲得失敗回数   */
+	obj_cnt_type        zero_fills;  /**<  事前クリア済みページの補充ページ数   */
+	obj_cnt_type      compact_runs;  /**<  メモリコンパクションの実行回数       */
+	obj_cnt_type   compact_success;  /**<  要求オーダの空きページを確保できた回数 */
+	obj_cnt_type     compact_fails;  /**<  要求オーダの空きページを確保できなかった回数 */
+	obj_cnt_type   compact_bg_runs;  /**<  バックグラウンドでの実行回数         */
+	obj_cnt_type    migrated_pages;  /**<  移動したページ数                     */
+	obj_cnt_type     migrate_fails;  /**<  ページの移動に失敗した回数           */
+	obj_cnt_type         wmark_min;  /**<  最低水位の合計 (単位:ページ)         */
+	obj_cnt_type         wmark_low;  /**<  低水位の合計 (単位:ページ)           */
+	obj_cnt_type        wmark_high;  /**<  高水位の合計 (単位:ページ)           */
+	int                wmark_level;  /**<  空きページ数の水位                   */
+	obj_cnt_type         cma_pages;  /**<  連続メモリ領域のページ数             */
+	obj_cnt_type          cma_free;  /**<  連続メモリ領域の空きページ数
+					       (nr_free_pagesに含まれる)  */
+	obj_cnt_type          cma_lent;  /**<  移動可能ページとして貸し出し中のページ数 */
+	obj_cnt_type     cma_allocated;  /**<  連続領域として獲得中のページ数       */
+	obj_cnt_type        cma_allocs;  /**<  連続領域の獲得回数                   */
+	obj_cnt_type         cma_fails;  /**<  連続領域の獲得失敗回数               */
+	obj_cnt_type         cma_lends;  /**<  移動可能ページの貸し出し回数         */
+	obj_cnt_type       color_pages;  /**<  カラー別ページプール中のページ数
+					       (nr_free_pagesに含まれる)  */
+	obj_cnt_type        color_hits;  /**<  要求したカラーのページの獲得回数     */
+	obj_cnt_type      color_misses;  /**<  要求したカラーのページの獲得失敗回数 */
+	obj_cnt_type     color_refills;  /**<  バディプールからの補充回数           */
 }pfdb_stat;
 
 /** バディページ管理情報
@@ -43,14 +148,20 @@ typedef struct _page_buddy{
 	spinlock                            lock;  /**< バディページ管理情報のロック       */
 	obj_cnt_type free_nr[PAGE_POOL_MAX_ORDER]; /**< ページオーダ単位でのフリーページ数 */
 	queue      page_list[PAGE_POOL_MAX_ORDER]; /**< ページオーダ単位でのページリスト   */
+	page_order_mask                order_mask; /**< 空きページがあるオーダのビットマスク */
+	uint64_t                        *pair_map; /**< オーダ単位のバディペアビットマップ
+						        (バディの一方のみが空きの場合にセット) */
+	obj_cnt_type pair_map_off[PAGE_POOL_MAX_ORDER]; /**< オーダ単位のバディペアビットマップの
+							     開始位置 (単位:ビット)  */
+	obj_cnt_type                      nr_free; /**< ノーマルページ換算での空きページ数 */
 	obj_cnt_type                     nr_pages; /**< ページフレーム管理配列の要素数     */
 	obj_cnt_type              available_pages; /**< 利用可能ページ数                   */
-	obj_cnt_type                  kdata_pages; /**< カーネルデータページ数             */
-	obj_cnt_type                 kstack_pages; /**< カーネルスタックページ数           */
-	obj_cnt_type                  pgtbl_pages; /**< ページテーブルページ数             */
-	obj_cnt_type                   slab_pages; /**< SLABページ数                       */
-	obj_cnt_type                   anon_pages; /**< アノニマスページ数                 */
-	obj_cnt_type                 pcache_pages; /**< ページキャッシュページ数           */
+	stat_cnt                      kdata_pages; /**< カーネルデータページ数             */
+	stat_cnt                     kstack_pages; /**< カーネルスタックページ数           */
+	stat_cnt                      pgtbl_pages; /**< ページテーブルページ数             */
+	stat_cnt                       slab_pages; /**< SLABページ数                       */
+	stat_cnt                       anon_pages; /**< アノニマスページ数                 */
+	stat_cnt                     pcache_pages; /**< ページキャッシュページ数           */
 	struct _pfdb_ent                *pfdb_ent; /**< ページフレームDBエントリへのリンク */
 	struct _page_frame                 *array; /**< ページフレーム配列                 */
 }page_buddy;
@@ -73,6 +184,9 @@ typedef struct _page_buddy{
                  |                      |
                  |                      |
                  +----------------------+
+                 | バディペアビットマップ|
+                 | (uint64_t[])         |
+                 +----------------------+
                  | ページフレーム配列   |
                  |(struct _page_frame[])|
                  +----------------------+
@@ -83,6 +197,16 @@ kvaddr + length  +----------------------+<-ページフレーム配列[max_pfn-m
    
  */
 
+/** 空きページ数の水位
+    空きページ数が低水位を下回ると回収スレッドを起床し, 高水位まで回収する.
+    最低水位を下回った場合は, 待ち合わせ可能なページ獲得処理で直接回収を行う
+ */
+typedef struct _pfdb_watermark{
+	obj_cnt_type   min;  /**< 最低水位 (単位:ページ) */
+	obj_cnt_type   low;  /**< 低水位 (単位:ページ)   */
+	obj_cnt_type  high;  /**< 高水位 (単位:ページ)   */
+}pfdb_watermark;
+
 /** ページフレーム管理情報(バディページプール含む)
     [min_pfn, max_pfn)の範囲のページを管理する
  */
@@ -95,13 +219,134 @@ typedef struct _pfdb_ent{
 	private_inf          private; /**< プライベート情報                              */
 	private_inf     mach_private; /**< アーキ固有プライベート情報                    */
 	page_buddy         page_pool; /**< ページプール(buddy ページプール)              */
+	pfdb_watermark         wmark; /**< 空きページ数の水位                            */
 }pfdb_ent;
 
+/** CPU単位ページキャッシュ
+    バディプールから一括して取り出したオーダ0のページを保持する
+    ページリストの先頭にキャッシュ上に残っている可能性の高いページ(hot)を,
+    末尾にバディプールから補充したページ(cold)をつなぐ
+    @note 自CPUからは割込み禁止状態でのみ操作する
+    ロックは, ページフレームDBのロック, バディページ管理情報のロックより先に獲得する
+ */
+typedef struct _pfdb_pcp{
+	spinlock            lock;  /**< CPU単位ページキャッシュのロック               */
+	queue          page_list;  /**< ページリスト (先頭:hot, 末尾:cold)            */
+	obj_cnt_type       count;  /**< キャッシュ中のページ数                       */
+	obj_cnt_type        high;  /**< 高水位 (単位:ページ)                         */
+	obj_cnt_type         low;  /**< 低水位 (単位:ページ)                         */
+	obj_cnt_type       batch;  /**< 一括補充/返却ページ数 (単位:ページ)          */
+	obj_cnt_type        hits;  /**< キャッシュからの獲得回数                     */
+	obj_cnt_type     refills;  /**< バディプールからの補充回数                   */
+	obj_cnt_type      drains;  /**< バディプールへの返却回数                     */
+}pfdb_pcp;
+
+/** 事前クリア済みページプール
+    アイドル時にゼロクリアしたオーダ0のページを保持する
+    @note 初期化前はhighが0であるため, ページを保持しない
+    @note ロックは, ページフレームDBのロック, バディページ管理情報のロックより先に獲得する
+ */
+typedef struct _pfdb_zero_pool{
+	spinlock            lock;  /**< 事前クリア済みページプールのロック     */
+	queue          page_list;  /**< ページリスト                           */
+	obj_cnt_type       count;  /**< プール中のページ数                     */
+	obj_cnt_type        high;  /**< プールに保持するページ数の上限         */
+	obj_cnt_type        hits;  /**< 事前クリア済みページの獲得回数         */
+	obj_cnt_type      misses;  /**< 事前クリア済みページの獲得失敗回数     */
+	obj_cnt_type       fills;  /**< 事前クリア済みページの補充ページ数     */
+}pfdb_zero_pool;
+
+/** カラー別ページプール
+    ページカラーごとにオーダ0の空きページを保持する.
+    バディプールからカラー数分のページからなるブロックを取り出して
+    各カラーのリストに1ページずつ補充する
+    @note 初期化前はhighが0であるため, ページを保持しない
+    @note ロックは, ページフレームDBのロック, バディページ管理情報のロックより先に獲得する
+ */
+typedef struct _pfdb_color_pool{
+	spinlock                       lock;  /**< カラー別ページプールのロック     */
+	queue     page_list[PFDB_COLOR_NR];  /**< カラー別ページリスト             */
+	obj_cnt_type     nr[PFDB_COLOR_NR];  /**< カラー別のページ数               */
+	obj_cnt_type                  count;  /**< プール中のページ数               */
+	obj_cnt_type                   high;  /**< プールに保持するページ数の上限   */
+	obj_cnt_type                   hits;  /**< 要求したカラーのページの獲得回数 */
+	obj_cnt_type                 misses;  /**< 要求したカラーのページの獲得失敗回数 */
+	obj_cnt_type                refills;  /**< バディプールからの補充回数       */
+}pfdb_color_pool;
+
+/**
+   ページ移動関数
+   @param[in] _src 移動元ページのページフレーム情報
+   @param[in] _dst 移動先ページのページフレーム情報
+   @retval    0      正常終了
+   @retval    -EBUSY ページが使用中のため移動できない
+   @note 移動先ページは移動元ページと同じ利用用途で獲得済みの状態で渡される.
+   移動に成功した場合は, 移動元ページの内容を移動先ページにコピーし, 移動元ページへの
+   参照を移動先ページに付け替えた上で, 移動元ページの利用者の参照を解放する
+ */
+typedef int (*pfdb_migrate_fn)(struct _page_frame *_src, struct _page_frame *_dst);
+
+/** メモリコンパクション管理情報
+    移動可能なページ(無名ページ, ページキャッシュ)を移動して
+    高次オーダの空きページを確保する
+    @note ロックは, ページフレームDBのロック, バディページ管理情報のロックより先に獲得する
+ */
+typedef struct _pfdb_compact{
+	spinlock                lock;  /**< メモリコンパクション管理情報のロック     */
+	bool                 running;  /**< メモリコンパクション実行中              */
+	page_order          bg_order;  /**< バックグラウンドで確保するオーダ
+					    (0の場合は要求なし)                     */
+	pfdb_migrate_fn migrate_anon;  /**< 無名ページの移動関数                     */
+	pfdb_migrate_fn migrate_pcache; /**< ページキャッシュの移動関数              */
+	obj_cnt_type            runs;  /**< メモリコンパクションの実行回数          */
+	obj_cnt_type         success;  /**< 要求オーダの空きページを確保できた回数  */
+	obj_cnt_type           fails;  /**< 要求オーダの空きページを確保できなかった回数 */
+	obj_cnt_type         bg_runs;  /**< バックグラウンドでの実行回数            */
+	obj_cnt_type        migrated;  /**< 移動したページ数                        */
+	obj_cnt_type   migrate_fails;  /**< ページの移動に失敗した回数              */
+}pfdb_compact;
+
+/** 連続メモリ領域
+    ページフレームDBエントリ内の連続した空きページを
+    バディプールから切り離して管理する. 空きページは移動可能なページ
+    (無名ページ, ページキャッシュ)として貸し出し, 連続領域の獲得時に
+    貸し出したページを領域外に移動して回収する
+    @note ロックは, ページフレームDBのロック, バディページ管理情報のロックより後に獲得する
+ */
+typedef struct _pfdb_cma{
+	spinlock                lock;  /**< 連続メモリ領域のロック                    */
+	struct _pfdb_ent        *ent;  /**< 領域を含むページフレームDBエントリ
+					    (NULLの場合は領域未設定)                */
+	obj_cnt_type             sta;  /**< 領域の開始インデクス (ページフレーム配列中) */
+	obj_cnt_type        nr_pages;  /**< 領域のページ数                            */
+	queue              page_list;  /**< 空きページリスト                          */
+	obj_cnt_type         free_nr;  /**< 空きページ数                              */
+	obj_cnt_type            lent;  /**< 貸し出し中のページ数                      */
+	obj_cnt_type       allocated;  /**< 連続領域として獲得中のページ数            */
+	bool                    busy;  /**< 連続領域の獲得処理中                      */
+	obj_cnt_type         iso_sta;  /**< 獲得処理中の範囲の開始インデクス          */
+	obj_cnt_type         iso_end;  /**< 獲得処理中の範囲の終了インデクス          */
+	obj_cnt_type          allocs;  /**< 連続領域の獲得回数                        */
+	obj_cnt_type           fails;  /**< 連続領域の獲得失敗回数                    */
+	obj_cnt_type           lends;  /**< 移動可能ページの貸し出し回数              */
+}pfdb_cma;
+
 /** ページフレームDB
+    @note セクション表はロックを獲得せずに参照する.
+    更新はページフレームDBのロックを獲得して行う
  */
 typedef struct _page_frame_db{
 	spinlock   lock;           /**< ページフレームDBキューのロック           */
 	RB_HEAD(_pfdb_tree, _pfdb_ent) dbroot;  /**< ページフレームDB            */
+	struct _pfdb_ent * volatile sections[PFDB_SECTIONS_NR];  /**< セクション表 */
+	bool            pcp_enabled;  /**< CPU単位ページキャッシュ利用可能       */
+	pfdb_pcp    pcp[KC_CPUS_NR];  /**< CPU単位ページキャッシュ               */
+	pfdb_zero_pool     zero_pool;  /**< 事前クリア済みページプール           */
+	pfdb_color_pool   color_pool;  /**< カラー別ページプール                 */
+	pfdb_compact         compact;  /**< メモリコンパクション管理情報         */
+	pfdb_cma                 cma;  /**< 連続メモリ領域                       */
+	int              wmark_level;  /**< 空きページ数の水位                   */
+	bool         reclaim_pending;  /**< ページ回収要求                       */
 }page_frame_db;
 
 /** ページフレームDB初期化子
@@ -109,6 +354,53 @@ typedef struct _page_frame_db{
 #define __PFDB_INITIALIZER(pfque) {		\
 	.lock = __SPINLOCK_INITIALIZER,		\
 	.dbroot  = RB_INITIALIZER(pfque),       \
+	.pcp_enabled = false,                   \
+	.zero_pool = {                          \
+		.lock = __SPINLOCK_INITIALIZER,  \
+		.count = 0,                      \
+		.high = 0,                       \
+		.hits = 0,                       \
+		.misses = 0,                     \
+		.fills = 0,                      \
+	},                                      \
+	.color_pool = {                         \
+		.lock = __SPINLOCK_INITIALIZER,  \
+		.count = 0,                      \
+		.high = 0,                       \
+		.hits = 0,                       \
+		.misses = 0,                     \
+		.refills = 0,                    \
+	},                                      \
+	.compact = {                            \
+		.lock = __SPINLOCK_INITIALIZER,  \
+		.running = false,                \
+		.bg_order = 0,                   \
+		.migrate_anon = NULL,            \
+		.migrate_pcache = NULL,          \
+		.runs = 0,                       \
+		.success = 0,                    \
+		.fails = 0,                      \
+		.bg_runs = 0,                    \
+		.migrated = 0,                   \
+		.migrate_fails = 0,              \
+	},                                      \
+	.cma = {                                \
+		.lock = __SPINLOCK_INITIALIZER,  \
+		.ent = NULL,                     \
+		.sta = 0,                        \
+		.nr_pages = 0,                   \
+		.free_nr = 0,                    \
+		.lent = 0,                       \
+		.allocated = 0,                  \
+		.busy = false,                   \
+		.iso_sta = 0,                    \
+		.iso_end = 0,                    \
+		.allocs = 0,                     \
+		.fails = 0,                      \
+		.lends = 0,                      \
+	},                                      \
+	.wmark_level = PFDB_WMARK_OK,           \
+	.reclaim_pending = false,               \
 	}
 
 void pfdb_add(uintptr_t _phys_start, size_t _length, struct _pfdb_ent **_pfdb_ent);
@@ -116,11 +408,37 @@ int pfdb_remove(pfdb_ent *_ent);
 
 void pfdb_free(void);
 
+void pfdb_pcp_drain_all(void);
+void pfdb_pcp_init(void);
+obj_cnt_type pfdb_zero_pool_fill(obj_cnt_type _nr);
+void pfdb_zero_pool_drain(void);
+void pfdb_zero_pool_init(void);
+obj_cnt_type pfdb_zero_pool_dequeue_bulk(page_usage _usage, obj_cnt_type _nr, void **_kvaddrs);
+void pfdb_color_pool_drain(void);
+void pfdb_color_pool_init(void);
+int pfdb_color_dequeue(page_color _color, page_usage _usage, obj_cnt_type *_pfnp);
+int pfdb_register_migrate_handler(page_usage _usage, pfdb_migrate_fn _fn);
+int pfdb_migrate_page(struct _page_frame *_pf);
+int pfdb_compact_memory(page_order _order);
+void pfdb_compact_request(page_order _order);
+bool pfdb_compact_background(void);
+int pfdb_watermark_level(void);
+int pfdb_watermark_update(void);
+bool pfdb_reclaim_pending_test_and_clear(void);
+int pfdb_cma_init(obj_cnt_type _nr);
+int pfdb_cma_alloc(obj_cnt_type _nr, obj_cnt_type _align, page_usage _usage,
+    void **_kvaddrp);
+void pfdb_cma_free(void *_kvaddr, obj_cnt_type _nr);
+
 void pfdb_buddy_enqueue(obj_cnt_type _pfn);
 int pfdb_buddy_dequeue(page_order _order, page_usage _usage, obj_cnt_type *_pfnp);
+int pfdb_buddy_dequeue_bulk(page_order _order, page_usage _usage, obj_cnt_type _nr,
+    void **_kvaddrs);
+obj_cnt_type pfdb_buddy_enqueue_bulk(obj_cnt_type _nr, void **_kvaddrs);
 
 void pfdb_mark_phys_range_reserved(vm_paddr _start, vm_paddr _end);
 void pfdb_unmark_phys_range_reserved(vm_paddr _start, vm_paddr _end);
+obj_cnt_type pfdb_release_early_heap(void);
 
 int pfdb_pfn_to_kvaddr(obj_cnt_type _pfn, void **_kvaddrp);
 int pfdb_kvaddr_to_pfn(void *_kvaddr, obj_cnt_type *_pfnp);
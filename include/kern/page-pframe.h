@@ -13,6 +13,9 @@
  */
 #define PAGE_STATE_STATE_SHIFT   (0)  /**<  使用状態シフト  */
 #define PAGE_STATE_USECASE_SHIFT (4)  /**<  使用用途シフト  */
+#define PAGE_STATE_POOL_SHIFT    (10) /**<  ページプール格納状態シフト  */
+#define PAGE_STATE_LOCK_SHIFT    (15) /**<  ビットロックシフト  */
+#define PAGE_STATE_ARCH_SHIFT    (16) /**<  アーキ依存状態シフト  */
 
 #define PAGE_STATE_FREE     \
 	(0x0 << PAGE_STATE_STATE_SHIFT )  /**< 未使用  */
@@ -23,6 +26,8 @@
 
 #define PAGE_STATE_CLUSTERED     \
 	(0x4 << PAGE_STATE_STATE_SHIFT )  /**< クラスタ化されたページ  */
+#define PAGE_STATE_PCP     \
+	(0x8 << PAGE_STATE_STATE_SHIFT )  /**< CPU単位ページキャッシュに格納中  */
 
 #define PAGE_STATE_UCASE_KERN     \
 	(0x1 << PAGE_STATE_USECASE_SHIFT )  /**< カーネル内部データ用に使用中 */
@@ -41,12 +46,52 @@
 	    PAGE_STATE_UCASE_PGTBL | PAGE_STATE_UCASE_SLAB  |	\
 	    PAGE_STATE_UCASE_ANON | PAGE_STATE_UCASE_PCACHE )  /**<  使用用途マスク  */
 
+#define PAGE_STATE_ZEROED     \
+	(0x1 << PAGE_STATE_POOL_SHIFT )  /**< 事前クリア済みページプールに格納中 */
+#define PAGE_STATE_CMA        \
+	(0x2 << PAGE_STATE_POOL_SHIFT )  /**< 連続メモリ領域のページ */
+#define PAGE_STATE_COLORED    \
+	(0x4 << PAGE_STATE_POOL_SHIFT )  /**< カラー別ページプールに格納中 */
+
+#define PAGE_STATE_LOCKED     \
+	(0x1 << PAGE_STATE_LOCK_SHIFT )  /**< ページフレーム情報のビットロック */
+#define PAGE_STATE_ARCH_MASK  \
+	(0xffff << PAGE_STATE_ARCH_SHIFT )  /**< アーキ依存のページ状態マスク */
+
 #if !defined(ASM_FILE)
 #include <klib/freestanding.h>
 #include <kern/kern-types.h>
 #include <klib/list.h>
 #include <klib/queue.h>
-#include <kern/spinlock.h>
+#include <klib/atomic.h>
+#include <klib/refcount.h>
+
+/**
+   ページ状態をアトミック変数として参照する
+   @param[in] _pf ページフレーム情報
+   @note ビットロックの獲得/解放はアトミック操作で行う
+ */
+#define PAGE_STATE_ATOMIC(_pf) \
+	( (struct _atomic *)&( ( (struct _page_frame *)(_pf) )->state ) )
+
+/**
+   ページ状態のビットを設定する
+   @param[in] _pf   ページフレーム情報
+   @param[in] _bits 設定するビット
+   @note ビットロックと同じ状態ワードを更新するため, アトミック操作で設定し,
+   並行するビットロックの獲得/解放を取り消さないようにする
+ */
+#define PAGE_STATE_SET_BITS(_pf, _bits) \
+	do{ atomic_or_fetch(PAGE_STATE_ATOMIC(_pf), (atomic_val)(_bits)); }while(0)
+
+/**
+   ページ状態のビットをクリアする
+   @param[in] _pf   ページフレーム情報
+   @param[in] _bits クリアするビット
+   @note 更新規則はPAGE_STATE_SET_BITSと同じ
+ */
+#define PAGE_STATE_CLR_BITS(_pf, _bits) \
+	do{ atomic_and_fetch(PAGE_STATE_ATOMIC(_pf), ~( (atomic_val)(_bits) ) ); }while(0)
 
 /**
    ページが空いていないことを確認する
@@ -55,35 +100,37 @@
    @retval 偽  ページが空いていない
  */
 #define PAGE_STATE_NOT_FREED(_pf) \
-	( ( ( (struct _page_frame *)(_pf) )->state ) & ( PAGE_STATE_USED | PAGE_STATE_RESERVED ) )
+	( ( ( (struct _page_frame *)(_pf) )->state ) &			\
+	    ( PAGE_STATE_USED | PAGE_STATE_RESERVED | PAGE_STATE_PCP |	\
+		PAGE_STATE_ZEROED | PAGE_STATE_COLORED ) )
 
 /**
    ページを予約する
    @param[in] _pf ページフレーム情報
  */
 #define PAGE_MARK_RESERVED(_pf) \
-	do{ ( (struct _page_frame *)(_pf) )->state |= PAGE_STATE_RESERVED; }while(0)
+	PAGE_STATE_SET_BITS((_pf), PAGE_STATE_RESERVED)
 
 /**
    ページ予約を解除する
    @param[in] _pf ページフレーム情報
  */
 #define PAGE_UNMARK_RESERVED(_pf) \
-	do{ ( (struct _page_frame *)(_pf) )->state &= ~PAGE_STATE_RESERVED; }while(0)
+	PAGE_STATE_CLR_BITS((_pf), PAGE_STATE_RESERVED)
 
 /**
    ページを使用中にする
    @param[in] _pf ページフレーム情報
  */
 #define PAGE_MARK_USED(_pf) \
-	do{ ( (struct _page_frame *)(_pf) )->state |= PAGE_STATE_USED; }while(0)
+	PAGE_STATE_SET_BITS((_pf), PAGE_STATE_USED)
 
 /**
    ページの使用中フラグを落とす
    @param[in] _pf ページフレーム情報
  */
 #define PAGE_UNMARK_USED(_pf) \
-	do{ ( (struct _page_frame *)(_pf) )->state &= ~PAGE_STATE_USED; }while(0)
+	PAGE_STATE_CLR_BITS((_pf), PAGE_STATE_USED)
 
 /**
    ページが使用中であることを確認する
@@ -93,6 +140,83 @@
 	( ( (struct _page_frame *)(_pf) )->state & PAGE_STATE_USED )
 
 
+/**
+   ページをCPU単位ページキャッシュに格納中に設定する
+   @param[in] _pf ページフレーム情報
+ */
+#define PAGE_MARK_PCP(_pf) \
+	PAGE_STATE_SET_BITS((_pf), PAGE_STATE_PCP)
+
+/**
+   ページのCPU単位ページキャッシュ格納中フラグを落とす
+   @param[in] _pf ページフレーム情報
+ */
+#define PAGE_UNMARK_PCP(_pf) \
+	PAGE_STATE_CLR_BITS((_pf), PAGE_STATE_PCP)
+
+/**
+   ページがCPU単位ページキャッシュに格納中であることを確認する
+   @param[in] _pf ページフレーム情報
+ */
+#define PAGE_IS_PCP(_pf) \
+	( ( (struct _page_frame *)(_pf) )->state & PAGE_STATE_PCP )
+
+/**
+   ページを事前クリア済みページプールに格納中に設定する
+   @param[in] _pf ページフレーム情報
+ */
+#define PAGE_MARK_ZEROED(_pf) \
+	PAGE_STATE_SET_BITS((_pf), PAGE_STATE_ZEROED)
+
+/**
+   ページの事前クリア済みページプール格納中フラグを落とす
+   @param[in] _pf ページフレーム情報
+ */
+#define PAGE_UNMARK_ZEROED(_pf) \
+	PAGE_STATE_CLR_BITS((_pf), PAGE_STATE_ZEROED)
+
+/**
+   ページが事前クリア済みページプールに格納中であることを確認する
+   @param[in] _pf ページフレーム情報
+ */
+#define PAGE_IS_ZEROED(_pf) \
+	( ( (struct _page_frame *)(_pf) )->state & PAGE_STATE_ZEROED )
+
+/**
+   ページをカラー別ページプールに格納中に設定する
+   @param[in] _pf ページフレーム情報
+ */
+#define PAGE_MARK_COLORED(_pf) \
+	PAGE_STATE_SET_BITS((_pf), PAGE_STATE_COLORED)
+
+/**
+   ページのカラー別ページプール格納中フラグを落とす
+   @param[in] _pf ページフレーム情報
+ */
+#define PAGE_UNMARK_COLORED(_pf) \
+	PAGE_STATE_CLR_BITS((_pf), PAGE_STATE_COLORED)
+
+/**
+   ページがカラー別ページプールに格納中であることを確認する
+   @param[in] _pf ページフレーム情報
+ */
+#define PAGE_IS_COLORED(_pf) \
+	( ( (struct _page_frame *)(_pf) )->state & PAGE_STATE_COLORED )
+
+/**
+   ページを連続メモリ領域のページに設定する
+   @param[in] _pf ページフレーム情報
+ */
+#define PAGE_MARK_CMA(_pf) \
+	PAGE_STATE_SET_BITS((_pf), PAGE_STATE_CMA)
+
+/**
+   ページが連続メモリ領域のページであることを確認する
+   @param[in] _pf ページフレーム情報
+ */
+#define PAGE_IS_CMA(_pf) \
+	( ( (struct _page_frame *)(_pf) )->state & PAGE_STATE_CMA )
+
 /**
    ページをクラスタページに設定する
    @param[in] _pf   ページフレーム情報
@@ -100,7 +224,7 @@
  */
 #define PAGE_MARK_CLUSTERED(_pf, _head)					              \
 	do{								              \
-		( (struct _page_frame *)(_pf) )->state |= PAGE_STATE_CLUSTERED;       \
+		PAGE_STATE_SET_BITS((_pf), PAGE_STATE_CLUSTERED);                     \
 		( (struct _page_frame *)(_pf) )->headp = (struct _page_frame *)_head; \
 	}while(0)
 
@@ -110,7 +234,7 @@
  */
 #define PAGE_UNMARK_CLUSTERED(_pf) \
 	do{								              \
-		( (struct _page_frame *)(_pf) )->state &= ~PAGE_STATE_CLUSTERED;       \
+		PAGE_STATE_CLR_BITS((_pf), PAGE_STATE_CLUSTERED);                     \
 		( (struct _page_frame *)(_pf) )->headp = (struct _page_frame *)NULL; \
 	}while(0)
 
@@ -127,14 +251,14 @@
    @param[in] _pf ページフレーム情報
  */
 #define PAGE_MARK_KERN(_pf) \
-	do{ ( (struct _page_frame *)(_pf) )->state |= PAGE_STATE_UCASE_KERN; }while(0)
+	PAGE_STATE_SET_BITS((_pf), PAGE_STATE_UCASE_KERN)
 
 /**
    ページをカーネルデータとして使用しない
    @param[in] _pf ページフレーム情報
  */
 #define PAGE_UNMARK_KERN(_pf) \
-	do{ ( (struct _page_frame *)(_pf) )->state &= ~PAGE_STATE_UCASE_KERN; }while(0)
+	PAGE_STATE_CLR_BITS((_pf), PAGE_STATE_UCASE_KERN)
 
 /**
    ページがカーネルデータとして使用中であることを確認する
@@ -148,14 +272,14 @@
    @param[in] _pf ページフレーム情報
  */
 #define PAGE_MARK_PGTBL(_pf) \
-	do{ ( (struct _page_frame *)(_pf) )->state |= PAGE_STATE_UCASE_PGTBL; }while(0)
+	PAGE_STATE_SET_BITS((_pf), PAGE_STATE_UCASE_PGTBL)
 
 /**
    ページをページテーブルとして使用しない
    @param[in] _pf ページフレーム情報
  */
 #define PAGE_UNMARK_PGTBL(_pf) \
-	do{ ( (struct _page_frame *)(_pf) )->state &= ~PAGE_STATE_UCASE_PGTBL; }while(0)
+	PAGE_STATE_CLR_BITS((_pf), PAGE_STATE_UCASE_PGTBL)
 
 /**
    ページがページテーブルとして使用中であることを確認する
@@ -169,14 +293,14 @@
    @param[in] _pf ページフレーム情報
  */
 #define PAGE_MARK_KSTACK(_pf) \
-	do{ ( (struct _page_frame *)(_pf) )->state |= PAGE_STATE_UCASE_KSTACK; }while(0)
+	PAGE_STATE_SET_BITS((_pf), PAGE_STATE_UCASE_KSTACK)
 
 /**
    ページをカーネルスタックとして使用しない
    @param[in] _pf ページフレーム情報
  */
 #define PAGE_UNMARK_KSTACK(_pf) \
-	do{ ( (struct _page_frame *)(_pf) )->state &= ~PAGE_STATE_UCASE_KSTACK; }while(0)
+	PAGE_STATE_CLR_BITS((_pf), PAGE_STATE_UCASE_KSTACK)
 
 /**
    ページがカーネルスタックとして使用中であることを確認する
@@ -190,14 +314,14 @@
    @param[in] _pf ページフレーム情報
  */
 #define PAGE_MARK_SLAB(_pf) \
-	do{ ( (struct _page_frame *)(_pf) )->state |= PAGE_STATE_UCASE_SLAB; }while(0)
+	PAGE_STATE_SET_BITS((_pf), PAGE_STATE_UCASE_SLAB)
 
 /**
    ページをSLABとして使用しない
    @param[in] _pf ページフレーム情報
  */
 #define PAGE_UNMARK_SLAB(_pf) \
-	do{ ( (struct _page_frame *)(_pf) )->state &= ~PAGE_STATE_UCASE_SLAB; }while(0)
+	PAGE_STATE_CLR_BITS((_pf), PAGE_STATE_UCASE_SLAB)
 
 /**
    ページがSLABとして使用中であることを確認する
@@ -211,14 +335,14 @@
    @param[in] _pf ページフレーム情報
  */
 #define PAGE_MARK_ANON(_pf) \
-	do{ ( (struct _page_frame *)(_pf) )->state |= PAGE_STATE_UCASE_ANON; }while(0)
+	PAGE_STATE_SET_BITS((_pf), PAGE_STATE_UCASE_ANON)
 
 /**
    ページを無名ページとして使用しない
    @param[in] _pf ページフレーム情報
  */
 #define PAGE_UNMARK_ANON(_pf) \
-	do{ ( (struct _page_frame *)(_pf) )->state &= ~PAGE_STATE_UCASE_ANON; }while(0)
+	PAGE_STATE_CLR_BITS((_pf), PAGE_STATE_UCASE_ANON)
 
 /**
    ページが無名ページとして使用中であることを確認する
@@ -232,14 +356,14 @@
    @param[in] _pf ページフレーム情報
  */
 #define PAGE_MARK_PCACHE(_pf) \
-	do{ ( (struct _page_frame *)(_pf) )->state |= PAGE_STATE_UCASE_PCACHE; }while(0)
+	PAGE_STATE_SET_BITS((_pf), PAGE_STATE_UCASE_PCACHE)
 
 /**
    ページをページキャッシュとして使用しない
    @param[in] _pf ページフレーム情報
  */
 #define PAGE_UNMARK_PCACHE(_pf) \
-	do{ ( (struct _page_frame *)(_pf) )->state &= ~PAGE_STATE_UCASE_PCACHE; }while(0)
+	PAGE_STATE_CLR_BITS((_pf), PAGE_STATE_UCASE_PCACHE)
 
 /**
    ページがページキャッシュとして使用中であることを確認する
@@ -253,29 +377,54 @@
    @param[in] _pf ページフレーム情報
  */
 #define PAGE_CLEAR_USECASE(_pf) \
-	do{ ( (struct _page_frame *)(_pf) )->state &= ~PAGE_STATE_UCASE_MASK; }while(0)
+	PAGE_STATE_CLR_BITS((_pf), PAGE_STATE_UCASE_MASK)
+
+/**
+   ページフレーム情報がロックされていることを確認する
+   @param[in] _pf ページフレーム情報
+ */
+#define PAGE_IS_LOCKED(_pf) \
+	( ( (struct _page_frame *)(_pf) )->state & PAGE_STATE_LOCKED )
+
+/**
+   アーキ依存のページ状態を参照する
+   @param[in] _pf ページフレーム情報
+ */
+#define PAGE_ARCH_STATE(_pf) \
+	( ( ( ( (struct _page_frame *)(_pf) )->state ) & PAGE_STATE_ARCH_MASK ) \
+	    >> PAGE_STATE_ARCH_SHIFT )
 
 struct _slab;
 struct _page_buddy;
 struct _page_cache;
 
 /** ページフレーム情報
+    @note 排他はページ状態中のビットロック(PAGE_STATE_LOCKED)で行う
+    @note 利用用途別の情報は共用体に格納する. 空きページはlinkを,
+    SLABはslabpを, ページキャッシュはpcachep/lru_entを,
+    無名ページはpv_headを使用する
  */
 typedef struct _page_frame{
-	spinlock                lock;  /**< 排他用のロック                 */
-	list                    link;  /**< バディキューへのリンク         */
-	page_state             state;  /**< ページの状態(アーキ共通)       */
-	page_state        arch_state;  /**< アーキ依存のページ状態         */
-	obj_cnt_type             pfn;  /**< ページフレーム番号             */
+	page_state             state;  /**< ページの状態(ビットロック, アーキ依存状態を含む) */
+	page_order             order;  /**< ページオーダ                   */
 	struct _refcounter    usecnt;  /**< 利用カウンタ                   */
 	struct _refcounter    mapcnt;  /**< マップカウンタ                 */
-	page_order             order;  /**< ページオーダ                   */
+	obj_cnt_type             pfn;  /**< ページフレーム番号             */
 	struct _page_buddy   *buddyp;  /**< バディキュー                   */
-	struct _queue        pv_head;  /**< 物理->仮想アドレス変換用キュー */
 	struct _page_frame    *headp;  /**< クラスタ化ページの先頭ページ   */
-	struct _list         lru_ent;  /**< LRUへのエントリ                */
-	struct _slab          *slabp;  /**< スラブキャッシュ               */
-	struct _page_cache  *pcachep;  /**< ページキャッシュ               */
+	union{
+		struct _list            link;  /**< バディキューへのリンク (空きページ) */
+		struct _slab          *slabp;  /**< スラブキャッシュ (SLAB)             */
+		struct{
+			struct _list         lru_ent;  /**< LRUへのエントリ (ページキャッシュ) */
+			struct _page_cache  *pcachep;  /**< ページキャッシュ                   */
+		};
+		struct _queue        pv_head;  /**< 物理->仮想アドレス変換用キュー (無名ページ) */
+	};
 }page_frame;
+
+void pfdb_page_lock(struct _page_frame *_pf);
+bool pfdb_page_trylock(struct _page_frame *_pf);
+void pfdb_page_unlock(struct _page_frame *_pf);
 #endif  /* !ASM_FILE  */
 #endif  /*  _PAGE_PFRAME_H  */
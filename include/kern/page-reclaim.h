@@ -0,0 +1,92 @@
+/* -*- mode: C; coding:utf-8 -*- */
+/**********************************************************************/
+/*  OS kernel sample                                                  */
+/*  Copyright 2019 Takeharu KATO                                      */
+/*                                                                    */
+/*  Page reclaim relevant definitions                                 */
+/*                                                                    */
+/**********************************************************************/
+#if !defined(_KERN_PAGE_RECLAIM_H)
+#define  _KERN_PAGE_RECLAIM_H 
+
+#include <kern/kern-types.h>
+
+/** ページ回収処理のパラメタ
+ */
+#define PGIF_RECLAIM_BATCH    (32)  /**< 1回の回収処理で解放を試みるページキャッシュ数 */
+#define PGIF_RECLAIM_RETRIES  (4)   /**< 直接回収後にページ獲得を再試行する回数 */
+#define PGIF_RECLAIM_PERIOD_MS (1000) /**< 定期回収の間隔 (単位:ms) */
+
+/** 縮小処理の契機
+ */
+#define PGIF_SHRINK_PRESSURE  (0)   /**< 空きページ不足による縮小 */
+#define PGIF_SHRINK_PERIODIC  (1)   /**< 定期回収による縮小 */
+
+#if !defined(ASM_FILE)
+
+#include <klib/freestanding.h>
+#include <kern/spinlock.h>
+#include <kern/wqueue.h>
+#include <kern/mutex.h>
+#include <klib/queue.h>
+
+struct _thread;
+struct _call_out_ent;
+
+/** 縮小処理登録情報
+    ページキャッシュやSLABキャッシュなどのサブシステムが回収処理を登録する
+    @note countは回収可能なオブジェクト数を, scanは最大nr個のオブジェクトを
+    回収して解放したページ数を返却する
+    @note count, scanは回収処理排他用mutexを獲得した状態で呼び出される
+ */
+typedef struct _pgif_shrinker{
+	struct _list                          link;  /**< 登録リストへのリンク  */
+	const char                           *name;  /**< 縮小処理の名前        */
+	obj_cnt_type (*count)(void *_private);       /**< 回収可能数算出関数    */
+	obj_cnt_type (*scan)(obj_cnt_type _nr, int _reason, void *_private); /**< 回収関数 */
+	void                              *private;  /**< プライベート情報      */
+	obj_cnt_type                          runs;  /**< 回収関数の呼び出し回数 */
+	obj_cnt_type                         freed;  /**< 解放したページ数      */
+}pgif_shrinker;
+
+/** ページ回収管理情報
+    空きページ数が低水位を下回ると回収スレッドを起床し, 高水位まで
+    ページキャッシュとSLABキャッシュを縮小する
+    @note 回収処理はmtxで排他し, 統計情報はlockで排他する
+ */
+typedef struct _pgif_reclaim{
+	spinlock               lock;  /**< 起床要求, 統計情報のロック          */
+	wque_waitqueue         wque;  /**< 回収スレッドのウエイトキュー        */
+	mutex                   mtx;  /**< 回収処理排他用mutex                 */
+	struct _thread         *thr;  /**< 回収スレッド (NULLの場合は初期化前) */
+	bool              requested;  /**< 回収スレッドへの起床要求            */
+	bool               periodic;  /**< 回収スレッドへの定期回収要求        */
+	struct _queue     shrinkers;  /**< 縮小処理の登録リスト (mtxで排他)    */
+	struct _call_out_ent *callout; /**< 定期回収のコールアウト             */
+	obj_cnt_type       requests;  /**< 回収スレッドの起床要求回数          */
+	obj_cnt_type        bg_runs;  /**< 回収スレッドでの回収処理実行回数    */
+	obj_cnt_type    direct_runs;  /**< 直接回収の実行回数                  */
+	obj_cnt_type  periodic_runs;  /**< 定期回収の実行回数                  */
+	obj_cnt_type      reclaimed;  /**< 回収したページ数                    */
+}pgif_reclaim;
+
+/** ページ回収統計情報
+ */
+typedef struct _pgif_reclaim_stat{
+	obj_cnt_type       requests;  /**< 回収スレッドの起床要求回数          */
+	obj_cnt_type        bg_runs;  /**< 回収スレッドでの回収処理実行回数    */
+	obj_cnt_type    direct_runs;  /**< 直接回収の実行回数                  */
+	obj_cnt_type  periodic_runs;  /**< 定期回収の実行回数                  */
+	obj_cnt_type      reclaimed;  /**< 回収したページ数                    */
+}pgif_reclaim_stat;
+
+void pgif_shrinker_register(struct _pgif_shrinker *_shr);
+void pgif_shrinker_unregister(struct _pgif_shrinker *_shr);
+void pgif_reclaim_wakeup(void);
+bool pgif_reclaim_direct(void);
+obj_cnt_type pgif_reclaim_periodic(void);
+void pgif_reclaim_obtain_stat(pgif_reclaim_stat *_statp);
+void pgif_reclaim_init(void);
+
+#endif  /*  !ASM_FILE  */
+#endif  /*  _KERN_PAGE_RECLAIM_H   */
@@ -25,6 +25,8 @@
 	( ULONG_C(4) << KM_SFLAGS_ARG_SHIFT)  /*< ハードウエアアラインメントに合わせる */
 #define KM_SFLAGS_COLORING           \
 	( ULONG_C(8) << KM_SFLAGS_ARG_SHIFT)  /*< カラーリングを行う                   */
+#define KM_SFLAGS_ZEROED             \
+	( ULONG_C(16) << KM_SFLAGS_ARG_SHIFT) /*< 事前クリア済みページを優先して獲得する */
 
 /** 引数で指定可能なフラグ  */
 #define KM_SFLAGS_ARGS		     \
@@ -44,6 +46,10 @@
 	( ULONG_C(2) << KM_SFLAGS_INTERNAL_SHIFT)  /*< 規定のスラブキャッシュ  */
 #define KM_SFLAGS_MARK_DESTROY   \
 	( ULONG_C(4) << KM_SFLAGS_INTERNAL_SHIFT)  /*< 解放予約  */
+#define KM_SFLAGS_NO_MAGAZINE          \
+	( ULONG_C(8) << KM_SFLAGS_INTERNAL_SHIFT)  /*< マガジン層を使用しない  */
+#define KM_SFLAGS_MERGEABLE            \
+	( ULONG_C(16) << KM_SFLAGS_INTERNAL_SHIFT)  /*< 互換な事前割当て済みキャッシュとの統合を許可する */
 
 #if !defined(HAL_CPUCACHE_HW_ALIGN)
 #define HAL_CPUCACHE_HW_ALIGN ( sizeof(void *) * 2 )  /*  ポインタ長の2倍に合わせる  */
@@ -83,17 +89,36 @@
  */
 #define SLAB_REAP_NORMAL        (0) /** 最低限保持するSLAB数を保持する  */
 #define SLAB_REAP_FORCE         (1) /** 最低限保持するSLAB数を保持する  */
+#define SLAB_REAP_AGED          (2) /** 一定期間未使用の空きSLABのみを解放する  */
+
+/** 定期回収(SLAB_REAP_AGED)で空きSLABを解放するまでに経過させる回収周期数
+ */
+#define SLAB_REAP_IDLE_PASSES   (2)
 
 /**
    事前割当て済みカーネルキャッシュ
  */
-#define SLAB_PREALLOC_CACHE_NR   (14)  /** 事前割当て済みカーネルキャッシュの数      */
+#define SLAB_PREALLOC_CACHE_NR   (17)  /** 事前割当て済みカーネルキャッシュの数      */
 #define SLAB_PREALLOC_BASE       (ULONG_C(8)) /** 事前割当て済みカーネルキャッシュの基準サイズ  */
 
 /**  事前割当て済みカーネルキャッシュの最小サイズ 8Byte (単位:バイト)  */
 #define SLAB_PREALLOC_MIN	(SLAB_PREALLOC_BASE << 0)
 /**  事前割当て済みカーネルキャッシュの最大サイズ 64KiB (単位:バイト) */
-#define SLAB_PREALLOC_MAX       (SLAB_PREALLOC_BASE << (SLAB_PREALLOC_CACHE_NR - 1)) 
+#define SLAB_PREALLOC_MAX       (SLAB_PREALLOC_BASE << 13) 
+
+/**
+   kmallocのサイズ区分検索
+   SLAB_KMALLOC_SMALL_MAX以下のサイズは8バイト単位の参照表で,
+   それを超えるサイズは最上位ビット位置で区分を求める
+ */
+#define SLAB_KMALLOC_TABLE_SHIFT (3)  /** 参照表のインデクスを求めるシフト数  */
+#define SLAB_KMALLOC_SMALL_SHIFT (9)  /** 参照表で検索する最大サイズの2を底とする対数  */
+/**  参照表で検索する最大サイズ 512Byte (単位:バイト) */
+#define SLAB_KMALLOC_SMALL_MAX   (ULONG_C(1) << SLAB_KMALLOC_SMALL_SHIFT)
+/**  SLAB_KMALLOC_SMALL_MAXの事前割当て済みカーネルキャッシュのインデクス */
+#define SLAB_KMALLOC_SMALL_INDEX (9)
+/**  参照表のエントリ数 */
+#define SLAB_KMALLOC_TABLE_NR    (SLAB_KMALLOC_SMALL_MAX >> SLAB_KMALLOC_TABLE_SHIFT)
 
 /**  事前割当て済みカーネルキャッシュのアラインメント(アラインメントを設定しない)  */
 #define SLAB_ALIGN_NONE         (0) /** アラインメントをつけない  */
@@ -101,19 +126,54 @@
 	(SLAB_ALIGN_NONE) /** 事前割当て済みカーネルキャッシュはアラインメントをつけない  */
 #define SLAB_PREALLOC_LIMIT     (0) /** 事前割当て済みカーネルキャッシュの最小保持SLAB  */
 
+/**
+   CPU単位マガジン
+ */
+#define SLAB_MAGAZINE_SIZE_MIN   (2)  /** 大きなオブジェクト用マガジンの初期容量 (単位:個)  */
+#define SLAB_MAGAZINE_SIZE_INIT  (8)  /** 小さなオブジェクト用マガジンの初期容量 (単位:個)  */
+#define SLAB_MAGAZINE_SIZE_MAX   (32) /** マガジンの最大容量 (単位:個)  */
+#define SLAB_MAGAZINE_CONTENTION_LIMIT \
+	(16) /** マガジン容量を拡大するデポロックの競合回数  */
+
 #if !defined(ASM_FILE)
 #include <klib/freestanding.h>
 #include <kern/spinlock.h>
 #include <klib/slist.h>
 #include <klib/list.h>
+#include <klib/atomic64.h>
+#include <klib/statcnt.h>
+#include <klib/splay.h>
 #include <klib/queue.h>
 
+/** マガジン
+    CPU単位に保持する解放済みオブジェクトのスタック
+ */
+typedef struct _slab_magazine{
+	struct _list                  link;  /*< デポへのリンク                       */
+	obj_cnt_type                rounds;  /*< 格納中のオブジェクト数 (単位:個)     */
+	obj_cnt_type              capacity;  /*< 格納可能なオブジェクト数 (単位:個)   */
+	void *objs[SLAB_MAGAZINE_SIZE_MAX];  /*< オブジェクトへのポインタ             */
+}slab_magazine;
+
+/** CPU単位キャッシュ
+    @note 自CPUからは割込み禁止状態で操作する
+    ロックは, デポのロックより先に獲得し, キャッシュのロックとは同時に獲得しない
+ */
+typedef struct _slab_cpu_cache{
+	struct _spinlock                lock;  /*< ロック変数                           */
+	struct _slab_magazine        *loaded;  /*< 使用中のマガジン                     */
+	struct _slab_magazine      *previous;  /*< 直前に使用したマガジン               */
+	obj_cnt_type                    hits;  /*< マガジンからの獲得回数               */
+	obj_cnt_type                  misses;  /*< マガジンから獲得できなかった回数     */
+}slab_cpu_cache;
+
 /** カーネルメモリキャッシュ
  */
 typedef struct _kmem_cache{
 	struct _spinlock                        lock;  /*< ロック変数  */
 	const char                             *name;  /*< メモリキャッシュの名前   */
 	SPLAY_ENTRY(_kmem_cache)                node;  /*< メモリキャッシュ管理へのリンク  */
+	obj_cnt_type                         walkers;  /*< 登録済みキャッシュをたどる処理からの参照数  */
 	size_t                          payload_size;  /*< オブジェクトサイズ(単位:バイト) */
 	size_t                              obj_size;  /*< アライメントを含むオブジェクトサイズ(単位: バイト)  */
 	page_order                             order;  /*< SLAB1つ分のサイズ(単位:ページオーダ)  */
@@ -128,19 +188,115 @@ typedef struct _kmem_cache{
 	struct _queue                        partial;  /*< 使用中SLABのリスト  */
 	struct _queue                           full;  /*< 空きがないSLABのリスト  */
 	struct _queue                           free;  /*< 未使用SLABのリスト  */
-	void (*constructor)(void *_obj, size_t _siz);  /*< オブジェクト獲得時のコンストラクタ */
-	void  (*destructor)(void *_obj, size_t _siz);  /*< オブジェクト解放時のデストラクタ  */
+	void (*constructor)(void *_obj, size_t _siz);  /*< SLAB作成時のコンストラクタ */
+	void  (*destructor)(void *_obj, size_t _siz);  /*< SLAB解放時のデストラクタ  */
+	struct _spinlock                  depot_lock;  /*< デポのロック  */
+	struct _queue                       mag_full;  /*< 満杯のマガジンのリスト  */
+	struct _queue                      mag_empty;  /*< 空のマガジンのリスト  */
+	obj_cnt_type                     nr_mag_full;  /*< 満杯のマガジン数  */
+	obj_cnt_type                    nr_mag_empty;  /*< 空のマガジン数  */
+	obj_cnt_type                        mag_size;  /*< 新たに割り当てるマガジンの容量 (単位:個)  */
+	obj_cnt_type                depot_contention;  /*< デポのロックの競合回数  */
+	obj_cnt_type                     mag_resizes;  /*< マガジン容量の拡大回数  */
+	obj_cnt_type                        reap_gen;  /*< 定期回収の世代  */
+	struct _kmem_cache                   *merged;  /*< 統合先のキャッシュ (エイリアスでない場合はNULL)  */
+	obj_cnt_type                      nr_aliases;  /*< 統合されたエイリアス数  */
+	struct _slab_cpu_cache cpu_cache[KC_CPUS_NR];  /*< CPU単位キャッシュ  */
+	struct _stat_cnt                      allocs;  /*< オブジェクト獲得数  */
+	struct _stat_cnt                       frees;  /*< オブジェクト解放数  */
+	struct _stat_cnt                 alloc_fails;  /*< オブジェクト獲得失敗回数  */
+	struct _stat_cnt                       grows;  /*< SLAB伸長回数  */
+	struct _stat_cnt                       reaps;  /*< 解放したSLAB数  */
 }kmem_cache;
 
+/** カーネルメモリキャッシュ管理情報
+ */
+typedef struct _kmem_cache_db{
+	struct _spinlock                        lock;  /*< ロック変数  */
+	SPLAY_HEAD(_kmem_cache_tree, _kmem_cache) head;  /*< メモリキャッシュのSPLAY木  */
+}kmem_cache_db;
+
+/**
+   カーネルメモリキャッシュ管理情報初期化子
+   @param[in] _db カーネルメモリキャッシュ管理情報へのポインタ
+ */
+#define __KMEM_CACHE_DB_INITIALIZER(_db)	        \
+	{						\
+		.lock = __SPINLOCK_INITIALIZER,		\
+		.head = SPLAY_INITIALIZER(&((_db)->head)),	\
+	}
+
+/** カーネルメモリキャッシュの統計情報
+ */
+typedef struct _slab_kmem_cache_stat{
+	const char            *name;  /*< メモリキャッシュの名前  */
+	const char        *alias_of;  /*< 統合先のキャッシュの名前 (エイリアスでない場合はNULL)  */
+	obj_cnt_type     nr_aliases;  /*< 統合されたエイリアス数  */
+	size_t         payload_size;  /*< オブジェクトサイズ (単位:バイト)  */
+	size_t             obj_size;  /*< 管理情報を含むオブジェクトサイズ (単位:バイト)  */
+	obj_cnt_type  objs_per_slab;  /*< SLAB1つに入るオブジェクトの数 (単位:個)  */
+	obj_cnt_type pages_per_slab;  /*< SLAB1つ分のページ数  */
+	obj_cnt_type          limit;  /*< 最低限保持するSLAB数  */
+	obj_cnt_type       nr_slabs;  /*< 作成済みSLAB数  */
+	obj_cnt_type        nr_full;  /*< 空きがないSLAB数  */
+	obj_cnt_type     nr_partial;  /*< 使用中SLAB数  */
+	obj_cnt_type        nr_free;  /*< 未使用SLAB数  */
+	obj_cnt_type     total_objs;  /*< 作成済みSLAB中のオブジェクト数  */
+	obj_cnt_type    active_objs;  /*< 使用中のオブジェクト数  */
+	obj_cnt_type   partial_free;  /*< 使用中SLAB中の空きオブジェクト数 (断片化量)  */
+	obj_cnt_type  magazine_objs;  /*< マガジンに格納されたオブジェクト数  */
+	stat_cnt_val         allocs;  /*< オブジェクト獲得数  */
+	stat_cnt_val          frees;  /*< オブジェクト解放数  */
+	stat_cnt_val    alloc_fails;  /*< オブジェクト獲得失敗回数  */
+	stat_cnt_val          grows;  /*< SLAB伸長回数  */
+	stat_cnt_val          reaps;  /*< 解放したSLAB数  */
+}slab_kmem_cache_stat;
+
+/**
+   空きオブジェクトリストの先頭情報
+   下位48ビットに先頭エントリのアドレスを, 上位16ビットに更新世代(タグ)を格納し,
+   比較交換命令で一括して更新することでABA問題を回避する
+ */
+#define SLAB_FREELIST_PTR_BITS   (48)  /*< アドレス部のビット数  */
+#define SLAB_FREELIST_PTR_MASK   \
+	( ( ULONG_C(1) << SLAB_FREELIST_PTR_BITS ) - 1 ) /*< アドレス部のマスク  */
+
+/**
+   空きオブジェクトリストの先頭情報を生成する
+   @param[in] _tag  更新世代
+   @param[in] _node 先頭エントリのアドレス
+ */
+#define SLAB_FREELIST_MAKE(_tag, _node)					\
+	( (atomic64_val)( ( (uint64_t)(_tag) << SLAB_FREELIST_PTR_BITS ) |	\
+	    ( (uint64_t)(uintptr_t)(_node) & SLAB_FREELIST_PTR_MASK ) ) )
+
+/**
+   空きオブジェクトリストの先頭情報から先頭エントリのアドレスを得る
+   @param[in] _v 空きオブジェクトリストの先頭情報
+   @note アドレス部の最上位ビットを符号拡張して上位アドレスを復元する
+ */
+#define SLAB_FREELIST_NODE(_v)						\
+	( (struct _slist_node *)(uintptr_t)				\
+	    ( ( (int64_t)( (uint64_t)(_v) << ( 64 - SLAB_FREELIST_PTR_BITS ) ) ) \
+		>> ( 64 - SLAB_FREELIST_PTR_BITS ) ) )
+
+/**
+   空きオブジェクトリストの先頭情報から更新世代を得る
+   @param[in] _v 空きオブジェクトリストの先頭情報
+ */
+#define SLAB_FREELIST_TAG(_v)				\
+	( (uint64_t)(_v) >> SLAB_FREELIST_PTR_BITS )
+
 /** SLAB管理情報
  *  @note count操作はkmem_cacheのロックを獲得して行う
+ *  @note 空きオブジェクトリストはロックを用いずに比較交換命令で操作する
  */
 typedef struct _slab{
-	struct _spinlock      lock;  /*< SLAB内の空きオブジェクトリストのロック     */
 	struct _kmem_cache  *cache;  /*< kmem_cacheへのバックリンク                 */
 	struct _list          link;  /*< kmem_cacheへのリンクエントリ               */
-	struct _slist_head objects;  /*< 空き領域キュー                             */
+	struct _atomic64   objects;  /*< 空き領域キュー (タグ付き先頭エントリ)      */
 	obj_cnt_type         count;  /*< SLAB内に含まれるオブジェクトの数(単位:個)  */
+	obj_cnt_type      reap_gen;  /*< 空きSLABになった時点の定期回収の世代       */
 	void                 *page;  /*< オブジェクトを格納したページへのポインタ   */
 }slab;
 
@@ -160,19 +316,44 @@ typedef struct _kmem_s_bufctl{
 	struct _slist_node link;  /*< 空き領域キューへのリンク  */
 }kmem_s_bufctl;
 
+/** kmalloc統計情報
+ */
+typedef struct _slab_kmalloc_stat{
+	size_t          size[SLAB_PREALLOC_CACHE_NR];  /*< サイズ区分 (単位:バイト)             */
+	obj_cnt_type  allocs[SLAB_PREALLOC_CACHE_NR];  /*< 獲得回数                             */
+	uint64_t   requested[SLAB_PREALLOC_CACHE_NR];  /*< 要求サイズの総和 (単位:バイト)       */
+	uint64_t   allocated;  /*< 割り当てたサイズの総和 (単位:バイト)                         */
+	uint64_t      wasted;  /*< 内部断片化による未使用領域の総和 (単位:バイト)               */
+	obj_cnt_type large_allocs;  /*< ページ単位での獲得回数                                  */
+	obj_cnt_type  large_pages;  /*< ページ単位で割り当てた使用中のページ数                  */
+}slab_kmalloc_stat;
+
 int slab_kmem_cache_create(struct _kmem_cache *_cache, const char *_name, size_t _size,
 			 uintptr_t _align, obj_cnt_type _limits, slab_flags _sflags,
 			 void  (*_constructor)(void *_obj, size_t _siz),
 			 void  (*_destructor)(void *_obj, size_t _siz));
 
-void slab_kmem_cache_destroy(kmem_cache *_cache);
-void slab_kmem_cache_reap(kmem_cache *_cache, int _reap_flags);
+int slab_kmem_cache_destroy(kmem_cache *_cache);
+obj_cnt_type slab_kmem_cache_reap(kmem_cache *_cache, int _reap_flags);
 void slab_kmem_cache_free(void *_obj);
+void slab_kmem_cache_free_obj(kmem_cache *_cache, void *_obj);
 int slab_kmem_cache_alloc(kmem_cache *_cache, pgalloc_flags _mflags, void **_objp);
+void slab_kmem_cache_free_bulk(kmem_cache *_cache, obj_cnt_type _nr, void **_objs);
+void slab_kmem_cache_obtain_stat(kmem_cache *_cache, slab_kmem_cache_stat *_statp);
+int slab_kmem_cache_foreach(int (*_fn)(kmem_cache *_cache, void *_arg), void *_arg);
+void slab_kmem_cache_show_info(void);
+int slab_kmem_cache_alloc_bulk(kmem_cache *_cache, pgalloc_flags _mflags,
+    obj_cnt_type _nr, void **_objs);
 
+void slab_magazine_init(void);
 void slab_prepare_preallocate_cahches(void);
 void slab_finalize_preallocate_cahches(void);
+obj_cnt_type slab_reap_preallocate_cahches(int _reap_flags);
+obj_cnt_type slab_reap_all_caches(int _reap_flags);
+void slab_shrinker_init(void);
 
+size_t slab_kmalloc_class_size(size_t _size);
+void slab_kmalloc_obtain_stat(slab_kmalloc_stat *_statp);
 void *kmalloc(size_t _size, pgalloc_flags _mflags);
 void kfree(void *);
 #endif  /* !ASM_FILE  */
@@ -36,8 +36,13 @@
 /**< ラウンドロビンクラスの最高優先度   */
 #define SCHED_MIN_RR_PRIO       ( SCHED_MAX_RR_PRIO + SCHED_PRIO_PER_POLICY - 1)
 
+/**< 公平スケジューリングクラスの最高優先度   */
+#define SCHED_MAX_FAIR_PRIO     ( SCHED_MIN_RR_PRIO + 1 )
+/**< 公平スケジューリングクラスの最低優先度   */
+#define SCHED_MIN_FAIR_PRIO     ( SCHED_MAX_FAIR_PRIO + SCHED_PRIO_PER_POLICY - 1)
+
 /**< ユーザスレッドが動作しうる最低優先度 */
-#define SCHED_MIN_USER_PRIO     (SCHED_MIN_RR_PRIO)
+#define SCHED_MIN_USER_PRIO     (SCHED_MIN_FAIR_PRIO)
 /**< ユーザスレッドが動作しうる最高優先度 */
 #define SCHED_MAX_USER_PRIO     (SCHED_MAX_FCFS_PRIO)
 
@@ -49,6 +54,9 @@
 /**< スレッドの優先度数 */
 #define SCHED_PRIO_NR           (SCHED_MIN_USER_PRIO + 1)
 
+/**< 優先度別キューで管理する優先度数 (公平スケジューリングクラスより上位) */
+#define SCHED_FIXED_PRIO_NR     (SCHED_MIN_RR_PRIO + 1)
+
 /**
    プロセスの優先度として有効であることを確認する
    @param[in] _prio 優先度
@@ -67,6 +75,44 @@
 #define SCHED_VALID_USER_PRIO(_prio) \
 	( ( SCHED_MAX_USER_PRIO <= (_prio) ) && ( ( (_prio) <= SCHED_MIN_USER_PRIO )  ) )
 
+/**
+   ラウンドロビンクラスの優先度であることを確認する
+   @param[in] _prio 優先度
+   @retval 真 ラウンドロビンクラスの優先度である
+   @retval 偽 ラウンドロビンクラスの優先度でない
+ */
+#define SCHED_RR_PRIO(_prio) \
+	( ( SCHED_MAX_RR_PRIO <= (_prio) ) && ( (_prio) <= SCHED_MIN_RR_PRIO ) )
+
+/**
+   公平スケジューリングクラスの優先度であることを確認する
+   @param[in] _prio 優先度
+   @retval 真 公平スケジューリングクラスの優先度である
+   @retval 偽 公平スケジューリングクラスの優先度でない
+ */
+#define SCHED_FAIR_PRIO(_prio) \
+	( ( SCHED_MAX_FAIR_PRIO <= (_prio) ) && ( (_prio) <= SCHED_MIN_FAIR_PRIO ) )
+
+/*
+ * 公平スケジューリング
+ */
+/**< 標準の重みを持つ公平スケジューリングクラスの優先度 */
+#define SCHED_FAIR_NICE0_PRIO         ( SCHED_MAX_FAIR_PRIO + SCHED_PRIO_PER_POLICY / 2 )
+#define SCHED_FAIR_NICE0_WEIGHT       (1024)  /**< 標準の重み                         */
+#define SCHED_FAIR_WEIGHT_LEVELS      (40)    /**< 重みの段階数                       */
+#define SCHED_FAIR_NS_PER_MS          (ULONGLONG_C(1000000))  /**< 1msあたりのナノ秒数 */
+/**< 横取りまでに許容する仮想実行時間の差 (単位:ms) */
+#define SCHED_FAIR_GRANULARITY_MS     (10)
+/**< 起床したスレッドに与える仮想実行時間の猶予 (単位:ms) */
+#define SCHED_FAIR_SLEEPER_CREDIT_MS  (20)
+
+/*
+ * 負荷分散
+ */
+#define SCHED_REBALANCE_PERIOD_MS  (100)  /**< 定期負荷分散の周期 (単位:ms)  */
+/**< 定期負荷分散でスレッドを移動するキュー内のスレッド数の差 */
+#define SCHED_REBALANCE_IMBALANCE  (2)
+
 #if !defined(ASM_FILE)
 #include <klib/freestanding.h>
 #include <kern/kern-types.h>
@@ -74,23 +120,63 @@
 #include <klib/queue.h>
 #include <klib/list.h>
 #include <klib/bitops.h>
+#include <klib/rbtree.h>
 
 struct _thread;
 
 /**
    スケジューラキュー
+   @note 論理CPUごとにCPU情報中に配置する
  */
 typedef struct _sched_queue{
 	spinlock                                   lock;  /**< スケジューラキューのロック */
-	struct _queue                que[SCHED_PRIO_NR];  /**< スケジューラキュー         */
-	BITMAP_TYPE(, uint64_t, SCHED_PRIO_NR)  bitmap;  /**< スケジューラビットマップ   */
+	obj_cnt_type                         nr_threads;  /**< キュー内のスレッド数       */
+	obj_cnt_type               nr_allowed[KC_CPUS_NR];  /**< CPUごとの実行可能なキュー内のスレッド数 */
+	obj_cnt_type                         migrations;  /**< 他のキューから移動したスレッド数 */
+	obj_cnt_type                             steals;  /**< アイドル時に奪取したスレッド数   */
+	bool                            resched_pending;  /**< 再スケジュールIPI送信済み       */
+	obj_cnt_type                          ipis_sent;  /**< 送信した再スケジュールIPI数     */
+	obj_cnt_type                     ipis_coalesced;  /**< 送信を抑止した再スケジュール要求数 */
+	obj_cnt_type                      ipis_received;  /**< 受信した再スケジュールIPI数     */
+	uint64_t                          ipi_sent_time;  /**< IPI送信時のサイクルカウンタ値   */
+	uint64_t                     ipi_latency_cycles;  /**< IPI送信から受信までのサイクル数の累計 */
+	obj_cnt_type                      slice_expires;  /**< タイムスライス満了による横取り数 */
+	obj_cnt_type                      fair_preempts;  /**< 仮想実行時間の超過による横取り数 */
+	uint64_t                      fair_min_vruntime;  /**< 公平スケジューリングクラスの最小仮想実行時間 */
+	RB_HEAD(_sched_fair_tree, _thread)    fair_tree;  /**< 公平スケジューリングクラスのスレッド */
+	struct _queue          que[SCHED_FIXED_PRIO_NR];  /**< スケジューラキュー         */
+	BITMAP_TYPE(, uint64_t, SCHED_FIXED_PRIO_NR)  bitmap;  /**< スケジューラビットマップ   */
 }sched_queue;
 
+/**
+   スケジューラキューの統計情報
+ */
+typedef struct _sched_queue_stat{
+	obj_cnt_type         nr_threads;  /**< キュー内のスレッド数                   */
+	obj_cnt_type         migrations;  /**< 他のキューから移動したスレッド数       */
+	obj_cnt_type             steals;  /**< アイドル時に奪取したスレッド数         */
+	obj_cnt_type          ipis_sent;  /**< 送信した再スケジュールIPI数            */
+	obj_cnt_type     ipis_coalesced;  /**< 送信を抑止した再スケジュール要求数     */
+	obj_cnt_type      ipis_received;  /**< 受信した再スケジュールIPI数            */
+	uint64_t     ipi_latency_cycles;  /**< IPI送信から受信までのサイクル数の累計  */
+	obj_cnt_type      slice_expires;  /**< タイムスライス満了による横取り数       */
+	obj_cnt_type      fair_preempts;  /**< 仮想実行時間の超過による横取り数       */
+	uint64_t      fair_min_vruntime;  /**< 公平スケジューリングクラスの最小仮想実行時間 */
+}sched_queue_stat;
+
 void sched_thread_add(struct _thread *_thr);
 void sched_thread_del(struct _thread *_thr);
+void sched_thread_migrate(struct _thread *_thr);
 void sched_schedule(void);
 bool sched_delay_disptach(void);
 void sched_idlethread_add(void);
+bool sched_has_stealable_thread(void);
+obj_cnt_type sched_rebalance(void);
+void sched_resched_ipi_handler(cpu_id _cpu);
+bool sched_timer_tick(void);
+uint32_t sched_fair_prio_to_weight(thr_prio _prio);
+int sched_obtain_queue_stat(cpu_id _cpu, struct _sched_queue_stat *_statp);
+void sched_rebalance_init(void);
 void sched_init(void);
 #endif  /*  !ASM_FILE  */
 #endif  /*  _KERN_SCHED_IF_H   */
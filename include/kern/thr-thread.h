@@ -17,6 +17,7 @@
 #include <kern/spinlock.h>
 #include <kern/wqueue.h>
 #include <kern/sched-queue.h>
+#include <kern/kern-cpuinfo.h>
 
 #include <klib/refcount.h>
 #include <klib/list.h>
@@ -42,6 +43,7 @@
 #define THR_TID_IDLE              (ULONGLONG_C(0))          /**< アイドルスレッドのスレッドID */
 #define THR_TID_REAPER            (ULONGLONG_C(2))          /**< 刈り取りスレッドのスレッドID */
 #define THR_PRIO_REAPER           (SCHED_MAX_SYS_PRIO - 1)  /**< 刈り取りスレッドの優先度 */ 
+#define THR_PRIO_RECLAIM          (SCHED_MAX_SYS_PRIO)      /**< ページ回収スレッドの優先度 */
 
 struct _thread_info;
 struct _proc;
@@ -81,6 +83,8 @@ typedef struct _thread_attr{
 	thr_prio        ini_prio;  /**< 初期化時スレッド優先度                       */
 	thr_prio       base_prio;  /**< ベーススレッド優先度                         */
 	thr_prio        cur_prio;  /**< 現在のスレッド優先度                         */
+	obj_cnt_type       slice;  /**< 残りタイムスライス (単位:ティック)           */
+	uint64_t        vruntime;  /**< 仮想実行時間 (単位:ns, 公平スケジューリング用) */
 }thread_attr;
 
 /**
@@ -97,6 +101,10 @@ typedef struct _thread{
 	void                       *ksp;  /**< スレッドスイッチコンテキスト       */
 	struct _thread_info      *tinfo;  /**< スレッド情報へのポインタ           */
 	struct _list               link;  /**< スケジューラキュー/wait待ちへのリンク  */
+	struct _sched_queue        *rdq;  /**< 接続中のレディキュー               */
+	RB_ENTRY(_thread)      fair_ent;  /**< 公平スケジューリングツリーのエントリ */
+	cpu_bitmap             affinity;  /**< 実行可能なCPU                      */
+	cpu_bitmap         rdq_affinity;  /**< レディキュー追加時のアフィニティ   */
 	struct _list          proc_link;  /**< プロセス管理情報のリンク           */
 	struct _list      children_link;  /**< 親スレッドのchildrenキューのリンク */
 	struct _thread_attr        attr;  /**< スレッド属性                       */
@@ -139,6 +147,8 @@ void thr_thread_exit(exit_code _ec);
 int thr_thread_create(tid _id, entry_addr _entry, void *_usp, void *_kstktop, thr_prio _prio, 
 		      thr_flags _flags, struct _thread **_thrp);
 void thr_thread_switch(struct _thread *_prev, struct _thread *_next);
+int thr_set_affinity(struct _thread *_thr, cpu_bitmap *_mask);
+void thr_get_affinity(struct _thread *_thr, cpu_bitmap *_maskp);
 bool thr_ref_dec(struct _thread *_thr);
 bool thr_ref_inc(struct _thread *_thr);
 int thr_id_alloc(tid *_idp);
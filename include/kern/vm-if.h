@@ -59,6 +59,7 @@
 #include <kern/spinlock.h>
 #include <kern/mutex.h>
 #include <klib/statcnt.h>
+#include <klib/list.h>
 #include <hal/hal-pgtbl.h>
 
 struct _proc;
@@ -71,12 +72,24 @@ typedef struct _vm_pgtbl_type{
 	vm_paddr  tblbase_paddr;  /*< ページテーブルベース(物理アドレス)         */
 	struct _proc         *p;  /*< procへの逆リンク                           */
 	stat_cnt       nr_pages;  /*< ページテーブルを構成するページ数           */
+	page_color   next_color;  /*< 次に割り当てるページテーブルのページカラー */
 	struct _hal_pgtbl_md md;  /*< アーキテクチャ依存部                       */
 }vm_pgtbl_type;
 
 typedef struct _vm_pgtbl_type *vm_pgtbl;  /*< ページテーブル型 */
 
+/** 物理->仮想アドレス変換エントリ
+    無名ページをマップしているアドレス空間と仮想アドレスを記録する
+    @note 無名ページのページフレーム情報のビットロックを獲得して操作する
+ */
+typedef struct _vm_pv_ent{
+	struct _list        link;  /*< 物理->仮想アドレス変換キューへのリンク */
+	vm_pgtbl             pgt;  /*< マップ先アドレス空間のページテーブル   */
+	vm_vaddr           vaddr;  /*< マップ先仮想アドレス                   */
+}vm_pv_ent;
+
 void vm_pgtbl_cache_init(void);
+void vm_map_init(void);
 int pgtbl_alloc_pgtbl_page(vm_pgtbl _pgt, hal_pte **_tblp, vm_paddr *_paddrp);
 int pgtbl_alloc_pgtbl(vm_pgtbl *_pgtp);
 int pgtbl_alloc_user_pgtbl(vm_pgtbl *_pgtp);
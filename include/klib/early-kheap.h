@@ -26,6 +26,7 @@ typedef struct _early_kernel_heap{
 void *ekheap_sbrk(vm_size _inc);
 void ekheap_stat(struct _early_kernel_heap *_st);
 void ekheap_init(vm_paddr _pstart, void *_start, vm_size _size);
+vm_size ekheap_retire(vm_paddr *_pstartp, vm_paddr *_pendp);
 void ekheap_kvaddr_to_paddr(void *_kvaddr, void **_paddrp);
 void ekheap_paddr_to_kvaddr(void *_paddr, void **_kvaddrp);
 #endif /*  _EARLY_KHEAP_H  */
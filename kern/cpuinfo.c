@@ -34,7 +34,7 @@ _cpu_info_cmp(struct _cpu_info *key, struct _cpu_info *ent){
 	if ( key->phys_id < ent->phys_id )
 		return 1;
 
-	if ( ent->phys_id  > key->phys_id )
+	if ( key->phys_id > ent->phys_id )
 		return -1;
 
 	return 0;	
@@ -107,8 +107,8 @@ krn_cpuinfo_cpu_is_online(cpu_id cpu_num){
 	cpu_map    *cmap;
 	intrflags iflags;
 
-	if (KC_CPUS_NR > cpu_num)
-		return -EINVAL;
+	if ( cpu_num >= KC_CPUS_NR )
+		return false;  /* 不正なCPUID */
 
 	cmap = &cpumap;  /*  CPUマップを参照  */
 
@@ -135,8 +135,8 @@ krn_cpuinfo_online(cpu_id cpu_num){
 	cpu_map    *cmap;
 	intrflags iflags;
 
-	if (KC_CPUS_NR > cpu_num)
-		return -EINVAL;
+	if ( cpu_num >= KC_CPUS_NR )
+		return -EINVAL;  /* 不正なCPUID */
 
 	cmap = &cpumap;  /*  CPUマップを参照  */
 
@@ -208,7 +208,7 @@ krn_cpuinfo_get(cpu_id cpu_num){
 	cpu_info   *cinf;
 	intrflags iflags;
 
-	if ( cpu_num > KC_CPUS_NR )
+	if ( cpu_num >= KC_CPUS_NR )
 		return NULL;
 
 	cmap = &cpumap;  /*  CPUマップを参照  */
@@ -252,9 +252,6 @@ krn_cpuinfo_cpu_register(cpu_id phys_id, cpu_id *log_idp){
 
 	cinf = &cmap->cpuinfo[newid];  /* CPU情報を参照 */
 
-	res = RB_INSERT(_cpu_map_tree, &cmap->head, cinf);   /* RBツリーによるインデクス */
-	kassert( res == NULL );
-
 	/* CPU情報のロックを獲得 */
 	spinlock_lock(&cinf->lock);
 
@@ -266,6 +263,10 @@ krn_cpuinfo_cpu_register(cpu_id phys_id, cpu_id *log_idp){
 	/* CPU情報のロックを解放 */
 	spinlock_unlock(&cinf->lock);
 
+	/* 物理CPUIDを設定してからインデクスに登録する */
+	res = RB_INSERT(_cpu_map_tree, &cmap->head, cinf);   /* RBツリーによるインデクス */
+	kassert( res == NULL );
+
 	bitops_set(newid, &cmap->available);  /* CPUを追加 */
 
 	/* CPUマップのロックを解放 */
@@ -18,6 +18,7 @@
 #include <kern/fs-fsimg.h>
 
 static kmem_cache pcache_cache;  /* ページキャッシュのSLABキャッシュ */
+static pgif_shrinker pcache_shrinker;  /* ページキャッシュの縮小処理 */
 /** ページキャッシュプール
  */
 static page_cache_pool pcache_pool = __PCACHE_POOL_INITIALIZER(&pcache_pool, PAGE_SIZE);
@@ -63,6 +64,8 @@ free_pagecache_nolock(page_cache *pc){
        kassert( PCACHE_IS_BUSY(pc) );   /* ページの更新権を得ていることを確認 */
        kassert( !PCACHE_IS_DIRTY(pc) ); /* 2次記憶へのキャッシュ書き出し完了を確認 */
        kassert( !mutex_locked_by_self(&pc->mtx) ); /* ページmutex解放済みであることを確認 */
+       /* 構築済み状態に戻っていることを確認 */
+       kassert( wque_is_empty(&pc->waiters) );
        /* ページキャッシュプールのロックを獲得済みであることを確認 */
        kassert( spinlock_locked_by_self(&pcache_pool.lock) ); 
 
@@ -72,6 +75,22 @@ free_pagecache_nolock(page_cache *pc){
        slab_kmem_cache_free((void *)pc); /* ページキャッシュ管理情報の解放 */
 }
 
+/**
+   ページキャッシュ管理情報のコンストラクタ (内部関数)
+   @param[in] obj ページキャッシュ管理情報
+   @param[in] siz オブジェクトサイズ
+   @note ページmutex, ページウエイトキューは解放時に初期状態に戻っているので,
+   SLAB作成時に一度だけ初期化する
+ */
+static void
+pagecache_ctor(void *obj, size_t __unused siz){
+	page_cache *pc;
+
+	pc = (page_cache *)obj;
+	mutex_init(&pc->mtx);               /* ページmutexの初期化          */
+	wque_init_wait_queue(&pc->waiters); /* ページウエイトキューの初期化 */
+}
+
 /**
    ページキャッシュの割り当て (内部関数)
    @param[out] pcp ページキャッシュ管理情報アドレス返却域
@@ -100,8 +119,7 @@ allocate_new_pcache(page_cache **pcp){
 		goto free_newpage_out;
 	}
 
-	mutex_init(&pc->mtx);               /* ページmutexの初期化          */
-	wque_init_wait_queue(&pc->waiters); /* ページウエイトキューの初期化 */
+	/* ページmutex, ページウエイトキューはコンストラクタで初期化済み */
 	/* 参照カウンタの初期化 (ページキャッシュプールからの参照分として1で初期化)  */
 	refcnt_init(&pc->refs);             
 	pc->bdevid  = 0;                     /* 無効デバイスIDに設定               */
@@ -643,8 +661,101 @@ pagecache_shrink_pages(obj_cnt_type max, bool wbonly, obj_cnt_type *free_nrp){
 
 	return ;
 }
+/**
+   ページキャッシュのページを移動する (内部関数)
+   @param[in] src 移動元ページのページフレーム情報
+   @param[in] dst 移動先ページのページフレーム情報
+   @retval    0      正常終了
+   @retval    -EBUSY ページが使用中のため移動できない
+   @note LRUにつながっている(他のスレッドから使用されていない)ページのみを移動する
+ */
+static int
+pagecache_migrate_page(page_frame *src, page_frame *dst){
+	int               rc;
+	page_cache       *pc;
+	void        *newpage;
+	void        *oldpage;
+
+	rc = pfdb_pfn_to_kvaddr(dst->pfn, &newpage);
+	kassert( rc == 0 );
+
+	/* ページキャッシュプールのロックを獲得 */
+	spinlock_lock(&pcache_pool.lock);
+
+	/* ページキャッシュの解放はページキャッシュプールのロックを獲得して行うため,
+	 * ロック獲得後にページキャッシュとして使用中であることを確認する
+	 */
+	pc = src->pcachep;
+	if ( !PAGE_USED_BY_PCACHE(src) || ( pc == NULL ) || PCACHE_IS_BUSY(pc)
+	    || list_not_linked(&src->lru_ent) ) {
+
+		/* ページキャッシュプールのロックを解放 */
+		spinlock_unlock(&pcache_pool.lock);
+		return -EBUSY;  /* 使用中のページ */
+	}
+
+	oldpage = pc->pc_data;
+	memcpy(newpage, oldpage, PAGE_SIZE);  /* ページの内容をコピーする */
+
+	/* LRU中の位置を引き継いで移動先ページに付け替える */
+	queue_add_after(&src->lru_ent, &dst->lru_ent);
+	queue_del(&pcache_pool.lru, &src->lru_ent);
+
+	src->pcachep = NULL;
+	dst->pcachep = pc;      /* ページキャッシュへの逆リンクを設定 */
+	pc->pf = dst;           /* ページフレーム情報を更新           */
+	pc->pc_data = newpage;  /* ページアドレスを更新               */
+
+	/* ページキャッシュプールのロックを解放 */
+	spinlock_unlock(&pcache_pool.lock);
+
+	pgif_free_page(oldpage);  /* 移動元ページへの参照を解放する */
+
+	return 0;
+}
+
+/**
+   ページキャッシュの縮小処理: 回収可能なページ数を返却する (内部関数)
+   @param[in] private 未使用
+   @return LRUに接続されているページキャッシュ数
+ */
+static obj_cnt_type
+pagecache_shrinker_count(void __unused *private){
+	obj_cnt_type cnt;
+	list         *lp;
+
+	cnt = 0;
+	spinlock_lock(&pcache_pool.lock);
+	queue_for_each(lp, &pcache_pool.lru)
+		++cnt;
+	spinlock_unlock(&pcache_pool.lock);
+
+	return cnt;
+}
+
+/**
+   ページキャッシュの縮小処理: LRUに従ってページキャッシュを解放する (内部関数)
+   @param[in] nr      解放を試みるページ数
+   @param[in] reason  縮小処理の契機
+   @param[in] private 未使用
+   @return 解放したページ数
+   @note ページキャッシュは空きページ不足時のみ解放し, 定期回収では解放しない
+ */
+static obj_cnt_type
+pagecache_shrinker_scan(obj_cnt_type nr, int reason, void __unused *private){
+	obj_cnt_type free_nr;
+
+	if ( reason != PGIF_SHRINK_PRESSURE )
+		return 0;  /* 定期回収ではキャッシュを保持する */
+
+	pagecache_shrink_pages(nr, false, &free_nr);  /* LRUに従ってページキャッシュを解放 */
+
+	return free_nr;
+}
+
 /**
    ページキャッシュ機構の初期化
+   @note ページ回収機構の初期化後に呼び出す
  */
 void
 pagecache_init(void){
@@ -654,6 +765,21 @@ pagecache_init(void){
 	 * ページキャッシュのSLABキャッシュを初期化する
 	 */
 	rc = slab_kmem_cache_create(&pcache_cache, "page-cache cache", sizeof(page_cache),
-	    SLAB_ALIGN_NONE,  0, KMALLOC_NORMAL, NULL, NULL);
+	    SLAB_ALIGN_NONE,  0, KMALLOC_NORMAL, pagecache_ctor, NULL);
 	kassert( rc == 0 );
+
+	/*
+	 * ページキャッシュの移動関数を登録する
+	 */
+	rc = pfdb_register_migrate_handler(PAGE_USAGE_PCACHE, pagecache_migrate_page);
+	kassert( rc == 0 );
+
+	/*
+	 * ページキャッシュの縮小処理を登録する
+	 */
+	pcache_shrinker.name = "page-cache";
+	pcache_shrinker.count = pagecache_shrinker_count;
+	pcache_shrinker.scan = pagecache_shrinker_scan;
+	pcache_shrinker.private = NULL;
+	pgif_shrinker_register(&pcache_shrinker);
 }
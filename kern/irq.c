@@ -524,7 +524,7 @@ irq_unregister_handler(irq_no irq, irq_handler handler){
 	if ( queue_is_empty(&irqline->handlers) ) 
 		irqline_put(irqline);  /* 参照を返却 */
 
-	slab_kmem_cache_free(hdlr);  /* 割込みハンドラエントリを解放 */
+	slab_kmem_cache_free_obj(&irq_handler_cache, hdlr);  /* 割込みハンドラエントリを解放 */
 
 	/* 割込み管理情報のロックを解放 */
 	spinlock_unlock_restore_intr(&inf->lock, &iflags);
@@ -702,7 +702,8 @@ irq_init(void){
 	/* 割込みハンドラキャッシュを初期化する
 	 */
 	rc = slab_kmem_cache_create(&irq_handler_cache, "irq handler cache", 
-	    sizeof(irq_handler_ent), SLAB_ALIGN_NONE,  0, KMALLOC_NORMAL, NULL, NULL);
+	    sizeof(irq_handler_ent), SLAB_ALIGN_NONE,  0,
+	    KMALLOC_NORMAL | KM_SFLAGS_MERGEABLE, NULL, NULL);
 	kassert( rc == 0 );
 
 	return ;
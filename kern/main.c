@@ -35,6 +35,8 @@ kern_common_tests(void){
 	tst_atomic();
 	tst_atomic64();
 	tst_cpuinfo();
+	tst_pfdb();
+	tst_slab();
 	tst_vmmap();
 	tst_pcache();
 	tst_proc();
@@ -68,22 +70,37 @@ test_thread(void __unused *_arg){
  */
 void
 kern_init(void) {
-	int      rc;
-	thread *thr;
+	int          rc;
+	thread     *thr;
+	obj_cnt_type nr;
 
 	kprintf("fsimage: [%p, %p) len:%u\n", 
 		(uintptr_t)&_fsimg_start, (uintptr_t)&_fsimg_end, 
 		(uintptr_t)&_fsimg_end - (uintptr_t)&_fsimg_start);
 
+	pfdb_pcp_init(); /* CPU単位ページキャッシュを初期化する */
+	pfdb_zero_pool_init(); /* 事前クリア済みページプールを初期化する */
+	pfdb_color_pool_init(); /* カラー別ページプールを初期化する */
+	slab_magazine_init();  /* SLABのマガジン層を初期化する */
+	rc = pfdb_cma_init(PFDB_CMA_PAGES); /* 連続メモリ領域を設定する */
+	if ( rc != 0 )
+		kprintf(KERN_WAR "cma: can not reserve %lu pages rc=%d\n", 
+		    PFDB_CMA_PAGES, rc);
 	proc_init();  /* プロセス管理情報を初期化する */
 	thr_init(); /* スレッド管理機構を初期化する */
 	sched_init(); /* スケジューラを初期化する */
 	irq_init(); /* 割込み管理を初期化する */
 	tim_callout_init();  /* コールアウト機構を初期化する */
+	sched_rebalance_init(); /* レディキューの定期負荷分散を開始する */
+	pgif_reclaim_init(); /* ページ回収機構を初期化する */
+	slab_shrinker_init(); /* SLABの縮小処理を登録する */
 	pagecache_init(); /* ページキャッシュ機構を初期化する */
 	fsimg_load();     /* ファイルシステムイメージをページキャッシュに読み込む */
 	hal_platform_init();  /* アーキ固有のプラットフォーム初期化処理 */
 
+	nr = pfdb_release_early_heap();  /* 初期カーネルヒープの未使用ページを返却する */
+	kprintf("early heap: %lu pages released\n", nr);
+
 	/**
 	   テスト処理用スレッドを起動する
 	 */
@@ -111,6 +128,7 @@ main(int argc, char *argv[]) {
 	tflib_kernlayout_init();
 	slab_prepare_preallocate_cahches();
 	vm_pgtbl_cache_init();  /* ページテーブル情報のキャッシュを初期化する */
+	vm_map_init();  /* 仮想空間のマップ処理を初期化する */
 
 	krn_cpuinfo_init();  /* CPU情報を初期化する */
 	krn_cpuinfo_cpu_register(0, &log_id); /* BSPを登録する */
@@ -59,6 +59,71 @@ success:
 	return 0;
 }
 
+/**
+   高次オーダのページ獲得失敗時にメモリコンパクションを行う (内部関数)
+   @param[in]  order       要求ページオーダ
+   @param[in]  alloc_flags ページ獲得条件
+   @retval     真          空きページを確保したため獲得を再試行する
+   @retval     偽          空きページを確保できなかった
+   @note 待ち合わせできない場合はバックグラウンドでの実行を要求する
+ */
+static bool
+compact_for_order(page_order order, pgalloc_flags alloc_flags){
+
+	if ( order == 0 )
+		return false;  /* オーダ0のページはコンパクションで確保しない */
+
+	if ( !( alloc_flags & KMALLOC_ATOMIC ) && ( pfdb_compact_memory(order) == 0 ) )
+		return true;  /* 空きページを確保した */
+
+	pfdb_compact_request(order);  /* バックグラウンドでの実行を要求する */
+
+	return false;
+}
+
+/**
+   ページ獲得前に空きページ数の水位を確認する (内部関数)
+   @param[in]  alloc_flags ページ獲得条件
+   @note 空きページ数が最低水位を下回っている場合は, 待ち合わせ可能な
+   ページ獲得処理の延長でページを回収する
+ */
+static void
+reclaim_before_alloc(pgalloc_flags alloc_flags){
+
+	if ( !( alloc_flags & KMALLOC_ATOMIC )
+	    && ( pfdb_watermark_level() == PFDB_WMARK_UNDER_MIN ) )
+		pgif_reclaim_direct();  /* 直接回収を行う */
+}
+
+/**
+   ページ獲得失敗時にページを回収する (内部関数)
+   @param[in]     alloc_flags ページ獲得条件
+   @param[in,out] retriesp    再試行回数
+   @retval        真          ページを回収したため獲得を再試行する
+   @retval        偽          ページを回収できなかった
+ */
+static bool
+reclaim_for_retry(pgalloc_flags alloc_flags, int *retriesp){
+
+	if ( ( alloc_flags & KMALLOC_ATOMIC ) || ( *retriesp >= PGIF_RECLAIM_RETRIES ) )
+		return false;  /* 待ち合わせできないか再試行回数を超えた */
+
+	++*retriesp;  /* 再試行回数を更新 */
+
+	return pgif_reclaim_direct();
+}
+
+/**
+   ページ獲得後にページ回収要求を確認する (内部関数)
+   @note 空きページ数が低水位を下回っていた場合は, 回収スレッドを起床する
+ */
+static void
+reclaim_after_alloc(void){
+
+	if ( pfdb_reclaim_pending_test_and_clear() )
+		pgif_reclaim_wakeup();  /* 回収スレッドを起床する */
+}
+
 /**
    指定されたページオーダの連続物理メモリを獲得する
    @param[out] addrp       ページに対するカーネル領域内のアドレスを返却する領域
@@ -73,14 +138,37 @@ int
 pgif_get_free_page_cluster(void **addrp, page_order order, 
     pgalloc_flags alloc_flags, page_usage usage){
 	int           rc;
+	int      retries;
 	obj_cnt_type pfn;
 	void     *kvaddr;
 
+	/* 事前クリア済みページの獲得を要求された場合は,
+	 * 事前クリア済みページプールからの獲得を試みる
+	 */
+	if ( ( order == 0 ) && ( alloc_flags & KM_SFLAGS_ZEROED )
+	    && !( alloc_flags & KM_SFLAGS_CLR_NONE ) 
+	    && ( pfdb_zero_pool_dequeue_bulk(usage, 1, &kvaddr) == 1 ) ) {
+
+		*addrp = kvaddr;  /*  クリア済みのため, クリアせずに返却する  */
+		return 0;
+	}
+
+	reclaim_before_alloc(alloc_flags);  /* 空きページ数の水位を確認する */
+
+	retries = 0;
 	do{
 		rc = pfdb_buddy_dequeue(order, usage, &pfn);  /* 指定されたオーダーのページを取り出す */
 		if ( ( rc != 0 ) && ( rc != -ESRCH ) )
 			rc = -ENOMEM;  /*  ページが見つからなかった  */
 
+		/* ページを移動して空きページを確保できた場合は再試行する */
+		if ( ( rc == -ENOMEM ) && compact_for_order(order, alloc_flags) )
+			continue;
+
+		/* ページを回収できた場合は再試行する */
+		if ( ( rc == -ENOMEM ) && reclaim_for_retry(alloc_flags, &retries) )
+			continue;
+
 		if ( ( rc != 0 ) && ( alloc_flags & KMALLOC_ATOMIC ) )
 			goto error_out;  /*  ページ待ちを行わない場合はエラー復帰  */
 
@@ -101,9 +189,12 @@ pgif_get_free_page_cluster(void **addrp, page_order order,
 
 	*addrp = kvaddr;  /*  カーネル空間中のアドレスを返却する  */
 
+	reclaim_after_alloc();  /* ページ回収要求を確認する */
+
 	return 0;
 
 error_out:
+	reclaim_after_alloc();  /* ページ回収要求を確認する */
 	return rc;
 }
 /**
@@ -121,6 +212,166 @@ pgif_get_free_page(void **addrp, pgalloc_flags alloc_flags, page_usage usage){
 	/*  ページオーダー0 (1ページ)のページを取得する  */
 	return pgif_get_free_page_cluster(addrp, 0, alloc_flags, usage);
 }
+
+/**
+   指定されたカラーの物理メモリを1ノーマルページ獲得する
+   @param[out] addrp       ページに対するカーネル領域内のアドレスを返却する領域
+   @param[in]  color       ページカラー
+   @param[in]  alloc_flags ページ獲得条件
+   @param[in]  usage       ページ利用用途
+   @retval  0      正常終了
+   @retval -EINVAL 不正なカラーを指定した
+   @retval -ENOMEM メモリ不足
+   @note 事前クリア済みページの獲得を要求された場合は, 事前クリア済みページを
+   カラーより優先する
+   @note 指定されたカラーのページがない場合は, pgif_get_free_page_clusterで
+   カラーを問わずにページを獲得する (ページ回収, 再試行を含む)
+ */
+int
+pgif_get_free_page_color(void **addrp, page_color color, pgalloc_flags alloc_flags,
+    page_usage usage){
+	int           rc;
+	obj_cnt_type pfn;
+	void     *kvaddr;
+
+	if ( color >= PFDB_COLOR_NR )
+		return -EINVAL;  /*  不正なカラー  */
+
+	/* 事前クリア済みページの獲得を要求された場合は,
+	 * 事前クリア済みページプールからの獲得を試みる
+	 */
+	if ( ( alloc_flags & KM_SFLAGS_ZEROED )
+	    && !( alloc_flags & KM_SFLAGS_CLR_NONE )
+	    && ( pfdb_zero_pool_dequeue_bulk(usage, 1, &kvaddr) == 1 ) ) {
+
+		*addrp = kvaddr;  /*  クリア済みのため, クリアせずに返却する  */
+		return 0;
+	}
+
+	rc = pfdb_color_dequeue(color, usage, &pfn); /* 指定されたカラーのページを取り出す */
+	if ( rc != 0 ) {
+
+		kassert( rc == -ENOENT );
+		/* カラーを問わずにページを獲得する */
+		return pgif_get_free_page_cluster(addrp, 0, alloc_flags, usage);
+	}
+
+	rc = pfdb_pfn_to_kvaddr(pfn, &kvaddr);
+	kassert( rc == 0 );
+	if ( !( alloc_flags & KM_SFLAGS_CLR_NONE ) )
+		memset(kvaddr, 0, PAGE_SIZE);  /*  メモリをクリアする  */
+
+	*addrp = kvaddr;  /*  カーネル空間中のアドレスを返却する  */
+
+	reclaim_after_alloc();  /* ページ回収要求を確認する */
+
+	return 0;
+}
+
+/**
+   次に使用するページカラーを得る
+   @param[in,out] cursorp アドレス空間などが保持するカラー選択位置
+   @return 使用するページカラー
+   @note 呼び出しごとにカラーを循環させ, アドレス空間内のページを
+   キャッシュセット上に分散させる
+ */
+page_color
+pgif_next_page_color(page_color *cursorp){
+	page_color color;
+
+	color = *cursorp % PFDB_COLOR_NR;
+	*cursorp = ( color + 1 ) % PFDB_COLOR_NR;  /* 次のカラーに進める */
+
+	return color;
+}
+/**
+   指定されたページオーダの連続物理メモリを一括して獲得する
+   @param[out] addrs       ページに対するカーネル領域内のアドレスを返却する配列
+   @param[in]  nr          獲得するページ(クラスタ)の数
+   @param[in]  order       要求ページオーダ
+   @param[in]  alloc_flags ページ獲得条件
+   @param[in]  usage       ページ利用用途
+   @retval  0      正常終了
+   @retval -ESRCH  格納可能なページオーダを越えている
+   @retval -ENOMEM メモリ不足
+   @note 要求されたページ数を獲得できなかった場合は, ページを獲得しない
+ */
+int
+pgif_get_free_pages_bulk(void **addrs, obj_cnt_type nr, page_order order, 
+    pgalloc_flags alloc_flags, page_usage usage){
+	int           rc;
+	int      retries;
+	obj_cnt_type   i;
+	obj_cnt_type got;
+
+	/* 事前クリア済みページの獲得を要求された場合は,
+	 * 事前クリア済みページプールから獲得可能な分を取り出す
+	 */
+	got = 0;
+	if ( ( order == 0 ) && ( alloc_flags & KM_SFLAGS_ZEROED )
+	    && !( alloc_flags & KM_SFLAGS_CLR_NONE ) )
+		got = pfdb_zero_pool_dequeue_bulk(usage, nr, addrs);
+	if ( got == nr )
+		return 0;  /* 全ページを事前クリア済みページプールから獲得した */
+
+	reclaim_before_alloc(alloc_flags);  /* 空きページ数の水位を確認する */
+
+	retries = 0;
+	do{
+		/* 指定されたオーダーのページを一括して取り出す */
+		rc = pfdb_buddy_dequeue_bulk(order, usage, nr - got, &addrs[got]);
+		if ( rc == -EINVAL )
+			rc = -ESRCH;  /*  格納可能なページオーダを越えている  */
+		else if ( rc != 0 )
+			rc = -ENOMEM;  /*  ページが見つからなかった  */
+
+		/* ページを移動して空きページを確保できた場合は再試行する */
+		if ( ( rc == -ENOMEM ) && compact_for_order(order, alloc_flags) )
+			continue;
+
+		/* ページを回収できた場合は再試行する */
+		if ( ( rc == -ENOMEM ) && reclaim_for_retry(alloc_flags, &retries) )
+			continue;
+
+		if ( ( rc != 0 ) && ( alloc_flags & KMALLOC_ATOMIC ) )
+			goto error_out;  /*  ページ待ちを行わない場合はエラー復帰  */
+
+		/*  ページ解放を待ち合わせる  */
+		/* TODO: 以下をwait処理に置き換えること  */
+		if ( rc != 0 )
+			goto error_out;
+
+	}while( rc != 0 );
+
+	if ( !( alloc_flags & KM_SFLAGS_CLR_NONE ) ) {
+
+		for(i = got; nr > i; ++i)
+			memset(addrs[i], 0, PAGE_SIZE << order );  /*  メモリをクリアする  */
+	}
+
+	reclaim_after_alloc();  /* ページ回収要求を確認する */
+
+	return 0;
+
+error_out:
+	if ( got > 0 )
+		pfdb_buddy_enqueue_bulk(got, addrs);  /* 獲得済みのページを返却する */
+	reclaim_after_alloc();  /* ページ回収要求を確認する */
+	return rc;
+}
+
+/**
+   物理メモリを一括して解放する
+   @param[in] addrs 解放するページのカーネル領域内のアドレスの配列
+   @param[in] nr    解放するページ(クラスタ)の数
+ */
+void
+pgif_free_pages_bulk(void **addrs, obj_cnt_type nr){
+
+	/*  参照を落とし, ページ開放を促す  */
+	pfdb_buddy_enqueue_bulk(nr, addrs);
+}
+
 /**
    物理メモリを解放する
    @param[in] addr 解放するページのカーネル領域内のアドレス
@@ -136,3 +387,46 @@ pgif_free_page(void *addr){
 
 	pfdb_dec_page_use_count(pf);  /*  参照を落とし, ページ開放を促す  */
 }
+
+/**
+   連続メモリ領域から物理的に連続したページを獲得する
+   @param[out] addrp       獲得した領域のカーネル領域内のアドレスを返却する領域
+   @param[in]  nr          獲得するページ数
+   @param[in]  align       開始ページフレーム番号の境界 (単位:ページ, 0の場合は境界を問わない)
+   @param[in]  alloc_flags ページ獲得条件
+   @param[in]  usage       ページ利用用途
+   @retval  0      正常終了
+   @retval -EINVAL ページ数に0を指定したか, 境界が2のべき乗でない
+   @retval -ENODEV 連続メモリ領域が設定されていない
+   @retval -EBUSY  他のスレッドが獲得処理中
+   @retval -ENOMEM メモリ不足
+   @note 最大オーダを超えるページ数の領域や特定の境界に揃った領域を獲得する場合に用いる
+ */
+int
+pgif_get_contig_pages(void **addrp, obj_cnt_type nr, obj_cnt_type align,
+    pgalloc_flags alloc_flags, page_usage usage){
+	int        rc;
+	void  *kvaddr;
+
+	rc = pfdb_cma_alloc(nr, align, usage, &kvaddr);
+	if ( rc != 0 )
+		return rc;
+
+	if ( !( alloc_flags & KM_SFLAGS_CLR_NONE ) )
+		memset(kvaddr, 0, nr << PAGE_SHIFT);  /*  メモリをクリアする  */
+
+	*addrp = kvaddr;  /*  カーネル空間中のアドレスを返却する  */
+
+	return 0;
+}
+
+/**
+   連続メモリ領域から獲得したページを解放する
+   @param[in] addr 獲得した領域のカーネル領域内のアドレス
+   @param[in] nr   獲得したページ数
+ */
+void
+pgif_free_contig_pages(void *addr, obj_cnt_type nr){
+
+	pfdb_cma_free(addr, nr);  /*  参照を落とし, ページ開放を促す  */
+}
@@ -12,6 +12,7 @@
 
 #include <kern/page-if.h>
 #include <kern/spinlock.h>
+#include <kern/thr-preempt.h>
 
 //#define DEQUEUE_PAGE_DEBUG  /*  デバッグ情報表示  */
 
@@ -47,19 +48,89 @@ _pfdb_ent_cmp(struct _pfdb_ent *key, struct _pfdb_ent *ent){
 	return 0;	
 }
 
-/** ページフレーム番号からページフレーム情報を得る
+/** セクション表からページフレーム番号を含むページフレームDBエントリを得る
+    @param[in]  pfn   ページフレーム番号
+    @return ページフレームDBエントリ
+    @retval NULL セクション表に指定されたページフレーム番号を含むエントリがない
+    @note ロックを獲得せずに参照する
+ */
+static pfdb_ent *
+pfdb_section_lookup(obj_cnt_type pfn){
+	obj_cnt_type sec;
+	pfdb_ent    *ent;
+
+	sec = PFDB_PFN_TO_SECTION(pfn);  /* セクション番号を算出する */
+	if ( sec >= PFDB_SECTIONS_NR )
+		return NULL;  /* セクション表の範囲外 */
+
+	ent = g_pfdb.sections[sec];
+	if ( ( ent == NULL ) || ( pfn < ent->min_pfn ) || ( pfn >= ent->max_pfn ) )
+		return NULL;  /* 未登録のセクションか他のエントリと共有しているセクション */
+
+	return ent;
+}
+
+/** ページフレームDBエントリをセクション表に登録する (ページフレームDBロック獲得済み)
+    @param[in]  ent   ページフレームDBエントリ
+    @note 他のエントリと共有するセクションは先に登録したエントリを優先する
+ */
+static void
+pfdb_section_register_nolock(pfdb_ent *ent){
+	obj_cnt_type sec;
+	obj_cnt_type last;
+
+	/*  ページフレームDBロック獲得済みであることを確認  */
+	kassert( spinlock_locked_by_self(&g_pfdb.lock) );  
+
+	last = MIN(PFDB_PFN_TO_SECTION(ent->max_pfn - 1), PFDB_SECTIONS_NR - 1);
+	for(sec = PFDB_PFN_TO_SECTION(ent->min_pfn); last >= sec; ++sec) 
+		if ( g_pfdb.sections[sec] == NULL )
+			g_pfdb.sections[sec] = ent;  /* エントリを登録する */
+}
+
+/** ページフレームDBエントリをセクション表から削除する (ページフレームDBロック獲得済み)
+    @param[in]  ent   ページフレームDBエントリ
+    @note 削除したエントリと共有していたセクションは残りのエントリで再登録する
+ */
+static void
+pfdb_section_unregister_nolock(pfdb_ent *ent){
+	obj_cnt_type sec;
+	obj_cnt_type last;
+	pfdb_ent    *oth;
+
+	/*  ページフレームDBロック獲得済みであることを確認  */
+	kassert( spinlock_locked_by_self(&g_pfdb.lock) );  
+
+	last = MIN(PFDB_PFN_TO_SECTION(ent->max_pfn - 1), PFDB_SECTIONS_NR - 1);
+	for(sec = PFDB_PFN_TO_SECTION(ent->min_pfn); last >= sec; ++sec) 
+		if ( g_pfdb.sections[sec] == ent )
+			g_pfdb.sections[sec] = NULL;  /* エントリを削除する */
+
+	RB_FOREACH(oth, _pfdb_tree, &g_pfdb.dbroot) 
+		pfdb_section_register_nolock(oth);  /* 共有セクションを再登録する */
+}
+
+/** ページフレーム番号からページフレーム情報を得る (ページフレームDBロック獲得済み)
     @param[in]  pfn   ページフレーム番号
     @param[out] pagep ページフレーム情報を指し示すポインタのアドレス
     @retval  0     正常終了
     @retval -ESRCH 指定されたページフレーム番号に対応するページがなかった
  */
 static int
-pfn_to_page_frame(obj_cnt_type pfn, page_frame **pagep){
-	int           rc;
+pfn_to_page_frame_nolock(obj_cnt_type pfn, page_frame **pagep){
 	pfdb_ent     key;
 	pfdb_ent    *res;
 	int          idx;	
-	intrflags iflags;
+
+	/*  ページフレームDBロック獲得済みであることを確認  */
+	kassert( spinlock_locked_by_self(&g_pfdb.lock) );  
+
+	/* セクション表から指定されたページフレーム番号を
+	 * 含むエントリを取り出す
+	 */
+	res = pfdb_section_lookup(pfn);
+	if ( res != NULL )
+		goto found;
 
 	/* ページフレームDBから指定されたページフレーム番号を
 	 * 含むエントリを取り出す
@@ -71,36 +142,61 @@ pfn_to_page_frame(obj_cnt_type pfn, page_frame **pagep){
 	/**  ページフレームDBから指定されたページフレーム番号に対応する
 	 * ページフレーム情報を得る
 	 */
-	spinlock_lock_disable_intr(&g_pfdb.lock, &iflags);
 	res = RB_FIND(_pfdb_tree, &g_pfdb.dbroot, &key); 
-	if ( res == NULL ) {  /*  対応するページフレーム情報が見つからなかった */
-
-		rc = -ESRCH;
-		goto unlock_out;
-	}
+	if ( res == NULL )  /*  対応するページフレーム情報が見つからなかった */
+		return -ESRCH;
 
+found:
 	/* pfnに対応するページフレーム情報を算出する
 	 */
 	idx = pfn - res->min_pfn;  /*  配列のインデクスを獲得  */
 	*pagep = &res->page_pool.array[idx];  /* ページフレーム情報を返却  */
 
-	rc = 0;
+	return 0;
+}
 
-unlock_out:
+/** ページフレーム番号からページフレーム情報を得る
+    @param[in]  pfn   ページフレーム番号
+    @param[out] pagep ページフレーム情報を指し示すポインタのアドレス
+    @retval  0     正常終了
+    @retval -ESRCH 指定されたページフレーム番号に対応するページがなかった
+    @note セクション表に登録されているページはロックを獲得せずに変換する
+ */
+static int
+pfn_to_page_frame(obj_cnt_type pfn, page_frame **pagep){
+	int           rc;
+	pfdb_ent    *res;
+	intrflags iflags;
+
+	res = pfdb_section_lookup(pfn);  /* セクション表を参照する */
+	if ( res != NULL ) {
+
+		/* pfnに対応するページフレーム情報を返却する */
+		*pagep = &res->page_pool.array[pfn - res->min_pfn];
+		return 0;
+	}
+
+	/* セクション表に登録されていないページはページフレームDBから探す */
+	spinlock_lock_disable_intr(&g_pfdb.lock, &iflags);
+	rc = pfn_to_page_frame_nolock(pfn, pagep);
 	spinlock_unlock_restore_intr(&g_pfdb.lock, &iflags);
+
 	return rc;
 }
 
 /**
    ページフレーム情報の利用用途を更新する
+   @param[in] pf    ページフレーム情報
+   @param[in] usage ページ利用用途
+   @note 利用用途別の情報はバディキューへのリンクと共用体になっているため,
+   バディキューから取り外した後に呼び出し, 利用用途に応じて初期化する
+   @note 利用用途別のページ数は統計情報カウンタで管理するため,
+   ページプールロックを獲得せずに呼び出してもよい
  */
 static void
 mark_page_usage(page_frame *pf, page_usage usage){
 	obj_cnt_type pages;
 
-	/*  ページプールロックを獲得中に呼び出されることを確認  */
-	kassert( spinlock_locked_by_self(&pf->buddyp->lock) );
-	
 	pages = 1 << pf->order;  /*  獲得ページ数  */
 
 	/*
@@ -113,42 +209,46 @@ mark_page_usage(page_frame *pf, page_usage usage){
 		/** その他カーネルデータページの利用ページ数を加算する
 		 */
 		PAGE_MARK_KERN(pf);
-		pf->buddyp->kdata_pages += pages;
+		statcnt_add(&pf->buddyp->kdata_pages, pages);
 		break;
 	case PAGE_USAGE_KSTACK:
 
 		/** カーネルスタックページの利用ページ数を加算する
 		 */
 		PAGE_MARK_KSTACK(pf);
-		pf->buddyp->kstack_pages += pages;
+		statcnt_add(&pf->buddyp->kstack_pages, pages);
 		break;
 	case PAGE_USAGE_PGTBL:
 
 		/** ページテーブルページの利用ページ数を加算する
 		 */
 		PAGE_MARK_PGTBL(pf);
-		pf->buddyp->pgtbl_pages += pages;
+		statcnt_add(&pf->buddyp->pgtbl_pages, pages);
 		break;
 	case PAGE_USAGE_SLAB:
 
 		/** SLABページの利用ページ数を加算する
 		 */
 		PAGE_MARK_SLAB(pf);
-		pf->buddyp->slab_pages += pages;
+		statcnt_add(&pf->buddyp->slab_pages, pages);
+		pf->slabp = NULL;  /* SLAB管理情報はSLAB作成時に設定する */
 		break;
 	case PAGE_USAGE_ANON:
 
 		/** 無名ページの利用ページ数を加算する
 		 */
 		PAGE_MARK_ANON(pf);
-		pf->buddyp->anon_pages += 1 << pf->order;
+		statcnt_add(&pf->buddyp->anon_pages, pages);
+		queue_init(&pf->pv_head);  /* 物理->仮想アドレス変換キューを初期化する */
 		break;
 	case PAGE_USAGE_PCACHE:
 
 		/** ページキャッシュの利用ページ数を加算する
 		 */
 		PAGE_MARK_PCACHE(pf);
-		pf->buddyp->pcache_pages += 1 << pf->order;
+		statcnt_add(&pf->buddyp->pcache_pages, pages);
+		list_init(&pf->lru_ent);   /* LRUエントリを初期化する */
+		pf->pcachep = NULL;        /* ページキャッシュ作成時に設定する */
 		break;
 	default:
 		kassert_no_reach();
@@ -158,14 +258,14 @@ mark_page_usage(page_frame *pf, page_usage usage){
 
 /**
    ページフレーム情報の利用用途をクリアする
+   @param[in] pf    ページフレーム情報
+   @note 利用用途別のページ数は統計情報カウンタで管理するため,
+   ページプールロックを獲得せずに呼び出してもよい
  */
 static void
 unmark_page_usage(page_frame *pf){
 	obj_cnt_type pages;
 
-	/*  ページプールロックを獲得中に呼び出されることを確認  */
-	kassert( spinlock_locked_by_self(&pf->buddyp->lock) );
-	
 	pages = 1 << pf->order;  /*  解放ページ数  */
 
 	if ( PAGE_USED_BY_KERN(pf) ) {
@@ -173,7 +273,7 @@ unmark_page_usage(page_frame *pf){
 		/** その他カーネルデータページの利用を終了する
 		 */
 		PAGE_UNMARK_KERN(pf);
-		pf->buddyp->kdata_pages -= pages;
+		statcnt_sub(&pf->buddyp->kdata_pages, pages);
 	}
 
 	if ( PAGE_USED_BY_KSTACK(pf) ) {
@@ -181,7 +281,7 @@ unmark_page_usage(page_frame *pf){
 		/** カーネルスタックページの利用を終了する
 		 */
 		PAGE_UNMARK_KSTACK(pf);
-		pf->buddyp->kstack_pages -= pages;
+		statcnt_sub(&pf->buddyp->kstack_pages, pages);
 	}
 
 	if ( PAGE_USED_BY_PGTBL(pf) ) {
@@ -189,7 +289,7 @@ unmark_page_usage(page_frame *pf){
 		/** ページテーブルページの利用を終了する
 		 */
 		PAGE_UNMARK_PGTBL(pf);
-		pf->buddyp->pgtbl_pages -= pages;
+		statcnt_sub(&pf->buddyp->pgtbl_pages, pages);
 	}
 
 	if ( PAGE_USED_BY_SLAB(pf) ) {
@@ -197,7 +297,7 @@ unmark_page_usage(page_frame *pf){
 		/** ページの利用を終了する
 		 */
        		PAGE_UNMARK_SLAB(pf);
-		pf->buddyp->slab_pages -= pages;
+		statcnt_sub(&pf->buddyp->slab_pages, pages);
 	}
 
 	if ( PAGE_USED_BY_ANON(pf) ) {
@@ -205,7 +305,7 @@ unmark_page_usage(page_frame *pf){
 		/** ページの利用を終了する
 		 */
 		PAGE_UNMARK_ANON(pf);
-		pf->buddyp->anon_pages -= pages;
+		statcnt_sub(&pf->buddyp->anon_pages, pages);
 	}
 
 	if ( PAGE_USED_BY_PCACHE(pf) ) {
@@ -213,10 +313,90 @@ unmark_page_usage(page_frame *pf){
 		/** ページの利用を終了する
 		 */
 		PAGE_UNMARK_PCACHE(pf);
-		pf->buddyp->pcache_pages -= pages;
+		statcnt_sub(&pf->buddyp->pcache_pages, pages);
 	}
 }
 
+/**
+   バディペアビットマップのビット位置を算出する
+   @param[in] pool  バディプール
+   @param[in] idx   ページフレーム配列のインデクス
+   @param[in] order ページオーダ
+   @return バディペアビットマップ中のビット位置
+ */
+static obj_cnt_type
+buddy_pair_bit(page_buddy *pool, obj_cnt_type idx, page_order order){
+
+	return pool->pair_map_off[order] + ( idx >> ( order + 1 ) );
+}
+
+/**
+   バディの一方のみが空きであることを確認する
+   @param[in] pool  バディプール
+   @param[in] idx   ページフレーム配列のインデクス
+   @param[in] order ページオーダ
+   @retval 真 バディの一方のみが指定されたオーダのページキューにつながっている
+   @retval 偽 バディの両方がページキューにつながっているか, 両方ともつながっていない
+ */
+static bool
+buddy_pair_is_set(page_buddy *pool, obj_cnt_type idx, page_order order){
+	obj_cnt_type bit;
+
+	bit = buddy_pair_bit(pool, idx, order);
+
+	return ( ( pool->pair_map[bit >> 6] & ( ULONGLONG_C(1) << ( bit & 63 ) ) ) != 0 );
+}
+
+/**
+   バディペアビットマップのビットを反転する
+   @param[in] pool  バディプール
+   @param[in] idx   ページフレーム配列のインデクス
+   @param[in] order ページオーダ
+ */
+static void
+buddy_pair_toggle(page_buddy *pool, obj_cnt_type idx, page_order order){
+	obj_cnt_type bit;
+
+	bit = buddy_pair_bit(pool, idx, order);
+	pool->pair_map[bit >> 6] ^= ( ULONGLONG_C(1) << ( bit & 63 ) );
+}
+
+/**
+   空きページをバディプールのページキューにつなぐ
+   @param[in] pool  バディプール
+   @param[in] pf    ページフレーム情報
+   @param[in] order ページオーダ
+   @note バディプールのロックを獲得して呼び出す
+ */
+static void
+buddy_list_add(page_buddy *pool, page_frame *pf, page_order order){
+
+	pf->order = order;                           /* ページオーダを更新する       */
+	queue_add(&pool->page_list[order], &pf->link);  /* ページをキューに追加する */
+	++pool->free_nr[order];                      /* 空きページ数を更新する       */
+	pool->nr_free += ULONG_C(1) << order;        /* 総空きページ数を更新する     */
+	pool->order_mask |= ( (page_order_mask)1 ) << order; /* 空きオーダを記録する */
+	buddy_pair_toggle(pool, pf - pool->array, order);  /* バディペアを更新する */
+}
+
+/**
+   空きページをバディプールのページキューから外す
+   @param[in] pool  バディプール
+   @param[in] pf    ページフレーム情報
+   @note バディプールのロックを獲得して呼び出す
+ */
+static void
+buddy_list_del(page_buddy *pool, page_frame *pf){
+	page_order order;
+
+	order = pf->order;
+	if ( queue_del(&pool->page_list[order], &pf->link) )  /* ページをキューから外す */
+		pool->order_mask &= ~( ( (page_order_mask)1 ) << order ); /* キューが空になった */
+	--pool->free_nr[order];                      /* 空きページ数を更新する       */
+	pool->nr_free -= ULONG_C(1) << order;        /* 総空きページ数を更新する     */
+	buddy_pair_toggle(pool, pf - pool->array, order);  /* バディペアを更新する */
+}
+
 /**
    クラスタページの設定を行う
    @param[in] pf ページフレーム情報
@@ -266,7 +446,6 @@ adjust_page_order(page_frame *pf, page_order request_order){
 	page_order    cur_order;
 	page_order   orig_order;
 	page_frame  *buddy_page;
-	queue         *pg_queue;
 	int                 idx;
 	obj_cnt_type  buddy_idx;
 
@@ -292,10 +471,7 @@ adjust_page_order(page_frame *pf, page_order request_order){
 
 		/*  バディページのページフレーム情報を取得  */
 		buddy_page = &pool->array[buddy_idx]; 
-		buddy_page->order = cur_order;           /*  バディページのオーダを更新     */
-		pg_queue = &pool->page_list[cur_order];  /*  対象オーダのページキューを参照 */
-		queue_add(pg_queue, &buddy_page->link);  /*  バディページをキューに追加     */
-		++pool->free_nr[cur_order];              /*  空きページ数を更新             */
+		buddy_list_add(pool, buddy_page, cur_order);  /* バディページをキューに追加 */
 
 		pf->order = cur_order;                   /*  自ページのオーダを更新         */
 	}
@@ -385,29 +561,29 @@ enqueue_page_to_buddy_pool(page_buddy *pool, page_frame *req_page) {
 		if (buddy_idx >= pool->nr_pages) 
 			break;
 
-		/*  バディページのページフレーム情報を取得  */
-		buddy_page = &base[buddy_idx];
-
 #if  defined(ENQUEUE_PAGE_LOOP_DEBUG)
 		kprintf(KERN_DBG "enque-dbg mask 0x%lx cur_idx %u, buddy_idx %u "
 		    "cur:%p buddy:%p array%p[%d]\n", 
-		    mask, cur_idx, buddy_idx, cur_page, buddy_page, 
+		    mask, cur_idx, buddy_idx, cur_page, &base[buddy_idx], 
 		    area, cur_order);
 #endif  /*  ENQUEUE_PAGE_LOOP_DEBUG  */
 
 		/*  
-		 *  互いのオーダが異なる場合は接続不能
+		 *  バディページが同じオーダのキューにつながっていない
+		 *  (使用中かオーダが異なる)場合は接続不能
+		 *  @note 追加対象ページはキューにつながっていないので,
+		 *  バディペアビットマップがセットされていればバディページが空いている
 		 */
-		if (cur_page->order != buddy_page->order)
+		if ( !buddy_pair_is_set(pool, cur_idx, cur_order) )
 			break;
 
-		/*  いずれかのページが使用中だった場合は接続不能  */
-		if ( PAGE_STATE_NOT_FREED(buddy_page) )
-			break;
+		/*  バディページのページフレーム情報を取得  */
+		buddy_page = &base[buddy_idx];
+		kassert( ( buddy_page->order == cur_order ) 
+		    && !PAGE_STATE_NOT_FREED(buddy_page) );
 
 		/*  バディページをキューから外す  */
-		queue_del(&pool->page_list[buddy_page->order], &buddy_page->link);
-		--pool->free_nr[buddy_page->order];
+		buddy_list_del(pool, buddy_page);
 
 		/*  ページオーダーを一段あげる  */
 		mask <<= 1;
@@ -438,12 +614,111 @@ enqueue_page_to_buddy_pool(page_buddy *pool, page_frame *req_page) {
 	/*
 	 * ページをキューに追加する  
 	 */
-	queue_add(area, &cur_page->link);  
-	++pool->free_nr[cur_page->order];
+	buddy_list_add(pool, cur_page, cur_page->order);
 
 	return;
 }
 
+/**
+   所定のオーダの空きページをバディプールから取り出す (内部関数)
+   @param[in]  pool   バディプール
+   @param[in]  order  取得するページのオーダ
+   @param[out] pfp    取得したページのページフレーム情報を返却する領域
+   @retval     0      正常にページを獲得した
+   @retval    -ENOMEM 空きページがない
+   @note 取り出したページの利用用途, 状態は呼び出し元で設定する
+*/
+static int
+get_free_page_from_buddy_nolock(page_buddy *pool, page_order order, page_frame **pfp){
+	page_order      cur_order;
+	page_frame      *cur_page;
+	page_order_mask     avail;
+
+	kassert( order < PAGE_POOL_MAX_ORDER );
+	/*  ページフレームDBロック, ページプールロック獲得済みであることを確認  */
+	kassert( spinlock_locked_by_self(&g_pfdb.lock) );  
+	kassert( spinlock_locked_by_self(&pool->lock) );
+
+	/* 要求オーダ以上で空きページがある最小のオーダを探す */
+	avail = pool->order_mask & ( ~( (page_order_mask)0 ) << order );
+	if ( avail == 0 )
+		return -ENOMEM;  /* 空きページがない */
+
+	cur_order = bitops_ffs64(avail) - 1;
+	kassert( !queue_is_empty(&pool->page_list[cur_order]) );
+
+	cur_page = container_of(queue_ref_top(&pool->page_list[cur_order]),
+	    page_frame, link); 
+	buddy_list_del(pool, cur_page);  /* 空きページを取り出す */
+
+	/* 要求オーダまでページオーダを落とす */
+	adjust_page_order(cur_page, order);
+
+	*pfp = cur_page;  /* ページフレーム情報を返却する */
+
+	return 0;
+}
+
+/**
+   空きページ数の水位を算出する (内部関数)
+   @return 空きページ数の水位
+   @note 空きページ数はバディプールのロックを獲得せずに参照する
+   @note ページフレームDBのロックを獲得して呼び出す
+ */
+static int
+update_wmark_level_nolock(void){
+	int           level;
+	int             cur;
+	pfdb_ent       *ent;
+	obj_cnt_type   free;
+
+	kassert( spinlock_locked_by_self(&g_pfdb.lock) );
+
+	/*
+	 * 最も空きページの多いエントリの水位をシステム全体の水位とする
+	 */
+	level = ( RB_EMPTY(&g_pfdb.dbroot) ) ? ( PFDB_WMARK_OK ) : ( PFDB_WMARK_UNDER_MIN );
+	RB_FOREACH(ent, _pfdb_tree, &g_pfdb.dbroot) {
+
+		free = ent->page_pool.nr_free;
+		if ( free >= ent->wmark.high )
+			cur = PFDB_WMARK_OK;
+		else if ( free >= ent->wmark.low )
+			cur = PFDB_WMARK_UNDER_HIGH;
+		else if ( free >= ent->wmark.min )
+			cur = PFDB_WMARK_UNDER_LOW;
+		else
+			cur = PFDB_WMARK_UNDER_MIN;
+
+		if ( level > cur )
+			level = cur;
+		if ( level == PFDB_WMARK_OK )
+			break;  /* 高水位以上の空きページがある */
+	}
+	g_pfdb.wmark_level = level;  /* 水位を更新する */
+
+	return level;
+}
+
+/**
+   ページ獲得後に空きページ数の水位を確認する (内部関数)
+   @param[in] ent  ページを獲得したページフレームDBエントリ
+   @note 獲得元のエントリの空きページ数が低水位を下回った場合にシステム全体の
+   水位を更新し, 低水位を下回っていればページ回収を要求する
+   @note ページフレームDBのロックを獲得して呼び出す
+ */
+static void
+check_wmark_nolock(pfdb_ent *ent){
+
+	kassert( spinlock_locked_by_self(&g_pfdb.lock) );
+
+	if ( ent->page_pool.nr_free >= ent->wmark.low )
+		return;  /* 低水位以上の空きページがある */
+
+	if ( update_wmark_level_nolock() >= PFDB_WMARK_UNDER_LOW )
+		g_pfdb.reclaim_pending = true;  /* ページ回収を要求する */
+}
+
 /**
    所定のオーダのページを指定されたメモリ領域から取り出しページフレーム番号を返す
    @param[in]  ent    メモリ獲得を試みるメモリ領域のページフレームデータベースエントリ
@@ -458,7 +733,6 @@ static int
 dequeue_page_from_memory_area(pfdb_ent *ent, page_order order, 
     page_usage usage, obj_cnt_type *pfnp){
 	int               rc;
-	page_order cur_order;
 	page_frame *cur_page;
 	page_buddy     *pool;
 	intrflags     iflags;
@@ -473,40 +747,250 @@ dequeue_page_from_memory_area(pfdb_ent *ent, page_order order,
 
 	spinlock_lock_disable_intr(&pool->lock, &iflags);  /*  ページプールロックを獲得 */
 
-	cur_order = order;
-
-	while (cur_order < PAGE_POOL_MAX_ORDER) { /* 空きページがあるキューを順番に調べる */
-
-		if ( !queue_is_empty(&pool->page_list[cur_order]) ) {
-			
-			cur_page = container_of(
-				queue_get_top(&pool->page_list[cur_order]),
-				page_frame, link); /* 空きページを取り出す */
-			--pool->free_nr[cur_order];
-			
-			/* 要求オーダまでページオーダを落とす */
-			adjust_page_order(cur_page, order);
-
-			/*
-			 * ページ返却
-			 */
-			setup_clustered_pages(cur_page);  /* ページクラスタ情報を設定する */
-			mark_page_usage(cur_page, usage); /* ページ利用用途を更新する  */
-
-			PAGE_MARK_USED(cur_page); /* ページを使用中にする */
-
-			*pfnp = cur_page->pfn;  /* ページフレーム番号を返却する */
-			refcnt_set(&cur_page->usecnt, REFCNT_INITIAL_VAL);  /* 参照を上げる */
-			
-			rc = 0;
-			goto unlock_out;
+	rc = get_free_page_from_buddy_nolock(pool, order, &cur_page);
+	if ( rc != 0 )
+		goto unlock_out;  /* 空きページがない */
+
+	/*
+	 * ページ返却
+	 */
+	setup_clustered_pages(cur_page);  /* ページクラスタ情報を設定する */
+	mark_page_usage(cur_page, usage); /* ページ利用用途を更新する  */
+
+	PAGE_MARK_USED(cur_page); /* ページを使用中にする */
+
+	*pfnp = cur_page->pfn;  /* ページフレーム番号を返却する */
+	refcnt_set(&cur_page->usecnt, REFCNT_INITIAL_VAL);  /* 参照を上げる */
+
+unlock_out:
+	spinlock_unlock_restore_intr(&pool->lock, &iflags);   /*  ページプールロックを解放 */
+	return rc;
+}
+
+/**
+   自CPUのCPU単位ページキャッシュを参照する (内部関数)
+   @return 自CPUのCPU単位ページキャッシュ
+   @retval NULL CPU単位ページキャッシュが利用できない
+   @note 他のCPUに移動しないように割込み禁止状態で呼び出す
+ */
+static pfdb_pcp *
+current_pcp(void){
+	cpu_id cpu;
+
+	if ( !g_pfdb.pcp_enabled )
+		return NULL;  /* CPU単位ページキャッシュ初期化前 */
+
+	cpu = ti_current_cpu_get();  /* スレッド情報から論理CPUIDを得る */
+	if ( cpu >= KC_CPUS_NR )
+		return NULL;  /* 不正なCPUID */
+
+	return &g_pfdb.pcp[cpu];
+}
+
+/**
+   CPU単位ページキャッシュにバディプールからページを補充する (内部関数)
+   @param[in] pcp  CPU単位ページキャッシュ
+   @param[in] nr   補充するページ数
+   @return 補充したページ数
+   @note バディプールから取り出したページは, CPU単位ページキャッシュの
+   末尾(cold側)につなぐ
+ */
+static obj_cnt_type
+fill_pcp_from_buddy(pfdb_pcp *pcp, obj_cnt_type nr){
+	int                rc;
+	obj_cnt_type    count;
+	pfdb_ent         *ent;
+	page_buddy      *pool;
+	page_frame        *pf;
+	intrflags db_iflags;
+	intrflags pool_iflags;
+
+	kassert( spinlock_locked_by_self(&pcp->lock) );
+
+	count = 0;
+
+	/*
+	 * ページフレームDBのロック, バディプールのロックを1回ずつ獲得して
+	 * 要求されたページ数分のページを取り出す
+	 */
+	spinlock_lock_disable_intr(&g_pfdb.lock, &db_iflags);
+	RB_FOREACH(ent, _pfdb_tree, &g_pfdb.dbroot) {
+
+		pool = &ent->page_pool;  /*  ページプール情報を参照  */
+
+		spinlock_lock_disable_intr(&pool->lock, &pool_iflags);
+		while( nr > count ) {
+
+			rc = get_free_page_from_buddy_nolock(pool, 0, &pf);
+			if ( rc != 0 )
+				break;  /* 空きページがない */
+
+			PAGE_UNMARK_CLUSTERED(pf);  /* ページクラスタ情報をクリアする     */
+			PAGE_MARK_PCP(pf);          /* CPU単位ページキャッシュ格納中に設定 */
+			queue_add(&pcp->page_list, &pf->link);  /* cold側につなぐ */
+			++count;
 		}
-		++cur_order;  /*  より上のオーダからページを切り出す  */
+		spinlock_unlock_restore_intr(&pool->lock, &pool_iflags);
+
+		check_wmark_nolock(ent);  /* 空きページ数の水位を確認する */
+
+		if ( count == nr )
+			break;  /* 要求されたページ数を補充した */
 	}
+	spinlock_unlock_restore_intr(&g_pfdb.lock, &db_iflags);
+
+	pcp->count += count;  /* キャッシュ中のページ数を更新 */
+	if ( count > 0 )
+		++pcp->refills;  /* 補充回数を更新 */
+
+	return count;
+}
+
+/**
+   CPU単位ページキャッシュからバディプールにページを返却する (内部関数)
+   @param[in] pcp  CPU単位ページキャッシュ
+   @param[in] nr   返却するページ数
+   @note CPU単位ページキャッシュの末尾(cold側)から返却し,
+   同じバディプールに属するページが続く間はバディプールのロックを保持したままにする
+ */
+static void
+drain_pcp_to_buddy(pfdb_pcp *pcp, obj_cnt_type nr){
+	obj_cnt_type    count;
+	page_buddy      *pool;
+	page_frame        *pf;
+	intrflags      iflags;
+
+	kassert( spinlock_locked_by_self(&pcp->lock) );
+
+	pool = NULL;
+	for(count = 0; ( nr > count ) && ( !queue_is_empty(&pcp->page_list) ); ++count) {
+
+		/* 最も古いページを取り出す */
+		pf = container_of(queue_get_last(&pcp->page_list), page_frame, link);
+		--pcp->count;
+		kassert( PAGE_IS_PCP(pf) );
+
+		if ( pool != pf->buddyp ) {  /* 異なるバディプールのページ */
+
+			if ( pool != NULL )  /* 獲得中のページプールロックを解放 */
+				spinlock_unlock_restore_intr(&pool->lock, &iflags);
+
+			pool = pf->buddyp;
+			spinlock_lock_disable_intr(&pool->lock, &iflags);
+		}
+
+		PAGE_UNMARK_PCP(pf);  /* CPU単位ページキャッシュ格納中フラグを落とす */
+		enqueue_page_to_buddy_pool(pool, pf); /* ページをバディプールに返却 */
+	}
+
+	if ( pool != NULL )  /* ページプールロックを解放 */
+		spinlock_unlock_restore_intr(&pool->lock, &iflags);
+
+	if ( count > 0 )
+		++pcp->drains;  /* 返却回数を更新 */
+}
+
+/**
+   CPU単位ページキャッシュからオーダ0のページを取り出す (内部関数)
+   @param[in]  usage  ページ利用用途
+   @param[out] pfnp   取得したページのページフレーム番号を返却する領域
+   @retval     0      正常にページを獲得した
+   @retval    -ENOENT CPU単位ページキャッシュが利用できない
+   @retval    -ENOMEM 空きページがない
+ */
+static int
+dequeue_page_from_pcp(page_usage usage, obj_cnt_type *pfnp){
+	int            rc;
+	pfdb_pcp     *pcp;
+	page_frame    *pf;
+	intrflags  iflags;
+
+	krn_cpu_save_and_disable_interrupt(&iflags);  /* 割り込み禁止 */
+
+	pcp = current_pcp();  /* 自CPUのページキャッシュを参照 */
+	if ( pcp == NULL ) {
+
+		rc = -ENOENT;  /* CPU単位ページキャッシュが利用できない */
+		goto restore_out;
+	}
+
+	spinlock_lock(&pcp->lock);
+
+	if ( pcp->low >= pcp->count )  /* 低水位以下になったらまとめて補充する */
+		fill_pcp_from_buddy(pcp, pcp->batch);
+
+	if ( queue_is_empty(&pcp->page_list) ) {
+
+		rc = -ENOMEM;  /* 空きページがない */
+		goto unlock_out;
+	}
+
+	/* 最も新しく解放されたページ(hot)を取り出す */
+	pf = container_of(queue_get_top(&pcp->page_list), page_frame, link);
+	--pcp->count;
+	++pcp->hits;
+	kassert( PAGE_IS_PCP(pf) );
+
+	PAGE_UNMARK_PCP(pf);          /* CPU単位ページキャッシュ格納中フラグを落とす */
+	mark_page_usage(pf, usage);   /* ページ利用用途を更新する  */
+	PAGE_MARK_USED(pf);           /* ページを使用中にする */
+
+	*pfnp = pf->pfn;  /* ページフレーム番号を返却する */
+	refcnt_set(&pf->usecnt, REFCNT_INITIAL_VAL);  /* 参照を上げる */
+
+	rc = 0;
 
-	rc = -ENOMEM;
 unlock_out:
-	spinlock_unlock_restore_intr(&pool->lock, &iflags);   /*  ページプールロックを解放 */
+	spinlock_unlock(&pcp->lock);
+
+restore_out:
+	krn_cpu_restore_interrupt(&iflags);  /* 割り込み復元 */
+
+	return rc;
+}
+
+/**
+   オーダ0のページをCPU単位ページキャッシュに返却する (内部関数)
+   @param[in]  pf     解放するページのページフレーム情報
+   @retval     0      正常に返却した
+   @retval    -ENOENT CPU単位ページキャッシュが利用できない
+ */
+static int
+enqueue_page_to_pcp(page_frame *pf){
+	int            rc;
+	pfdb_pcp     *pcp;
+	intrflags  iflags;
+
+	kassert( pf->order == 0 );
+
+	krn_cpu_save_and_disable_interrupt(&iflags);  /* 割り込み禁止 */
+
+	pcp = current_pcp();  /* 自CPUのページキャッシュを参照 */
+	if ( pcp == NULL ) {
+
+		rc = -ENOENT;  /* CPU単位ページキャッシュが利用できない */
+		goto restore_out;
+	}
+
+	spinlock_lock(&pcp->lock);
+
+	unmark_page_usage(pf);     /* 利用用途をクリアする         */
+	PAGE_UNMARK_USED(pf);      /* ページの使用中フラグを落とす */
+	PAGE_MARK_PCP(pf);         /* CPU単位ページキャッシュ格納中に設定 */
+
+	queue_add_top(&pcp->page_list, &pf->link);  /* hot側につなぐ */
+	++pcp->count;
+
+	if ( pcp->count > pcp->high )  /* 高水位を超えたらまとめて返却する */
+		drain_pcp_to_buddy(pcp, pcp->batch);
+
+	spinlock_unlock(&pcp->lock);
+
+	rc = 0;
+
+restore_out:
+	krn_cpu_restore_interrupt(&iflags);  /* 割り込み復元 */
+
 	return rc;
 }
 
@@ -553,8 +1037,7 @@ mark_page_frame_reserved(obj_cnt_type pfn){
 
 	/*  ページプールロックを獲得 */
 	spinlock_lock_disable_intr(&pool->lock, &iflags);
-	queue_del(&pool->page_list[pf->order], &pf->link); /* ページをキューから外す */
-	--pool->free_nr[pf->order];                        /* 空きページ数を更新     */
+	buddy_list_del(pool, pf);  /* ページをキューから外す */
 
 	/*  クラスタページの場合後続のページをキューに返却する
 	 */
@@ -700,6 +1183,8 @@ remove_pfdb_ent_common(pfdb_ent *ent){
 		goto error_out;
 	}
 
+	pfdb_section_unregister_nolock(ent);  /* セクション表から削除する */
+
 	return 0;
 
 unlock_out:
@@ -708,237 +1193,2020 @@ error_out:
 	return rc;
 }
 
-/*
- * IF関数
+/**
+   事前クリア済みページプールからページを取り出す (内部関数)
+   @param[in]  usage  ページ利用用途
+   @param[in]  nr     取り出すページ数
+   @param[out] kvaddrs 取り出したページのカーネル仮想アドレスを格納する配列
+   @return 取り出したページ数
+   @note 取り出せなかったページ数分を獲得失敗回数として計上する
  */
+static obj_cnt_type
+dequeue_pages_from_zero_pool(page_usage usage, obj_cnt_type nr, void **kvaddrs){
+	int                rc;
+	obj_cnt_type    count;
+	pfdb_zero_pool    *zp;
+	page_frame        *pf;
+	intrflags      iflags;
+
+	zp = &g_pfdb.zero_pool;
+
+	spinlock_lock_disable_intr(&zp->lock, &iflags);
+	for(count = 0; ( nr > count ) && ( zp->count > 0 ); ++count) {
+
+		pf = container_of(queue_get_top(&zp->page_list), page_frame, link);
+		--zp->count;
+		kassert( PAGE_IS_ZEROED(pf) );
+
+		PAGE_UNMARK_ZEROED(pf);       /* 事前クリア済みページプール格納中フラグを落とす */
+		mark_page_usage(pf, usage);   /* ページ利用用途を更新する  */
+		PAGE_MARK_USED(pf);           /* ページを使用中にする */
+		refcnt_set(&pf->usecnt, REFCNT_INITIAL_VAL);  /* 参照を上げる */
+
+		rc = hal_pfn_to_kvaddr(pf->pfn, &kvaddrs[count]);
+		kassert( rc == 0 );
+	}
+	zp->hits += count;          /* 獲得回数を更新     */
+	zp->misses += nr - count;   /* 獲得失敗回数を更新 */
+	spinlock_unlock_restore_intr(&zp->lock, &iflags);
+
+	return count;
+}
 
 /**
-   所定のオーダのページを取り出しページフレーム番号を返す
-   @param[in]  order  取得するページのオーダ
-   @param[in]  usage  ページ利用用途
-   @param[out] pfnp   取得したページのページフレーム番号を返却する領域
+   事前クリア済みページプールに補充するページをバディプールから取り出す (内部関数)
+   @param[out] pfp    取得したページのページフレーム情報を返却する領域
    @retval     0      正常にページを獲得した
-   @retval    -EINVAL ページフレーム情報返却域が不正か要求したページオーダが不正
+   @retval    -ENOMEM 空きページがない
+   @note 取り出したページは事前クリア済みページプール格納中に設定する
+ */
+static int
+get_zero_pool_candidate(page_frame **pfp){
+	int                rc;
+	pfdb_ent         *ent;
+	page_buddy      *pool;
+	page_frame        *pf;
+	intrflags db_iflags;
+	intrflags pool_iflags;
+
+	rc = -ENOMEM;
+
+	spinlock_lock_disable_intr(&g_pfdb.lock, &db_iflags);
+	RB_FOREACH(ent, _pfdb_tree, &g_pfdb.dbroot) {
+
+		pool = &ent->page_pool;  /*  ページプール情報を参照  */
+
+		spinlock_lock_disable_intr(&pool->lock, &pool_iflags);
+		rc = get_free_page_from_buddy_nolock(pool, 0, &pf);
+		if ( rc == 0 ) {
+
+			PAGE_UNMARK_CLUSTERED(pf);  /* ページクラスタ情報をクリアする           */
+			PAGE_MARK_ZEROED(pf);       /* 事前クリア済みページプール格納中に設定 */
+		}
+		spinlock_unlock_restore_intr(&pool->lock, &pool_iflags);
+
+		if ( rc == 0 )
+			break;  /* ページを獲得した */
+	}
+	spinlock_unlock_restore_intr(&g_pfdb.lock, &db_iflags);
+
+	if ( rc == 0 )
+		*pfp = pf;  /* ページフレーム情報を返却する */
+
+	return rc;
+}
+
+/**
+   事前クリア済みページプールのページをバディプールに返却する (内部関数)
+   @param[in] pf ページフレーム情報
+ */
+static void
+put_zero_pool_page_to_buddy(page_frame *pf){
+	intrflags iflags;
+
+	kassert( PAGE_IS_ZEROED(pf) );
+
+	PAGE_UNMARK_ZEROED(pf);  /* 事前クリア済みページプール格納中フラグを落とす */
+	spinlock_lock_disable_intr(&pf->buddyp->lock, &iflags);
+	enqueue_page_to_buddy_pool(pf->buddyp, pf); /* ページをバディプールに返却 */
+	spinlock_unlock_restore_intr(&pf->buddyp->lock, &iflags);
+}
+
+/**
+   カラー別ページプールのページをバディプールに返却する (内部関数)
+   @param[in] pf ページフレーム情報
+ */
+static void
+put_color_pool_page_to_buddy(page_frame *pf){
+	intrflags iflags;
+
+	kassert( PAGE_IS_COLORED(pf) );
+
+	PAGE_UNMARK_COLORED(pf);  /* カラー別ページプール格納中フラグを落とす */
+	spinlock_lock_disable_intr(&pf->buddyp->lock, &iflags);
+	enqueue_page_to_buddy_pool(pf->buddyp, pf); /* ページをバディプールに返却 */
+	spinlock_unlock_restore_intr(&pf->buddyp->lock, &iflags);
+}
+
+/**
+   カラー別ページプールにページを補充する (内部関数)
+   @param[in] cp カラー別ページプール
+   @retval     0      正常に補充した
+   @retval    -ENOMEM 空きページがない
+   @note カラー数分の連続したページからなるブロックを取り出し, 各カラーの
+   リストに1ページずつ補充する. ブロックを取り出せない場合は1ページだけ補充する
+   @note カラー別ページプールのロックを獲得して呼び出す
+ */
+static int
+refill_color_pool_nolock(pfdb_color_pool *cp){
+	int                rc;
+	obj_cnt_type        i;
+	obj_cnt_type       nr;
+	page_order      order;
+	pfdb_ent         *ent;
+	page_buddy      *pool;
+	page_frame        *pf;
+	intrflags   db_iflags;
+	intrflags pool_iflags;
+
+	kassert( spinlock_locked_by_self(&cp->lock) );
+
+	spinlock_lock_disable_intr(&g_pfdb.lock, &db_iflags);
+	for(order = PFDB_COLOR_SHIFT, rc = -ENOMEM; ( rc != 0 ) && ( order >= 0 ); 
+	    order -= PFDB_COLOR_SHIFT) {
+
+		RB_FOREACH(ent, _pfdb_tree, &g_pfdb.dbroot) {
+
+			pool = &ent->page_pool;  /*  ページプール情報を参照  */
+
+			spinlock_lock_disable_intr(&pool->lock, &pool_iflags);
+			rc = get_free_page_from_buddy_nolock(pool, order, &pf);
+			spinlock_unlock_restore_intr(&pool->lock, &pool_iflags);
+
+			if ( rc == 0 ) {
+
+				check_wmark_nolock(ent);  /* 空きページ数の水位を確認する */
+				break;  /* ページを獲得した */
+			}
+		}
+	}
+	spinlock_unlock_restore_intr(&g_pfdb.lock, &db_iflags);
+
+	if ( rc != 0 )
+		return rc;  /* 空きページがない */
+
+	/*
+	 * ブロックをオーダ0のページに分けて各カラーのリストにつなぐ
+	 */
+	nr = ULONG_C(1) << pf->order;
+	for(i = 0; nr > i; ++i) {
+
+		pf[i].order = 0;
+		PAGE_UNMARK_CLUSTERED(&pf[i]);  /* ページクラスタ情報をクリアする */
+		PAGE_MARK_COLORED(&pf[i]);      /* カラー別ページプール格納中に設定 */
+		queue_add(&cp->page_list[PFDB_PFN_TO_COLOR(pf[i].pfn)], &pf[i].link);
+		++cp->nr[PFDB_PFN_TO_COLOR(pf[i].pfn)];
+	}
+	cp->count += nr;
+	++cp->refills;  /* 補充回数を更新 */
+
+	return 0;
+}
+
+/**
+   移動可能なページであることを確認する (内部関数)
+   @param[in]  pf     ページフレーム情報
+   @param[out] usagep ページ利用用途返却領域
+   @return ページ移動関数
+   @retval NULL 移動できないページ
+   @note 移動対象は移動関数が登録されたオーダ0の無名ページとページキャッシュのみ
+ */
+static pfdb_migrate_fn
+lookup_migrate_handler(page_frame *pf, page_usage *usagep){
+
+	if ( !PAGE_IS_USED(pf) || ( pf->order != 0 ) )
+		return NULL;  /* 空きページかクラスタページ */
+
+	if ( PAGE_USED_BY_ANON(pf) && ( g_pfdb.compact.migrate_anon != NULL ) ) {
+
+		*usagep = PAGE_USAGE_ANON;
+		return g_pfdb.compact.migrate_anon;
+	}
+
+	if ( PAGE_USED_BY_PCACHE(pf) && ( g_pfdb.compact.migrate_pcache != NULL ) ) {
+
+		*usagep = PAGE_USAGE_PCACHE;
+		return g_pfdb.compact.migrate_pcache;
+	}
+
+	return NULL;  /* 移動できないページ */
+}
+
+/**
+   ページの移動先をバディプールから取り出す (内部関数)
+   @param[in]  pool   バディプール
+   @param[in]  sta    移動先から除外するページフレーム配列の開始インデクス
+   @param[in]  end    移動先から除外するページフレーム配列の終了インデクス
+   @param[in]  hold   除外範囲内から取り出したページを保留するキュー
+   @param[out] dstp   移動先ページのページフレーム情報返却領域
+   @retval     0      正常終了
+   @retval    -ENOMEM 空きページがない
+   @note 除外範囲内のページは保留キューにつなぎ, 呼び出し元で返却する
+   @note 指定されたバディプールに空きページがない場合は, 他のバディプールから取り出す
+ */
+static int
+get_migrate_target(page_buddy *pool, obj_cnt_type sta, obj_cnt_type end, 
+    queue *hold, page_frame **dstp){
+	int                rc;
+	obj_cnt_type      idx;
+	pfdb_ent         *ent;
+	page_frame        *pf;
+	intrflags   db_iflags;
+	intrflags pool_iflags;
+
+	spinlock_lock_disable_intr(&g_pfdb.lock, &db_iflags);
+	spinlock_lock_disable_intr(&pool->lock, &pool_iflags);
+	for( ; ; ) {
+
+		rc = get_free_page_from_buddy_nolock(pool, 0, &pf);
+		if ( rc != 0 )
+			break;  /* 空きページがない */
+
+		PAGE_UNMARK_CLUSTERED(pf);  /* ページクラスタ情報をクリアする */
+
+		idx = pf - pool->array;  /*  配列のインデクスを算出  */
+		if ( ( sta > idx ) || ( idx >= end ) )
+			break;  /* 除外範囲外のページを獲得した */
+
+		queue_add(hold, &pf->link);  /* 除外範囲内のページを保留する */
+	}
+	spinlock_unlock_restore_intr(&pool->lock, &pool_iflags);
+
+	/*
+	 * 他のバディプールから移動先ページを取り出す
+	 */
+	RB_FOREACH(ent, _pfdb_tree, &g_pfdb.dbroot) {
+
+		if ( rc == 0 )
+			break;  /* 移動先ページを獲得済み */
+
+		if ( &ent->page_pool == pool )
+			continue;  /* 獲得を試みたバディプール */
+
+		spinlock_lock_disable_intr(&ent->page_pool.lock, &pool_iflags);
+		rc = get_free_page_from_buddy_nolock(&ent->page_pool, 0, &pf);
+		if ( rc == 0 )
+			PAGE_UNMARK_CLUSTERED(pf);  /* ページクラスタ情報をクリアする */
+		spinlock_unlock_restore_intr(&ent->page_pool.lock, &pool_iflags);
+	}
+	spinlock_unlock_restore_intr(&g_pfdb.lock, &db_iflags);
+
+	if ( rc == 0 )
+		*dstp = pf;  /* 移動先ページを返却する */
+
+	return rc;
+}
+
+/**
+   保留したページをバディプールに返却する (内部関数)
+   @param[in] hold   保留キュー
+ */
+static void
+release_held_pages(queue *hold){
+	page_frame        *pf;
+	intrflags      iflags;
+
+	while( !queue_is_empty(hold) ) {
+
+		pf = container_of(queue_get_top(hold), page_frame, link);
+
+		spinlock_lock_disable_intr(&pf->buddyp->lock, &iflags);
+		enqueue_page_to_buddy_pool(pf->buddyp, pf); /* ページをバディプールに返却 */
+		spinlock_unlock_restore_intr(&pf->buddyp->lock, &iflags);
+	}
+}
+
+/**
+   ページを移動する (内部関数)
+   @param[in]  src    移動元ページのページフレーム情報
+   @param[in]  sta    移動先から除外するページフレーム配列の開始インデクス
+   @param[in]  end    移動先から除外するページフレーム配列の終了インデクス
+   @param[in]  hold   除外範囲内から取り出したページを保留するキュー
+   @retval     0      正常終了
+   @retval    -EBUSY  移動できないページだった
+   @retval    -ENOMEM 移動先ページを獲得できなかった
+   @note 移動元ページへの参照を獲得した状態で呼び出す
+ */
+static int
+migrate_page_common(page_frame *src, obj_cnt_type sta, obj_cnt_type end, queue *hold){
+	int                rc;
+	pfdb_migrate_fn    fn;
+	page_usage      usage;
+	page_frame       *dst;
+	intrflags      iflags;
+
+	fn = lookup_migrate_handler(src, &usage);
+	if ( fn == NULL ) {
+
+		rc = -EBUSY;  /* 移動できないページ */
+		goto error_out;
+	}
+
+	rc = get_migrate_target(src->buddyp, sta, end, hold, &dst);
+	if ( rc != 0 )
+		goto error_out;  /* 移動先ページがない */
+
+	/* 移動元ページと同じ利用用途で移動先ページを獲得済みにする */
+	mark_page_usage(dst, usage);
+	PAGE_MARK_USED(dst);
+	refcnt_set(&dst->usecnt, REFCNT_INITIAL_VAL);
+
+	rc = fn(src, dst);  /* ページの内容と参照を移動先に移す */
+	if ( rc != 0 ) {
+
+		pfdb_dec_page_use_count(dst);  /* 移動先ページを解放する */
+		goto error_out;
+	}
+
+	spinlock_lock_disable_intr(&g_pfdb.compact.lock, &iflags);
+	++g_pfdb.compact.migrated;  /* 移動したページ数を更新 */
+	spinlock_unlock_restore_intr(&g_pfdb.compact.lock, &iflags);
+
+	return 0;
+
+error_out:
+	spinlock_lock_disable_intr(&g_pfdb.compact.lock, &iflags);
+	++g_pfdb.compact.migrate_fails;  /* 移動失敗回数を更新 */
+	spinlock_unlock_restore_intr(&g_pfdb.compact.lock, &iflags);
+
+	return rc;
+}
+
+/**
+   移動するページ数が最小となる指定オーダのブロックを選択する (内部関数)
+   @param[in]  pool   バディプール
+   @param[in]  order  確保するページオーダ
+   @param[in]  limit  移動するページ数の上限
+   @param[out] idxp   ブロックの先頭ページのページフレーム配列インデクス返却領域
+   @return 移動するページ数
+   @retval 負  移動するページ数がlimit未満のブロックがない
+   @note 使用中のページが全て移動可能で, 予約ページ, キャッシュ中のページ,
+   連続メモリ領域のページを含まないブロックを対象とする
+ */
+static int
+select_compact_block_nolock(page_buddy *pool, page_order order, int limit, 
+    obj_cnt_type *idxp){
+	int           best;
+	int        movable;
+	obj_cnt_type   blk;
+	obj_cnt_type     i;
+	obj_cnt_type  size;
+	page_usage   usage;
+	page_frame     *pf;
+
+	kassert( spinlock_locked_by_self(&g_pfdb.lock) );
+	kassert( spinlock_locked_by_self(&pool->lock) );
+
+	best = -1;
+	size = ULONG_C(1) << order;  /* ブロック内のページ数 */
+	for(blk = 0; pool->nr_pages >= ( blk + size ); blk += size) {
+
+		for(i = 0, movable = 0; ( size > i ) && ( limit > movable ); ++i) {
+
+			pf = &pool->array[blk + i];
+			if ( PAGE_IS_CMA(pf) )
+				break;  /* 連続メモリ領域のページ */
+			if ( PAGE_IS_USED(pf) ) {
+
+				if ( lookup_migrate_handler(pf, &usage) == NULL )
+					break;  /* 移動できないページ */
+				++movable;
+			} else if ( pf->state & ( PAGE_STATE_RESERVED | PAGE_STATE_PCP |
+				PAGE_STATE_ZEROED | PAGE_STATE_COLORED | PAGE_STATE_CLUSTERED ) )
+				break;  /* 予約ページ, キャッシュ中のページ, クラスタページ */
+		}
+		if ( ( size > i ) || ( movable >= limit ) )
+			continue;  /* 対象外のブロック */
+
+		best = limit = movable;  /* 移動ページ数が最小のブロックを記録 */
+		*idxp = blk;
+		if ( movable == 0 )
+			break;  /* 空きブロック */
+	}
+
+	return best;
+}
+
+/**
+   移動可能なページの利用用途であることを確認する (内部関数)
+   @param[in] usage ページ利用用途
+   @retval    真    移動関数が登録された利用用途である
+   @retval    偽    移動できない利用用途である
+ */
+static bool
+page_usage_is_movable(page_usage usage){
+
+	if ( usage == PAGE_USAGE_ANON )
+		return ( g_pfdb.compact.migrate_anon != NULL );
+
+	if ( usage == PAGE_USAGE_PCACHE )
+		return ( g_pfdb.compact.migrate_pcache != NULL );
+
+	return false;
+}
+
+/**
+   バディプールの空きページであることを確認する (内部関数)
+   @param[in] pool  バディプール
+   @param[in] idx   ページフレーム配列のインデクス
+   @retval    真    空きページキューにつながったブロックに含まれる
+   @retval    偽    使用中か, キャッシュ中, 予約中のページ
+   @note バディプールのロックを獲得して呼び出す
+ */
+static bool
+is_free_page_nolock(page_buddy *pool, obj_cnt_type idx){
+	page_order     order;
+	page_frame       *pf;
+
+	kassert( spinlock_locked_by_self(&pool->lock) );
+
+	/*
+	 * ページを含むブロックの先頭ページが空きページキューに
+	 * つながっていることを確認する
+	 */
+	for(order = 0; PAGE_POOL_MAX_ORDER > order; ++order) {
+
+		pf = &pool->array[idx & ~( ( ULONG_C(1) << order ) - 1 )];
+		if ( !PAGE_STATE_NOT_FREED(pf) && !PAGE_IS_CMA(pf) 
+		    && ( pf->order == order ) && !list_not_linked(&pf->link) )
+			return true;  /* 空きブロックに含まれる */
+	}
+
+	return false;
+}
+
+/**
+   連続メモリ領域に割り当てる連続した空きページを探す (内部関数)
+   @param[in]  pool   バディプール
+   @param[in]  nr     ページ数
+   @param[out] stap   先頭ページのページフレーム配列インデクス返却領域
+   @retval     0      正常終了
+   @retval    -ENOMEM 連続した空きページがない
+   @note バディプールのロックを獲得して呼び出す
+ */
+static int
+find_cma_range_nolock(page_buddy *pool, obj_cnt_type nr, obj_cnt_type *stap){
+	obj_cnt_type   idx;
+	obj_cnt_type   run;
+
+	for(idx = 0, run = 0; pool->nr_pages > idx; ++idx) {
+
+		if ( !is_free_page_nolock(pool, idx) ) {
+
+			run = 0;  /* 連続した空きページが途切れた */
+			continue;
+		}
+
+		if ( ++run == nr ) {
+
+			*stap = idx + 1 - nr;  /* 先頭ページを返却する */
+			return 0;
+		}
+	}
+
+	return -ENOMEM;
+}
+
+/**
+   空きブロックのうち指定範囲外の部分をバディプールに戻す (内部関数)
+   @param[in] pool   バディプール
+   @param[in] idx    ブロックの先頭ページのページフレーム配列インデクス
+   @param[in] order  ブロックのオーダ
+   @param[in] sta    範囲の開始インデクス
+   @param[in] end    範囲の終了インデクス
+   @return 範囲内のページ数
+   @note ブロックを半分に分割しながら範囲外の部分をキューに戻す
+   @note バディプールのロックを獲得して呼び出す
+ */
+static obj_cnt_type
+putback_outside_range_nolock(page_buddy *pool, obj_cnt_type idx, page_order order, 
+    obj_cnt_type sta, obj_cnt_type end){
+	obj_cnt_type size;
+
+	size = ULONG_C(1) << order;  /* ブロック内のページ数 */
+	if ( ( idx >= sta ) && ( end >= ( idx + size ) ) )
+		return size;  /* ブロック全体が範囲内 */
+
+	if ( ( sta >= ( idx + size ) ) || ( idx >= end ) ) {
+
+		buddy_list_add(pool, &pool->array[idx], order);  /* ブロック全体が範囲外 */
+		return 0;
+	}
+
+	kassert( order > 0 );
+	return putback_outside_range_nolock(pool, idx, order - 1, sta, end)
+	    + putback_outside_range_nolock(pool, idx + ( size >> 1 ), order - 1, sta, end);
+}
+
+/**
+   空きページをバディプールから外して連続メモリ領域に設定する (内部関数)
+   @param[in] ent  ページフレームDBエントリ
+   @param[in] sta  先頭ページのページフレーム配列インデクス
+   @param[in] nr   ページ数
+   @note ページフレームDBのロックとバディプールのロックを獲得して呼び出す
+ */
+static void
+setup_cma_nolock(pfdb_ent *ent, obj_cnt_type sta, obj_cnt_type nr){
+	obj_cnt_type     i;
+	obj_cnt_type   idx;
+	obj_cnt_type taken;
+	page_order   order;
+	pfdb_cma      *cma;
+	page_buddy   *pool;
+	page_frame     *pf;
+	list           *lp;
+	list           *np;
+	intrflags   iflags;
+
+	pool = &ent->page_pool;
+	cma = &g_pfdb.cma;
+
+	kassert( spinlock_locked_by_self(&g_pfdb.lock) );
+	kassert( spinlock_locked_by_self(&pool->lock) );
+
+	/*
+	 * 範囲と重なる空きブロックをキューから外し, 範囲外の部分をキューに戻す
+	 */
+	for(order = PAGE_POOL_MAX_ORDER, taken = 0; order > 0; --order) {
+
+		queue_for_each_safe(lp, &pool->page_list[order - 1], np) {
+
+			pf = container_of(lp, page_frame, link);
+			idx = pf - pool->array;
+			if ( ( sta >= ( idx + ( ULONG_C(1) << ( order - 1 ) ) ) )
+			    || ( idx >= ( sta + nr ) ) )
+				continue;  /* 範囲と重ならないブロック */
+
+			buddy_list_del(pool, pf);
+			taken += putback_outside_range_nolock(pool, idx, order - 1, sta, sta + nr);
+		}
+	}
+	kassert( taken == nr );
+
+	spinlock_lock_disable_intr(&cma->lock, &iflags);
+
+	/*
+	 * オーダ0のページとして空きページリストにつなぐ
+	 */
+	queue_init(&cma->page_list);
+	for(i = 0; nr > i; ++i) {
+
+		pf = &pool->array[sta + i];
+		kassert( !PAGE_STATE_NOT_FREED(pf) );
+
+		pf->order = 0;
+		PAGE_MARK_CMA(pf);  /* 連続メモリ領域のページに設定する */
+		queue_add(&cma->page_list, &pf->link);
+	}
+
+	cma->ent = ent;
+	cma->sta = sta;
+	cma->nr_pages = nr;
+	cma->free_nr = nr;
+
+	spinlock_unlock_restore_intr(&cma->lock, &iflags);
+}
+
+/**
+   連続メモリ領域の空きページを移動可能なページとして貸し出す (内部関数)
+   @param[in]  usage  ページ利用用途
+   @param[out] pfnp   取得したページのページフレーム番号を返却する領域
+   @retval     0      正常にページを獲得した
+   @retval    -EPERM  移動できない利用用途を指定した
+   @retval    -ENOMEM 空きページがない
+ */
+static int
+dequeue_page_from_cma(page_usage usage, obj_cnt_type *pfnp){
+	int           rc;
+	pfdb_cma    *cma;
+	page_frame   *pf;
+	intrflags iflags;
+
+	if ( !page_usage_is_movable(usage) )
+		return -EPERM;  /* 移動できない利用用途 */
+
+	cma = &g_pfdb.cma;
+
+	spinlock_lock_disable_intr(&cma->lock, &iflags);
+
+	if ( cma->free_nr == 0 ) {
+
+		rc = -ENOMEM;  /* 空きページがない */
+		goto unlock_out;
+	}
+
+	pf = container_of(queue_get_top(&cma->page_list), page_frame, link);
+	--cma->free_nr;
+	++cma->lent;   /* 貸し出し中のページ数を更新 */
+	++cma->lends;  /* 貸し出し回数を更新 */
+	kassert( PAGE_IS_CMA(pf) && ( pf->order == 0 ) );
+
+	mark_page_usage(pf, usage); /* ページ利用用途を更新する  */
+	PAGE_MARK_USED(pf);         /* ページを使用中にする */
+	refcnt_set(&pf->usecnt, REFCNT_INITIAL_VAL);  /* 参照を上げる */
+
+	*pfnp = pf->pfn;  /* ページフレーム番号を返却する */
+
+	rc = 0;
+
+unlock_out:
+	spinlock_unlock_restore_intr(&cma->lock, &iflags);
+
+	return rc;
+}
+
+/**
+   連続メモリ領域のページを返却する (内部関数)
+   @param[in] pf 解放するページのページフレーム情報
+   @note 獲得処理中の範囲のページは空きページリストにつながずに,
+   獲得処理側で回収する
+ */
+static void
+enqueue_page_to_cma(page_frame *pf){
+	obj_cnt_type  idx;
+	pfdb_cma     *cma;
+	intrflags  iflags;
+
+	kassert( PAGE_IS_CMA(pf) && ( pf->order == 0 ) );
+
+	cma = &g_pfdb.cma;
+
+	spinlock_lock_disable_intr(&cma->lock, &iflags);
+
+	unmark_page_usage(pf);     /* 利用用途をクリアする         */
+	PAGE_UNMARK_USED(pf);      /* ページの使用中フラグを落とす */
+
+	if ( PAGE_IS_CLUSTERED(pf) ) {  /* 連続領域として獲得したページ */
+
+		PAGE_UNMARK_CLUSTERED(pf);
+		--cma->allocated;
+	} else
+		--cma->lent;
+
+	idx = pf - cma->ent->page_pool.array;  /*  配列のインデクスを算出  */
+	if ( cma->busy && ( idx >= cma->iso_sta ) && ( cma->iso_end > idx ) )
+		goto unlock_out;  /* 獲得処理中の範囲のページ */
+
+	queue_add(&cma->page_list, &pf->link);  /* 空きページリストにつなぐ */
+	++cma->free_nr;
+
+unlock_out:
+	spinlock_unlock_restore_intr(&cma->lock, &iflags);
+}
+
+/**
+   連続領域として獲得可能な範囲であることを確認する (内部関数)
+   @param[in] cma  連続メモリ領域
+   @param[in] sta  範囲の開始インデクス
+   @param[in] nr   範囲のページ数
+   @retval    真   範囲内の使用中のページが全て移動可能である
+   @retval    偽   連続領域として獲得済みか移動できないページを含む
+   @note 連続メモリ領域のロックを獲得して呼び出す
+ */
+static bool
+cma_range_is_movable_nolock(pfdb_cma *cma, obj_cnt_type sta, obj_cnt_type nr){
+	obj_cnt_type    i;
+	page_usage  usage;
+	page_frame    *pf;
+
+	kassert( spinlock_locked_by_self(&cma->lock) );
+
+	for(i = 0; nr > i; ++i) {
+
+		pf = &cma->ent->page_pool.array[sta + i];
+		if ( !PAGE_IS_USED(pf) )
+			continue;  /* 空きページ */
+
+		if ( PAGE_IS_CLUSTERED(pf) || ( lookup_migrate_handler(pf, &usage) == NULL ) )
+			return false;  /* 獲得済みのページか移動できないページ */
+	}
+
+	return true;
+}
+
+/**
+   獲得処理中の範囲の空きページを空きページリストから外す (内部関数)
+   @param[in] cma  連続メモリ領域
+   @param[in] sta  範囲の開始インデクス
+   @param[in] nr   範囲のページ数
+   @note 連続メモリ領域のロックを獲得して呼び出す
+ */
+static void
+cma_isolate_range_nolock(pfdb_cma *cma, obj_cnt_type sta, obj_cnt_type nr){
+	obj_cnt_type   i;
+	page_frame   *pf;
+
+	kassert( spinlock_locked_by_self(&cma->lock) );
+
+	cma->iso_sta = sta;
+	cma->iso_end = sta + nr;
+	for(i = cma->iso_sta; cma->iso_end > i; ++i) {
+
+		pf = &cma->ent->page_pool.array[i];
+		if ( PAGE_IS_USED(pf) )
+			continue;  /* 貸し出し中のページ */
+
+		queue_del(&cma->page_list, &pf->link);  /* 空きページリストから外す */
+		--cma->free_nr;
+	}
+}
+
+/**
+   獲得処理中の範囲の空きページを空きページリストに戻す (内部関数)
+   @param[in] cma  連続メモリ領域
+   @note 連続メモリ領域のロックを獲得して呼び出す
+ */
+static void
+cma_putback_range_nolock(pfdb_cma *cma){
+	obj_cnt_type   i;
+	page_frame   *pf;
+
+	kassert( spinlock_locked_by_self(&cma->lock) );
+
+	for(i = cma->iso_sta; cma->iso_end > i; ++i) {
+
+		pf = &cma->ent->page_pool.array[i];
+		if ( PAGE_IS_USED(pf) )
+			continue;  /* 移動できなかったページ */
+
+		queue_add(&cma->page_list, &pf->link);  /* 空きページリストにつなぐ */
+		++cma->free_nr;
+	}
+	cma->iso_sta = cma->iso_end = 0;
+}
+
+/**
+   獲得処理中の範囲のページを連続領域として獲得する (内部関数)
+   @param[in] cma    連続メモリ領域
+   @param[in] usage  ページ利用用途
+   @retval    0      正常終了
+   @retval   -EBUSY  使用中のページが残っている
+   @note 連続メモリ領域のロックを獲得して呼び出す
+   @note 各ページを先頭ページを指すクラスタページとして獲得済みにする
+ */
+static int
+cma_claim_range_nolock(pfdb_cma *cma, page_usage usage){
+	obj_cnt_type    i;
+	page_frame    *pf;
+	page_frame  *head;
+
+	kassert( spinlock_locked_by_self(&cma->lock) );
+
+	for(i = cma->iso_sta; cma->iso_end > i; ++i)
+		if ( PAGE_IS_USED(&cma->ent->page_pool.array[i]) )
+			return -EBUSY;  /* 移動できなかったページがある */
+
+	head = &cma->ent->page_pool.array[cma->iso_sta];
+	for(i = cma->iso_sta; cma->iso_end > i; ++i) {
+
+		pf = &cma->ent->page_pool.array[i];
+
+		PAGE_MARK_CLUSTERED(pf, head); /* 先頭ページを記録する */
+		mark_page_usage(pf, usage);    /* ページ利用用途を更新する  */
+		PAGE_MARK_USED(pf);            /* ページを使用中にする */
+		refcnt_set(&pf->usecnt, REFCNT_INITIAL_VAL);  /* 参照を上げる */
+	}
+	cma->allocated += cma->iso_end - cma->iso_sta;  /* 獲得中のページ数を更新 */
+	cma->iso_sta = cma->iso_end = 0;
+
+	return 0;
+}
+
+/**
+   獲得処理中の範囲の貸し出し中のページを領域外に移動する (内部関数)
+   @param[in] cma  連続メモリ領域
+   @param[in] sta  範囲の開始インデクス
+   @param[in] nr   範囲のページ数
+   @retval    0      正常終了
+   @retval   -EBUSY  移動できないページだった
+   @retval   -ENOMEM 移動先ページを獲得できなかった
+   @note 連続メモリ領域のロックを獲得せずに呼び出す
+   @note 移動元ページは解放時に空きページリストにつながれずに残る
+ */
+static int
+cma_migrate_range(pfdb_cma *cma, obj_cnt_type sta, obj_cnt_type nr){
+	int             rc;
+	obj_cnt_type     i;
+	page_frame     *pf;
+
+	for(i = 0; nr > i; ++i) {
+
+		pf = &cma->ent->page_pool.array[sta + i];
+		if ( !PAGE_IS_USED(pf) )
+			continue;  /* 空きページ */
+
+		rc = pfdb_migrate_page(pf);  /* バディプールのページに移動する */
+		if ( ( rc != 0 ) && ( rc != -ENOENT ) )
+			return rc;  /* 移動できなかった */
+	}
+
+	return 0;
+}
+
+/*
+ * IF関数
+ */
+
+/**
+   所定のオーダのページを取り出しページフレーム番号を返す
+   @param[in]  order  取得するページのオーダ
+   @param[in]  usage  ページ利用用途
+   @param[out] pfnp   取得したページのページフレーム番号を返却する領域
+   @retval     0      正常にページを獲得した
+   @retval    -EINVAL ページフレーム情報返却域が不正か要求したページオーダが不正
    @retval    -ENOMEM 空きページがない
 */
 int
-pfdb_buddy_dequeue(page_order order, page_usage usage, obj_cnt_type *pfnp){
-	int           rc;   
-	pfdb_ent    *ent;
-	obj_cnt_type pfn;
+pfdb_buddy_dequeue(page_order order, page_usage usage, obj_cnt_type *pfnp){
+	int           rc;   
+	pfdb_ent    *ent;
+	obj_cnt_type pfn;
+	intrflags iflags;
+
+	if ( order == 0 ) {  /* オーダ0のページはCPU単位ページキャッシュから獲得する */
+
+		/* 空きページが高水位を下回っている場合は, 移動可能なページを
+		 * 連続メモリ領域から優先して貸し出す
+		 */
+		if ( ( g_pfdb.wmark_level != PFDB_WMARK_OK )
+		    && ( dequeue_page_from_cma(usage, &pfn) == 0 ) ) {
+
+			*pfnp = pfn;  /*  ページフレーム番号を返却  */
+			return 0;
+		}
+
+		rc = dequeue_page_from_pcp(usage, &pfn);
+		if ( rc == 0 ) {
+
+			*pfnp = pfn;  /*  ページフレーム番号を返却  */
+			return 0;
+		}
+
+		/* 空きページがない場合は, 他のCPUのキャッシュ中のページを
+		 * バディプールに返却してからバディプールからの獲得を試みる
+		 */
+		if ( rc == -ENOMEM ) {
+
+			pfdb_pcp_drain_all();
+			pfdb_zero_pool_drain();
+			pfdb_color_pool_drain();
+		}
+	}
+
+	/*
+	 * ページフレームDBの全エントリを走査し, 空きページの獲得を試みる
+	 */
+	spinlock_lock_disable_intr(&g_pfdb.lock, &iflags);
+	RB_FOREACH(ent, _pfdb_tree, &g_pfdb.dbroot) {
+
+		/* 空きページの獲得を試みる
+		 */
+		rc = dequeue_page_from_memory_area(ent, order, usage, &pfn);
+		if ( rc == 0 ) {
+
+			check_wmark_nolock(ent);  /* 空きページ数の水位を確認する */
+			*pfnp = pfn;  /*  ページが獲得できたらページフレーム番号を返却  */
+		}
+
+		/*  エントリ内にメモリがない場合は, 次のエントリから獲得を試み,
+		 *  メモリ不足以外のエラーがあった場合は, 即時に復帰する
+		 */
+		if ( rc != -ENOMEM )
+			goto unlock_out;  
+	}
+
+	update_wmark_level_nolock();     /* 空きページ数の水位を更新する */
+	g_pfdb.reclaim_pending = true;   /* ページ回収を要求する */
+	rc = -ENOMEM;  /*  メモリ不足によるメモリ獲得失敗  */
+
+unlock_out:
+	spinlock_unlock_restore_intr(&g_pfdb.lock, &iflags);
+
+	/* 空きページがない場合は, 移動可能なページを連続メモリ領域から貸し出す */
+	if ( ( rc == -ENOMEM ) && ( order == 0 ) 
+	    && ( dequeue_page_from_cma(usage, &pfn) == 0 ) ) {
+
+		*pfnp = pfn;  /*  ページフレーム番号を返却  */
+		rc = 0;
+	}
+
+	return rc;
+}
+
+/**
+   所定のオーダのページを一括して取り出す (内部関数)
+   @param[in]  order   取得するページのオーダ
+   @param[in]  usage   ページ利用用途
+   @param[in]  nr      取得するページ数
+   @param[out] kvaddrs 取得したページのカーネル仮想アドレスを返却する配列
+   @retval     0       正常にページを獲得した
+   @retval    -ENOMEM  空きページがない
+   @note ページフレームDBのロックと各バディプールのロックを1回ずつ獲得して
+   ページを取り出す. 要求されたページ数を獲得できなかった場合は,
+   獲得したページをバディプールに返却する.
+ */
+static int
+dequeue_pages_bulk(page_order order, page_usage usage, obj_cnt_type nr, void **kvaddrs){
+	int                rc;
+	obj_cnt_type    count;
+	obj_cnt_type      pfn;
+	pfdb_ent         *ent;
+	page_buddy      *pool;
+	page_frame        *pf;
+	intrflags   db_iflags;
+	intrflags pool_iflags;
+
+	count = 0;
+
+	spinlock_lock_disable_intr(&g_pfdb.lock, &db_iflags);
+	RB_FOREACH(ent, _pfdb_tree, &g_pfdb.dbroot) {
+
+		pool = &ent->page_pool;  /*  ページプール情報を参照  */
+
+		spinlock_lock_disable_intr(&pool->lock, &pool_iflags);
+		while( nr > count ) {
+
+			rc = get_free_page_from_buddy_nolock(pool, order, &pf);
+			if ( rc != 0 )
+				break;  /* 空きページがない */
+
+			setup_clustered_pages(pf);  /* ページクラスタ情報を設定する */
+			mark_page_usage(pf, usage); /* ページ利用用途を更新する  */
+			PAGE_MARK_USED(pf);         /* ページを使用中にする */
+			refcnt_set(&pf->usecnt, REFCNT_INITIAL_VAL);  /* 参照を上げる */
+
+			rc = hal_pfn_to_kvaddr(pf->pfn, &kvaddrs[count]);
+			kassert( rc == 0 );
+
+			++count;
+		}
+		spinlock_unlock_restore_intr(&pool->lock, &pool_iflags);
+
+		check_wmark_nolock(ent);  /* 空きページ数の水位を確認する */
+
+		if ( count == nr )
+			break;  /* 要求されたページ数を獲得した */
+	}
+
+	if ( count == nr ) {
+
+		rc = 0;
+		goto unlock_out;
+	}
+
+	/*
+	 * 獲得済みのページをバディプールに返却する
+	 */
+	while( count > 0 ) {
+
+		--count;
+		rc = hal_kvaddr_to_pfn(kvaddrs[count], &pfn);
+		kassert( rc == 0 );
+		rc = pfn_to_page_frame_nolock(pfn, &pf);
+		kassert( rc == 0 );
+
+		refcnt_set(&pf->usecnt, 0);  /* 参照を落とす */
+		spinlock_lock_disable_intr(&pf->buddyp->lock, &pool_iflags);
+		enqueue_page_to_buddy_pool(pf->buddyp, pf);  /*  ページを解放する  */
+		spinlock_unlock_restore_intr(&pf->buddyp->lock, &pool_iflags);
+	}
+
+	update_wmark_level_nolock();     /* 空きページ数の水位を更新する */
+	g_pfdb.reclaim_pending = true;   /* ページ回収を要求する */
+	rc = -ENOMEM;  /*  メモリ不足によるメモリ獲得失敗  */
+
+unlock_out:
+	spinlock_unlock_restore_intr(&g_pfdb.lock, &db_iflags);
+	return rc;
+}
+
+/**
+   所定のオーダのページを一括して取り出す
+   @param[in]  order   取得するページのオーダ
+   @param[in]  usage   ページ利用用途
+   @param[in]  nr      取得するページ数
+   @param[out] kvaddrs 取得したページのカーネル仮想アドレスを返却する配列
+   @retval     0       正常にページを獲得した
+   @retval    -EINVAL  要求したページオーダが不正
+   @retval    -ENOMEM  空きページがない
+   @note 要求されたページ数を獲得できなかった場合は, ページを獲得しない
+ */
+int
+pfdb_buddy_dequeue_bulk(page_order order, page_usage usage, obj_cnt_type nr, 
+    void **kvaddrs){
+	int rc;
+
+	if ( order >= PAGE_POOL_MAX_ORDER )
+		return -EINVAL;  /* 要求したページオーダが不正 */
+
+	if ( nr == 0 )
+		return 0;  /* 獲得するページがない */
+
+	rc = dequeue_pages_bulk(order, usage, nr, kvaddrs);
+	if ( rc == -ENOMEM ) {
+
+		/* CPU単位ページキャッシュ中のページをバディプールに返却して再試行する
+		 */
+		pfdb_pcp_drain_all();
+		pfdb_zero_pool_drain();
+		pfdb_color_pool_drain();
+		rc = dequeue_pages_bulk(order, usage, nr, kvaddrs);
+	}
+
+	return rc;
+}
+
+/**
+   ページの利用カウントを一括して下げ, 利用されなくなったページをバディプールに返却する
+   @param[in] nr      ページ数
+   @param[in] kvaddrs 解放するページのカーネル仮想アドレスの配列
+   @return 解放したページ数
+   @note ページフレームDBのロックを1回だけ獲得し, 
+   同じバディプールに属するページが続く間はバディプールのロックを保持したままにする
+ */
+obj_cnt_type
+pfdb_buddy_enqueue_bulk(obj_cnt_type nr, void **kvaddrs){
+	int                 rc;
+	obj_cnt_type         i;
+	obj_cnt_type       pfn;
+	obj_cnt_type   free_nr;
+	page_buddy       *pool;
+	page_frame         *pf;
+	intrflags    db_iflags;
+	intrflags  pool_iflags;
+
+	pool = NULL;
+	spinlock_lock_disable_intr(&g_pfdb.lock, &db_iflags);
+	for(i = 0, free_nr = 0; nr > i; ++i) {
+
+		/*  解放対象ページのページフレーム情報を得る  */
+		rc = hal_kvaddr_to_pfn(kvaddrs[i], &pfn);
+		kassert( rc == 0 );
+		rc = pfn_to_page_frame_nolock(pfn, &pf);
+		kassert( rc == 0 );
+
+		if ( !refcnt_dec_and_test(&pf->usecnt) ) 
+			continue;  /* 最終参照者でない */
+
+		kassert( PAGE_IS_USED(pf) );  /*  多重開放でないことを確認  */
+		/* マップされていないことを確認 */
+		kassert( pfdb_ref_page_map_count(pf) == 0 ); 
+
+		if ( PAGE_IS_CMA(pf) ) {
+
+			enqueue_page_to_cma(pf);  /* 連続メモリ領域に返却する */
+			++free_nr;
+			continue;
+		}
+
+		if ( pool != pf->buddyp ) {  /* 異なるバディプールのページ */
+
+			if ( pool != NULL )  /* 獲得中のページプールロックを解放 */
+				spinlock_unlock_restore_intr(&pool->lock, &pool_iflags);
+
+			pool = pf->buddyp;
+			spinlock_lock_disable_intr(&pool->lock, &pool_iflags);
+		}
+		enqueue_page_to_buddy_pool(pool, pf);  /*  ページを解放する  */
+		++free_nr;
+	}
+
+	if ( pool != NULL )  /* ページプールロックを解放 */
+		spinlock_unlock_restore_intr(&pool->lock, &pool_iflags);
+
+	spinlock_unlock_restore_intr(&g_pfdb.lock, &db_iflags);
+
+	return free_nr;
+}
+
+/**
+   ページフレームDBのエントリを初期化する
+   @param[in]  phys_start 連続した物理メモリ領域の開始物理アドレス
+   @param[in]  length     連続した物理メモリ領域のサイズ
+   @param[out] pfdbp      ページフレームDBエントリの返却領域
+ */
+void
+pfdb_add(uintptr_t phys_start, size_t length, pfdb_ent **pfdbp){
+	pfdb_ent     *pfdb;
+	pfdb_ent      *res;
+	obj_cnt_type     i;
+	obj_cnt_type map_words;
+	void        *kaddr;
+	void *kvaddr_start;
+	int            idx;
+	page_buddy   *pool;
+	page_frame    *pgf;
+	size_t       total;
+	intrflags   iflags;
+
+	/*  領域先頭の物理メモリに対応するカーネルストレートマップ領域アドレスを得る  */
+	hal_phys_to_kvaddr((void *)phys_start, &kvaddr_start);
+
+	/*  領域の末尾にページフレームDBエントリを配置する  */
+	pfdb = (pfdb_ent *)( (uintptr_t)kvaddr_start + length - sizeof(pfdb_ent));
+
+	/*
+	 * メンバ初期化
+	 */
+	RB_ENT_INIT(pfdb, ent);  /*< 赤黒木のエントリを初期化する  */
+	pfdb->kvaddr = kvaddr_start;  /*< カーネル仮想アドレスでの開始アドレスを設定 */
+	pfdb->length = length; /*< 登録する物理メモリ領域の長さ(単位:バイト)を設定  */
+
+	/*  領域中の最小/最大ページフレーム番号を算出する  */
+	hal_kvaddr_to_pfn(pfdb->kvaddr, &pfdb->min_pfn);
+	hal_kvaddr_to_pfn((void *)PAGE_ROUNDUP(pfdb->kvaddr + pfdb->length - 1),
+			  &pfdb->max_pfn);
+	/*
+	 * buddy poolを初期化する
+	 */
+	pool = &pfdb->page_pool;
+	spinlock_init(&pool->lock);
+
+	pool->nr_pages = pfdb->max_pfn - pfdb->min_pfn;  /*  領域中のページ数  */
+
+	/* ページフレーム配列の開始アドレスを算出する
+	 * (page/page-pfdb.h参照)
+	 */
+	pool->array = (void *)(pfdb) - (pool->nr_pages * sizeof(page_frame));
+	pool->pfdb_ent = pfdb;  /* ページフレームDBエントリへの逆リンクを設定 */
+
+	/* バディペアビットマップの配置を算出する
+	 * (ページフレーム配列の直前に配置する, page/page-pfdb.h参照)
+	 */
+	for(idx = 0, map_words = 0; PAGE_POOL_MAX_ORDER > idx; ++idx) {
+
+		pool->pair_map_off[idx] = map_words * 64;  /* 開始ビット位置 */
+		/* オーダ内のバディペア数分のビットを確保する */
+		map_words += roundup_align( ( pool->nr_pages >> ( idx + 1 ) ) + 1, 64 ) / 64;
+	}
+	pool->pair_map = (uint64_t *)truncate_align( (uintptr_t)pool->array 
+	    - ( map_words * sizeof(uint64_t) ), sizeof(uint64_t));
+	memset(pool->pair_map, 0, map_words * sizeof(uint64_t));
+
+	/* buddy管理情報を初期化
+	 */
+	for(idx = 0; PAGE_POOL_MAX_ORDER > idx; ++idx) {
+
+		pool->free_nr[idx] = 0;
+		queue_init(&pool->page_list[idx]);
+	}
+	pool->nr_free = 0;     /* 空きページはない */
+	pool->order_mask = 0;  /* 空きページがあるオーダはない */
+
+	/* 利用用途別ページ数を初期化
+	 */
+	statcnt_set(&pool->kdata_pages, 0);
+	statcnt_set(&pool->kstack_pages, 0);
+	statcnt_set(&pool->pgtbl_pages, 0);
+	statcnt_set(&pool->slab_pages, 0);
+	statcnt_set(&pool->anon_pages, 0);
+	statcnt_set(&pool->pcache_pages, 0);
+
+	/*
+	 * ページフレーム配列初期化
+	 */
+	for(i = 0; pool->nr_pages > i; ++i) {
+
+		pgf = &pool->array[i];
+		/*
+		 * ページフレーム情報の各要素を初期化
+		 */
+		pgf->state = PAGE_STATE_RESERVED;  /* ページフレームを予約 (ロック解放状態) */
+		pgf->pfn = pfdb->min_pfn + i;  /* 最小ページ番号を初期化          */
+		refcnt_init_with_value(&pgf->usecnt, 0);  /* 利用カウント初期化   */
+		refcnt_init_with_value(&pgf->mapcnt, 0);  /* マップカウント初期化 */
+		pgf->order = 0;                           /* ページオーダ初期化   */
+		pgf->buddyp = pool;         /* ページプールを設定                 */
+		pgf->headp = NULL;          /* ページクラスタ情報初期化           */
+		pgf->pcachep = NULL;        /* 利用用途別の情報を初期化           */
+		list_init(&pgf->link);      /* ページキューへのリンクを初期化     */
+	}
+
+	/*
+	 * page frame dbに登録
+	 */
+	spinlock_lock_disable_intr(&g_pfdb.lock, &iflags);
+	res = RB_INSERT(_pfdb_tree, &g_pfdb.dbroot, pfdb);
+	kassert( res == NULL );
+	pfdb_section_register_nolock(pfdb);  /* セクション表に登録する */
+	spinlock_unlock_restore_intr(&g_pfdb.lock, &iflags);
+
+	/* 利用可能なページをbuddy poolに返却する
+	 */
+	pool->available_pages = 0;  /*  利用可能ページ数を初期化  */
+	for(i = 0; pool->nr_pages > i; ++i) {
+
+		/*  ページフレーム配列やページフレームDBエントリを
+		 *  配置した領域のページは予約したままとする
+		 */
+		/*  ページに対応したカーネルストレートマップ領域のアドレスを算出する  */
+		hal_pfn_to_kvaddr(pfdb->min_pfn + i, &kaddr);
+
+		/*  バディペアビットマップを含むページの先頭から
+		 *  ページフレームDBエントリを含むページの末尾
+		 *  (ページフレームDBエントリ配置ページの次のページの先頭アドレス)
+		 *  までの範囲に算出したアドレスが含まれている場合は,
+		 *  予約を解除しない
+		 */
+		if ( ( (void *)PAGE_TRUNCATE(pool->pair_map) <= kaddr ) &&
+		    ( kaddr <  (void *)PAGE_ROUNDUP(pfdb->kvaddr + pfdb->length - 1) ) ) 
+			continue;
+
+		/*
+		 * ページフレーム配列以前のページの場合は, 予約を解除し,
+		 * バディページキューに格納
+		 */
+		PAGE_UNMARK_RESERVED(&pool->array[i]);  /*  予約解除  */
+		spinlock_lock_disable_intr(&pool->lock, &iflags);
+		enqueue_page_to_buddy_pool(pool, &pool->array[i]); /* ページをキューに追加 */
+		++pool->available_pages;  /*  利用可能ページ数を加算  */
+		spinlock_unlock_restore_intr(&pool->lock, &iflags);
+	}
+
+	/*
+	 * 空きページ数の水位を設定する
+	 * 最低水位を利用可能ページ数の1/PFDB_WMARK_MIN_DIVとし,
+	 * 低水位を最低水位の5/4, 高水位を最低水位の3/2とする
+	 */
+	pfdb->wmark.min = pool->available_pages / PFDB_WMARK_MIN_DIV;
+	if ( PFDB_WMARK_MIN_PAGES > pfdb->wmark.min )
+		pfdb->wmark.min = PFDB_WMARK_MIN_PAGES;
+	pfdb->wmark.low = pfdb->wmark.min + pfdb->wmark.min / 4;
+	pfdb->wmark.high = pfdb->wmark.min + pfdb->wmark.min / 2;
+
+	/*
+	 * 初期化の検証
+	 */
+	total = 0;
+	for(idx = 0; PAGE_POOL_MAX_ORDER > idx; ++idx) {
+
+		/*  buddyプール内の総容量を算出  */
+		total += pool->free_nr[idx] * (PAGE_SIZE << idx);
+	}
+
+	/*  buddyプール内の総容量 + バディペアビットマップ + ページフレーム配列
+	 *  + ページフレームDBエントリの領域長が登録された物理メモリ領域と等しいことを確認する
+	 */
+	kassert( ( total + PAGE_ROUNDUP(pfdb->kvaddr + pfdb->length - 1) -
+		PAGE_TRUNCATE(pool->pair_map) ) == pfdb->length );
+
+	*pfdbp = pfdb;  /*  ページフレームDBエントリを返却する  */
+
+	return ;
+}
+
+/**
+   ページフレームDBのエントリの登録を抹消する
+   @param[in] ent   ページフレームDBエントリ
+   @retval  0      正常終了
+   @retval -EBUSY  使用中ページが存在する
+   @retval -ENOENT 指定されたページフレームDBのエントリが登録されていない
+ */
+int
+pfdb_remove(pfdb_ent *ent){
+	int               rc;
+	intrflags     iflags;
+
+	pfdb_pcp_drain_all();  /* CPU単位ページキャッシュ中のページを返却する */
+	pfdb_zero_pool_drain(); /* 事前クリア済みページを返却する */
+	pfdb_color_pool_drain(); /* カラー別ページプール中のページを返却する */
+
+	spinlock_lock_disable_intr(&g_pfdb.lock, &iflags);  /* ページフレームDBのロック獲得 */
+
+	rc = remove_pfdb_ent_common(ent);  /*  指定されたエントリを解放する  */
+
+	/* ページフレームDBのロック解放 */
+	spinlock_unlock_restore_intr(&g_pfdb.lock, &iflags);
+
+	return rc;
+}
+
+/**
+   ページフレームDBの全エントリを解放する
+ */
+void
+pfdb_free(void){
+	pfdb_ent     *nxt;
+	pfdb_ent     *ent;
+	intrflags  iflags;
+
+	pfdb_pcp_drain_all();  /* CPU単位ページキャッシュ中のページを返却する */
+	pfdb_zero_pool_drain(); /* 事前クリア済みページを返却する */
+	pfdb_color_pool_drain(); /* カラー別ページプール中のページを返却する */
+
+	spinlock_lock_disable_intr(&g_pfdb.lock, &iflags);  /* ページフレームDBのロック獲得 */
+
+	/*  ループ内で削除処理を行うのでRB_FOREACH_SAFEを使用  */
+	RB_FOREACH_SAFE(ent, _pfdb_tree, &g_pfdb.dbroot, nxt) { /*  登録済み領域を探査 */
+		
+		remove_pfdb_ent_common(ent);  /*  指定されたエントリを解放する  */
+	}
+
+	/* ページフレームDBのロック解放 */
+	spinlock_unlock_restore_intr(&g_pfdb.lock, &iflags);
+}
+
+/**
+   全CPUのCPU単位ページキャッシュ中のページをバディプールに返却する
+ */
+void
+pfdb_pcp_drain_all(void){
+	cpu_id       cpu;
+	pfdb_pcp    *pcp;
+	intrflags iflags;
+
+	if ( !g_pfdb.pcp_enabled )
+		return;  /* CPU単位ページキャッシュ初期化前 */
+
+	for(cpu = 0; KC_CPUS_NR > cpu; ++cpu) {
+
+		pcp = &g_pfdb.pcp[cpu];
+		spinlock_lock_disable_intr(&pcp->lock, &iflags);
+		drain_pcp_to_buddy(pcp, pcp->count);  /* 全ページを返却する */
+		spinlock_unlock_restore_intr(&pcp->lock, &iflags);
+	}
+}
+
+/**
+   CPU単位ページキャッシュを初期化し, 利用を開始する
+   @note スレッド情報中の論理CPUIDが参照可能になった後に呼び出す
+ */
+void
+pfdb_pcp_init(void){
+	cpu_id       cpu;
+	pfdb_pcp    *pcp;
+
+	kassert( !g_pfdb.pcp_enabled );
+
+	for(cpu = 0; KC_CPUS_NR > cpu; ++cpu) {
+
+		pcp = &g_pfdb.pcp[cpu];
+
+		spinlock_init(&pcp->lock);      /* ロックを初期化               */
+		queue_init(&pcp->page_list);    /* ページリストを初期化         */
+		pcp->count = 0;                 /* キャッシュ中のページ数を初期化 */
+		pcp->high = PFDB_PCP_HIGH;      /* 高水位を設定                 */
+		pcp->low = PFDB_PCP_LOW;        /* 低水位を設定                 */
+		pcp->batch = PFDB_PCP_BATCH;    /* 一括補充/返却ページ数を設定  */
+		pcp->hits = 0;                  /* 統計情報を初期化             */
+		pcp->refills = 0;
+		pcp->drains = 0;
+	}
+
+	g_pfdb.pcp_enabled = true;  /* CPU単位ページキャッシュの利用を開始 */
+}
+
+/**
+   事前クリア済みページプールにページを補充する
+   @param[in] nr 補充するページ数の上限
+   @return 補充したページ数
+   @note アイドルスレッドから割込み許可状態で呼び出す.
+   ページのクリアはロックを獲得せずに行う
+   @note 空きページ数が高水位を下回っている場合は補充しない
+ */
+obj_cnt_type
+pfdb_zero_pool_fill(obj_cnt_type nr){
+	int                rc;
+	obj_cnt_type    count;
+	pfdb_zero_pool    *zp;
+	page_frame        *pf;
+	void          *kvaddr;
+	bool             full;
+	intrflags      iflags;
+
+	zp = &g_pfdb.zero_pool;
+
+	if ( pfdb_watermark_update() != PFDB_WMARK_OK )
+		return 0;  /* 空きページが少ない */
+
+	for(count = 0; nr > count; ++count) {
+
+		spinlock_lock_disable_intr(&zp->lock, &iflags);
+		full = ( zp->count >= zp->high );  /* 上限に達している */
+		spinlock_unlock_restore_intr(&zp->lock, &iflags);
+		if ( full )
+			break;
+
+		rc = get_zero_pool_candidate(&pf);  /* バディプールからページを取り出す */
+		if ( rc != 0 )
+			break;  /* 空きページがない */
+
+		rc = hal_pfn_to_kvaddr(pf->pfn, &kvaddr);
+		kassert( rc == 0 );
+		memset(kvaddr, 0, PAGE_SIZE);  /* ページをクリアする */
+
+		spinlock_lock_disable_intr(&zp->lock, &iflags);
+		full = ( zp->count >= zp->high );  /* クリア中に他のCPUが補充した */
+		if ( !full ) {
+
+			queue_add(&zp->page_list, &pf->link);  /* プールに追加する */
+			++zp->count;
+			++zp->fills;
+		}
+		spinlock_unlock_restore_intr(&zp->lock, &iflags);
+
+		if ( full ) {
+
+			put_zero_pool_page_to_buddy(pf);  /* バディプールに返却する */
+			break;
+		}
+	}
+
+	return count;
+}
+
+/**
+   事前クリア済みページプール中のページを全てバディプールに返却する
+ */
+void
+pfdb_zero_pool_drain(void){
+	pfdb_zero_pool    *zp;
+	page_frame        *pf;
+	intrflags      iflags;
+
+	zp = &g_pfdb.zero_pool;
+
+	spinlock_lock_disable_intr(&zp->lock, &iflags);
+	while( zp->count > 0 ) {
+
+		pf = container_of(queue_get_top(&zp->page_list), page_frame, link);
+		--zp->count;
+		put_zero_pool_page_to_buddy(pf);  /* バディプールに返却する */
+	}
+	spinlock_unlock_restore_intr(&zp->lock, &iflags);
+}
+
+/**
+   事前クリア済みページプールを初期化する
+ */
+void
+pfdb_zero_pool_init(void){
+	pfdb_zero_pool    *zp;
+	intrflags      iflags;
+
+	zp = &g_pfdb.zero_pool;
+
+	spinlock_lock_disable_intr(&zp->lock, &iflags);
+	kassert( zp->high == 0 );
+	queue_init(&zp->page_list);      /* ページリストを初期化       */
+	zp->count = 0;                   /* プール中のページ数を初期化 */
+	zp->high = PFDB_ZERO_POOL_HIGH;  /* 上限を設定して利用を開始する */
+	spinlock_unlock_restore_intr(&zp->lock, &iflags);
+}
+
+/**
+   事前クリア済みページを獲得する
+   @param[in]  usage  ページ利用用途
+   @param[in]  nr     獲得するページ数
+   @param[out] kvaddrs 獲得したページのカーネル仮想アドレスを格納する配列
+   @return 獲得したページ数
+   @note 事前クリア済みページはオーダ0のページのみ
+ */
+obj_cnt_type
+pfdb_zero_pool_dequeue_bulk(page_usage usage, obj_cnt_type nr, void **kvaddrs){
+
+	return dequeue_pages_from_zero_pool(usage, nr, kvaddrs);
+}
+
+/**
+   カラー別ページプール中のページを全てバディプールに返却する
+ */
+void
+pfdb_color_pool_drain(void){
+	page_color          color;
+	pfdb_color_pool       *cp;
+	page_frame            *pf;
+	intrflags          iflags;
+
+	cp = &g_pfdb.color_pool;
+
+	spinlock_lock_disable_intr(&cp->lock, &iflags);
+	for(color = 0; ( cp->count > 0 ) && ( PFDB_COLOR_NR > color ); ++color) {
+
+		while( cp->nr[color] > 0 ) {
+
+			pf = container_of(queue_get_top(&cp->page_list[color]), page_frame, link);
+			--cp->nr[color];
+			--cp->count;
+			put_color_pool_page_to_buddy(pf);  /* バディプールに返却する */
+		}
+	}
+	spinlock_unlock_restore_intr(&cp->lock, &iflags);
+}
+
+/**
+   カラー別ページプールを初期化する
+ */
+void
+pfdb_color_pool_init(void){
+	page_color          color;
+	pfdb_color_pool       *cp;
+	intrflags          iflags;
+
+	cp = &g_pfdb.color_pool;
+
+	spinlock_lock_disable_intr(&cp->lock, &iflags);
+	kassert( cp->high == 0 );
+	for(color = 0; PFDB_COLOR_NR > color; ++color) {
+
+		queue_init(&cp->page_list[color]);  /* ページリストを初期化       */
+		cp->nr[color] = 0;                  /* カラー別のページ数を初期化 */
+	}
+	cp->count = 0;                  /* プール中のページ数を初期化 */
+	cp->high = PFDB_COLOR_HIGH;     /* 上限を設定して利用を開始する */
+	spinlock_unlock_restore_intr(&cp->lock, &iflags);
+}
+
+/**
+   指定されたカラーのオーダ0のページを獲得する
+   @param[in]  color  ページカラー
+   @param[in]  usage  ページ利用用途
+   @param[out] pfnp   取得したページのページフレーム番号を返却する領域
+   @retval     0      正常にページを獲得した
+   @retval    -EINVAL 不正なカラーを指定した
+   @retval    -ENOENT 指定されたカラーのページがない
+ */
+int
+pfdb_color_dequeue(page_color color, page_usage usage, obj_cnt_type *pfnp){
+	int                 rc;
+	pfdb_color_pool    *cp;
+	page_frame         *pf;
+	intrflags       iflags;
+
+	if ( color >= PFDB_COLOR_NR )
+		return -EINVAL;  /* 不正なカラー */
+
+	cp = &g_pfdb.color_pool;
+
+	spinlock_lock_disable_intr(&cp->lock, &iflags);
+
+	/* 指定されたカラーのページがない場合は補充する */
+	if ( ( cp->nr[color] == 0 ) && ( cp->high > cp->count ) )
+		refill_color_pool_nolock(cp);
+
+	if ( ( cp->high == 0 ) || ( cp->nr[color] == 0 ) ) {
+
+		++cp->misses;  /* 獲得失敗回数を更新 */
+		spinlock_unlock_restore_intr(&cp->lock, &iflags);
+
+		return -ENOENT;  /* 指定されたカラーのページがない */
+	}
+
+	pf = container_of(queue_get_top(&cp->page_list[color]), page_frame, link);
+	--cp->nr[color];
+	--cp->count;
+	++cp->hits;  /* 獲得回数を更新 */
+	kassert( PAGE_IS_COLORED(pf) && ( PFDB_PFN_TO_COLOR(pf->pfn) == color ) );
+
+	PAGE_UNMARK_COLORED(pf);      /* カラー別ページプール格納中フラグを落とす */
+	mark_page_usage(pf, usage);   /* ページ利用用途を更新する  */
+	PAGE_MARK_USED(pf);           /* ページを使用中にする */
+	refcnt_set(&pf->usecnt, REFCNT_INITIAL_VAL);  /* 参照を上げる */
+
+	*pfnp = pf->pfn;  /* ページフレーム番号を返却する */
+	rc = 0;
+
+	spinlock_unlock_restore_intr(&cp->lock, &iflags);
+
+	return rc;
+}
+
+/**
+   ページ移動関数を登録する
+   @param[in] usage  ページ利用用途
+   @param[in] fn     ページ移動関数 (NULLの場合は登録を抹消する)
+   @retval    0      正常終了
+   @retval   -EINVAL 移動できない利用用途を指定した
+ */
+int
+pfdb_register_migrate_handler(page_usage usage, pfdb_migrate_fn fn){
+	int               rc;
+	intrflags     iflags;
+
+	rc = 0;
+	spinlock_lock_disable_intr(&g_pfdb.compact.lock, &iflags);
+	if ( usage == PAGE_USAGE_ANON )
+		g_pfdb.compact.migrate_anon = fn;    /* 無名ページの移動関数を登録     */
+	else if ( usage == PAGE_USAGE_PCACHE )
+		g_pfdb.compact.migrate_pcache = fn;  /* ページキャッシュの移動関数を登録 */
+	else
+		rc = -EINVAL;  /* 移動できない利用用途 */
+	spinlock_unlock_restore_intr(&g_pfdb.compact.lock, &iflags);
+
+	return rc;
+}
+
+/**
+   ページを同じメモリ領域内の他のページに移動する
+   @param[in] pf     移動元ページのページフレーム情報
+   @retval    0      正常終了
+   @retval   -ENOENT 解放済みのページを指定した
+   @retval   -EBUSY  移動できないページだった
+   @retval   -ENOMEM 移動先ページを獲得できなかった
+ */
+int
+pfdb_migrate_page(page_frame *pf){
+	int rc;
+
+	if ( !pfdb_inc_page_use_count(pf) )
+		return -ENOENT;  /* 解放済みのページ */
+
+	rc = migrate_page_common(pf, 0, 0, NULL);
+
+	pfdb_dec_page_use_count(pf);  /* 移動元ページへの参照を解放する */
+
+	return rc;
+}
+
+/**
+   ページを移動して指定されたオーダの空きページを確保する
+   @param[in] order  確保するページオーダ
+   @retval    0      正常終了
+   @retval   -EINVAL 不正なページオーダを指定した
+   @retval   -EBUSY  他のCPUがメモリコンパクションを実行中
+   @retval   -ENOMEM 空きページを確保できなかった
+   @note ページの移動は待ち合わせを行わずに実施するため, 
+   アイドルスレッドからも呼び出し可能である
+ */
+int
+pfdb_compact_memory(page_order order){
+	int                rc;
+	int              best;
+	int           movable;
+	obj_cnt_type        i;
+	obj_cnt_type      idx;
+	obj_cnt_type     size;
+	pfdb_ent         *ent;
+	page_buddy      *pool;
+	page_frame        *pf;
+	queue            hold;
+	page_order_mask  mask;
+	intrflags   db_iflags;
+	intrflags pool_iflags;
+
+	if ( ( order == 0 ) || ( order >= PAGE_POOL_MAX_ORDER ) )
+		return -EINVAL;  /* 不正なページオーダ */
+
+	spinlock_lock_disable_intr(&g_pfdb.compact.lock, &db_iflags);
+	if ( g_pfdb.compact.running ) {
+
+		spinlock_unlock_restore_intr(&g_pfdb.compact.lock, &db_iflags);
+		return -EBUSY;  /* 他のCPUが実行中 */
+	}
+	g_pfdb.compact.running = true;
+	++g_pfdb.compact.runs;  /* 実行回数を更新 */
+	spinlock_unlock_restore_intr(&g_pfdb.compact.lock, &db_iflags);
+
+	/* キャッシュ中のページをバディプールに返却して結合させる */
+	pfdb_pcp_drain_all();
+	pfdb_zero_pool_drain();
+	pfdb_color_pool_drain();
+
+	/*
+	 * 移動するページ数が最小のブロックを選択する
+	 */
+	mask = ~( (page_order_mask)0 ) << order;  /* 要求オーダ以上の空きページ */
+	best = PFDB_COMPACT_MAX_MIGRATE + 1;
+	pool = NULL;
+	idx = 0;
+	spinlock_lock_disable_intr(&g_pfdb.lock, &db_iflags);
+	RB_FOREACH(ent, _pfdb_tree, &g_pfdb.dbroot) {
+
+		spinlock_lock_disable_intr(&ent->page_pool.lock, &pool_iflags);
+		if ( ent->page_pool.order_mask & mask )
+			movable = 0;  /* 空きページがある */
+		else
+			movable = select_compact_block_nolock(&ent->page_pool, order, 
+			    best, &i);
+		spinlock_unlock_restore_intr(&ent->page_pool.lock, &pool_iflags);
+
+		if ( ( movable >= 0 ) && ( best > movable ) ) {
+
+			best = movable;
+			pool = &ent->page_pool;
+			idx = i;
+		}
+		if ( best == 0 )
+			break;  /* 移動不要 */
+	}
+	spinlock_unlock_restore_intr(&g_pfdb.lock, &db_iflags);
+
+	if ( pool == NULL ) {
+
+		rc = -ENOMEM;  /* 移動可能なブロックがない */
+		goto out;
+	}
+
+	/*
+	 * ブロック内の使用中ページをブロック外に移動する
+	 */
+	queue_init(&hold);
+	size = ULONG_C(1) << order;
+	for(i = 0, rc = 0; ( best > 0 ) && ( size > i ); ++i) {
+
+		pf = &pool->array[idx + i];
+		if ( !pfdb_inc_page_use_count(pf) )
+			continue;  /* 空きページ */
+
+		rc = migrate_page_common(pf, idx, idx + size, &hold);
+
+		pfdb_dec_page_use_count(pf);  /* 移動元ページへの参照を解放する */
+		if ( rc != 0 )
+			break;
+	}
+	release_held_pages(&hold);  /* 保留したページを返却する */
+	pfdb_pcp_drain_all();  /* 移動元ページをバディプールに返却して結合させる */
+
+	spinlock_lock_disable_intr(&pool->lock, &pool_iflags);
+	rc = ( pool->order_mask & mask ) ? ( 0 ) : ( -ENOMEM );
+	spinlock_unlock_restore_intr(&pool->lock, &pool_iflags);
+
+out:
+	spinlock_lock_disable_intr(&g_pfdb.compact.lock, &db_iflags);
+	if ( rc == 0 )
+		++g_pfdb.compact.success;  /* 確保できた回数を更新 */
+	else
+		++g_pfdb.compact.fails;    /* 確保できなかった回数を更新 */
+	g_pfdb.compact.running = false;
+	spinlock_unlock_restore_intr(&g_pfdb.compact.lock, &db_iflags);
+
+	return rc;
+}
+
+/**
+   バックグラウンドでのメモリコンパクションを要求する
+   @param[in] order  確保するページオーダ
+   @note 待ち合わせできない高次オーダのページ獲得に失敗した場合に呼び出す
+ */
+void
+pfdb_compact_request(page_order order){
+	intrflags iflags;
+
+	if ( ( order == 0 ) || ( order >= PAGE_POOL_MAX_ORDER ) )
+		return;
+
+	spinlock_lock_disable_intr(&g_pfdb.compact.lock, &iflags);
+	if ( order > g_pfdb.compact.bg_order )
+		g_pfdb.compact.bg_order = order;  /* 最も高いオーダを記録する */
+	spinlock_unlock_restore_intr(&g_pfdb.compact.lock, &iflags);
+}
+
+/**
+   要求されたメモリコンパクションをバックグラウンドで実行する
+   @retval 真 メモリコンパクションを実行した
+   @retval 偽 メモリコンパクションの要求がなかった
+   @note アイドルスレッドから割込み許可状態で呼び出す
+ */
+bool
+pfdb_compact_background(void){
+	page_order  order;
+	intrflags  iflags;
+
+	spinlock_lock_disable_intr(&g_pfdb.compact.lock, &iflags);
+	order = g_pfdb.compact.bg_order;
+	g_pfdb.compact.bg_order = 0;  /* 要求を受け付けた */
+	if ( order > 0 )
+		++g_pfdb.compact.bg_runs;  /* バックグラウンドでの実行回数を更新 */
+	spinlock_unlock_restore_intr(&g_pfdb.compact.lock, &iflags);
+
+	if ( order == 0 )
+		return false;  /* 要求なし */
+
+	if ( pfdb_compact_memory(order) == -EBUSY )
+		pfdb_compact_request(order);  /* 実行中だったため再要求する */
+
+	return true;
+}
+
+/**
+   空きページ数の水位を参照する
+   @return 最後に算出した空きページ数の水位
+   @note ロックを獲得せずに参照するため, 最新の水位を得る場合は
+   pfdb_watermark_updateを呼び出す
+ */
+int
+pfdb_watermark_level(void){
+
+	return g_pfdb.wmark_level;
+}
+
+/**
+   空きページ数の水位を更新する
+   @return 空きページ数の水位
+ */
+int
+pfdb_watermark_update(void){
+	int        level;
 	intrflags iflags;
 
-	/*
-	 * ページフレームDBの全エントリを走査し, 空きページの獲得を試みる
-	 */
 	spinlock_lock_disable_intr(&g_pfdb.lock, &iflags);
-	RB_FOREACH(ent, _pfdb_tree, &g_pfdb.dbroot) {
+	level = update_wmark_level_nolock();
+	spinlock_unlock_restore_intr(&g_pfdb.lock, &iflags);
 
-		/* 空きページの獲得を試みる
-		 */
-		rc = dequeue_page_from_memory_area(ent, order, usage, &pfn);
-		if ( rc == 0 ) 
-			*pfnp = pfn;  /*  ページが獲得できたらページフレーム番号を返却  */
+	return level;
+}
 
-		/*  エントリ内にメモリがない場合は, 次のエントリから獲得を試み,
-		 *  メモリ不足以外のエラーがあった場合は, 即時に復帰する
-		 */
-		if ( rc != -ENOMEM )
-			goto unlock_out;  
-	}
+/**
+   ページ回収要求を確認し, 要求を取り下げる
+   @retval 真 ページ回収が要求されていた
+   @retval 偽 ページ回収が要求されていない
+ */
+bool
+pfdb_reclaim_pending_test_and_clear(void){
+	bool     pending;
+	intrflags iflags;
 
-	rc = -ENOMEM;  /*  メモリ不足によるメモリ獲得失敗  */
+	if ( !g_pfdb.reclaim_pending )
+		return false;  /* 要求がない */
 
-unlock_out:
+	spinlock_lock_disable_intr(&g_pfdb.lock, &iflags);
+	pending = g_pfdb.reclaim_pending;
+	g_pfdb.reclaim_pending = false;
 	spinlock_unlock_restore_intr(&g_pfdb.lock, &iflags);
-	return rc;
+
+	return pending;
 }
 
 /**
-   ページフレームDBのエントリを初期化する
-   @param[in]  phys_start 連続した物理メモリ領域の開始物理アドレス
-   @param[in]  length     連続した物理メモリ領域のサイズ
-   @param[out] pfdbp      ページフレームDBエントリの返却領域
+   連続メモリ領域を設定する
+   @param[in] nr  連続メモリ領域のページ数
+   @retval    0      正常終了
+   @retval   -EINVAL ページ数に0を指定した
+   @retval   -EEXIST 連続メモリ領域が設定済み
+   @retval   -ENOMEM 連続した空きページがない
+   @note 一つのページフレームDBエントリ内の連続した空きページを
+   バディプールから切り離して連続メモリ領域とする
  */
-void
-pfdb_add(uintptr_t phys_start, size_t length, pfdb_ent **pfdbp){
-	pfdb_ent     *pfdb;
-	pfdb_ent      *res;
-	obj_cnt_type     i;
-	void        *kaddr;
-	void *kvaddr_start;
-	int            idx;
-	page_buddy   *pool;
-	page_frame    *pgf;
-	size_t       total;
-	intrflags   iflags;
+int
+pfdb_cma_init(obj_cnt_type nr){
+	int                rc;
+	obj_cnt_type      sta;
+	pfdb_ent         *ent;
+	page_buddy      *pool;
+	intrflags   db_iflags;
+	intrflags pool_iflags;
 
-	/*  領域先頭の物理メモリに対応するカーネルストレートマップ領域アドレスを得る  */
-	hal_phys_to_kvaddr((void *)phys_start, &kvaddr_start);
+	if ( nr == 0 )
+		return -EINVAL;  /* ページ数が不正 */
 
-	/*  領域の末尾にページフレームDBエントリを配置する  */
-	pfdb = (pfdb_ent *)( (uintptr_t)kvaddr_start + length - sizeof(pfdb_ent));
+	/* キャッシュ中のページをバディプールに返却して結合させる */
+	pfdb_pcp_drain_all();
+	pfdb_zero_pool_drain();
+	pfdb_color_pool_drain();
 
-	/*
-	 * メンバ初期化
-	 */
-	RB_ENT_INIT(pfdb, ent);  /*< 赤黒木のエントリを初期化する  */
-	pfdb->kvaddr = kvaddr_start;  /*< カーネル仮想アドレスでの開始アドレスを設定 */
-	pfdb->length = length; /*< 登録する物理メモリ領域の長さ(単位:バイト)を設定  */
+	spinlock_lock_disable_intr(&g_pfdb.lock, &db_iflags);
 
-	/*  領域中の最小/最大ページフレーム番号を算出する  */
-	hal_kvaddr_to_pfn(pfdb->kvaddr, &pfdb->min_pfn);
-	hal_kvaddr_to_pfn((void *)PAGE_ROUNDUP(pfdb->kvaddr + pfdb->length - 1),
-			  &pfdb->max_pfn);
-	/*
-	 * buddy poolを初期化する
-	 */
-	pool = &pfdb->page_pool;
-	spinlock_init(&pool->lock);
+	if ( g_pfdb.cma.ent != NULL ) {
 
-	pool->nr_pages = pfdb->max_pfn - pfdb->min_pfn;  /*  領域中のページ数  */
+		rc = -EEXIST;  /* 設定済み */
+		goto unlock_out;
+	}
 
-	/* ページフレーム配列の開始アドレスを算出する
-	 * (page/page-pfdb.h参照)
-	 */
-	pool->array = (void *)(pfdb) - (pool->nr_pages * sizeof(page_frame));
-	pool->pfdb_ent = pfdb;  /* ページフレームDBエントリへの逆リンクを設定 */
+	rc = -ENOMEM;
+	RB_FOREACH(ent, _pfdb_tree, &g_pfdb.dbroot) {
 
-	/* buddy管理情報を初期化
-	 */
-	for(idx = 0; PAGE_POOL_MAX_ORDER > idx; ++idx) {
+		pool = &ent->page_pool;  /*  ページプール情報を参照  */
 
-		pool->free_nr[idx] = 0;
-		queue_init(&pool->page_list[idx]);
+		spinlock_lock_disable_intr(&pool->lock, &pool_iflags);
+		rc = find_cma_range_nolock(pool, nr, &sta);
+		if ( rc == 0 )
+			setup_cma_nolock(ent, sta, nr);
+		spinlock_unlock_restore_intr(&pool->lock, &pool_iflags);
+
+		if ( rc == 0 )
+			break;  /* 連続メモリ領域を設定した */
 	}
 
-	/*
-	 * ページフレーム配列初期化
-	 */
-	for(i = 0; pool->nr_pages > i; ++i) {
+	if ( rc == 0 )
+		update_wmark_level_nolock();  /* 空きページ数の水位を更新する */
 
-		pgf = &pool->array[i];
-		/*
-		 * ページフレーム情報の各要素を初期化
-		 */
-		spinlock_init(&pgf->lock);     /* ロックを初期化                  */
-		list_init(&pgf->link);         /* ページキューへのリンクを初期化  */
-		PAGE_MARK_RESERVED(pgf);       /* ページフレームを予約            */
-		pgf->arch_state = 0;           /* アーキ依存ページ状態を初期化    */
-		pgf->pfn = pfdb->min_pfn + i;  /* 最小ページ番号を初期化          */
-		refcnt_init_with_value(&pgf->usecnt, 0);  /* 利用カウント初期化   */
-		refcnt_init_with_value(&pgf->mapcnt, 0);  /* マップカウント初期化 */
-		pgf->order = 0;                           /* ページオーダ初期化   */
-		queue_init(&pgf->pv_head);  /* 物理->仮想アドレス変換キュー初期化 */
-		pgf->buddyp = pool;         /* ページプールを設定                 */
-		pgf->headp = NULL;          /* ページクラスタ情報初期化           */
-		list_init(&pgf->lru_ent);   /* LRUエントリの初期化                */
-		pgf->slabp = NULL;          /* SLABアドレスを初期化               */
-		pgf->pcachep = NULL;        /* ページキャッシュアドレスを初期化   */
-	}
+unlock_out:
+	spinlock_unlock_restore_intr(&g_pfdb.lock, &db_iflags);
 
-	/*
-	 * page frame dbに登録
-	 */
-	spinlock_lock_disable_intr(&g_pfdb.lock, &iflags);
-	res = RB_INSERT(_pfdb_tree, &g_pfdb.dbroot, pfdb);
-	spinlock_unlock_restore_intr(&g_pfdb.lock, &iflags);
-	kassert( res == NULL );
+	return rc;
+}
 
-	/* 利用可能なページをbuddy poolに返却する
-	 */
-	pool->available_pages = 0;  /*  利用可能ページ数を初期化  */
-	for(i = 0; pool->nr_pages > i; ++i) {
+/**
+   連続メモリ領域から物理的に連続したページを獲得する
+   @param[in]  nr      獲得するページ数
+   @param[in]  align   開始ページフレーム番号の境界 (単位:ページ, 0の場合は境界を問わない)
+   @param[in]  usage   ページ利用用途
+   @param[out] kvaddrp 獲得した領域のカーネル仮想アドレス返却領域
+   @retval     0       正常終了
+   @retval    -EINVAL  ページ数に0を指定したか, 境界が2のべき乗でない
+   @retval    -ENODEV  連続メモリ領域が設定されていない
+   @retval    -EBUSY   他のスレッドが獲得処理中
+   @retval    -ENOMEM  連続した空きページを確保できなかった
+   @note 貸し出し中のページは領域外に移動して回収する. ページの移動は
+   待ち合わせを行わずに実施する
+   @note 獲得したページはクリアしない
+ */
+int
+pfdb_cma_alloc(obj_cnt_type nr, obj_cnt_type align, page_usage usage, void **kvaddrp){
+	int                rc;
+	obj_cnt_type      sta;
+	obj_cnt_type      end;
+	obj_cnt_type      pfn;
+	pfdb_cma         *cma;
+	intrflags      iflags;
 
-		/*  ページフレーム配列やページフレームDBエントリを
-		 *  配置した領域のページは予約したままとする
-		 */
-		/*  ページに対応したカーネルストレートマップ領域のアドレスを算出する  */
-		hal_pfn_to_kvaddr(pfdb->min_pfn + i, &kaddr);
+	if ( align == 0 )
+		align = 1;  /* 境界を問わない */
 
-		/*  ページフレーム配列を含むページの先頭から
-		 *  ページフレームDBエントリを含むページの末尾
-		 *  (ページフレームDBエントリ配置ページの次のページの先頭アドレス)
-		 *  までの範囲に算出したアドレスが含まれている場合は,
-		 *  予約を解除しない
-		 */
-		if ( ( (void *)PAGE_TRUNCATE(&pool->array[0]) <= kaddr ) &&
-		    ( kaddr <  (void *)PAGE_ROUNDUP(pfdb->kvaddr + pfdb->length - 1) ) ) 
-			continue;
+	if ( ( nr == 0 ) || ( align & ( align - 1 ) ) )
+		return -EINVAL;  /* 不正なページ数か境界 */
 
-		/*
-		 * ページフレーム配列以前のページの場合は, 予約を解除し,
-		 * バディページキューに格納
-		 */
-		PAGE_UNMARK_RESERVED(&pool->array[i]);  /*  予約解除  */
-		spinlock_lock_disable_intr(&pool->lock, &iflags);
-		enqueue_page_to_buddy_pool(pool, &pool->array[i]); /* ページをキューに追加 */
-		++pool->available_pages;  /*  利用可能ページ数を加算  */
-		spinlock_unlock_restore_intr(&pool->lock, &iflags);
+	cma = &g_pfdb.cma;
+
+	spinlock_lock_disable_intr(&cma->lock, &iflags);
+
+	if ( cma->ent == NULL ) {
+
+		rc = -ENODEV;  /* 連続メモリ領域が設定されていない */
+		goto unlock_out;
 	}
 
-	/*
-	 * 初期化の検証
-	 */
-	total = 0;
-	for(idx = 0; PAGE_POOL_MAX_ORDER > idx; ++idx) {
+	if ( cma->busy ) {
 
-		/*  buddyプール内の総容量を算出  */
-		total += pool->free_nr[idx] * (PAGE_SIZE << idx);
+		rc = -EBUSY;  /* 他のスレッドが獲得処理中 */
+		goto unlock_out;
 	}
+	cma->busy = true;
 
-	/*  buddyプール内の総容量 + ページフレーム配列+ページフレームDBエントリの領域長が
-	 *  登録された物理メモリ領域と等しいことを確認する
+	/*
+	 * 開始ページフレーム番号が境界に揃った範囲を先頭から順に試みる
 	 */
-	kassert( ( total + PAGE_ROUNDUP(pfdb->kvaddr + pfdb->length - 1) -
-		PAGE_TRUNCATE(&pool->array[0]) ) == pfdb->length );
+	pfn = cma->ent->page_pool.array[cma->sta].pfn;
+	sta = cma->sta + ( roundup_align(pfn, align) - pfn );
+	end = cma->sta + cma->nr_pages;
+	for(rc = -ENOMEM; end >= ( sta + nr ); sta += align) {
 
-	*pfdbp = pfdb;  /*  ページフレームDBエントリを返却する  */
+		if ( !cma_range_is_movable_nolock(cma, sta, nr) )
+			continue;  /* 獲得できない範囲 */
 
-	return ;
-}
+		cma_isolate_range_nolock(cma, sta, nr);  /* 空きページを外す */
+		spinlock_unlock_restore_intr(&cma->lock, &iflags);
 
-/**
-   ページフレームDBのエントリの登録を抹消する
-   @param[in] ent   ページフレームDBエントリ
-   @retval  0      正常終了
-   @retval -EBUSY  使用中ページが存在する
-   @retval -ENOENT 指定されたページフレームDBのエントリが登録されていない
- */
-int
-pfdb_remove(pfdb_ent *ent){
-	int               rc;
-	intrflags     iflags;
+		rc = cma_migrate_range(cma, sta, nr);  /* 貸し出し中のページを移動する */
 
-	spinlock_lock_disable_intr(&g_pfdb.lock, &iflags);  /* ページフレームDBのロック獲得 */
+		spinlock_lock_disable_intr(&cma->lock, &iflags);
+		if ( rc == 0 )
+			rc = cma_claim_range_nolock(cma, usage);  /* 範囲内のページを獲得する */
+		if ( rc == 0 )
+			break;  /* 獲得した */
 
-	rc = remove_pfdb_ent_common(ent);  /*  指定されたエントリを解放する  */
+		cma_putback_range_nolock(cma);  /* 空きページを戻す */
+		rc = -ENOMEM;
+	}
 
-	/* ページフレームDBのロック解放 */
-	spinlock_unlock_restore_intr(&g_pfdb.lock, &iflags);
+	if ( rc == 0 )
+		++cma->allocs;  /* 獲得回数を更新 */
+	else
+		++cma->fails;   /* 獲得失敗回数を更新 */
+	cma->busy = false;
+
+	if ( rc == 0 ) {
+
+		rc = hal_pfn_to_kvaddr(cma->ent->page_pool.array[sta].pfn, kvaddrp);
+		kassert( rc == 0 );
+	}
+
+unlock_out:
+	spinlock_unlock_restore_intr(&cma->lock, &iflags);
 
 	return rc;
 }
 
 /**
-   ページフレームDBの全エントリを解放する
+   連続メモリ領域から獲得したページを解放する
+   @param[in] kvaddr 獲得した領域のカーネル仮想アドレス
+   @param[in] nr     獲得したページ数
  */
 void
-pfdb_free(void){
-	pfdb_ent     *nxt;
-	pfdb_ent     *ent;
-	intrflags  iflags;
+pfdb_cma_free(void *kvaddr, obj_cnt_type nr){
+	int            rc;
+	obj_cnt_type    i;
+	page_frame    *pf;
 
-	spinlock_lock_disable_intr(&g_pfdb.lock, &iflags);  /* ページフレームDBのロック獲得 */
+	for(i = 0; nr > i; ++i) {
 
-	/*  ループ内で削除処理を行うのでRB_FOREACH_SAFEを使用  */
-	RB_FOREACH_SAFE(ent, _pfdb_tree, &g_pfdb.dbroot, nxt) { /*  登録済み領域を探査 */
-		
-		remove_pfdb_ent_common(ent);  /*  指定されたエントリを解放する  */
-	}
+		rc = pfdb_kvaddr_to_page_frame((void *)( (uintptr_t)kvaddr + ( i << PAGE_SHIFT ) ),
+		    &pf);
+		kassert( rc == 0 );
+		kassert( PAGE_IS_CMA(pf) && PAGE_IS_CLUSTERED(pf) );
 
-	/* ページフレームDBのロック解放 */
-	spinlock_unlock_restore_intr(&g_pfdb.lock, &iflags);
+		pfdb_dec_page_use_count(pf);  /* 参照を落とし, 連続メモリ領域に返却する */
+	}
 }
 
 /**
@@ -959,6 +3227,14 @@ pfdb_mark_phys_range_reserved(vm_paddr start, vm_paddr end){
 	page_start = PAGE_TRUNCATE(start);
 	page_end = PAGE_ROUNDUP(end);
 
+	/* 予約対象のページがバディプールにつながっているように
+	 * CPU単位ページキャッシュ中, 事前クリア済みページプール中,
+	 * カラー別ページプール中のページを返却する
+	 */
+	pfdb_pcp_drain_all();
+	pfdb_zero_pool_drain();
+	pfdb_color_pool_drain();
+
 	/* 指定されたページをページプールから外して予約する
 	 */
 	for( resv_page = page_start; page_end > resv_page; resv_page += PAGE_SIZE) {
@@ -997,6 +3273,30 @@ pfdb_unmark_phys_range_reserved(vm_paddr start, vm_paddr end){
 	}
 }
 
+/**
+   初期カーネルヒープの未使用ページをページプールに返却する
+   @return 返却したページ数
+   @note 初期カーネルヒープの末尾の空き領域をヒープに返却させた後, ヒープを
+   使用中の領域までに縮め, 切り離した領域の予約を解除してバディプールに返却する
+   @note カーネルの初期化完了後に呼び出す. 呼び出し後は初期カーネルヒープを伸長しない
+ */
+obj_cnt_type
+pfdb_release_early_heap(void){
+	vm_size      size;
+	vm_paddr    start;
+	vm_paddr      end;
+
+	dlmalloc_trim(0);  /*  末尾の空き領域を初期カーネルヒープに返却する  */
+
+	size = ekheap_retire(&start, &end);  /*  未使用領域を切り離す  */
+	if ( size == 0 )
+		return 0;  /*  返却可能な領域がない  */
+
+	pfdb_unmark_phys_range_reserved(start, end);  /*  ページプールに返却する  */
+
+	return size >> PAGE_SHIFT;
+}
+
 /**
    ストレートマップ領域アドレスに対応する物理アドレスを返却する
    @param[in]  kvaddr  ストレートマップ領域アドレス
@@ -1256,17 +3556,68 @@ pfdb_dec_page_use_count(page_frame *pf){
 		/* マップされていないことを確認 */
 		kassert( pfdb_ref_page_map_count(pf) == 0 ); 
 
-		/* LRUにつながっていないことを確認 */
-		list_not_linked(&pf->lru_ent);
+		/* ページキャッシュの場合はLRUにつながっていないことを確認 */
+		kassert( !PAGE_USED_BY_PCACHE(pf) || list_not_linked(&pf->lru_ent) );
+
+		/* 連続メモリ領域のページは連続メモリ領域に返却する */
+		if ( PAGE_IS_CMA(pf) ) {
+
+			enqueue_page_to_cma(pf);
+			goto free_out;
+		}
+
+		/* オーダ0のページはCPU単位ページキャッシュに返却する */
+		if ( ( pf->order == 0 ) && ( enqueue_page_to_pcp(pf) == 0 ) )
+			goto free_out;
 
 		spinlock_lock_disable_intr(&pf->buddyp->lock, &iflags);
 		enqueue_page_to_buddy_pool(pf->buddyp, pf);  /*  ページを解放する  */
 		spinlock_unlock_restore_intr(&pf->buddyp->lock, &iflags);
 	}
 
+free_out:
 	return rc;
 }
 
+/**
+   ページフレーム情報のロックを獲得する
+   @param[in] pf ページフレーム情報
+   @note ページ状態中のビットロックを使用する
+ */
+void
+pfdb_page_lock(page_frame *pf){
+
+	while( !pfdb_page_trylock(pf) ) 
+		while( atomic_read(PAGE_STATE_ATOMIC(pf)) & PAGE_STATE_LOCKED )
+			;  /* ロックが解放されるまで待ち合わせる */
+}
+
+/**
+   ページフレーム情報のロックの獲得を試みる
+   @param[in] pf ページフレーム情報
+   @retval 真 ロックを獲得した
+   @retval 偽 他のスレッドがロックを獲得している
+ */
+bool
+pfdb_page_trylock(page_frame *pf){
+	atomic_val old;
+
+	old = atomic_or_fetch(PAGE_STATE_ATOMIC(pf), PAGE_STATE_LOCKED);
+
+	return ( ( old & PAGE_STATE_LOCKED ) == 0 );  /* 獲得前にロックされていなかった */
+}
+
+/**
+   ページフレーム情報のロックを解放する
+   @param[in] pf ページフレーム情報
+ */
+void
+pfdb_page_unlock(page_frame *pf){
+
+	kassert( PAGE_IS_LOCKED(pf) );
+	atomic_and_fetch(PAGE_STATE_ATOMIC(pf), ~PAGE_STATE_LOCKED);
+}
+
 /**
    指定されたページフレーム番号に対応するページが存在することを確認する
    @param[in]  pfn   ページフレーム番号
@@ -1291,13 +3642,85 @@ kcom_is_pfn_valid (obj_cnt_type pfn){
  */
 void
 kcom_obtain_pfdb_stat(pfdb_stat *statp){
-	int          order;
-	pfdb_ent      *ent;
-	page_buddy   *pool;
-	intrflags   iflags;
+	int            order;
+	cpu_id           cpu;
+	pfdb_ent        *ent;
+	page_buddy     *pool;
+	pfdb_pcp        *pcp;
+	pfdb_zero_pool   *zp;
+	intrflags     iflags;
 
 	memset(statp, 0 , sizeof(pfdb_stat));
 
+	/*
+	 * CPU単位ページキャッシュの情報を取得
+	 * @note ロック順序を守るためページフレームDBのロック獲得前に参照する
+	 */
+	statp->pcp_high = PFDB_PCP_HIGH;
+	statp->pcp_low = PFDB_PCP_LOW;
+	statp->pcp_batch = PFDB_PCP_BATCH;
+	for(cpu = 0; ( g_pfdb.pcp_enabled ) && ( KC_CPUS_NR > cpu ); ++cpu) {
+
+		pcp = &g_pfdb.pcp[cpu];
+		spinlock_lock_disable_intr(&pcp->lock, &iflags);
+		statp->pcp_pages += pcp->count;
+		statp->pcp_hits += pcp->hits;
+		statp->pcp_refills += pcp->refills;
+		statp->pcp_drains += pcp->drains;
+		spinlock_unlock_restore_intr(&pcp->lock, &iflags);
+	}
+
+	/*
+	 * 事前クリア済みページプールの情報を取得
+	 */
+	zp = &g_pfdb.zero_pool;
+	spinlock_lock_disable_intr(&zp->lock, &iflags);
+	statp->zero_pages = zp->count;
+	statp->zero_high = zp->high;
+	statp->zero_hits = zp->hits;
+	statp->zero_misses = zp->misses;
+	statp->zero_fills = zp->fills;
+	spinlock_unlock_restore_intr(&zp->lock, &iflags);
+
+	/*
+	 * カラー別ページプールの情報を取得
+	 */
+	spinlock_lock_disable_intr(&g_pfdb.color_pool.lock, &iflags);
+	statp->color_pages = g_pfdb.color_pool.count;
+	statp->color_hits = g_pfdb.color_pool.hits;
+	statp->color_misses = g_pfdb.color_pool.misses;
+	statp->color_refills = g_pfdb.color_pool.refills;
+	spinlock_unlock_restore_intr(&g_pfdb.color_pool.lock, &iflags);
+
+	/*
+	 * 連続メモリ領域の情報を取得
+	 */
+	spinlock_lock_disable_intr(&g_pfdb.cma.lock, &iflags);
+	statp->cma_pages = g_pfdb.cma.nr_pages;
+	statp->cma_free = g_pfdb.cma.free_nr;
+	statp->cma_lent = g_pfdb.cma.lent;
+	statp->cma_allocated = g_pfdb.cma.allocated;
+	statp->cma_allocs = g_pfdb.cma.allocs;
+	statp->cma_fails = g_pfdb.cma.fails;
+	statp->cma_lends = g_pfdb.cma.lends;
+	spinlock_unlock_restore_intr(&g_pfdb.cma.lock, &iflags);
+
+	/*  キャッシュ中のページと連続メモリ領域の空きページは空きページに含める */
+	statp->nr_free_pages = statp->pcp_pages + statp->zero_pages + statp->color_pages
+	    + statp->cma_free;
+
+	/*
+	 * メモリコンパクションの統計情報を取得
+	 */
+	spinlock_lock_disable_intr(&g_pfdb.compact.lock, &iflags);
+	statp->compact_runs = g_pfdb.compact.runs;
+	statp->compact_success = g_pfdb.compact.success;
+	statp->compact_fails = g_pfdb.compact.fails;
+	statp->compact_bg_runs = g_pfdb.compact.bg_runs;
+	statp->migrated_pages = g_pfdb.compact.migrated;
+	statp->migrate_fails = g_pfdb.compact.migrate_fails;
+	spinlock_unlock_restore_intr(&g_pfdb.compact.lock, &iflags);
+
 	spinlock_lock_disable_intr(&g_pfdb.lock, &iflags);
 
 	RB_FOREACH(ent, _pfdb_tree, &g_pfdb.dbroot) {  /*  各物理メモリ領域を探査 */
@@ -1311,12 +3734,12 @@ kcom_obtain_pfdb_stat(pfdb_stat *statp){
 		/*
 		 * ページ利用用途数を取得
 		 */
-		statp->kdata_pages += pool->kdata_pages;
-		statp->kstack_pages += pool->kstack_pages;
-		statp->pgtbl_pages += pool->pgtbl_pages;
-		statp->slab_pages += pool->slab_pages;
-		statp->anon_pages += pool->anon_pages;
-		statp->pcache_pages += pool->pcache_pages;
+		statp->kdata_pages += statcnt_read(&pool->kdata_pages);
+		statp->kstack_pages += statcnt_read(&pool->kstack_pages);
+		statp->pgtbl_pages += statcnt_read(&pool->pgtbl_pages);
+		statp->slab_pages += statcnt_read(&pool->slab_pages);
+		statp->anon_pages += statcnt_read(&pool->anon_pages);
+		statp->pcache_pages += statcnt_read(&pool->pcache_pages);
 
 		/*
 		 * オーダ別空きページ情報を取得
@@ -1328,7 +3751,17 @@ kcom_obtain_pfdb_stat(pfdb_stat *statp){
 			/*  オーダ単位での空きページ数を加算  */
 			statp->free_nr[order] += pool->free_nr[order];	
 		}
+		/*  空きページがあるオーダを記録  */
+		statp->free_order_mask |= pool->order_mask;
+
+		/*
+		 * 空きページ数の水位を取得
+		 */
+		statp->wmark_min += ent->wmark.min;
+		statp->wmark_low += ent->wmark.low;
+		statp->wmark_high += ent->wmark.high;
 	}
+	statp->wmark_level = g_pfdb.wmark_level;
 
 	spinlock_unlock_restore_intr(&g_pfdb.lock, &iflags);
 }
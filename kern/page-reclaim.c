@@ -0,0 +1,324 @@
+/* -*- mode: C; coding:utf-8 -*- */
+/**********************************************************************/
+/*  OS kernel sample                                                  */
+/*  Copyright 2019 Takeharu KATO                                      */
+/*                                                                    */
+/*  Page reclaim                                                      */
+/*                                                                    */
+/**********************************************************************/
+
+#include <klib/freestanding.h>
+#include <kern/kern-common.h>
+#include <kern/spinlock.h>
+#include <kern/wqueue.h>
+#include <kern/mutex.h>
+#include <kern/page-if.h>
+#include <kern/thr-if.h>
+#include <kern/sched-if.h>
+#include <kern/dev-pcache.h>
+#include <kern/timer.h>
+
+static pgif_reclaim g_reclaim;  /**< ページ回収管理情報 */
+
+/**
+   登録されている縮小処理を呼び出す (内部関数)
+   @param[in] nr     空きページ不足時に1つの縮小処理で回収を試みるオブジェクト数
+   @param[in] reason 縮小処理の契機 (PGIF_SHRINK_PRESSURE, PGIF_SHRINK_PERIODIC)
+   @return 解放したページ数
+   @note 空きページ不足時は各縮小処理にnr個までの回収を, 定期回収時は
+   回収可能な全オブジェクトを対象とした回収を依頼する.
+   定期回収時にどのオブジェクトを回収するかは各縮小処理が判断する
+   @note 回収処理排他用mutexを獲得して呼び出す
+ */
+static obj_cnt_type
+reclaim_pages_common(obj_cnt_type nr, int reason){
+	obj_cnt_type   free_nr;
+	obj_cnt_type       cnt;
+	obj_cnt_type     freed;
+	pgif_shrinker     *shr;
+	struct _list       *lp;
+
+	kassert( mutex_locked_by_self(&g_reclaim.mtx) );
+
+	free_nr = 0;
+	queue_for_each(lp, &g_reclaim.shrinkers) {
+
+		shr = container_of(lp, pgif_shrinker, link);
+
+		cnt = shr->count(shr->private);  /* 回収可能なオブジェクト数を得る */
+		if ( cnt == 0 )
+			continue;  /* 回収可能なオブジェクトがない */
+
+		if ( reason == PGIF_SHRINK_PRESSURE )
+			cnt = MIN(cnt, nr);
+
+		freed = shr->scan(cnt, reason, shr->private);  /* 回収する */
+		++shr->runs;           /* 呼び出し回数を更新 */
+		shr->freed += freed;   /* 解放したページ数を更新 */
+		free_nr += freed;
+	}
+
+	/* 解放したページをバディプールに返却して空きページ数に反映する */
+	pfdb_pcp_drain_all();
+	pfdb_zero_pool_drain();
+	pfdb_color_pool_drain();
+
+	return free_nr;
+}
+
+/**
+   ページ回収の統計情報を更新する (内部関数)
+   @param[in] direct  直接回収の場合は真
+   @param[in] free_nr 回収したページ数
+ */
+static void
+update_reclaim_stat(bool direct, obj_cnt_type free_nr){
+	intrflags iflags;
+
+	spinlock_lock_disable_intr(&g_reclaim.lock, &iflags);
+	if ( direct )
+		++g_reclaim.direct_runs;  /* 直接回収の実行回数を更新 */
+	else
+		++g_reclaim.bg_runs;      /* 回収スレッドでの実行回数を更新 */
+	g_reclaim.reclaimed += free_nr;  /* 回収したページ数を更新 */
+	spinlock_unlock_restore_intr(&g_reclaim.lock, &iflags);
+}
+
+/**
+   定期回収を実行する (内部関数)
+   @return 解放したページ数
+   @note 回収処理排他用mutexを獲得して呼び出す
+ */
+static obj_cnt_type
+reclaim_periodic_nolock(void){
+	obj_cnt_type free_nr;
+	intrflags     iflags;
+
+	free_nr = reclaim_pages_common(PGIF_RECLAIM_BATCH, PGIF_SHRINK_PERIODIC);
+
+	spinlock_lock_disable_intr(&g_reclaim.lock, &iflags);
+	++g_reclaim.periodic_runs;       /* 定期回収の実行回数を更新 */
+	g_reclaim.reclaimed += free_nr;  /* 回収したページ数を更新 */
+	spinlock_unlock_restore_intr(&g_reclaim.lock, &iflags);
+
+	return free_nr;
+}
+
+/**
+   ページ回収スレッド (内部関数)
+   @param[in] arg 引数へのポインタ
+   @note 起床後, 定期回収要求があれば定期回収を行い, その後
+   空きページ数が高水位に達するか回収できるページが
+   なくなるまで回収処理を繰り返す
+*/
+static void
+reclaim_thread(void __unused *arg){
+	obj_cnt_type free_nr;
+	bool        periodic;
+	intrflags     iflags;
+
+	for( ; ; ) {
+
+		krn_cpu_save_and_disable_interrupt(&iflags);  /* 割込みを禁止する */
+		spinlock_lock(&g_reclaim.lock);
+
+		/* 起床要求を待ち合わせる */
+		while( ( !g_reclaim.requested ) && ( !g_reclaim.periodic ) )
+			wque_wait_on_queue_with_spinlock(&g_reclaim.wque, &g_reclaim.lock);
+		periodic = g_reclaim.periodic;
+		g_reclaim.requested = false;  /* 起床要求を取り下げる */
+		g_reclaim.periodic = false;   /* 定期回収要求を取り下げる */
+
+		spinlock_unlock(&g_reclaim.lock);
+		krn_cpu_restore_interrupt(&iflags);   /* 割込みを許可する */
+
+		mutex_lock(&g_reclaim.mtx);  /* 回収処理を排他する */
+		if ( periodic )
+			reclaim_periodic_nolock();  /* 定期回収を行う */
+		while( pfdb_watermark_update() != PFDB_WMARK_OK ) {
+
+			free_nr = reclaim_pages_common(PGIF_RECLAIM_BATCH,
+			    PGIF_SHRINK_PRESSURE);
+			update_reclaim_stat(false, free_nr);
+			if ( free_nr == 0 )
+				break;  /* 回収できるページがない */
+		}
+		mutex_unlock(&g_reclaim.mtx);
+	}
+}
+
+/**
+   ページ回収スレッドを起床する
+   @note 初期化前は何もしない
+ */
+void
+pgif_reclaim_wakeup(void){
+	intrflags iflags;
+
+	if ( g_reclaim.thr == NULL )
+		return;  /* 初期化前 */
+
+	spinlock_lock_disable_intr(&g_reclaim.lock, &iflags);
+	if ( !g_reclaim.requested ) {
+
+		g_reclaim.requested = true;  /* 起床を要求する */
+		++g_reclaim.requests;        /* 起床要求回数を更新する */
+		wque_wakeup(&g_reclaim.wque, WQUE_RELEASED);  /* 回収スレッドを起床 */
+	}
+	spinlock_unlock_restore_intr(&g_reclaim.lock, &iflags);
+}
+
+/**
+   ページ獲得処理の延長でページを回収する
+   @retval 真 ページを回収した
+   @retval 偽 ページを回収できなかった
+   @note 休眠可能なコンテキストから呼び出す
+   @note 他のスレッドが回収処理中の場合は回収を行わない
+ */
+bool
+pgif_reclaim_direct(void){
+	obj_cnt_type free_nr;
+
+	if ( g_reclaim.thr == NULL )
+		return false;  /* 初期化前 */
+
+	if ( mutex_try_lock(&g_reclaim.mtx) != 0 )
+		return false;  /* 他のスレッドが回収処理中 */
+
+	free_nr = reclaim_pages_common(PGIF_RECLAIM_BATCH, PGIF_SHRINK_PRESSURE);
+	update_reclaim_stat(true, free_nr);
+	pfdb_watermark_update();  /* 空きページ数の水位を更新する */
+
+	mutex_unlock(&g_reclaim.mtx);
+
+	return ( free_nr > 0 );
+}
+
+/**
+   定期回収を実行する
+   @return 解放したページ数
+   @note 休眠可能なコンテキストから呼び出す
+   @note 通常は定期回収のコールアウトから起床された回収スレッドが実行する
+ */
+obj_cnt_type
+pgif_reclaim_periodic(void){
+	obj_cnt_type free_nr;
+
+	mutex_lock(&g_reclaim.mtx);  /* 回収処理を排他する */
+	free_nr = reclaim_periodic_nolock();
+	mutex_unlock(&g_reclaim.mtx);
+
+	return free_nr;
+}
+
+/**
+   定期回収のコールアウト (内部関数)
+   @param[in] ctx     割込みコンテキスト
+   @param[in] private 未使用
+   @note 回収スレッドに定期回収を要求し, 次回のコールアウトを登録する
+ */
+static void
+reclaim_callout(struct _trap_context __unused *ctx, void __unused *private){
+	int       rc;
+	intrflags iflags;
+
+	spinlock_lock_disable_intr(&g_reclaim.lock, &iflags);
+	if ( !g_reclaim.periodic ) {
+
+		g_reclaim.periodic = true;  /* 定期回収を要求する */
+		wque_wakeup(&g_reclaim.wque, WQUE_RELEASED);  /* 回収スレッドを起床 */
+	}
+	spinlock_unlock_restore_intr(&g_reclaim.lock, &iflags);
+
+	rc = tim_callout_add(PGIF_RECLAIM_PERIOD_MS, reclaim_callout, NULL,
+	    &g_reclaim.callout);
+	if ( rc != 0 )
+		g_reclaim.callout = NULL;  /* 定期回収を停止する */
+}
+
+/**
+   縮小処理を登録する
+   @param[in] shr 縮小処理登録情報 (name, count, scan, privateを設定しておく)
+   @note 休眠可能なコンテキストから呼び出す
+   @note ページ回収機構の初期化後に呼び出す
+ */
+void
+pgif_shrinker_register(pgif_shrinker *shr){
+
+	kassert( ( shr->count != NULL ) && ( shr->scan != NULL ) );
+
+	list_init(&shr->link);
+	shr->runs = 0;
+	shr->freed = 0;
+
+	mutex_lock(&g_reclaim.mtx);  /* 回収処理を排他する */
+	queue_add(&g_reclaim.shrinkers, &shr->link);
+	mutex_unlock(&g_reclaim.mtx);
+}
+
+/**
+   縮小処理の登録を抹消する
+   @param[in] shr 縮小処理登録情報
+   @note 休眠可能なコンテキストから呼び出す
+   @note 抹消後は縮小処理が呼び出されないことを保証する
+ */
+void
+pgif_shrinker_unregister(pgif_shrinker *shr){
+
+	mutex_lock(&g_reclaim.mtx);  /* 実行中の回収処理の完了を待ち合わせる */
+	queue_del(&g_reclaim.shrinkers, &shr->link);
+	mutex_unlock(&g_reclaim.mtx);
+}
+
+/**
+   ページ回収の統計情報を取得する
+   @param[out] statp 統計情報返却領域
+ */
+void
+pgif_reclaim_obtain_stat(pgif_reclaim_stat *statp){
+	intrflags iflags;
+
+	spinlock_lock_disable_intr(&g_reclaim.lock, &iflags);
+	statp->requests = g_reclaim.requests;
+	statp->bg_runs = g_reclaim.bg_runs;
+	statp->direct_runs = g_reclaim.direct_runs;
+	statp->periodic_runs = g_reclaim.periodic_runs;
+	statp->reclaimed = g_reclaim.reclaimed;
+	spinlock_unlock_restore_intr(&g_reclaim.lock, &iflags);
+}
+
+/**
+   ページ回収機構を初期化し, 回収スレッドと定期回収を起動する
+   @note スレッド管理機構, スケジューラ, コールアウト機構の初期化後, 縮小処理を
+   登録するサブシステムの初期化前に呼び出す
+ */
+void
+pgif_reclaim_init(void){
+	int      rc;
+	thread *thr;
+
+	spinlock_init(&g_reclaim.lock);
+	wque_init_wait_queue(&g_reclaim.wque);
+	mutex_init(&g_reclaim.mtx);
+	g_reclaim.requested = false;
+	g_reclaim.periodic = false;
+	queue_init(&g_reclaim.shrinkers);
+	g_reclaim.requests = 0;
+	g_reclaim.bg_runs = 0;
+	g_reclaim.direct_runs = 0;
+	g_reclaim.periodic_runs = 0;
+	g_reclaim.reclaimed = 0;
+
+	/* ページ回収スレッドを生成する */
+	rc = thr_thread_create(THR_TID_AUTO, (entry_addr)reclaim_thread, NULL, NULL,
+	    THR_PRIO_RECLAIM, THR_THRFLAGS_KERNEL, &thr);
+	kassert( rc == 0 );
+
+	g_reclaim.thr = thr;    /* 回収スレッドを登録 */
+	sched_thread_add(thr);  /* 回収スレッドを実行可能にする */
+
+	/* 定期回収のコールアウトを登録する */
+	rc = tim_callout_add(PGIF_RECLAIM_PERIOD_MS, reclaim_callout, NULL,
+	    &g_reclaim.callout);
+	kassert( rc == 0 );
+}
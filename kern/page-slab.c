@@ -12,6 +12,7 @@
 
 #include <kern/page-if.h>
 #include <kern/kern-cpuinfo.h>
+#include <kern/thr-preempt.h>
 
 /**
    キャッシュが使用中であることを確認する
@@ -21,6 +22,14 @@
 #define KMEM_CACHE_IS_BUSY(_cache)  \
 	( !queue_is_empty(&(_cache)->partial) || !queue_is_empty(&(_cache)->full) )
 
+/**
+   オブジェクトを供給するキャッシュを得る
+   @param[in] _cache  カーネルキャッシュ管理情報
+   @note エイリアスの場合は統合先のキャッシュを, それ以外の場合は自身を返す
+ */
+#define KMEM_CACHE_POOL(_cache)  \
+	( ( (_cache)->merged != NULL ) ? ( (_cache)->merged ) : (_cache) )
+
 /**
    管理情報へのポインタを配置するために必要なサイズ
  */
@@ -35,25 +44,131 @@ typedef struct _slab_prealloc_cache_info{
 }slab_prealloc_cache_info;
 
 static kmem_cache prealloc_caches[SLAB_PREALLOC_CACHE_NR];  /** 事前割当て済みキャッシュ  */
+static kmem_cache magazine_cache;   /** マガジンのキャッシュ  */
+static bool magazine_enabled;       /** マガジン層の利用可否  */
+static pgif_shrinker slab_shrinker; /** SLABの縮小処理  */
+/** カーネルメモリキャッシュ管理情報  */
+static kmem_cache_db g_kmem_cache_db = __KMEM_CACHE_DB_INITIALIZER(&g_kmem_cache_db);
+
+/** カーネルメモリキャッシュSPLAY木
+ */
+static int _kmem_cache_cmp(struct _kmem_cache *_key, struct _kmem_cache *_ent);
+SPLAY_GENERATE_STATIC(_kmem_cache_tree, _kmem_cache, node, _kmem_cache_cmp);
+
+/**
+   全キャッシュ縮小処理の引数
+ */
+typedef struct _slab_reap_arg{
+	int          reap_flags;  /** 解放条件  */
+	obj_cnt_type    free_nr;  /** 解放したページ数  */
+}slab_reap_arg;
 
 /**  事前割当て済みキャッシュ初期化情報  */
 static slab_prealloc_cache_info prealloc_caches_info[]={
-	{"kmalloc-8", SLAB_PREALLOC_BASE << 0},
-	{"kmalloc-16", SLAB_PREALLOC_BASE << 1},
-	{"kmalloc-32", SLAB_PREALLOC_BASE << 2},
-	{"kmalloc-64", SLAB_PREALLOC_BASE << 3},
-	{"kmalloc-128", SLAB_PREALLOC_BASE << 4},
-	{"kmalloc-256", SLAB_PREALLOC_BASE << 5},
-	{"kmalloc-512", SLAB_PREALLOC_BASE << 6},
-	{"kmalloc-1024", SLAB_PREALLOC_BASE << 7},
-	{"kmalloc-2048", SLAB_PREALLOC_BASE << 8},
-	{"kmalloc-4096", SLAB_PREALLOC_BASE << 9},
-	{"kmalloc-8192", SLAB_PREALLOC_BASE << 10},
-	{"kmalloc-16384", SLAB_PREALLOC_BASE << 11},
-	{"kmalloc-32768", SLAB_PREALLOC_BASE << 12},
-	{"kmalloc-65536", SLAB_PREALLOC_BASE << 13},
+	{"kmalloc-8", 8},
+	{"kmalloc-16", 16},
+	{"kmalloc-32", 32},
+	{"kmalloc-64", 64},
+	{"kmalloc-96", 96},
+	{"kmalloc-128", 128},
+	{"kmalloc-192", 192},
+	{"kmalloc-256", 256},
+	{"kmalloc-384", 384},
+	{"kmalloc-512", 512},
+	{"kmalloc-1024", 1024},
+	{"kmalloc-2048", 2048},
+	{"kmalloc-4096", 4096},
+	{"kmalloc-8192", 8192},
+	{"kmalloc-16384", 16384},
+	{"kmalloc-32768", 32768},
+	{"kmalloc-65536", 65536},
+};
+
+/**  サイズ区分参照表 ((要求サイズ - 1) >> SLAB_KMALLOC_TABLE_SHIFTでインデクスを引く)  */
+static const uint8_t kmalloc_size_index[SLAB_KMALLOC_TABLE_NR]={
+	0,                              /*   1 -   8 */
+	1,                              /*   9 -  16 */
+	2, 2,                           /*  17 -  32 */
+	3, 3, 3, 3,                     /*  33 -  64 */
+	4, 4, 4, 4,                     /*  65 -  96 */
+	5, 5, 5, 5,                     /*  97 - 128 */
+	6, 6, 6, 6, 6, 6, 6, 6,         /* 129 - 192 */
+	7, 7, 7, 7, 7, 7, 7, 7,         /* 193 - 256 */
+	8, 8, 8, 8, 8, 8, 8, 8,         /* 257 - 384 */
+	8, 8, 8, 8, 8, 8, 8, 8,
+	9, 9, 9, 9, 9, 9, 9, 9,         /* 385 - 512 */
+	9, 9, 9, 9, 9, 9, 9, 9,
 };
 
+/**
+   kmallocのサイズ区分ごとの統計情報
+ */
+typedef struct _slab_kmalloc_class_stat{
+	stat_cnt    allocs;  /** 獲得回数                       */
+	stat_cnt requested;  /** 要求サイズの総和 (単位:バイト) */
+}slab_kmalloc_class_stat;
+
+static slab_kmalloc_class_stat kmalloc_stats[SLAB_PREALLOC_CACHE_NR];  /** kmalloc統計情報 */
+
+/**
+   ページ単位で割り当てたkmalloc領域の統計情報
+ */
+typedef struct _slab_kmalloc_large_stat{
+	stat_cnt    allocs;  /** 獲得回数                       */
+	stat_cnt     pages;  /** 使用中のページ数               */
+}slab_kmalloc_large_stat;
+
+static slab_kmalloc_large_stat kmalloc_large_stat;  /** ページ単位のkmalloc統計情報 */
+
+/**
+   カーネルメモリキャッシュ比較関数 (内部関数)
+   @param[in] key 比較対象のキャッシュ
+   @param[in] ent SPLAY木内の各エントリ
+   @retval 負  keyが entより前にある
+   @retval 正  keyが entより後にある
+   @retval 0   keyが entに等しい
+   @note 名前順に並べ, 同名のキャッシュは管理情報のアドレス順に並べる
+ */
+static int
+_kmem_cache_cmp(struct _kmem_cache *key, struct _kmem_cache *ent){
+	int rc;
+
+	rc = strcmp(key->name, ent->name);
+	if ( rc != 0 )
+		return rc;
+
+	if ( (uintptr_t)key < (uintptr_t)ent )
+		return -1;
+
+	if ( (uintptr_t)key > (uintptr_t)ent )
+		return 1;
+
+	return 0;
+}
+
+/**
+   要求サイズを格納可能な事前割当て済みキャッシュのインデクスを得る (内部関数)
+   @param[in] size 要求サイズ (単位:バイト)
+   @return 事前割当て済みキャッシュのインデクス
+   @retval -ESRCH 事前割当て済みキャッシュの最大サイズを越えている
+ */
+static int
+kmalloc_index(size_t size){
+
+	if ( size == 0 )
+		return 0;  /* 最小のキャッシュから割り当てる */
+
+	if ( SLAB_KMALLOC_SMALL_MAX >= size )  /* 参照表から求める */
+		return kmalloc_size_index[( size - 1 ) >> SLAB_KMALLOC_TABLE_SHIFT];
+
+	if ( size > SLAB_PREALLOC_MAX )
+		return -ESRCH;  /* 最大サイズを越えている */
+
+	/* SLAB_KMALLOC_SMALL_MAXを超えるキャッシュは2のべき乗サイズで並んでいる */
+	return SLAB_KMALLOC_SMALL_INDEX 
+		+ bitops_fls64(size - 1) - SLAB_KMALLOC_SMALL_SHIFT;
+}
+
 /**
    OFF SLABのスラブサイズを算出する (内部関数)
    @param[in] obj_size オブジェクトサイズ
@@ -269,55 +384,114 @@ error_out:
 static void
 init_slab_info(kmem_cache *cache, slab  *sinfo, void *kpage_addr) {
 
-	spinlock_init(&sinfo->lock);  /*  ロックの初期化  */
 	sinfo->cache = cache;         /*  キャッシュ情報へのリンクを設定  */
 	list_init(&sinfo->link);      /*  SLAB情報のリンクを初期化  */
-	slist_init_head(&sinfo->objects); /*  空きオブジェクトのリストを初期化  */
+	/*  空きオブジェクトのリストを初期化  */
+	atomic64_set(&sinfo->objects, SLAB_FREELIST_MAKE(0, NULL));
 	sinfo->count = 0;                 /*  割り当て済みオブジェクト数を初期化  */
 	sinfo->page = kpage_addr;         /*  オブジェクトページへのリンクを設定  */
 }
 
 /**
-   SLABからオブジェクトを割り当てる (内部関数)
-   @param[in]  cache  カーネルメモリキャッシュ
-   @param[in]  sinfo  SLAB管理情報
-   @param[out] objp   獲得したオブジェクトを指し示すポインタ変数のアドレス
+   空きオブジェクトリストにエントリの連鎖を追加する (内部関数)
+   @param[in] sinfo SLAB管理情報
+   @param[in] first 追加する連鎖の先頭エントリ
+   @param[in] last  追加する連鎖の末尾エントリ
+   @note 比較交換命令で先頭情報を更新し, 他のCPUとの競合時は再試行する
+   @note 先頭情報の更新世代を更新することで, 取り出し処理でのABA問題を回避する
  */
 static void
-alloc_slab_obj(kmem_cache *cache, slab *sinfo, void **objp){
-	intrflags       iflags;
+push_freelist(slab *sinfo, struct _slist_node *first, struct _slist_node *last){
+	atomic64_val old;
+
+	old = atomic64_read(&sinfo->objects);
+	do{
+		last->next = SLAB_FREELIST_NODE(old);  /* 連鎖の末尾を現在の先頭につなぐ */
+	}while( !atomic64_try_cmpxchg_fetch(&sinfo->objects, &old,
+		SLAB_FREELIST_MAKE(SLAB_FREELIST_TAG(old) + 1, first)) );
+}
+
+/**
+   空きオブジェクトリストから複数のエントリを取り出す (内部関数)
+   @param[in]  sinfo SLAB管理情報
+   @param[in]  nr    取り出すエントリ数
+   @param[out] nodes 取り出したエントリを返却する配列
+   @note 先頭からnr個のエントリをたどり, 比較交換命令で一括して取り外す
+   @note 呼び出し元はキャッシュロック獲得中にSLABの使用オブジェクト数を加算して
+   nr個のエントリを予約済みである. 解放処理はエントリを返却してから使用オブジェクト数を
+   減算するため, 予約済みのエントリは常に空きオブジェクトリスト中に存在する
+   @note 他のCPUが取り出したエントリのリンクを参照する可能性があるが, SLAB中の
+   バッファ制御情報は予約中のSLABから解放されることはなく, 参照した値は
+   更新世代の比較で破棄される
+ */
+static void
+pop_freelist(slab *sinfo, obj_cnt_type nr, void **nodes){
+	obj_cnt_type          i;
+	atomic64_val        old;
+	struct _slist_node *node;
+
+	kassert( nr > 0 );
+
+	old = atomic64_read(&sinfo->objects);
+	for( ; ; ) {
+
+		/* 先頭からnr個のエントリをたどる */
+		node = SLAB_FREELIST_NODE(old);
+		for(i = 0; ( node != NULL ) && ( nr > i ); ++i) {
+
+			nodes[i] = (void *)node;
+			node = node->next;
+		}
+
+		if ( nr > i ) {
+
+			/* たどっている間に他のCPUがエントリを取り出して連鎖が
+			 * 途切れた場合は, 更新された先頭から再試行する
+			 */
+			old = atomic64_read(&sinfo->objects);
+			continue;
+		}
+
+		/* nr個のエントリを一括して取り外す */
+		if ( atomic64_try_cmpxchg_fetch(&sinfo->objects, &old,
+			SLAB_FREELIST_MAKE(SLAB_FREELIST_TAG(old) + 1, node)) )
+			break;
+	}
+
+	for(i = 0; nr > i; ++i)  /* 取り出したエントリのリンクを外す */
+		((struct _slist_node *)nodes[i])->next = NULL;
+}
+
+/**
+   空きオブジェクトリストのエントリからオブジェクトのアドレスを算出する (内部関数)
+   @param[in]  cache  カーネルメモリキャッシュ
+   @param[in]  node   空きオブジェクトリストから取り外したエントリ
+   @return オブジェクトのアドレス
+ */
+static void *
+bufctl_to_obj(kmem_cache *cache, struct _slist_node *node){
 	void              *ptr;
 	void         *mctl_ptr;
 	kmem_s_bufctl  *s_bctl;
 	kmem_bufctl      *bctl;
 
-	/*
-	 *  空きオブジェクトリストから空きオブジェクトを獲得
-	 */
-
-	/*  空きオブジェクトリストのロックを獲得  */
-	spinlock_lock_disable_intr(&sinfo->lock, &iflags);  
-
 	if ( KMEM_CACHE_IS_ON_SLAB(cache) ) {  
 
 		/* ON SLABの場合は, kmem_s_bufctl分後の領域から
 		 * オブジェクトが配置されている
 		 */
-		s_bctl = container_of(slist_get_top(&sinfo->objects), kmem_s_bufctl, link);
+		s_bctl = container_of(node, kmem_s_bufctl, link);
 		kassert(s_bctl->link.next == NULL);  /*  リンクを外したことを確認  */
 		ptr = (void *)(&s_bctl[1]);  /*  ペイロードへのポインタを取得  */
 	} else {
 
 		/* OFF SLABの場合は, kmem_bufctlからオブジェクトのアドレスを求める
 		 */
-		bctl = container_of(slist_get_top(&sinfo->objects), kmem_bufctl, link);
+		bctl = container_of(node, kmem_bufctl, link);
 		kassert(bctl->link.next == NULL);  /*  リンクを外したことを確認  */
 		ptr = bctl->obj;    /*  ペイロードへのポインタを取得  */
 	}
 
-	/*  空きオブジェクトリストのロックを解放  */
-	spinlock_unlock_restore_intr(&sinfo->lock, &iflags);
-
 	/* アライメントありでの割り当ての場合, バッファ制御情報をペイロードの直前に
 	 * 配置し, オブジェクト解放時にバッファ制御情報を参照可能にする。
 	 */
@@ -343,17 +517,59 @@ alloc_slab_obj(kmem_cache *cache, slab *sinfo, void **objp){
 			*((void **)mctl_ptr) = (void *)bctl;
 	}
 
-	if ( cache->constructor != NULL ) /*  コンストラクタ呼び出し  */
-		cache->constructor(ptr, cache->payload_size);
-
-	*objp = ptr;  /*  オブジェクトのアドレスを返却  */	
-
 	/* ON SLABの場合のオブジェクトサイズを確認  */
 	kassert( ( !KMEM_CACHE_IS_ON_SLAB(cache) ) ||
 	    ( cache->obj_size >= 
 		( (size_t)
 		    ( ( (void *)ptr + cache->payload_size ) - (void *)&s_bctl[0] ) ) ) );
 
+	return ptr;
+}
+
+/**
+   オブジェクトからバッファ制御情報のアドレスを算出する (内部関数)
+   @param[in]  cache  カーネルメモリキャッシュ
+   @param[in]  obj    オブジェクト
+   @return バッファ制御情報のアドレス
+ */
+static void *
+obj_to_bufctl(kmem_cache *cache, void *obj){
+
+	if ( ( cache->align == 0 ) && ( KMEM_CACHE_IS_ON_SLAB(cache) ) ) { 		
+
+		/* アライメントなしで, ON SLABの場合は, バッファ制御情報の直後に
+		 * オブジェクトが配置されている
+		 */
+		return (void *)obj - sizeof(kmem_s_bufctl);
+	}
+
+	/* OFF SLABやアライメント付き割り当ての場合は, バッファ制御情報へのポインタが
+	 * オブジェクトの直前に配置されている
+	 */
+	return *(void **)((void *)obj - sizeof(void *));
+}
+
+/**
+   SLABからオブジェクトを割り当てる (内部関数)
+   @param[in]  cache  カーネルメモリキャッシュ
+   @param[in]  sinfo  SLAB管理情報
+   @param[in]  nr     割り当てるオブジェクト数
+   @param[out] objs   獲得したオブジェクトを返却する配列
+   @note 1回の比較交換でnr個のオブジェクトを空きオブジェクトリストから取り出す
+ */
+static void
+alloc_slab_objs(kmem_cache *cache, slab *sinfo, obj_cnt_type nr, void **objs){
+	obj_cnt_type         i;
+
+	/*
+	 *  空きオブジェクトリストから空きオブジェクトを一括して獲得
+	 */
+	pop_freelist(sinfo, nr, objs);
+
+	/* 取り出したエントリをオブジェクトのアドレスに変換する */
+	for(i = 0; nr > i; ++i) 
+		objs[i] = bufctl_to_obj(cache, (struct _slist_node *)objs[i]);
+
 	return ;
 }
 
@@ -361,39 +577,71 @@ alloc_slab_obj(kmem_cache *cache, slab *sinfo, void **objp){
    オブジェクトをSLABに返却する (内部関数)
    @param[in]  cache  カーネルメモリキャッシュ
    @param[in]  sinfo  SLAB管理情報
-   @param[in]  bufctl バッファ管理情報へのポインタ
+   @param[in]  nr     返却するオブジェクト数
+   @param[in]  objs   返却するオブジェクトの配列
+   @note 1回の比較交換でnr個のオブジェクトを空きオブジェクトリストに返却する
  */
 static void
-free_slab_obj(kmem_cache *cache, slab *sinfo, void *bufctl){
-	intrflags       iflags;
-	kmem_s_bufctl  *s_bctl;
-	kmem_bufctl      *bctl;
+free_slab_objs(kmem_cache *cache, slab *sinfo, obj_cnt_type nr, void **objs){
+	obj_cnt_type           i;
+	struct _slist_node  *node;
+	struct _slist_node *first;
+	struct _slist_node  *last;
+	kmem_s_bufctl     *s_bctl;
+	kmem_bufctl         *bctl;
+
+	kassert( nr > 0 );
 
 	/*
-	 * SLAB管理情報の空きオブジェクトキューを更新する
+	 * 返却するオブジェクトのバッファ制御情報を連鎖させる
 	 */
+	for(i = 0, first = NULL, last = NULL; nr > i; ++i) {
 
-	/*  空きオブジェクトリストのロックを獲得  */
-	spinlock_lock_disable_intr(&sinfo->lock, &iflags);
+		if ( KMEM_CACHE_IS_ON_SLAB(cache) ) { /* ON SLABの場合  */
 
-	if ( KMEM_CACHE_IS_ON_SLAB(cache) ) { /* ON SLABの場合  */
+			/* バッファ制御情報のアドレスを取得  */
+			s_bctl = (kmem_s_bufctl *)obj_to_bufctl(cache, objs[i]);
+			kassert(s_bctl->link.next == NULL); /* 空きオブジェクトリスト中にない  */
+			node = &s_bctl->link;
+		} else {
 
-		s_bctl = (kmem_s_bufctl *)bufctl;  /* バッファ制御情報のアドレスを取得  */
-		kassert(s_bctl->link.next == NULL); /* 空きオブジェクトリスト中にない  */
-		slist_add(&sinfo->objects, &s_bctl->link); /* 空きオブジェクトリストに追加  */
-	} else {
+			/* バッファ制御情報のアドレスを取得  */
+			bctl = (kmem_bufctl *)obj_to_bufctl(cache, objs[i]);
+			kassert(bctl->link.next == NULL);  /* 空きオブジェクトリスト中にない  */
+			node = &bctl->link;
+		}
 
-		bctl = (kmem_bufctl *)bufctl;   /* バッファ制御情報のアドレスを取得  */
-		kassert(bctl->link.next == NULL);  /* 空きオブジェクトリスト中にない  */
-		slist_add(&sinfo->objects, &bctl->link);  /* 空きオブジェクトリストに追加  */
+		if ( last == NULL )
+			last = node;   /* 連鎖の末尾 */
+		node->next = first;
+		first = node;
 	}
 
-	/*  空きオブジェクトリストのロックを解放  */
-	spinlock_unlock_restore_intr(&sinfo->lock, &iflags);
+	/*
+	 * SLAB管理情報の空きオブジェクトリストに一括して追加する
+	 */
+	push_freelist(sinfo, first, last);
 
 	return ;
 }
 
+/**
+   オブジェクトを構築する (内部関数)
+   @param[in] cache カーネルメモリキャッシュ
+   @param[in] node  空きオブジェクトリストに追加する前のエントリ
+   @note コンストラクタはSLAB作成時にのみ呼び出し, オブジェクトは
+   構築済み状態で獲得/返却される
+ */
+static void
+construct_obj(kmem_cache *cache, struct _slist_node *node){
+
+	if ( cache->constructor == NULL )
+		return;
+
+	kassert( node->next == NULL );
+	cache->constructor(bufctl_to_obj(cache, node), cache->payload_size);
+}
+
 /**
    SLABを解放する (内部関数)
    @param[in]  cache  カーネルメモリキャッシュ
@@ -401,10 +649,12 @@ free_slab_obj(kmem_cache *cache, slab *sinfo, void *bufctl){
 */
 static void
 free_slab_info(kmem_cache *cache, slab *sinfo) {
-	int                rc;
-	kmem_bufctl     *bctl;
-	page_frame        *pf;
-	void         *objpage;
+	int                 rc;
+	kmem_bufctl      *bctl;
+	page_frame         *pf;
+	void          *objpage;
+	struct _slist_node *node;
+	struct _slist_node *next;
 
 	/* OFF SLABのSLAB情報の解放前にオブジェクトページのページフレーム情報を得ておく  */
 	rc = pfdb_kvaddr_to_page_frame(sinfo->page, &pf);
@@ -412,6 +662,22 @@ free_slab_info(kmem_cache *cache, slab *sinfo) {
 
 	objpage = sinfo->page;  /* オブジェクトページをページフレーム情報から取得  */
 
+	/* 空きSLAB中のオブジェクトは全て構築済み状態で返却されているので,
+	 * SLABを解放する際にデストラクタを呼び出す
+	 */
+	if ( cache->destructor != NULL ) {
+
+		node = SLAB_FREELIST_NODE(atomic64_read(&sinfo->objects));
+		while( node != NULL ) {
+
+			next = node->next;
+			node->next = NULL;  /* オブジェクトのアドレスを得るためにリンクを外す */
+			cache->destructor(bufctl_to_obj(cache, node), cache->payload_size);
+			node->next = next;
+			node = next;
+		}
+	}
+
 	/* ON SLABの場合は, オブジェクトページの最後にSLAB管理領域があり, かつ
 	 * バッファ管理情報は各オブジェクトの直前にあるのでオブジェクトページを
 	 * 解放するだけでよい
@@ -421,16 +687,17 @@ free_slab_info(kmem_cache *cache, slab *sinfo) {
 		/* OFF SLABの場合は, バッファ制御情報と
 		 * SLAB管理情報とを解放する
 		 */
-		while( !slist_is_empty(&sinfo->objects) ) { 
+		/* 空きSLABは他から参照されないので, 空きオブジェクトリストを
+		 * 先頭からたどってバッファ制御情報を取り出し, 解放する
+		 */
+		node = SLAB_FREELIST_NODE(atomic64_read(&sinfo->objects));
+		while( node != NULL ) { 
 			
-			/* 空きオブジェクトリストが空でなければ,
-			 * バッファ制御情報を取り出し, 解放する
-			 */
-			bctl = container_of(slist_get_top(&sinfo->objects), 
-			    kmem_bufctl, link);  /*  バッファ制御情報を取り出し  */
-			kassert(bctl->link.next == NULL); /* 空きオブジェクトリスト中にない */
+			bctl = container_of(node, kmem_bufctl, link);  /*  バッファ制御情報を取り出し  */
+			node = node->next;
 			kfree( bctl ); /*  バッファ制御情報を解放  */
 		}
+		atomic64_set(&sinfo->objects, SLAB_FREELIST_MAKE(0, NULL));
 		kfree(sinfo);  /* SLAB管理情報を解放  */
 	}
 
@@ -490,7 +757,9 @@ slab_kmem_cache_grow(kmem_cache *cache, pgalloc_flags mflags, slab **sinfop) {
 			sbfctl = (kmem_s_bufctl *)
 				((void *)kaddr +
 				    cache->obj_size * i );
-			slist_add(&sinfo->objects, &sbfctl->link); 
+			slist_init_node(&sbfctl->link);  /* 空きオブジェクトリストエントリを初期化  */
+			construct_obj(cache, &sbfctl->link);  /* オブジェクトを構築する */
+			push_freelist(sinfo, &sbfctl->link, &sbfctl->link); 
 		}
 	} else {  /*  OFF SLABの場合  */
 		
@@ -556,8 +825,10 @@ slab_kmem_cache_grow(kmem_cache *cache, pgalloc_flags mflags, slab **sinfop) {
 			slist_init_node(&bctl->link);  
 			bctl->backlink = sinfo;  /* SLAB情報へのバックリンクを設定 */
 
+			construct_obj(cache, &bctl->link);  /* オブジェクトを構築する */
+
 			/*  空きオブジェクトリストに追加  */
-			slist_add(&sinfo->objects, &bctl->link); 
+			push_freelist(sinfo, &bctl->link, &bctl->link); 
 		}
 	}
 
@@ -573,229 +844,785 @@ error_out:
 }
 
 /**
-   カーネルメモリキャッシュを縮小する
-   @param[in] cache  カーネルキャッシュ管理情報
-   @param[in] reap_flags 解放条件
+   オブジェクトを格納しているSLABの管理情報を得る (内部関数)
+   @param[in] obj オブジェクト
+   @return SLAB管理情報
  */
-void
-slab_kmem_cache_reap(kmem_cache *cache, int reap_flags){
-	intrflags      iflags;
-	slab           *sinfo;
+static slab *
+obj_to_slab(void *obj){
+	int                 rc;
+	page_frame         *pf;
 
-	/* 空きSLABキューを操作するためキャッシュロックを獲得 */
-	spinlock_lock_disable_intr(&cache->lock, &iflags);
-	while( !queue_is_empty(&cache->free) ) {
+	/* オブジェクトが配置されているページのページフレーム情報を取得  */
+	rc = pfdb_kvaddr_to_page_frame(obj, &pf);
+	kassert( rc == 0 );
 
-		/*
-		 * 空きキャッシュがあれば解放する
-		 */
-		if ( ( !( reap_flags & SLAB_REAP_FORCE ) ) &&
-		    ( cache->slab_count <= cache->limits ) )
-			break;  /*  最低保持数以下になったので解放を中止  */
-			
-		/*
-		 * SLAB管理情報をキューから外して解放する
-		 */
+	if ( PAGE_IS_CLUSTERED(pf) )
+		pf = pf->headp;  /*  クラスタページの場合先頭ページを参照する  */
 
-		/* フリーキューの先頭のSLAB管理情報を取り出し, 
-		 * メモリ獲得処理と衝突しないようにする
-		 */
-		sinfo = container_of(queue_get_top(&cache->free), slab, link);
-		--cache->slab_count;  /*  確保済みSLAB数を減算する  */
+	kassert( PAGE_USED_BY_SLAB(pf) );  /*  SLABとして使用していることを確認 */
 
-		/* SLAB管理情報解放のためキャッシュロックを解放 */
-		spinlock_unlock_restore_intr(&cache->lock, &iflags);
+	return pf->slabp;     /*  SLAB管理情報を返却する  */
+}
 
-		/*  SLAB管理情報を解放する
-		 *  空きリストから取り外しているので
-		 *  他に参照者はいない
-		 */
-		free_slab_info(cache, sinfo);
-		/* 空きSLABキューを操作するためキャッシュロックを獲得 */
-		spinlock_lock_disable_intr(&cache->lock, &iflags);
+/**
+   同じSLABに属するオブジェクトをSLABに返却する (内部関数)
+   @param[in] sinfo SLAB管理情報
+   @param[in] nr    返却するオブジェクト数
+   @param[in] objs  返却するオブジェクトの配列
+   @note 返却するオブジェクトは構築済み状態である
+ */
+static void
+free_objs_to_slab(slab *sinfo, obj_cnt_type nr, void **objs){
+	intrflags       iflags;
+	kmem_cache      *cache;
+
+	cache = sinfo->cache;  /*  キャッシュ管理情報を得る  */
+
+	/*  割り当て済みオブジェクト数を減算する前にオブジェクトを返却し,
+	 *  予約済みのオブジェクト数分のエントリが常に空きオブジェクトリスト中に
+	 *  存在するようにする
+	 *  割り当て済みオブジェクト数が0になるまではSLAB管理情報は解放されない
+	 */
+	free_slab_objs(cache, sinfo, nr, objs);  /*  オブジェクトを返却する  */
+
+	spinlock_lock_disable_intr(&cache->lock, &iflags); /* キャッシュロックを獲得 */
+
+	kassert( sinfo->count >= nr );  /*  2重解放されていないことを確認  */
+
+	/*  キューから取り外す  */
+	if ( sinfo->count == cache->objs_per_slab )  /*  フルキューに接続中  */
+		queue_del(&cache->full, &sinfo->link);   /* フルキューから取り出し */
+	else
+		queue_del(&cache->partial, &sinfo->link); /* パーシャルキューから取り出し */
+
+	sinfo->count -= nr;  /*  割り当て済みオブジェクト数を減算  */
+
+	kassert( list_not_linked(&sinfo->link) ); /* 他のキューに接続されていない */
+	if ( sinfo->count > 0 )  /* SLAB中に割り当て済みオブジェクトが存在する  */
+		queue_add(&cache->partial, &sinfo->link); /* パーシャルキューに接続 */
+	else {
+
+		/* 割り当て済みオブジェクトがなければ, フリーキューに接続する  */
+		sinfo->reap_gen = cache->reap_gen;  /* 空きSLABになった世代を記録する */
+		queue_add(&cache->free, &sinfo->link); /* フリーキューに接続する  */
 	}
 
-	/* キャッシュロックを解放 */
-	spinlock_unlock_restore_intr(&cache->lock, &iflags);
+	spinlock_unlock_restore_intr(&cache->lock, &iflags);  /* キャッシュロックを解放 */
+}
+
+/**
+   オブジェクトを一括してSLABに返却する (内部関数)
+   @param[in] nr    返却するオブジェクト数
+   @param[in] objs  返却するオブジェクトの配列
+   @note 同じSLABに属するオブジェクトが連続する間はまとめて返却する
+   @note 返却するオブジェクトは構築済み状態である
+ */
+static void
+free_bulk_to_slab(obj_cnt_type nr, void **objs){
+	obj_cnt_type    i;
+	obj_cnt_type    k;
+	slab       *sinfo;
 
-	return;
+	for(i = 0; nr > i; i += k) {
+
+		sinfo = obj_to_slab(objs[i]);  /*  SLAB管理情報を得る  */
+		for(k = 1; ( nr > ( i + k ) ) && ( obj_to_slab(objs[i + k]) == sinfo ); ++k);
+		free_objs_to_slab(sinfo, k, &objs[i]);
+	}
 }
 
 /**
-   カーネルメモリキャッシュからオブジェクトを割り当てる
+   SLABからオブジェクトを一括して割り当てる (内部関数)
    @param[in]  cache  カーネルメモリキャッシュ
    @param[in]  mflags メモリ獲得時のフラグ指定
-   @param[out] objp   獲得したオブジェクトを指し示すポインタ変数のアドレス
+   @param[in]  nr     割り当てるオブジェクト数
+   @param[out] objs   獲得したオブジェクトを返却する配列
    @retval     0      正常終了
    @retval    -ENOMEM メモリ不足
+   @note キャッシュロックを1回獲得する間に既存のSLABから割り当て可能な
+   オブジェクトを予約し, SLABごとにまとめて空きオブジェクトリストから取り出す.
+   予約中はobjsの要素に予約したSLABの管理情報を格納する
+   @note 要求された数のオブジェクトを獲得できなかった場合は, オブジェクトを獲得しない
+   @note メモリのクリアは呼び出し元で行う
  */
-int
-slab_kmem_cache_alloc(kmem_cache *cache, pgalloc_flags mflags, void **objp){
+static int
+alloc_bulk_from_slab(kmem_cache *cache, pgalloc_flags mflags, obj_cnt_type nr,
+    void **objs){
 	int                rc;
+	obj_cnt_type      cnt;
+	obj_cnt_type     resv;
+	obj_cnt_type        k;
 	intrflags      iflags;
 	slab           *sinfo;
-	void     *alloced_obj;
 
-	/*
-	 * パーシャルキューのSLABからメモリを獲得する
-	 */
+	for(cnt = 0; nr > cnt; ) {
 
-	spinlock_lock_disable_intr(&cache->lock, &iflags); /* キャッシュロックを獲得 */
-	if ( !queue_is_empty(&cache->partial) ) {
+		/*
+		 * パーシャルキュー, フリーキューのSLABからオブジェクトを予約する
+		 */
+		resv = cnt;
+		spinlock_lock_disable_intr(&cache->lock, &iflags); /* キャッシュロックを獲得 */
+		while( nr > resv ) {
 
-		/*  途中まで使用中のSLABからオブジェクトを獲得  */
-		sinfo = container_of(queue_ref_top(&cache->partial), slab, link);
-	} else {  /* 使用中のSLABがなければ  */
+			if ( !queue_is_empty(&cache->partial) ) {
 
-		if ( !queue_is_empty(&cache->free) ) { /*  割り当て済み空きSLABがある場合 */
-			
-			/*
-			 * フリーキューから空きSLABを取り出す
+				/*  途中まで使用中のSLABからオブジェクトを獲得  */
+				sinfo = container_of(queue_ref_top(&cache->partial), slab, link);
+			} else if ( !queue_is_empty(&cache->free) ) {
+
+				/* フリーキューから取り出した空きSLABを
+				 * パーシャルキュー(使用中SLABのリスト)につなぐ
+				 */
+				sinfo = container_of(queue_get_top(&cache->free), slab, link);
+				kassert( list_not_linked(&sinfo->link) );
+				queue_add(&cache->partial, &sinfo->link);
+			} else
+				break;  /* 割り当て可能なSLABがない */
+
+			/* キャッシュロック獲得中にSLABの使用オブジェクト数を
+			 * 加算することで, パーシャルキューにつないだSLABが
+			 * 空きオブジェクトリスト操作中に空きスラブキューに接続されないようにする
+			 * (オブジェクト開放操作との衝突を避ける)。
 			 */
-			sinfo = container_of(queue_get_top(&cache->free), slab, link);
-		} else {  /*  SLABを新たに割り当てる場合   */
-			
-			/* SLABを割り当てによる休眠を考慮し, キャッシュロックを解放 */
-			spinlock_unlock_restore_intr(&cache->lock, &iflags); 
-			
-			/*  新規にSLABを割り当て  */
-			rc = slab_kmem_cache_grow(cache, mflags, &sinfo);
-			if ( rc != 0 )
-				goto error_out;
-			
-			/* キャッシュロックを獲得 */
-			spinlock_lock_disable_intr(&cache->lock, &iflags);
-			++cache->slab_count;  /*  確保済みSLAB数をインクリメントする  */
+			k = MIN(nr - resv, cache->objs_per_slab - sinfo->count);
+			sinfo->count += k;
+
+			/* SLABのオブジェクトカウントが最大オブジェクト数なら
+			 * フルキューにつなぎなおす
+			 */
+			if ( sinfo->count == cache->objs_per_slab ) {
+
+				queue_del(&cache->partial, &sinfo->link);
+				queue_add(&cache->full, &sinfo->link);
+			}
+
+			while( k-- > 0 )
+				objs[resv++] = (void *)sinfo;  /* 予約したSLABを記録する */
 		}
+		/* キャッシュロック解放 */
+		spinlock_unlock_restore_intr(&cache->lock, &iflags); 
 
-		/* フリーキューから取り出したSLABまたは新規に割り当てた
-		 * SLABをパーシャルキュー(使用中SLABのリスト)につなぐ
+		/*
+		 * 予約したオブジェクトをSLABごとにまとめて取り出す
 		 */
-		kassert( list_not_linked(&sinfo->link) );  /* 他のキューに接続されていない */
-		queue_add(&cache->partial, &sinfo->link); /* パーシャルキューにつなぐ */
-	}
-	/* キャッシュロック獲得中にSLABの使用オブジェクト数を
-	 * インクリメントすることで, パーシャルキューにつないだSLABが
-	 * 空きオブジェクトリスト操作中に空きスラブキューに接続されないようにする
-	 * (オブジェクト開放操作との衝突を避ける)。
-	 */
-	++sinfo->count;
-
-	/* SLABのオブジェクトカウントが最大オブジェクト数なら
-	 * フルキューにつなぎなおす
-	 */
-	if ( sinfo->count == cache->objs_per_slab ) {
+		while( resv > cnt ) {
 
-		kassert( !list_not_linked(&sinfo->link) );  /* パーシャルキューに接続 */
-		queue_del(&cache->partial, &sinfo->link); /* パーシャルキューから取り出し */
-		queue_add(&cache->full, &sinfo->link);  /* フルキューに接続 */
-	}
+			sinfo = (slab *)objs[cnt];
+			for(k = 1; ( resv > ( cnt + k ) ) && ( objs[cnt + k] == (void *)sinfo ); ++k);
+			alloc_slab_objs(cache, sinfo, k, &objs[cnt]);
+			cnt += k;
+		}
 
-	/* キャッシュロック解放 */
-	spinlock_unlock_restore_intr(&cache->lock, &iflags); 
+		if ( cnt == nr )
+			break;  /* 要求された数のオブジェクトを獲得した */
 
-	/*
-	 * SLABからメモリオブジェクトを獲得
-	 */
-	alloc_slab_obj(cache, sinfo, &alloced_obj);
-	if ( !( mflags & KM_SFLAGS_CLR_NONE ) )
-		memset(alloced_obj, 0, cache->payload_size );  /*  メモリをクリアする  */
+		/*  新規にSLABを割り当て, フリーキューにつなぐ  */
+		rc = slab_kmem_cache_grow(cache, mflags, &sinfo);
+		if ( rc != 0 )
+			goto free_out;
 
-	*objp = alloced_obj;  /*  オブジェクトを返却する  */
+		spinlock_lock_disable_intr(&cache->lock, &iflags);
+		++cache->slab_count;  /*  確保済みSLAB数をインクリメントする  */
+		sinfo->reap_gen = cache->reap_gen;
+		queue_add(&cache->free, &sinfo->link);
+		spinlock_unlock_restore_intr(&cache->lock, &iflags);
+		statcnt_inc(&cache->grows);  /* SLAB伸長回数を更新 */
+	}
 
 	return 0;
 
-error_out:
+free_out:
+	free_bulk_to_slab(cnt, objs);  /* 獲得済みのオブジェクトを返却する */
 	return rc;
 }
 
 /**
-   オブジェクトをカーネルメモリキャッシュに返却する
-   @param[in] obj   解放するオブジェクト
+   自CPUのCPU単位キャッシュを参照する (内部関数)
+   @param[in] cache カーネルメモリキャッシュ
+   @return 自CPUのCPU単位キャッシュ
+   @retval NULL マガジン層を使用しない
+   @note 他のCPUに移動しないように割込み禁止状態で呼び出す
  */
-void
-slab_kmem_cache_free(void *obj){
-	int                 rc;
-	intrflags       iflags;
-	slab            *sinfo;
-	void           *bufctl;
-	kmem_cache      *cache;
-	page_frame         *pf;
-
-	/* オブジェクトが配置されているページのページフレーム情報を取得  */
-	rc = pfdb_kvaddr_to_page_frame(obj, &pf);
-	kassert( rc == 0 );
+static slab_cpu_cache *
+current_cpu_cache(kmem_cache *cache){
+	cpu_id cpu;
 
-	if ( PAGE_IS_CLUSTERED(pf) )
-		pf = pf->headp;  /*  クラスタページの場合先頭ページを参照する  */
+	if ( !magazine_enabled || ( cache->sflags & KM_SFLAGS_NO_MAGAZINE ) )
+		return NULL;  /* マガジン層を使用しない */
 
-	kassert( PAGE_USED_BY_SLAB(pf) );  /*  SLABとして使用していることを確認 */
+	cpu = ti_current_cpu_get();  /* スレッド情報から論理CPUIDを得る */
+	if ( cpu >= KC_CPUS_NR )
+		return NULL;  /* 不正なCPUID */
 
-	sinfo = pf->slabp;     /*  SLAB管理情報を得る  */
-	cache = sinfo->cache;  /*  キャッシュ管理情報を得る  */
+	return &cache->cpu_cache[cpu];
+}
 
-	spinlock_lock_disable_intr(&cache->lock, &iflags); /* キャッシュロックを獲得 */
+/**
+   デポのロックを獲得する (内部関数)
+   @param[in] cache カーネルメモリキャッシュ
+   @note 獲得時に他のCPUがロックを保持していた回数を計数し,
+   閾値に達した場合は, 以後に割り当てるマガジンの容量を拡大して
+   デポへのアクセス頻度を下げる
+   @note 割込み禁止状態で呼び出す
+ */
+static void
+lock_depot(kmem_cache *cache){
+	bool contended;
 
-	kassert( sinfo->count > 0 );  /*  2重解放されていないことを確認  */
+	contended = ( cache->depot_lock.locked != 0 );  /* 他のCPUが保持している */
 
-	/*  キューから取り外す  */
-	if ( sinfo->count == cache->objs_per_slab )  /*  フルキューに接続中  */
-		queue_del(&cache->full, &sinfo->link);   /* フルキューから取り出し */
-	else
-		queue_del(&cache->partial, &sinfo->link); /* パーシャルキューから取り出し */
+	spinlock_lock(&cache->depot_lock);
 
-	--sinfo->count;  /*  割り当て済みオブジェクト数を減算  */
+	if ( !contended )
+		return;
 
-	/*  割り当て済みオブジェクト数が0でなければパーシャルキューにつなぎ替える
-	 *  割り当て済みオブジェクト数が0ならリンクから外したままにし, 
-	 *  獲得と衝突しないようにする
-	 *  フリーキューに接続しないことで, カウンタ更新後の空きオブジェクトリスト操作中に
-	 *  SLAB管理情報が解放されないようにしている
-	 */
-	if ( sinfo->count > 0 ) {  /* SLAB中に割り当て済みオブジェクトが存在する  */
+	++cache->depot_contention;  /* 競合回数を更新 */
+	if ( ( cache->depot_contention >= SLAB_MAGAZINE_CONTENTION_LIMIT )
+	    && ( SLAB_MAGAZINE_SIZE_MAX > cache->mag_size ) ) {
+
+		/* マガジンの容量を拡大する */
+		cache->mag_size = MIN(cache->mag_size * 2, SLAB_MAGAZINE_SIZE_MAX);
+		cache->depot_contention = 0;
+		++cache->mag_resizes;  /* 拡大回数を更新 */
+	}
+}
+
+/**
+   マガジンを解放する (内部関数)
+   @param[in] cache カーネルメモリキャッシュ
+   @param[in] mag   マガジン
+   @note マガジン中のオブジェクトをSLABに返却した後, マガジンを解放する
+ */
+static void
+free_magazine(kmem_cache __unused *cache, slab_magazine *mag){
+	void *obj;
+
+	free_bulk_to_slab(mag->rounds, &mag->objs[0]);  /* SLABに返却する */
+	mag->rounds = 0;
+
+	obj = (void *)mag;
+	free_objs_to_slab(obj_to_slab(obj), 1, &obj);  /* マガジンを解放する */
+	statcnt_inc(&magazine_cache.frees);  /* マガジンの解放数を更新 */
+}
+
+/**
+   マガジンからオブジェクトを一括して獲得する (内部関数)
+   @param[in]  cache カーネルメモリキャッシュ
+   @param[in]  nr    獲得するオブジェクト数
+   @param[out] objs  獲得したオブジェクトを返却する配列
+   @return 獲得したオブジェクト数
+   @note 使用中のマガジン, 直前に使用したマガジン, デポ中の満杯のマガジンの順に
+   オブジェクトを探す
+ */
+static obj_cnt_type
+alloc_bulk_from_magazine(kmem_cache *cache, obj_cnt_type nr, void **objs){
+	bool                 got;
+	obj_cnt_type         cnt;
+	slab_cpu_cache       *cc;
+	slab_magazine       *mag;
+	intrflags         iflags;
+
+	krn_cpu_save_and_disable_interrupt(&iflags);  /* 割込みを禁止する */
+
+	cc = current_cpu_cache(cache);
+	if ( cc == NULL ) {
+
+		krn_cpu_restore_interrupt(&iflags);   /* 割込みを許可する */
+		return 0;  /* マガジン層を使用しない */
+	}
+
+	spinlock_lock(&cc->lock);
+
+	for(cnt = 0; nr > cnt; ) {
+
+		if ( ( cc->loaded != NULL ) && ( cc->loaded->rounds > 0 ) ) {
+
+			/* オブジェクトを取り出す */
+			objs[cnt++] = cc->loaded->objs[--cc->loaded->rounds];
+			continue;
+		}
+
+		if ( ( cc->previous != NULL ) && ( cc->previous->rounds > 0 ) ) {
+
+			/* 直前に使用したマガジンと入れ替える */
+			mag = cc->loaded;
+			cc->loaded = cc->previous;
+			cc->previous = mag;
+			continue;
+		}
+
+		/* デポから満杯のマガジンを取り出し, 空のマガジンを返却する */
+		got = false;
+		lock_depot(cache);
+		if ( !queue_is_empty(&cache->mag_full) ) {
+
+			mag = container_of(queue_get_top(&cache->mag_full),
+			    slab_magazine, link);
+			--cache->nr_mag_full;
+			if ( cc->previous != NULL ) {
+
+				queue_add(&cache->mag_empty, &cc->previous->link);
+				++cache->nr_mag_empty;
+			}
+			cc->previous = cc->loaded;
+			cc->loaded = mag;
+			got = true;
+		}
+		spinlock_unlock(&cache->depot_lock);
+
+		if ( !got )
+			break;  /* 満杯のマガジンがない */
+	}
+
+	cc->hits += cnt;     /* 獲得回数を更新 */
+	if ( nr > cnt )
+		++cc->misses;  /* 獲得失敗回数を更新 */
+
+	spinlock_unlock(&cc->lock);
+	krn_cpu_restore_interrupt(&iflags);   /* 割込みを許可する */
+
+	return cnt;
+}
+
+/**
+   オブジェクトを一括してマガジンに格納する (内部関数)
+   @param[in] cache カーネルメモリキャッシュ
+   @param[in] nr    格納するオブジェクト数
+   @param[in] objs  格納するオブジェクトの配列
+   @return マガジンに格納したオブジェクト数
+   @note 使用中のマガジン, 直前に使用したマガジン, デポ中の空のマガジンの順に
+   格納先を探し, 空のマガジンがない場合はマガジンを割り当てて再試行する
+ */
+static obj_cnt_type
+free_bulk_to_magazine(kmem_cache *cache, obj_cnt_type nr, void **objs){
+	int                   rc;
+	bool                 got;
+	bool           allocated;
+	obj_cnt_type         cnt;
+	obj_cnt_type   alloc_cnt;
+	slab_cpu_cache       *cc;
+	slab_magazine       *mag;
+	intrflags         iflags;
+
+	allocated = false;
+	alloc_cnt = 0;
+
+	krn_cpu_save_and_disable_interrupt(&iflags);  /* 割込みを禁止する */
+
+	for(cnt = 0; nr > cnt; ) {
 
-		/* パーシャルキューに接続 
+		cc = current_cpu_cache(cache);
+		if ( cc == NULL )
+			break;  /* マガジン層を使用しない */
+
+		spinlock_lock(&cc->lock);
+		while( nr > cnt ) {
+
+			if ( ( cc->loaded != NULL )
+			    && ( cc->loaded->capacity > cc->loaded->rounds ) ) {
+
+				/* オブジェクトを格納 */
+				cc->loaded->objs[cc->loaded->rounds++] = objs[cnt++];
+				continue;
+			}
+
+			if ( ( cc->previous != NULL )
+			    && ( cc->previous->capacity > cc->previous->rounds ) ) {
+
+				/* 直前に使用したマガジンと入れ替える */
+				mag = cc->loaded;
+				cc->loaded = cc->previous;
+				cc->previous = mag;
+				continue;
+			}
+
+			/* デポから空のマガジンを取り出し, 満杯のマガジンを返却する */
+			got = false;
+			lock_depot(cache);
+			if ( !queue_is_empty(&cache->mag_empty) ) {
+
+				mag = container_of(queue_get_top(&cache->mag_empty),
+				    slab_magazine, link);
+				--cache->nr_mag_empty;
+				if ( cc->previous != NULL ) {
+
+					queue_add(&cache->mag_full, &cc->previous->link);
+					++cache->nr_mag_full;
+				}
+				cc->previous = cc->loaded;
+				cc->loaded = mag;
+				got = true;
+			}
+			spinlock_unlock(&cache->depot_lock);
+
+			if ( !got )
+				break;  /* 空のマガジンがない */
+		}
+		spinlock_unlock(&cc->lock);
+
+		if ( cnt == nr )
+			break;  /* 全てのオブジェクトを格納した */
+
+		if ( allocated && ( cnt == alloc_cnt ) )
+			break;  /* 割り当てたマガジンを他のCPUが使用した */
+
+		/*
+		 * 空のマガジンを割り当ててデポに追加する
 		 */
-		kassert( list_not_linked(&sinfo->link) ); /* 他のキューに接続されていない */
-		queue_add(&cache->partial, &sinfo->link); /* パーシャルキューに接続 */
+		krn_cpu_restore_interrupt(&iflags);   /* 割込みを許可する */
+		rc = alloc_bulk_from_slab(&magazine_cache, KMALLOC_ATOMIC, 1, (void **)&mag);
+		krn_cpu_save_and_disable_interrupt(&iflags);  /* 割込みを禁止する */
+		if ( rc != 0 )
+			break;  /* マガジンを割り当てられなかった */
+
+		statcnt_inc(&magazine_cache.allocs);  /* マガジンの獲得数を更新 */
+		list_init(&mag->link);
+		mag->rounds = 0;
+		mag->capacity = cache->mag_size;
+
+		spinlock_lock(&cache->depot_lock);
+		queue_add(&cache->mag_empty, &mag->link);
+		++cache->nr_mag_empty;
+		spinlock_unlock(&cache->depot_lock);
+
+		allocated = true;
+		alloc_cnt = cnt;
 	}
 
-	/* キャッシュロックを解放 */
-	spinlock_unlock_restore_intr(&cache->lock, &iflags);
+	krn_cpu_restore_interrupt(&iflags);   /* 割込みを許可する */
+
+	return cnt;
+}
+
+/**
+   構築済み状態のオブジェクトを一括して返却する (内部関数)
+   @param[in] cache カーネルメモリキャッシュ
+   @param[in] nr    返却するオブジェクト数
+   @param[in] objs  返却するオブジェクトの配列
+   @note マガジンに格納できなかったオブジェクトはSLABに返却する
+ */
+static void
+release_objs(kmem_cache *cache, obj_cnt_type nr, void **objs){
+	obj_cnt_type cnt;
+
+	cnt = free_bulk_to_magazine(cache, nr, objs);  /* マガジンに格納する */
+	if ( nr > cnt )
+		free_bulk_to_slab(nr - cnt, &objs[cnt]);  /* 残りをSLABに返却する */
+}
+
+/**
+   マガジン中のオブジェクトをSLABに返却する (内部関数)
+   @param[in] cache      カーネルメモリキャッシュ
+   @param[in] reap_flags 解放条件
+   @note SLAB_REAP_NORMALの場合はデポ中のマガジンを,
+   SLAB_REAP_FORCEの場合はCPU単位キャッシュのマガジンも解放する
+ */
+static void
+drain_magazines(kmem_cache *cache, int reap_flags){
+	cpu_id               cpu;
+	slab_cpu_cache       *cc;
+	slab_magazine       *mag;
+	queue               mags;
+	intrflags         iflags;
+
+	queue_init(&mags);
+
+	if ( reap_flags & SLAB_REAP_FORCE ) {
+
+		/*
+		 * CPU単位キャッシュからマガジンを取り外す
+		 */
+		for(cpu = 0; KC_CPUS_NR > cpu; ++cpu) {
+
+			cc = &cache->cpu_cache[cpu];
+			spinlock_lock_disable_intr(&cc->lock, &iflags);
+			if ( cc->loaded != NULL )
+				queue_add(&mags, &cc->loaded->link);
+			if ( cc->previous != NULL )
+				queue_add(&mags, &cc->previous->link);
+			cc->loaded = NULL;
+			cc->previous = NULL;
+			spinlock_unlock_restore_intr(&cc->lock, &iflags);
+		}
+	}
 
 	/*
-	 * バッファ制御情報を取得
+	 * デポからマガジンを取り外す
 	 */
-	if ( ( cache->align == 0 ) && ( KMEM_CACHE_IS_ON_SLAB(cache) ) ) { 		
+	spinlock_lock_disable_intr(&cache->depot_lock, &iflags);
+	while( !queue_is_empty(&cache->mag_full) )
+		queue_add(&mags, queue_get_top(&cache->mag_full));
+	while( !queue_is_empty(&cache->mag_empty) )
+		queue_add(&mags, queue_get_top(&cache->mag_empty));
+	cache->nr_mag_full = 0;
+	cache->nr_mag_empty = 0;
+	spinlock_unlock_restore_intr(&cache->depot_lock, &iflags);
 
-		/* アライメントなしで, ON SLABの場合は, バッファ制御情報の直後に
-		 * オブジェクトが配置されている
+	/*
+	 * ロックを保持せずにオブジェクトとマガジンを解放する
+	 */
+	while( !queue_is_empty(&mags) ) {
+
+		mag = container_of(queue_get_top(&mags), slab_magazine, link);
+		free_magazine(cache, mag);
+	}
+}
+
+/**
+   カーネルメモリキャッシュを縮小する
+   @param[in] cache  カーネルキャッシュ管理情報
+   @param[in] reap_flags 解放条件
+   @return 解放したページ数
+   @note SLAB_REAP_NORMAL, SLAB_REAP_FORCEの場合は, マガジン中のオブジェクトを
+   SLABに返却してから空きSLABを解放する
+   @note SLAB_REAP_AGEDの場合は, 定期回収の世代を進め, SLAB_REAP_IDLE_PASSES回の
+   定期回収の間, 空きSLABのままだったSLABのみを解放する. マガジンは解放しない.
+   空きSLABを即座に解放しないことで, 獲得と解放とを繰り返す際のSLABの
+   伸長と解放との繰り返しを避ける
+ */
+obj_cnt_type
+slab_kmem_cache_reap(kmem_cache *cache, int reap_flags){
+	intrflags      iflags;
+	slab           *sinfo;
+	obj_cnt_type  free_nr;
+	struct _list      *lp;
+	struct _list      *np;
+	queue          reaped;
+
+	if ( cache->merged != NULL )
+		return 0;  /* エイリアスのSLABは統合先のキャッシュで解放する */
+
+	if ( !( reap_flags & SLAB_REAP_AGED ) )
+		drain_magazines(cache, reap_flags);  /* マガジン中のオブジェクトを返却する */
+
+	free_nr = 0;
+	queue_init(&reaped);
+
+	/* 空きSLABキューを操作するためキャッシュロックを獲得 */
+	spinlock_lock_disable_intr(&cache->lock, &iflags);
+
+	if ( reap_flags & SLAB_REAP_AGED )
+		++cache->reap_gen;  /* 定期回収の世代を進める */
+
+	queue_for_each_safe(lp, &cache->free, np) {
+
+		/*
+		 * 空きキャッシュがあれば解放する
 		 */
-		bufctl = (void *)obj - sizeof(kmem_s_bufctl);
-	} else {  
+		if ( ( !( reap_flags & SLAB_REAP_FORCE ) ) &&
+		    ( cache->slab_count <= cache->limits ) )
+			break;  /*  最低保持数以下になったので解放を中止  */
 
-		/* OFF SLABやアライメント付き割り当ての場合は, バッファ制御情報へのポインタが
-		 * オブジェクトの直前に配置されている
+		sinfo = container_of(lp, slab, link);
+		if ( ( reap_flags & SLAB_REAP_AGED )
+		    && ( SLAB_REAP_IDLE_PASSES > ( cache->reap_gen - sinfo->reap_gen ) ) )
+			continue;  /* 空きSLABになってから間もないSLABは保持する */
+
+		/* フリーキューからSLAB管理情報を取り出し, 
+		 * メモリ獲得処理と衝突しないようにする
 		 */
-		bufctl = *(void **)((void *)obj - sizeof(void *));
+		queue_del(&cache->free, &sinfo->link);
+		--cache->slab_count;  /*  確保済みSLAB数を減算する  */
+		queue_add(&reaped, &sinfo->link);
 	}
 
-	if ( cache->destructor != NULL )
-		cache->destructor(obj, cache->payload_size);  /*  デストラクタ呼び出し  */
+	/* SLAB管理情報解放のためキャッシュロックを解放 */
+	spinlock_unlock_restore_intr(&cache->lock, &iflags);
 
-	free_slab_obj(cache, sinfo, bufctl);  /*  オブジェクトを返却する  */
+	while( !queue_is_empty(&reaped) ) {
 
-	/* SLAB管理情報のキューを操作するためにキャッシュロックを獲得 */
-	spinlock_lock_disable_intr(&cache->lock, &iflags); 
+		/*  SLAB管理情報を解放する
+		 *  空きリストから取り外しているので
+		 *  他に参照者はいない
+		 */
+		sinfo = container_of(queue_get_top(&reaped), slab, link);
+		free_slab_info(cache, sinfo);
+		free_nr += ULONG_C(1) << cache->order;  /* 解放したページ数を加算 */
+		statcnt_inc(&cache->reaps);  /* 解放したSLAB数を更新 */
+	}
 
-	/* 割り当て済みオブジェクトがなければ,  フリーキューをつなぎ替える  */
-	if ( sinfo->count == 0 ) { 
+	return free_nr;
+}
 
-		kassert( list_not_linked(&sinfo->link) );  /*  他のキューにつながっていない */
-		queue_add(&cache->free, &sinfo->link); /* フリーキューに接続する  */
+/**
+   カーネルメモリキャッシュからオブジェクトを一括して割り当てる
+   @param[in]  cache  カーネルメモリキャッシュ
+   @param[in]  mflags メモリ獲得時のフラグ指定
+   @param[in]  nr     割り当てるオブジェクト数
+   @param[out] objs   獲得したオブジェクトを返却する配列
+   @retval     0      正常終了
+   @retval    -ENOMEM メモリ不足
+   @note 自CPUのマガジンから獲得できなかった分は, キャッシュのロックを1回獲得する間に
+   SLABから予約し, SLABごとにまとめて獲得する
+   @note 要求された数のオブジェクトを獲得できなかった場合は, オブジェクトを獲得しない
+   @note コンストラクタを持つキャッシュのオブジェクトは, メモリをクリアせずに
+   構築済み状態で返却する
+   @note エイリアスの場合は統合先のキャッシュから獲得し, 獲得数を
+   エイリアスと統合先の双方に計上する
+ */
+int
+slab_kmem_cache_alloc_bulk(kmem_cache *cache, pgalloc_flags mflags, obj_cnt_type nr,
+    void **objs){
+	int                rc;
+	obj_cnt_type        i;
+	obj_cnt_type      cnt;
+	kmem_cache      *pool;
+
+	pool = KMEM_CACHE_POOL(cache);  /* オブジェクトを供給するキャッシュ */
+
+	cnt = alloc_bulk_from_magazine(pool, nr, objs);  /* マガジンから獲得 */
+
+	/*
+	 * マガジンから獲得できなかった分はSLABからメモリオブジェクトを獲得
+	 */
+	if ( nr > cnt ) {
+
+		rc = alloc_bulk_from_slab(pool, mflags, nr - cnt, &objs[cnt]);
+		if ( rc != 0 )
+			goto free_out;
 	}
+	statcnt_add(&pool->allocs, nr);  /* 獲得数を更新 */
+	if ( pool != cache )
+		statcnt_add(&cache->allocs, nr);  /* エイリアスの獲得数を更新 */
 
-	spinlock_unlock_restore_intr(&cache->lock, &iflags);  /* キャッシュロックを解放 */
+	/* コンストラクタを持つキャッシュのオブジェクトは構築済み状態で返却する */
+	for(i = 0; ( cache->constructor == NULL ) && ( nr > i ); ++i) {
+
+		if ( !( mflags & KM_SFLAGS_CLR_NONE ) )
+			memset(objs[i], 0, cache->payload_size );  /*  メモリをクリアする  */
+	}
+
+	return 0;
+
+free_out:
+	release_objs(pool, cnt, objs);  /* マガジンから獲得したオブジェクトを返却 */
+	statcnt_inc(&pool->alloc_fails);  /* 獲得失敗回数を更新 */
+	if ( pool != cache )
+		statcnt_inc(&cache->alloc_fails);  /* エイリアスの獲得失敗回数を更新 */
+	return rc;
+}
+
+/**
+   カーネルメモリキャッシュからオブジェクトを割り当てる
+   @param[in]  cache  カーネルメモリキャッシュ
+   @param[in]  mflags メモリ獲得時のフラグ指定
+   @param[out] objp   獲得したオブジェクトを指し示すポインタ変数のアドレス
+   @retval     0      正常終了
+   @retval    -ENOMEM メモリ不足
+   @note 自CPUのマガジンから獲得できた場合は, キャッシュのロックを獲得しない
+ */
+int
+slab_kmem_cache_alloc(kmem_cache *cache, pgalloc_flags mflags, void **objp){
+
+	return slab_kmem_cache_alloc_bulk(cache, mflags, 1, objp);
+}
+
+/**
+   オブジェクトを一括してカーネルメモリキャッシュに返却する
+   @param[in] cache カーネルメモリキャッシュ
+   @param[in] nr    返却するオブジェクト数
+   @param[in] objs  返却するオブジェクトの配列
+   @note 自CPUのマガジンに格納できなかった分は, 同じSLABに属するオブジェクトを
+   まとめてSLABに返却する
+   @note コンストラクタを持つキャッシュには, オブジェクトを構築済み状態に戻して返却する
+   @note エイリアスの場合は統合先のキャッシュに返却し, 解放数を
+   エイリアスと統合先の双方に計上する
+ */
+void
+slab_kmem_cache_free_bulk(kmem_cache *cache, obj_cnt_type nr, void **objs){
+	obj_cnt_type    i;
+	kmem_cache  *pool;
+
+	pool = KMEM_CACHE_POOL(cache);  /* オブジェクトを供給したキャッシュ */
+
+	for(i = 0; nr > i; ++i)
+		kassert( obj_to_slab(objs[i])->cache == pool );  /* 同一キャッシュ */
+
+	release_objs(pool, nr, objs);  /*  オブジェクトを返却する  */
+	statcnt_add(&pool->frees, nr);  /* 解放数を更新 */
+	if ( pool != cache )
+		statcnt_add(&cache->frees, nr);  /* エイリアスの解放数を更新 */
+}
+
+/**
+   オブジェクトを所属するSLABのキャッシュに返却する (内部関数)
+   @param[in] obj 解放するオブジェクト
+   @note 解放数はSLABを持つキャッシュにのみ計上する
+ */
+static void
+free_obj_to_cache(void *obj){
+	kmem_cache      *cache;
+
+	cache = obj_to_slab(obj)->cache;      /*  キャッシュ管理情報を得る  */
+
+	release_objs(cache, 1, &obj);  /*  オブジェクトを返却する  */
+	statcnt_inc(&cache->frees);   /* 解放数を更新 */
+}
+
+/**
+   オブジェクトを獲得元のカーネルメモリキャッシュに返却する
+   @param[in] cache オブジェクトを獲得したカーネルメモリキャッシュ
+   @param[in] obj   解放するオブジェクト
+   @note エイリアスから獲得したオブジェクトの解放数をエイリアスに計上する場合に使用する
+ */
+void
+slab_kmem_cache_free_obj(kmem_cache *cache, void *obj){
+
+	slab_kmem_cache_free_bulk(cache, 1, &obj);
+}
+
+/**
+   オブジェクトをカーネルメモリキャッシュに返却する
+   @param[in] obj   解放するオブジェクト
+   @note 自CPUのマガジンに格納できた場合は, キャッシュのロックを獲得しない
+   @note コンストラクタを持つキャッシュには, オブジェクトを構築済み状態に戻して返却する
+   @note 解放数をエイリアスに計上できないため, エイリアスを持つキャッシュの
+   オブジェクトは解放できない. エイリアスから獲得したオブジェクトは
+   slab_kmem_cache_free_objまたはslab_kmem_cache_free_bulkで解放する
+ */
+void
+slab_kmem_cache_free(void *obj){
+
+	/* エイリアス経由で獲得したオブジェクトでないことを確認する */
+	kassert( obj_to_slab(obj)->cache->nr_aliases == 0 );
+
+	free_obj_to_cache(obj);  /*  オブジェクトを返却する  */
+}
+
+/**
+   統合先の事前割当て済みキャッシュを探す (内部関数)
+   @param[in] cache  配置情報を算出済みのカーネルメモリキャッシュ
+   @return 統合先のキャッシュ
+   @retval NULL 統合可能なキャッシュがない
+   @note オブジェクトサイズ, アラインメント, SLABのサイズと格納方式, 獲得条件が
+   一致する事前割当て済みキャッシュを統合先とする
+   @note コンストラクタやデストラクタを持つキャッシュは, オブジェクトの状態が
+   異なるため統合しない
+ */
+static kmem_cache *
+find_merge_target(kmem_cache *cache){
+	int          idx;
+	kmem_cache *pool;
+
+	if ( ( cache->constructor != NULL ) || ( cache->destructor != NULL ) )
+		return NULL;  /* 構築済み状態を保持するキャッシュ */
+
+	idx = kmalloc_index(cache->payload_size);
+	if ( idx < 0 )
+		return NULL;  /* 事前割当て済みキャッシュの最大サイズを越えている */
+
+	pool = &prealloc_caches[idx];
+	if ( ( pool->objs_per_slab == 0 ) || ( pool->merged != NULL ) )
+		return NULL;  /* 初期化前の事前割当て済みキャッシュ */
+
+	if ( ( cache->obj_size != pool->obj_size ) || ( cache->align != pool->align )
+	    || ( cache->order != pool->order )
+	    || ( cache->objs_per_slab != pool->objs_per_slab )
+	    || ( cache->sflags != pool->sflags ) || ( cache->limits > pool->limits ) )
+		return NULL;  /* 配置情報が異なる */
+
+	return pool;
 }
 
 /**
@@ -803,11 +1630,14 @@ slab_kmem_cache_free(void *obj){
    @param[in] cache キャッシュ管理領域
    @param[in] name  キャッシュ名
    @param[in] limits slab_kmem_cache_reap時でも確保しておくSLAB数(単位:個)
-   @param[in] sflags メモリ獲得条件フラグ
+   @param[in] sflags メモリ獲得条件フラグ (KM_SFLAGS_NO_MAGAZINE指定時はマガジン層を使用しない.
+   KM_SFLAGS_MERGEABLE指定時は配置情報が一致する事前割当て済みキャッシュのエイリアスとし,
+   SLABを共有する. エイリアスから獲得したオブジェクトはslab_kmem_cache_free_objまたは
+   slab_kmem_cache_free_bulkで解放する)
    @param[in] size  格納するオブジェクトのサイズ
    @param[in] align オブジェクト割り当て時のアラインメント
-   @param[in] constructor オブジェクト割り当て時の初期化処理関数
-   @param[in] destructor  オブジェクト解放時の解放処理関数
+   @param[in] constructor SLAB作成時に各オブジェクトを構築する初期化処理関数
+   @param[in] destructor  SLAB解放時に各オブジェクトを破棄する解放処理関数
    @retval  0      正常終了
    @retval -EINVAL 奇数アラインメントを指定した
    @retval -ENOMEM メモリ不足
@@ -818,7 +1648,11 @@ slab_kmem_cache_create(kmem_cache *cache, const char *name, size_t size,
 		uintptr_t align, obj_cnt_type limits, slab_flags sflags, 
 		void (*constructor)(void *_obj, size_t _siz),
 		void (*destructor)(void *_obj, size_t _siz)){
-	int rc;
+	int          rc;
+	cpu_id      cpu;
+	kmem_cache *res;
+	kmem_cache *pool;
+	intrflags iflags;
 
 	/*
 	 * カーネルメモリキャッシュを初期化する
@@ -843,6 +1677,15 @@ slab_kmem_cache_create(kmem_cache *cache, const char *name, size_t size,
 	cache->constructor = constructor;  /* コンストラクタを設定 */
 	cache->destructor = destructor;    /* デストラクタを設定 */
 
+	/*
+	 * マガジン層を初期化する
+	 */
+	spinlock_init(&cache->depot_lock);  /* デポのロックを初期化 */
+	queue_init(&cache->mag_full);       /* 満杯のマガジンのリストを初期化 */
+	queue_init(&cache->mag_empty);      /* 空のマガジンのリストを初期化 */
+	for(cpu = 0; KC_CPUS_NR > cpu; ++cpu)
+		spinlock_init(&cache->cpu_cache[cpu].lock);  /* CPU単位キャッシュのロックを初期化 */
+
 	/*
 	 * オブジェクトページの長さを算出
 	 */
@@ -850,6 +1693,49 @@ slab_kmem_cache_create(kmem_cache *cache, const char *name, size_t size,
 	if ( rc != 0 )
 		goto error_out;  /*  割り当て可能なサイズを超えている  */
 
+	cache->sflags |= ( sflags & KM_SFLAGS_NO_MAGAZINE ); /* マガジン層の使用可否を設定 */
+
+	/* 大きなオブジェクトは小さなマガジンから開始し, デポのロックの
+	 * 競合に応じて拡大する
+	 */
+	if ( cache->obj_size >= ( PAGE_SIZE / KM_SLAB_TYPE_DIVISOR ) )
+		cache->mag_size = SLAB_MAGAZINE_SIZE_MIN;
+	else
+		cache->mag_size = SLAB_MAGAZINE_SIZE_INIT;
+
+	/*
+	 * 統計情報を初期化する
+	 */
+	statcnt_set(&cache->allocs, 0);
+	statcnt_set(&cache->frees, 0);
+	statcnt_set(&cache->alloc_fails, 0);
+	statcnt_set(&cache->grows, 0);
+	statcnt_set(&cache->reaps, 0);
+
+	/*
+	 * 統合を許可されたキャッシュは, 配置情報が一致する事前割当て済みキャッシュの
+	 * エイリアスとし, SLABとマガジンを共有する
+	 */
+	if ( sflags & KM_SFLAGS_MERGEABLE ) {
+
+		pool = find_merge_target(cache);
+		if ( pool != NULL ) {
+
+			spinlock_lock_disable_intr(&pool->lock, &iflags);
+			cache->merged = pool;  /* 統合先を設定 */
+			++pool->nr_aliases;    /* エイリアス数を更新 */
+			spinlock_unlock_restore_intr(&pool->lock, &iflags);
+		}
+	}
+
+	/*
+	 * カーネルメモリキャッシュ管理情報に登録する
+	 */
+	spinlock_lock_disable_intr(&g_kmem_cache_db.lock, &iflags);
+	res = SPLAY_INSERT(_kmem_cache_tree, &g_kmem_cache_db.head, cache);
+	kassert( res == NULL );  /* 登録済みのキャッシュでないことを確認 */
+	spinlock_unlock_restore_intr(&g_kmem_cache_db.lock, &iflags);
+
 	return 0;
 
 error_out:
@@ -859,34 +1745,277 @@ error_out:
 /**
    キャッシュを破棄する
    @param[in] cache キャッシュ管理情報
+   @retval     0      正常終了
+   @retval    -EBUSY  使用中のオブジェクトがあるか, 登録済みキャッシュをたどる処理が参照中
+   @note 破棄できない場合は, 登録を抹消せずにキャッシュを残す.
+   エイリアスの場合は, エイリアス経由で獲得したオブジェクトが全て
+   解放されていなければ破棄できない. エイリアスを持つキャッシュは破棄できない
  */
-void
+int
 slab_kmem_cache_destroy(kmem_cache *cache) {
+	bool              busy;
 	intrflags       iflags;
+	kmem_cache        *res;
 
-	/* 使用中のキャッシュがあれば解放を取りやめ, そうでなければ
-	 * Freeキャッシュが空になるまでキャッシュを解放する
+	/*
+	 * 使用中のオブジェクトがないことを確認する
 	 */
-	spinlock_lock_disable_intr(&cache->lock, &iflags); /* キャッシュロックを獲得 */
-	while( !queue_is_empty(&cache->free) ) {
-		
-		if ( KMEM_CACHE_IS_BUSY(cache) ) 
-			goto unlock_out;  /* 使用中のSLABがあるため解放を取りやめ  */
+	if ( cache->merged != NULL ) {
+
+		/* エイリアス経由で獲得したオブジェクトが使用中 */
+		if ( statcnt_read(&cache->allocs) != statcnt_read(&cache->frees) )
+			return -EBUSY;
+	} else {
 
-		/* 空きスラブ解放前にキャッシュロックを解放 */
+		drain_magazines(cache, SLAB_REAP_FORCE);  /* マガジン中のオブジェクトを返却する */
+
+		spinlock_lock_disable_intr(&cache->lock, &iflags); /* キャッシュロックを獲得 */
+		/* 使用中のSLABがあるか, 統合されたエイリアスがある */
+		busy = ( KMEM_CACHE_IS_BUSY(cache) || ( cache->nr_aliases > 0 ) );
 		spinlock_unlock_restore_intr(&cache->lock, &iflags);
+		if ( busy )
+			return -EBUSY;
+	}
 
-		slab_kmem_cache_reap(cache, SLAB_REAP_FORCE);  /*  空きスラブを解放  */
+	/*
+	 * カーネルメモリキャッシュ管理情報から登録を抹消する
+	 */
+	spinlock_lock_disable_intr(&g_kmem_cache_db.lock, &iflags);
+	if ( cache->walkers > 0 ) {
 
-		/* SLAB管理情報キューを操作するためにキャッシュロックを獲得 */
-		spinlock_lock_disable_intr(&cache->lock, &iflags); 
+		/* 縮小処理などが参照中のため破棄を取りやめ */
+		spinlock_unlock_restore_intr(&g_kmem_cache_db.lock, &iflags);
+		return -EBUSY;
+	}
+	res = SPLAY_REMOVE(_kmem_cache_tree, &g_kmem_cache_db.head, cache);
+	kassert( res == cache );
+	spinlock_unlock_restore_intr(&g_kmem_cache_db.lock, &iflags);
+
+	if ( cache->merged != NULL ) {
+
+		/* エイリアスはSLABを持たないので統合先から登録を外す */
+		spinlock_lock_disable_intr(&cache->merged->lock, &iflags);
+		kassert( cache->merged->nr_aliases > 0 );
+		--cache->merged->nr_aliases;  /* エイリアス数を更新 */
+		spinlock_unlock_restore_intr(&cache->merged->lock, &iflags);
+		cache->merged = NULL;
+		return 0;
 	}
 
-unlock_out:
-	/* キャッシュロックを解放 */
-	spinlock_unlock_restore_intr(&cache->lock, &iflags);  
+	slab_kmem_cache_reap(cache, SLAB_REAP_FORCE);  /*  空きスラブを解放  */
 
-	return ;
+	return 0;
+}
+
+/**
+   カーネルメモリキャッシュの統計情報を取得する
+   @param[in]  cache カーネルメモリキャッシュ
+   @param[out] statp 統計情報返却領域
+   @note 使用中のオブジェクト数は獲得数と解放数との差から算出するため,
+   マガジンに格納されたオブジェクトは使用中に含まない
+   @note エイリアスのSLABとマガジンの使用状況は統合先のキャッシュに計上される
+ */
+void
+slab_kmem_cache_obtain_stat(kmem_cache *cache, slab_kmem_cache_stat *statp){
+	cpu_id               cpu;
+	slab_cpu_cache       *cc;
+	slab               *sinfo;
+	slab_magazine       *mag;
+	struct _list         *lp;
+	intrflags         iflags;
+
+	memset(statp, 0, sizeof(slab_kmem_cache_stat));
+
+	statp->name = cache->name;
+	if ( cache->merged != NULL )
+		statp->alias_of = cache->merged->name;
+	statp->payload_size = cache->payload_size;
+	statp->obj_size = cache->obj_size;
+	statp->objs_per_slab = cache->objs_per_slab;
+	statp->pages_per_slab = ULONG_C(1) << cache->order;
+	statp->limit = cache->limits;
+
+	/*
+	 * SLABの使用状況を集計する
+	 */
+	spinlock_lock_disable_intr(&cache->lock, &iflags); /* キャッシュロックを獲得 */
+	statp->nr_aliases = cache->nr_aliases;
+	statp->nr_slabs = cache->slab_count;
+	queue_for_each(lp, &cache->full)
+		++statp->nr_full;
+	queue_for_each(lp, &cache->partial) {
+
+		sinfo = container_of(lp, slab, link);
+		++statp->nr_partial;
+		/* 使用中SLAB中の空きオブジェクト数を加算 */
+		statp->partial_free += cache->objs_per_slab - sinfo->count;
+	}
+	queue_for_each(lp, &cache->free)
+		++statp->nr_free;
+	spinlock_unlock_restore_intr(&cache->lock, &iflags);  /* キャッシュロックを解放 */
+
+	statp->total_objs = statp->nr_slabs * cache->objs_per_slab;
+
+	/*
+	 * マガジンに格納されたオブジェクト数を集計する
+	 */
+	for(cpu = 0; KC_CPUS_NR > cpu; ++cpu) {
+
+		cc = &cache->cpu_cache[cpu];
+		spinlock_lock_disable_intr(&cc->lock, &iflags);
+		if ( cc->loaded != NULL )
+			statp->magazine_objs += cc->loaded->rounds;
+		if ( cc->previous != NULL )
+			statp->magazine_objs += cc->previous->rounds;
+		spinlock_unlock_restore_intr(&cc->lock, &iflags);
+	}
+
+	spinlock_lock_disable_intr(&cache->depot_lock, &iflags);
+	queue_for_each(lp, &cache->mag_full) {
+
+		mag = container_of(lp, slab_magazine, link);
+		statp->magazine_objs += mag->rounds;
+	}
+	spinlock_unlock_restore_intr(&cache->depot_lock, &iflags);
+
+	/*
+	 * 統計情報カウンタを読み出す
+	 */
+	statp->allocs = statcnt_read(&cache->allocs);
+	statp->frees = statcnt_read(&cache->frees);
+	statp->alloc_fails = statcnt_read(&cache->alloc_fails);
+	statp->grows = statcnt_read(&cache->grows);
+	statp->reaps = statcnt_read(&cache->reaps);
+	if ( statp->allocs > statp->frees )
+		statp->active_objs = statp->allocs - statp->frees;
+}
+
+/**
+   登録されている全てのカーネルメモリキャッシュに対して処理を行う
+   @param[in] fn  各キャッシュに対して呼び出す関数
+   @param[in] arg fnに渡す引数
+   @retval    0   全てのキャッシュを処理した
+   @retval    非0 fnが返却した0以外の値 (処理を中断した)
+   @note キャッシュを名前順にたどる
+   @note カーネルメモリキャッシュ管理情報のロックは処理中のキャッシュへの参照を
+   獲得する間だけ保持し, fnはロックを解放した状態で呼び出す.
+   fnの処理中のキャッシュは破棄できない (slab_kmem_cache_destroyは-EBUSYを返却する)
+ */
+int
+slab_kmem_cache_foreach(int (*fn)(kmem_cache *_cache, void *_arg), void *arg){
+	int                  rc;
+	kmem_cache       *cache;
+	kmem_cache        *next;
+	intrflags        iflags;
+
+	rc = 0;
+	spinlock_lock_disable_intr(&g_kmem_cache_db.lock, &iflags);
+	for(cache = SPLAY_MIN(_kmem_cache_tree, &g_kmem_cache_db.head); cache != NULL;
+	    cache = next) {
+
+		++cache->walkers;  /* 破棄されないように参照を獲得 */
+		spinlock_unlock_restore_intr(&g_kmem_cache_db.lock, &iflags);
+
+		rc = fn(cache, arg);
+
+		spinlock_lock_disable_intr(&g_kmem_cache_db.lock, &iflags);
+		/* 参照中のキャッシュは登録されたままなので次のキャッシュをたどれる */
+		next = SPLAY_NEXT(_kmem_cache_tree, &g_kmem_cache_db.head, cache);
+		kassert( cache->walkers > 0 );
+		--cache->walkers;  /* 参照を解放 */
+		if ( rc != 0 )
+			break;  /* 処理を中断する */
+	}
+	spinlock_unlock_restore_intr(&g_kmem_cache_db.lock, &iflags);
+
+	return rc;
+}
+
+/**
+   カーネルメモリキャッシュの統計情報を表示する (内部関数)
+   @param[in] cache カーネルメモリキャッシュ
+   @param[in] arg   未使用
+   @retval    0     常に0を返却し, 次のキャッシュを処理する
+ */
+static int
+show_cache_info(kmem_cache *cache, void __unused *arg){
+	slab_kmem_cache_stat st;
+
+	slab_kmem_cache_obtain_stat(cache, &st);
+	kprintf("%-20s %8qu %8qu %6qu %4qu %4qu : slabdata %6qu %6qu %6qu %6qu : "
+	    "frag %6qu mag %6qu : stats %qu %qu %qu %qu %qu",
+	    st.name, (uint64_t)st.active_objs, (uint64_t)st.total_objs,
+	    (uint64_t)st.obj_size, (uint64_t)st.objs_per_slab,
+	    (uint64_t)st.pages_per_slab,
+	    (uint64_t)st.nr_slabs, (uint64_t)st.nr_full, (uint64_t)st.nr_partial,
+	    (uint64_t)st.nr_free, (uint64_t)st.partial_free, (uint64_t)st.magazine_objs,
+	    (uint64_t)st.allocs, (uint64_t)st.frees, (uint64_t)st.alloc_fails,
+	    (uint64_t)st.grows, (uint64_t)st.reaps);
+	if ( st.alias_of != NULL )
+		kprintf(" : alias %s", st.alias_of);  /* 統合先のキャッシュ */
+	else if ( st.nr_aliases > 0 )
+		kprintf(" : aliases %qu", (uint64_t)st.nr_aliases);  /* エイリアス数 */
+	kprintf("\n");
+
+	return 0;
+}
+
+/**
+   全てのカーネルメモリキャッシュの統計情報を表示する
+   @note Linuxの/proc/slabinfoに倣った形式で1キャッシュ1行で表示する
+ */
+void
+slab_kmem_cache_show_info(void){
+
+	kprintf("# %-18s %8s %8s %6s %4s %4s : slabdata %6s %6s %6s %6s : "
+	    "frag %6s mag %6s : stats <allocs> <frees> <fails> <grows> <reaps>\n",
+	    "name", "<active>", "<objs>", "<size>", "<ps>", "<pgs>",
+	    "<nr>", "<full>", "<part>", "<free>", "<objs>", "<objs>");
+	slab_kmem_cache_foreach(show_cache_info, NULL);
+}
+
+/**
+   事前割当て済みカーネルキャッシュの最大サイズを越える領域をページ単位で割り当てる (内部関数)
+   @param[in] size   割り当てるメモリサイズ
+   @param[in] mflags メモリ獲得条件
+   @return 割り当てたメモリ領域のアドレスまたはメモリ割り当て失敗時はNULLを返却
+   @note ページオーダは先頭ページのページフレーム情報に記録され, kfreeで参照する
+ */
+static void *
+kmalloc_large(size_t size, pgalloc_flags mflags){
+	int           rc;
+	page_order order;
+	void          *m;
+
+	rc = pgif_calc_page_order(size, &order);
+	if ( rc != 0 )
+		goto fail;  /* 格納可能なページオーダを越えている */
+
+	rc = pgif_get_free_page_cluster(&m, order, mflags, PAGE_USAGE_KERN);
+	if ( rc != 0 )
+		goto fail;
+
+	statcnt_inc(&kmalloc_large_stat.allocs);          /* 獲得回数を更新 */
+	statcnt_add(&kmalloc_large_stat.pages, ULONG_C(1) << order); /* 使用中ページ数を加算 */
+
+	return m;
+
+fail:
+	return NULL;
+}
+
+/**
+   ページ単位で割り当てた領域を解放する (内部関数)
+   @param[in] pf 先頭ページのページフレーム情報
+ */
+static void
+kfree_large(page_frame *pf){
+	page_order order;
+
+	order = pf->order;  /* 割り当て時のページオーダを得る */
+
+	if ( pfdb_dec_page_use_count(pf) )  /* ページを解放する */
+		statcnt_sub(&kmalloc_large_stat.pages, ULONG_C(1) << order);
 }
 
 /**
@@ -894,39 +2023,46 @@ unlock_out:
    @param[in] size   割り当てるメモリサイズ
    @param[in] mflags メモリ獲得条件
    @return 割り当てたメモリ領域のアドレスまたはメモリ割り当て失敗時はNULLを返却
+   @note 事前割当て済みカーネルキャッシュの最大サイズを越える場合は,
+   ページ単位で割り当てる
  */
 void *
 kmalloc(size_t size, pgalloc_flags mflags){
 	int           rc;
-	unsigned int   i;
+	int          idx;
 	void          *m;
 
-	for(i = 0; SLAB_PREALLOC_CACHE_NR > i; ++i) {
-		
-		/* 事前割当て済みカーネルキャッシュ中から指定されたサイズの
-		 * メモリを格納可能なキャッシュを検索
-		 */
-		if ( ( SLAB_PREALLOC_BASE << i) >= size ) {
+	/* 事前割当て済みカーネルキャッシュ中から指定されたサイズの
+	 * メモリを格納可能なキャッシュを検索
+	 */
+	idx = kmalloc_index(size);
+	if ( idx < 0 )
+		return kmalloc_large(size, mflags);  /* ページ単位で割り当てる */
+
+	/* 事前割当て済みカーネルキャッシュからメモリを割り当て
+	 */
+	rc = slab_kmem_cache_alloc(&prealloc_caches[idx], mflags, &m);
+	if ( rc != 0 )
+		goto fail;
+
+	statcnt_inc(&kmalloc_stats[idx].allocs);          /* 獲得回数を更新 */
+	statcnt_add(&kmalloc_stats[idx].requested, size); /* 要求サイズを加算 */
+
+	return m;
 
-			/* 事前割当て済みカーネルキャッシュからメモリを割り当て
-			 */
-			rc = slab_kmem_cache_alloc(&prealloc_caches[i], mflags, &m);
-			if ( rc != 0 )
-				goto fail;
-			return m;
-		}
-	}
 fail:
 	return NULL;
 }
 
 /**
-   事前割当て済みカーネルキャッシュにメモリを返却する
+   kmallocで割り当てたメモリを返却する
    @param[in] m  返却するメモリ領域へのポインタ
+   @note SLABのオブジェクトはSLABに返却し, ページ単位で割り当てた領域はページを解放する
  */
 void
 kfree(void *m){
 	int                 rc;
+	obj_cnt_type       pfn;
 	page_frame         *pf;
 
 	if ( m == NULL )
@@ -942,9 +2078,85 @@ kfree(void *m){
 	
 	/*
 	 * SLABページの場合, メモリオブジェクトをSLABに返却する
+	 * SLAB管理情報は共用体中にあるため, SLABページであることを先に確認する
 	 */
-	if ( PAGE_USED_BY_SLAB(pf) )
-		slab_kmem_cache_free(m);  /*  メモリオブジェクトをSLABに返却する  */
+	if ( PAGE_USED_BY_SLAB(pf) ) {
+
+		free_obj_to_cache(m);  /*  メモリオブジェクトをSLABに返却する  */
+		return;
+	}
+
+	/*
+	 * ページ単位で割り当てた領域の場合, ページを解放する
+	 */
+	if ( PAGE_USED_BY_KERN(pf) ) {
+
+		/* 先頭ページの先頭アドレスを指定していることを確認 */
+		kassert( PAGE_ALIGNED((uintptr_t)m) );
+		rc = pfdb_kvaddr_to_pfn(m, &pfn);
+		kassert( ( rc == 0 ) && ( pfn == pf->pfn ) );
+
+		kfree_large(pf);  /*  ページを解放する  */
+	}
+}
+
+/**
+   要求サイズに対してkmallocが割り当てる領域のサイズを得る
+   @param[in] size 要求サイズ (単位:バイト)
+   @return 割り当てる領域のサイズ (単位:バイト)
+   @retval 0 格納可能なページオーダを越えている
+ */
+size_t
+slab_kmalloc_class_size(size_t size){
+	int           rc;
+	int          idx;
+	page_order order;
+
+	idx = kmalloc_index(size);
+	if ( idx >= 0 )
+		return prealloc_caches_info[idx].size;
+
+	/* ページ単位で割り当てる */
+	rc = pgif_calc_page_order(size, &order);
+	if ( rc != 0 )
+		return 0;  /* 格納可能なページオーダを越えている */
+
+	return PAGE_SIZE << order;
+}
+
+/**
+   kmallocの統計情報を取得する
+   @param[out] statp 統計情報返却領域
+   @note 割り当てたサイズと要求サイズとの差を内部断片化による未使用領域とする
+ */
+void
+slab_kmalloc_obtain_stat(slab_kmalloc_stat *statp){
+	unsigned int   i;
+
+	statp->allocated = 0;
+	statp->wasted = 0;
+	for(i = 0; SLAB_PREALLOC_CACHE_NR > i; ++i) {
+
+		statp->size[i] = prealloc_caches_info[i].size;
+		statp->allocs[i] = statcnt_read(&kmalloc_stats[i].allocs);
+		statp->requested[i] = statcnt_read(&kmalloc_stats[i].requested);
+		statp->allocated += statp->allocs[i] * statp->size[i];
+		statp->wasted += statp->allocs[i] * statp->size[i] - statp->requested[i];
+	}
+	statp->large_allocs = statcnt_read(&kmalloc_large_stat.allocs);
+	statp->large_pages = statcnt_read(&kmalloc_large_stat.pages);
+}
+
+/**
+   マガジン層の利用を開始する
+   @note スレッド情報中の論理CPUIDが参照可能になった後に呼び出す
+ */
+void
+slab_magazine_init(void){
+
+	kassert( !magazine_enabled );
+
+	magazine_enabled = true;  /* マガジン層の利用を開始 */
 }
 
 /**
@@ -955,8 +2167,16 @@ slab_prepare_preallocate_cahches(void){
 	int           rc;
 	unsigned int   i;
 
+	/* マガジンのキャッシュを初期化する */
+	rc = slab_kmem_cache_create(&magazine_cache, "slab-magazine", sizeof(slab_magazine),
+	    SLAB_ALIGN_NONE, SLAB_PREALLOC_LIMIT, KM_SFLAGS_NO_MAGAZINE, NULL, NULL);
+	kassert( rc == 0 );
+
 	for(i = 0; SLAB_PREALLOC_CACHE_NR > i; ++i) {
 
+		/* 参照表と初期化情報との整合性を確認する */
+		kassert( kmalloc_index(prealloc_caches_info[i].size) == (int)i );
+
 		/*  事前割当て済みキャッシュを初期化する  */
 		rc = slab_kmem_cache_create(&prealloc_caches[i], 
 		    prealloc_caches_info[i].name, prealloc_caches_info[i].size,
@@ -981,7 +2201,127 @@ slab_finalize_preallocate_cahches(void){
 		 */
 		slab_kmem_cache_destroy(&prealloc_caches[i - 1]);
 	}
+	slab_kmem_cache_destroy(&magazine_cache);  /* マガジンのキャッシュを解放する */
+}
+
+/**
+   事前割当て済みキャッシュを縮小する
+   @param[in] reap_flags 解放条件
+   @return 解放したページ数
+ */
+obj_cnt_type
+slab_reap_preallocate_cahches(int reap_flags){
+	unsigned int        i;
+	obj_cnt_type  free_nr;
+
+	for(i = 0, free_nr = 0; SLAB_PREALLOC_CACHE_NR > i; ++i) 
+		free_nr += slab_kmem_cache_reap(&prealloc_caches[i], reap_flags);
+
+	return free_nr;
+}
+
+/**
+   登録されている全てのカーネルメモリキャッシュを縮小する (内部関数)
+   @param[in] cache カーネルメモリキャッシュ
+   @param[in] arg   解放条件と解放したページ数の格納領域
+   @retval    0     常に0を返却し, 次のキャッシュを処理する
+ */
+static int
+reap_cache(kmem_cache *cache, void *arg){
+	slab_reap_arg *rarg;
+
+	rarg = (slab_reap_arg *)arg;
+	rarg->free_nr += slab_kmem_cache_reap(cache, rarg->reap_flags);
+
+	return 0;
+}
+
+/**
+   登録されている全てのカーネルメモリキャッシュを縮小する
+   @param[in] reap_flags 解放条件
+   @return 解放したページ数
+ */
+obj_cnt_type
+slab_reap_all_caches(int reap_flags){
+	slab_reap_arg rarg;
+
+	rarg.reap_flags = reap_flags;
+	rarg.free_nr = 0;
+	slab_kmem_cache_foreach(reap_cache, &rarg);
+
+	return rarg.free_nr;
+}
+
+/**
+   回収可能なSLAB数を集計する (内部関数)
+   @param[in] cache カーネルメモリキャッシュ
+   @param[in] arg   回収可能なSLAB数の格納領域
+   @retval    0     常に0を返却し, 次のキャッシュを処理する
+   @note 空きSLABとデポ中のマガジンを回収可能なオブジェクトとして数える
+ */
+static int
+count_reclaimable(kmem_cache *cache, void *arg){
+	obj_cnt_type *cntp;
+	struct _list   *lp;
+	intrflags   iflags;
+
+	cntp = (obj_cnt_type *)arg;
+
+	spinlock_lock_disable_intr(&cache->lock, &iflags);
+	queue_for_each(lp, &cache->free)
+		++*cntp;
+	spinlock_unlock_restore_intr(&cache->lock, &iflags);
+
+	spinlock_lock_disable_intr(&cache->depot_lock, &iflags);
+	*cntp += cache->nr_mag_full + cache->nr_mag_empty;
+	spinlock_unlock_restore_intr(&cache->depot_lock, &iflags);
+
+	return 0;
+}
+
+/**
+   SLABの縮小処理: 回収可能なオブジェクト数を返却する (内部関数)
+   @param[in] private 未使用
+   @return 回収可能な空きSLAB数とデポ中のマガジン数との和
+ */
+static obj_cnt_type
+slab_shrinker_count(void __unused *private){
+	obj_cnt_type cnt;
+
+	cnt = 0;
+	slab_kmem_cache_foreach(count_reclaimable, &cnt);
+
+	return cnt;
 }
 
+/**
+   SLABの縮小処理: 空きSLABを解放する (内部関数)
+   @param[in] nr      未使用 (全キャッシュを縮小する)
+   @param[in] reason  縮小処理の契機
+   @param[in] private 未使用
+   @return 解放したページ数
+   @note 定期回収時は一定期間未使用の空きSLABのみを解放し,
+   空きページ不足時はマガジンを含めて最低保持数を越える空きSLABを解放する
+ */
+static obj_cnt_type
+slab_shrinker_scan(obj_cnt_type __unused nr, int reason, void __unused *private){
 
+	if ( reason == PGIF_SHRINK_PERIODIC )
+		return slab_reap_all_caches(SLAB_REAP_AGED);
 
+	return slab_reap_all_caches(SLAB_REAP_NORMAL);
+}
+
+/**
+   SLABの縮小処理をページ回収機構に登録する
+   @note ページ回収機構の初期化後に呼び出す
+ */
+void
+slab_shrinker_init(void){
+
+	slab_shrinker.name = "slab";
+	slab_shrinker.count = slab_shrinker_count;
+	slab_shrinker.scan = slab_shrinker_scan;
+	slab_shrinker.private = NULL;
+	pgif_shrinker_register(&slab_shrinker);
+}
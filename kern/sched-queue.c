@@ -13,57 +13,510 @@
 #include <kern/thr-if.h>
 #include <kern/sched-if.h>
 #include <kern/kern-cpuinfo.h>
+#include <kern/timer.h>
 
-static sched_queue ready_queue={.lock = __SPINLOCK_INITIALIZER,}; /** レディキュー      */
 static thread     *idle_threads[KC_CPUS_NR];                      /**< アイドルスレッド */
+static call_out_ent *rebalance_callout;                           /**< 定期負荷分散のコールアウト */
 
 /**
-   実行可能なスレッドを返却する
-   @return 実行可能なスレッド
-   @return NULL 実行可能なスレッドがない
-   @note TODO: unusedを落とす
+   公平スケジューリングクラスの重み
+   @note 優先度の高い順に並べる. 隣接する段階の重みの比は約1.25
  */
-static thread * 
-get_next_thread(void){
+static const uint32_t fair_weights[SCHED_FAIR_WEIGHT_LEVELS] = {
+	88761, 71755, 56483, 46273, 36291,
+	29154, 23254, 18705, 14949, 11916,
+	9548,  7620,  6100,  4904,  3906,
+	3121,  2501,  1991,  1586,  1277,
+	1024,  820,   655,   526,   423,
+	335,   272,   215,   172,   137,
+	110,   87,    70,    56,    45,
+	36,    29,    23,    18,    15,
+};
+
+static int _fair_thread_cmp(struct _thread *_key, struct _thread *_ent);
+RB_GENERATE_STATIC(_sched_fair_tree, _thread, fair_ent, _fair_thread_cmp);
+
+/** 
+    公平スケジューリングツリーのエントリ比較関数
+    @param[in] key 比較対象1
+    @param[in] ent RB木内の各エントリ
+    @retval 正  keyの仮想実行時間がentより後にある
+    @retval 負  keyの仮想実行時間がentより前にある
+    @retval 0   keyがentに等しい
+    @note 仮想実行時間が等しい場合はスレッドIDの順に並べる
+ */
+static int
+_fair_thread_cmp(struct _thread *key, struct _thread *ent){
+
+	if ( key->attr.vruntime < ent->attr.vruntime )
+		return -1;
+
+	if ( key->attr.vruntime > ent->attr.vruntime )
+		return 1;
+
+	if ( key->id < ent->id )
+		return -1;
+
+	if ( key->id > ent->id )
+		return 1;
+
+	return 0;
+}
+
+/**
+   論理CPUのレディキューを参照する (内部関数)
+   @param[in] cpu 論理CPUID
+   @return レディキュー
+ */
+static sched_queue *
+cpu_ready_queue(cpu_id cpu){
+	cpu_info *cinf;
+
+	cinf = krn_cpuinfo_get(cpu);  /* CPU情報を参照 */
+	kassert( cinf != NULL );
+
+	return &cinf->rdq;
+}
+
+/**
+   公平スケジューリングクラスのスレッドの仮想実行時間を補正する (内部関数)
+   @param[in] rdq 追加先のレディキュー
+   @param[in] thr 追加するスレッド
+   @note 休眠していたスレッドや生成直後のスレッドの仮想実行時間をキューの最小仮想実行時間からSCHED_FAIR_SLEEPER_CREDIT_MS分
+   遡った値までに引き上げる. 休眠中の時間を貯め込んで他のスレッドを長時間
+   待たせないようにしつつ, 起床直後のスレッドを速やかに実行させる
+   @note レディキューのロックを獲得して呼び出す
+ */
+static void
+place_fair_thread_nolock(sched_queue *rdq, thread *thr){
+	uint64_t credit;
+
+	credit = SCHED_FAIR_SLEEPER_CREDIT_MS * SCHED_FAIR_NS_PER_MS;
+	if ( rdq->fair_min_vruntime > ( thr->attr.vruntime + credit ) )
+		thr->attr.vruntime = rdq->fair_min_vruntime - credit;
+}
+
+/**
+   公平スケジューリングクラスのスレッドの仮想実行時間を移動元のキューからの相対値に変換する (内部関数)
+   @param[in] rdq 移動元のレディキュー
+   @param[in] thr 移動するスレッド
+   @note キューごとに最小仮想実行時間の進み方が異なるため, 他のキューに移動する
+   スレッドは移動元の最小仮想実行時間との差を保持して移動する.
+   最小仮想実行時間より小さい場合は負の差を2の補数で保持する
+   @note 移動元のレディキューのロックを獲得して呼び出す
+ */
+static void
+detach_fair_vruntime_nolock(sched_queue *rdq, thread *thr){
+
+	if ( SCHED_FAIR_PRIO(thr->attr.cur_prio) )
+		thr->attr.vruntime -= rdq->fair_min_vruntime;
+}
+
+/**
+   公平スケジューリングクラスのスレッドの仮想実行時間を移動先のキューでの値に変換する (内部関数)
+   @param[in] rdq 移動先のレディキュー
+   @param[in] thr 移動するスレッド
+   @note detach_fair_vruntime_nolockで求めた差を移動先の最小仮想実行時間に加算する
+   @note 移動先のレディキューのロックを獲得して呼び出す
+ */
+static void
+attach_fair_vruntime_nolock(sched_queue *rdq, thread *thr){
+	int64_t lag;
+
+	if ( !SCHED_FAIR_PRIO(thr->attr.cur_prio) )
+		return;
+
+	lag = (int64_t)thr->attr.vruntime;  /* 移動元の最小仮想実行時間との差 */
+	if ( ( 0 > lag ) && ( (uint64_t)( -lag ) > rdq->fair_min_vruntime ) )
+		thr->attr.vruntime = 0;
+	else
+		thr->attr.vruntime = rdq->fair_min_vruntime + lag;
+}
+
+/**
+   最小仮想実行時間を更新する (内部関数)
+   @param[in] rdq 自CPUのレディキュー
+   @param[in] thr 自CPUで実行するスレッド
+   @note レディキューのロックを獲得して呼び出す
+ */
+static void
+update_fair_min_vruntime_nolock(sched_queue *rdq, thread *thr){
+
+	if ( ( SCHED_FAIR_PRIO(thr->attr.cur_prio) )
+	    && ( thr->attr.vruntime > rdq->fair_min_vruntime ) )
+		rdq->fair_min_vruntime = thr->attr.vruntime;
+}
+
+/**
+   CPUごとの実行可能なスレッド数を更新する (内部関数)
+   @param[in] rdq  レディキュー
+   @param[in] mask スレッドのアフィニティ
+   @param[in] add  スレッドを追加する場合は真, 取り外す場合は偽
+   @note レディキューのロックを獲得して呼び出す
+ */
+static void
+account_allowed_cpus_nolock(sched_queue *rdq, cpu_bitmap *mask, bool add){
+	cpu_id cpu;
+
+	for( cpu = 0; KC_CPUS_NR > cpu; ++cpu) {
+
+		if ( !bitops_isset(cpu, mask) )
+			continue;
+
+		if ( add )
+			++rdq->nr_allowed[cpu];
+		else
+			--rdq->nr_allowed[cpu];
+	}
+}
+
+/**
+   スレッドをレディキューに追加する (内部関数)
+   @param[in] rdq レディキュー
+   @param[in] thr 追加するスレッド
+   @note 公平スケジューリングクラスのスレッドは仮想実行時間順のツリーに,
+   それ以外のスレッドは優先度別のキューに追加する
+   @note レディキューのロックを獲得して呼び出す
+ */
+static void
+enqueue_thread_nolock(sched_queue *rdq, thread *thr){
+	thr_prio        prio;
+	thread          *res;
+
+	prio = thr->attr.cur_prio;
+
+	if ( SCHED_FAIR_PRIO(prio) ) {  /* 公平スケジューリングクラス */
+
+		place_fair_thread_nolock(rdq, thr);  /* 仮想実行時間を補正 */
+		res = RB_INSERT(_sched_fair_tree, &rdq->fair_tree, thr); /* ツリーに追加 */
+		kassert( res == NULL );
+	} else {
+
+		if ( queue_is_empty(&rdq->que[prio]) )   /*  キューが空だった場合     */
+			bitops_set(prio, &rdq->bitmap);  /* ビットマップ中のビットをセット */
+
+		queue_add(&rdq->que[prio], &thr->link);  /* キューにスレッドを追加 */
+	}
+	thr->rdq = rdq;     /* 接続先のレディキューを記録 */
+	++rdq->nr_threads;  /* キュー内のスレッド数を更新 */
+
+	/* 取り外し時に同じCPUの計数を減算するため, 追加時のアフィニティを記録する */
+	bitops_copy(&thr->rdq_affinity, &thr->affinity);
+	account_allowed_cpus_nolock(rdq, &thr->rdq_affinity, true);
+}
+
+/**
+   スレッドをレディキューから外す (内部関数)
+   @param[in] rdq レディキュー
+   @param[in] thr 取り外すスレッド
+   @note レディキューのロックを獲得して呼び出す
+ */
+static void
+dequeue_thread_nolock(sched_queue *rdq, thread *thr){
+	thr_prio        prio;
+	thread          *res;
+
+	kassert( thr->rdq == rdq );
+
+	prio = thr->attr.cur_prio;
+
+	if ( SCHED_FAIR_PRIO(prio) ) {  /* 公平スケジューリングクラス */
+
+		res = RB_REMOVE(_sched_fair_tree, &rdq->fair_tree, thr); /* ツリーから削除 */
+		kassert( res == thr );
+	} else {
+
+		queue_del(&rdq->que[prio], &thr->link);  /*  キューからスレッドを削除 */
+		if ( queue_is_empty(&rdq->que[prio]) )   /*  キューが空になった場合   */
+			bitops_clr(prio, &rdq->bitmap);  /*  ビットマップ中のビットをクリア  */
+	}
+	thr->rdq = NULL;    /* レディキューとの接続を解除 */
+	--rdq->nr_threads;  /* キュー内のスレッド数を更新 */
+	account_allowed_cpus_nolock(rdq, &thr->rdq_affinity, false);
+}
+
+/**
+   優先度別キューから指定したCPUで実行可能なスレッドを探す (内部関数)
+   @param[in] rdq     レディキュー
+   @param[in] highest 真の場合は最高優先度のスレッドを, 偽の場合は最低優先度のスレッドを探す
+   @param[in] cpu     スレッドを実行するCPUの論理CPUID
+   @return 見つかったスレッド
+   @retval NULL 優先度別キューに指定したCPUで実行可能なスレッドがない
+   @note レディキューのロックを獲得して呼び出す
+ */
+static thread *
+find_fixed_thread_nolock(sched_queue *rdq, bool highest, cpu_id cpu){
 	thread          *thr;
+	struct _list     *lp;
 	singned_cnt_type idx;
-	intrflags     iflags;
 
-	/* レディキューをロック */
-	spinlock_lock_disable_intr(&ready_queue.lock, &iflags); 
-
-	/* ビットマップの最初に立っているビットの位置を確認  */
-	idx = bitops_ffs(&ready_queue.bitmap);
+	/* ビットマップの最初/最後に立っているビットの位置を確認  */
+	if ( highest )
+		idx = bitops_ffs(&rdq->bitmap);
+	else
+		idx = bitops_fls(&rdq->bitmap);
 	if ( idx == 0 )
-		goto unlock_out;  /* 実行可能なスレッドがない  */
+		return NULL;  /* 実行可能なスレッドがない  */
+
+	/* 優先度順に指定したCPUで実行可能なスレッドを探す */
+	for( --idx; ( idx >= 0 ) && ( SCHED_FIXED_PRIO_NR > idx ); idx += ( highest ? 1 : -1 ) ) {
+
+		if ( !bitops_isset(idx, &rdq->bitmap) )
+			continue;  /* キューが空 */
+
+		queue_for_each(lp, &rdq->que[idx]) {
+
+			thr = container_of(lp, thread, link);
+			if ( bitops_isset(cpu, &thr->affinity) )
+				return thr;  /* 実行可能なスレッドを見つけた */
+		}
+	}
+
+	return NULL;  /* 指定したCPUで実行可能なスレッドがない  */
+}
+
+/**
+   公平スケジューリングツリーから指定したCPUで実行可能なスレッドを探す (内部関数)
+   @param[in] rdq     レディキュー
+   @param[in] highest 真の場合は仮想実行時間が最小のスレッドを, 偽の場合は最大のスレッドを探す
+   @param[in] cpu     スレッドを実行するCPUの論理CPUID
+   @return 見つかったスレッド
+   @retval NULL ツリーに指定したCPUで実行可能なスレッドがない
+   @note レディキューのロックを獲得して呼び出す
+ */
+static thread *
+find_fair_thread_nolock(sched_queue *rdq, bool highest, cpu_id cpu){
+	thread *thr;
+
+	if ( highest ) {
 
-	--idx;  /* レディキュー配列のインデックスに変換 */
+		RB_FOREACH(thr, _sched_fair_tree, &rdq->fair_tree) {
+
+			if ( bitops_isset(cpu, &thr->affinity) )
+				return thr;  /* 実行可能なスレッドを見つけた */
+		}
+	} else {
+
+		RB_FOREACH_REVERSE(thr, _sched_fair_tree, &rdq->fair_tree) {
+
+			if ( bitops_isset(cpu, &thr->affinity) )
+				return thr;  /* 実行可能なスレッドを見つけた */
+		}
+	}
+
+	return NULL;  /* 指定したCPUで実行可能なスレッドがない  */
+}
+
+/**
+   レディキューからスレッドを取り出す (内部関数)
+   @param[in] rdq     レディキュー
+   @param[in] highest 真の場合は最高優先度のスレッドを, 偽の場合は最低優先度のスレッドを取り出す
+   @param[in] cpu     スレッドを実行するCPUの論理CPUID
+   @return 取り出したスレッド
+   @retval NULL レディキューに指定したCPUで実行可能なスレッドがない
+   @note 公平スケジューリングクラスのスレッドは優先度別キューのスレッドより
+   優先度が低いものとして扱い, クラス内では仮想実行時間の小さい順に取り出す
+   @note 指定したCPUでの実行を許可されていないスレッドは取り出さない
+   @note レディキューのロックを獲得して呼び出す
+ */
+static thread *
+pick_thread_nolock(sched_queue *rdq, bool highest, cpu_id cpu){
+	thread          *thr;
+
+	if ( highest ) {
+
+		thr = find_fixed_thread_nolock(rdq, true, cpu);
+		if ( thr == NULL )
+			thr = find_fair_thread_nolock(rdq, true, cpu);
+	} else {
+
+		thr = find_fair_thread_nolock(rdq, false, cpu);
+		if ( thr == NULL )
+			thr = find_fixed_thread_nolock(rdq, false, cpu);
+	}
+	if ( thr == NULL )
+		return NULL;  /* 指定したCPUで実行可能なスレッドがない  */
 
-	/* キューの最初のスレッドを取り出す */
-	thr = container_of(queue_get_top(&ready_queue.que[idx]), thread, link);
-	if ( queue_is_empty(&ready_queue.que[idx]) )   /*  キューが空になった  */
-		bitops_clr(idx, &ready_queue.bitmap);  /* ビットマップ中のビットをクリア */
 	kassert( thr->state == THR_TSTATE_RUNABLE );   /* 実行可能スレッドである事を確認する */
+	dequeue_thread_nolock(rdq, thr);
+
+	return thr;
+}
+
+/**
+   スレッドを追加するCPUを選択する (内部関数)
+   @param[in] thr 追加するスレッド
+   @return 選択したCPUの論理CPUID
+   @note スレッドが最後に動作したCPU, 自CPU, その他のオンラインCPUの順に
+   スレッドのアフィニティに含まれるCPUを選択する.
+   アフィニティに含まれるCPUがオンラインでない場合は, 自CPUを選択する
+ */
+static cpu_id
+select_thread_cpu(thread *thr){
+	cpu_id cpu;
+
+	cpu = thr->tinfo->cpu;  /* 最後に動作したCPU */
+	if ( ( krn_cpuinfo_cpu_is_online(cpu) ) && ( bitops_isset(cpu, &thr->affinity) ) )
+		return cpu;
+
+	cpu = krn_current_cpu_get();  /* 自CPU */
+	if ( bitops_isset(cpu, &thr->affinity) )
+		return cpu;
+
+	FOREACH_ONLINE_CPUS(cpu) {
+
+		if ( bitops_isset(cpu, &thr->affinity) )
+			return cpu;  /* 実行可能なオンラインCPU */
+	}
+
+	return krn_current_cpu_get();  /* 実行可能なCPUがオンラインでない */
+}
+
+/**
+   再スケジュールIPIの送信要否を判定する (内部関数)
+   @param[in] rdq 再スケジュールを要求するCPUのレディキュー
+   @retval 真 再スケジュールIPIを送信する
+   @retval 偽 未処理のIPIがあるため送信を抑止する
+   @note 受信側が未処理のIPIがある場合は, 受信時にまとめて再スケジュール
+   されるため, 送信を抑止する
+   @note レディキューのロックを獲得して呼び出す
+ */
+static bool
+request_resched_ipi_nolock(sched_queue *rdq){
+
+	if ( rdq->resched_pending ) {
+
+		++rdq->ipis_coalesced;  /* 送信を抑止したIPI数を更新 */
+		return false;
+	}
+
+	rdq->resched_pending = true;  /* IPI送信済みに設定 */
+	rdq->ipi_sent_time = hal_get_cpu_cycles();  /* 送信時刻を記録 */
+	++rdq->ipis_sent;       /* 送信したIPI数を更新 */
+
+	return true;
+}
+
+/**
+   指定したCPUで実行可能なスレッドが最も多いレディキューを持つCPUを探す (内部関数)
+   @param[in]  cur_cpu 奪取先のCPUの論理CPUID (探索対象から除く)
+   @param[in]  skip    探索対象から除くCPUのビットマップ
+   @param[out] cpup    見つかったCPUの論理CPUID返却領域
+   @return 見つかったCPUのキュー内のcur_cpuで実行可能なスレッド数
+   (見つからなかった場合は0)
+   @note スレッド数はロックを獲得せずに参照するため, 目安として使用する
+ */
+static obj_cnt_type
+find_busiest_cpu(cpu_id cur_cpu, cpu_bitmap *skip, cpu_id *cpup){
+	cpu_id          cpu;
+	obj_cnt_type     nr;
+	obj_cnt_type    max;
+
+	max = 0;
+	FOREACH_ONLINE_CPUS(cpu) {
+
+		if ( ( cpu == cur_cpu ) || ( bitops_isset(cpu, skip) ) )
+			continue;
+
+		nr = cpu_ready_queue(cpu)->nr_allowed[cur_cpu];
+		if ( nr > max ) {
+
+			max = nr;
+			*cpup = cpu;
+		}
+	}
 
-	 /* レディキューをアンロック */
-	spinlock_unlock_restore_intr(&ready_queue.lock, &iflags);
+	return max;
+}
+
+/**
+   他のCPUのレディキューから実行可能なスレッドを奪取する (内部関数)
+   @param[in] cur_cpu 自CPUの論理CPUID
+   @return 奪取したスレッド
+   @retval NULL 奪取できるスレッドがない
+   @note 自CPUで実行可能なスレッドが最も多いCPUから最高優先度のスレッドを
+   奪取する. 奪取できなかった場合は, 次に多いCPUから奪取する
+ */
+static thread *
+steal_thread(cpu_id cur_cpu){
+	thread          *thr;
+	cpu_id        victim;
+	cpu_bitmap     tried;
+	sched_queue     *rdq;
+	intrflags     iflags;
+
+	bitops_zero(&tried);
+	for( ; ; ) {
+
+		if ( find_busiest_cpu(cur_cpu, &tried, &victim) == 0 )
+			return NULL;  /* 奪取できるスレッドがない */
+
+		rdq = cpu_ready_queue(victim);
+		spinlock_lock_disable_intr(&rdq->lock, &iflags);
+		thr = pick_thread_nolock(rdq, true, cur_cpu);
+		if ( thr != NULL )
+			detach_fair_vruntime_nolock(rdq, thr);  /* 移動元からの相対値に変換 */
+		spinlock_unlock_restore_intr(&rdq->lock, &iflags);
+		if ( thr != NULL )
+			break;  /* スレッドを奪取した */
+
+		/* 他のCPUが先に取り出した場合は, 次の候補から奪取する */
+		bitops_set(victim, &tried);
+	}
+
+	rdq = cpu_ready_queue(cur_cpu);
+	spinlock_lock_disable_intr(&rdq->lock, &iflags);
+	attach_fair_vruntime_nolock(rdq, thr);    /* 自CPUでの値に変換 */
+	update_fair_min_vruntime_nolock(rdq, thr);  /* 最小仮想実行時間を更新 */
+	++rdq->steals;      /* 奪取したスレッド数を更新 */
+	++rdq->migrations;  /* 移動したスレッド数を更新 */
+	spinlock_unlock_restore_intr(&rdq->lock, &iflags);
 
 	return thr;
+}
 
-unlock_out:
-	spinlock_unlock_restore_intr(&ready_queue.lock, &iflags); /* レディキューをアンロック */
-	return NULL;
+/**
+   実行可能なスレッドを返却する
+   @param[in] cur_cpu 自CPUの論理CPUID
+   @return 実行可能なスレッド
+   @return NULL 実行可能なスレッドがない
+   @note 自CPUのレディキューが空の場合は, 他のCPUからスレッドを奪取する
+ */
+static thread * 
+get_next_thread(cpu_id cur_cpu){
+	thread          *thr;
+	sched_queue     *rdq;
+	intrflags     iflags;
+
+	rdq = cpu_ready_queue(cur_cpu);
+
+	/* レディキューをロック */
+	spinlock_lock_disable_intr(&rdq->lock, &iflags); 
+	thr = pick_thread_nolock(rdq, true, cur_cpu);  /* 最高優先度のスレッドを取り出す */
+	if ( thr != NULL )
+		update_fair_min_vruntime_nolock(rdq, thr);  /* 最小仮想実行時間を更新 */
+	/* レディキューをアンロック */
+	spinlock_unlock_restore_intr(&rdq->lock, &iflags);
+
+	if ( thr == NULL )
+		thr = steal_thread(cur_cpu);  /* 他のCPUから奪取する */
+
+	return thr;
 }
 
 /**
-   スレッドをレディキューに追加する
-   @param[in] thr 追加するスレッド
+   スレッドをレディキューに追加する (内部関数)
+   @param[in] thr      追加するスレッド
+   @param[in] migrated 他のCPUのレディキューから移動したスレッドの場合は真
+   (仮想実行時間は移動元の最小仮想実行時間からの相対値)
    @note LO: レディーキューのロック, スレッドのロックの順に獲得
  */
-void
-sched_thread_add(thread *thr){
+static void
+add_thread(thread *thr, bool migrated){
 	bool            tref;
-	thr_prio        prio;
+	bool        send_ipi;
+	cpu_id           cpu;
+	sched_queue     *rdq;
 	intrflags     iflags;
 
 	tref = thr_ref_inc(thr);
@@ -74,32 +527,52 @@ sched_thread_add(thread *thr){
 	kassert(list_not_linked(&thr->link));  
 	kassert( thr->state == THR_TSTATE_RUNABLE ); /* 実行可能スレッドである事を確認する */
 
-	spinlock_lock_disable_intr(&ready_queue.lock, &iflags); /* レディキューをロック */
+	for( ; ; ) {
 
-	prio = thr->attr.cur_prio;
+		cpu = select_thread_cpu(thr);  /* 追加先のCPUを選択する */
+		rdq = cpu_ready_queue(cpu);
 
-	if ( queue_is_empty(&ready_queue.que[prio]) )   /*  キューが空だった場合     */
-		bitops_set(prio, &ready_queue.bitmap);  /* ビットマップ中のビットをセット */
+		spinlock_lock_disable_intr(&rdq->lock, &iflags); /* レディキューをロック */
+		spinlock_lock(&thr->lock);  /* スレッドのロックを獲得 */
 
-	spinlock_lock(&thr->lock);  /* スレッドのロックを獲得 */
-	/* キューにスレッドを追加          */
-	queue_add(&ready_queue.que[prio], &thr->link);
+		/* アフィニティはスレッドのロックを獲得して更新されるため,
+		 * ロック獲得後に選択し直して選択結果が変わらないことを確認する
+		 */
+		if ( select_thread_cpu(thr) == cpu )
+			break;
 
-	if ( thr->tinfo->cpu == krn_current_cpu_get() ) {
+		spinlock_unlock(&thr->lock);  /* スレッドのロックを解放 */
+		/* レディキューをアンロック   */
+		spinlock_unlock_restore_intr(&rdq->lock, &iflags);
+	}
+
+	if ( migrated ) {
+
+		attach_fair_vruntime_nolock(rdq, thr);  /* 移動先での値に変換 */
+		++rdq->migrations;  /* 移動したスレッド数を更新 */
+	}
+	enqueue_thread_nolock(rdq, thr);  /* キューにスレッドを追加 */
+
+	if ( cpu == krn_current_cpu_get() ) {
 
 		spinlock_unlock(&thr->lock);   /* スレッドのロックを解放 */
 		tref = thr_ref_dec(thr);    /* スレッドの参照を解放 */
 		ti_set_delay_dispatch(ti_get_current_thread_info()); /* 遅延ディスパッチ */
 		/* レディキューをアンロック   */
-		spinlock_unlock_restore_intr(&ready_queue.lock, &iflags);
+		spinlock_unlock_restore_intr(&rdq->lock, &iflags);
 	} else {
 
 		spinlock_unlock(&thr->lock);   /* スレッドのロックを解放 */
 		tref = thr_ref_dec(thr);    /* スレッドの参照を解放 */
-		/* TODO: 他のプロセッサで動作中のスレッドの場合はスケジュールIPIを発行 */
+
+		/* 他のプロセッサのキューに追加した場合はスケジュールIPIを発行する */
+		send_ipi = request_resched_ipi_nolock(rdq);
 
 		/* レディキューをアンロック   */
-		spinlock_unlock_restore_intr(&ready_queue.lock, &iflags);
+		spinlock_unlock_restore_intr(&rdq->lock, &iflags);
+
+		if ( send_ipi )
+			hal_cpu_send_resched_ipi(krn_cpuinfo_get(cpu)); /* IPIを送信 */
 	}
 
 	return;
@@ -108,29 +581,158 @@ error_out:
 	return;
 }
 
+/**
+   スレッドをレディキューに追加する
+   @param[in] thr 追加するスレッド
+   @note LO: レディーキューのロック, スレッドのロックの順に獲得
+   @note スレッドが最後に動作したCPUのレディキューに追加する.
+   そのCPUがオンラインでないか, スレッドのアフィニティに含まれない場合は,
+   アフィニティに含まれる他のオンラインCPUのレディキューに追加する
+ */
+void
+sched_thread_add(thread *thr){
+
+	add_thread(thr, false);
+}
+
 /**
    スレッドをレディキューから外す
    @param[in] thr 操作対象スレッド
+   @note 他のCPUが奪取, 負荷分散などで接続先のレディキューを変更するため,
+   スレッドのロックを獲得して接続先を参照し, レディキューのロック獲得後に再確認する
    @note LO: レディーキューのロック, スレッドのロックの順に獲得
  */
 void
 sched_thread_del(thread *thr){
-	thr_prio        prio;
+	sched_queue     *rdq;
 	intrflags     iflags;
 
-	spinlock_lock_disable_intr(&ready_queue.lock, &iflags); /* レディキューをロック */
-	spinlock_lock(&thr->lock);  /* スレッドのロックを獲得 */
+	krn_cpu_save_and_disable_interrupt(&iflags);  /* 割り込み禁止 */
 
-	prio = thr->attr.cur_prio;
+	for( ; ; ) {
+
+		/* 接続中のレディキューをスレッドのロックを獲得して参照する */
+		spinlock_lock(&thr->lock);
+		rdq = thr->rdq;
+		spinlock_unlock(&thr->lock);
+
+		if ( rdq == NULL )
+			goto restore_intr_out;  /* ディスパッチされたためレディキューに接続されていない */
+
+		spinlock_lock(&rdq->lock);  /* レディキューをロック */
+		spinlock_lock(&thr->lock);  /* スレッドのロックを獲得 */
+
+		if ( thr->rdq == rdq )
+			break;  /* ロック獲得までに他のキューに移動していない */
 
-	queue_del(&ready_queue.que[prio], &thr->link);  /*  キューからスレッドを削除 */
-	if ( queue_is_empty(&ready_queue.que[prio]) )   /*  キューが空になった場合   */
-		bitops_clr(prio, &ready_queue.bitmap);  /*  ビットマップ中のビットをクリア  */
+		/* 奪取, 負荷分散, アフィニティ変更により他のキューに移動したため再確認する */
+		spinlock_unlock(&thr->lock);  /* スレッドのロックを解放 */
+		spinlock_unlock(&rdq->lock);  /* レディキューをアンロック */
+	}
+
+	dequeue_thread_nolock(rdq, thr);  /*  キューからスレッドを削除 */
 
 	spinlock_unlock(&thr->lock);  /* スレッドのロックを解放 */
+	spinlock_unlock(&rdq->lock);  /* レディキューをアンロック */
 
-	/* レディキューをアンロック   */
-	spinlock_unlock_restore_intr(&ready_queue.lock, &iflags);
+restore_intr_out:
+	krn_cpu_restore_interrupt(&iflags); /* 割り込み復元 */
+}
+
+/**
+   スレッドをアフィニティに含まれるCPUに移動する
+   @param[in] thr 操作対象スレッド
+   @note レディキューに接続されているスレッドはアフィニティに含まれるCPUの
+   レディキューに移し替える. 実行中のスレッドは動作中のCPUに再スケジュールを
+   要求し, ディスパッチ時にアフィニティに含まれるCPUのレディキューに追加させる
+   @note スレッドのアフィニティ更新後に呼び出す
+   @note LO: レディーキューのロック, スレッドのロックの順に獲得
+ */
+void
+sched_thread_migrate(thread *thr){
+	bool        send_ipi;
+	cpu_id           cpu;
+	cpu_info        *cinf;
+	thr_state      state;
+	sched_queue     *rdq;
+	intrflags     iflags;
+
+	krn_cpu_save_and_disable_interrupt(&iflags);  /* 割り込み禁止 */
+
+	for( ; ; ) {
+
+		/* 接続中のレディキューと状態をスレッドのロックを獲得して参照する */
+		spinlock_lock(&thr->lock);
+		rdq = thr->rdq;
+		state = thr->state;
+		cpu = thr->tinfo->cpu;
+		spinlock_unlock(&thr->lock);
+
+		if ( rdq == NULL )
+			break;  /* レディキューに接続されていない */
+
+		cinf = container_of(rdq, cpu_info, rdq);
+
+		spinlock_lock(&rdq->lock);  /* レディキューをロック */
+		spinlock_lock(&thr->lock);  /* スレッドのロックを獲得 */
+
+		if ( ( thr->rdq == rdq ) && ( bitops_isset(cinf->log_id, &thr->affinity) ) ) {
+
+			/* 移動不要. 奪取可否の判定に使用する実行可能なCPUごとの
+			 * スレッド数を更新後のアフィニティで数え直す
+			 */
+			account_allowed_cpus_nolock(rdq, &thr->rdq_affinity, false);
+			bitops_copy(&thr->rdq_affinity, &thr->affinity);
+			account_allowed_cpus_nolock(rdq, &thr->rdq_affinity, true);
+			spinlock_unlock(&thr->lock);  /* スレッドのロックを解放 */
+			spinlock_unlock(&rdq->lock);  /* レディキューをアンロック */
+			goto restore_intr_out;
+		}
+
+		if ( thr->rdq == rdq ) {  /* ロック獲得までにディスパッチされていない */
+
+			dequeue_thread_nolock(rdq, thr);  /*  キューからスレッドを削除 */
+			detach_fair_vruntime_nolock(rdq, thr);  /* 移動元からの相対値に変換 */
+			spinlock_unlock(&thr->lock);  /* スレッドのロックを解放 */
+			spinlock_unlock(&rdq->lock);  /* レディキューをアンロック */
+
+			add_thread(thr, true);  /* アフィニティに含まれるCPUに追加する */
+			goto restore_intr_out;
+		}
+
+		/* 他のキューに移動したか, ディスパッチされたため再確認する */
+		spinlock_unlock(&thr->lock);  /* スレッドのロックを解放 */
+		spinlock_unlock(&rdq->lock);  /* レディキューをアンロック */
+	}
+
+	/* 休眠中のスレッドは起床時に, 奪取されて実行開始前のスレッドは
+	 * ディスパッチ時に, スレッドのロックを獲得してアフィニティを確認する
+	 */
+	if ( state != THR_TSTATE_RUN )
+		goto restore_intr_out;
+
+	/*
+	 * 実行中のスレッドの場合は動作中のCPUに再スケジュールを要求する
+	 */
+	if ( bitops_isset(cpu, &thr->affinity) )
+		goto restore_intr_out;  /* 移動不要 */
+
+	if ( thr == ti_get_current_thread() ) {
+
+		ti_set_delay_dispatch(thr->tinfo);  /* 遅延ディスパッチ */
+		goto restore_intr_out;
+	}
+
+	rdq = cpu_ready_queue(cpu);
+	spinlock_lock(&rdq->lock);  /* レディキューをロック */
+	send_ipi = request_resched_ipi_nolock(rdq);
+	spinlock_unlock(&rdq->lock);  /* レディキューをアンロック */
+
+	if ( send_ipi )
+		hal_cpu_send_resched_ipi(krn_cpuinfo_get(cpu)); /* IPIを送信 */
+
+restore_intr_out:
+	krn_cpu_restore_interrupt(&iflags); /* 割り込み復元 */
 }
 
 /**
@@ -139,7 +741,6 @@ sched_thread_del(thread *thr){
 void
 sched_schedule(void) {
 	thread  *prev, *next;
-	thread          *cur;
 	cpu_id       cur_cpu;
 	intrflags     iflags;
 
@@ -160,31 +761,48 @@ sched_schedule(void) {
 
 	ti_set_preempt_active();         /* プリエンプションの抑止 */
 
-	next = get_next_thread();        /* 次に実行するスレッドの管理情報を取得 */
+	if ( ( prev->state == THR_TSTATE_RUN ) && ( prev != idle_threads[cur_cpu] ) ) {
+
+		/*  実行中スレッドの場合は, 実行可能に遷移し, 次のスレッドを選択する前に
+		 *  レディキューに戻す. 戻したスレッドより優先すべきスレッドがなければ,
+		 *  そのまま実行を継続する
+		 *  それ以外の場合は回収処理キューに接続されているか, 待ちキューから
+		 *  参照されている状態にあるので, キュー操作を行わない
+		 *  アイドルスレッドはレディキューに戻さない
+		 */
+		prev->state = THR_TSTATE_RUNABLE;  /* 実行中の場合は, 実行可能に遷移 */
+		sched_thread_add(prev);    /* レディキューに戻す             */
+	}
+
+	next = get_next_thread(cur_cpu); /* 次に実行するスレッドの管理情報を取得 */
 	if ( next == NULL )
 		next = idle_threads[cur_cpu];                  /* アイドルスレッドを参照 */
 	kassert( next != NULL );         /* 少なくともアイドルスレッドを参照しているはず */
 
-	ti_clr_delay_dispatch();  /* ディスパッチ要求をクリア */
+	/* ディスパッチ要求をクリア
+	 * (再追加時に自スレッドに設定された遅延ディスパッチ要求も取り下げ,
+	 * 再開直後に再度ディスパッチしないようにする)
+	 */
+	ti_clr_delay_dispatch();
+
+	/* 切り替え先のスレッドの状態を実行中に遷移
+	 * @note 初めて実行されるスレッドはスレッドの開始アドレスから
+	 * 動作を開始するため, 切り替え前に遷移させる
+	 * @note 取り出した後にアフィニティから自CPUが外された場合は,
+	 * 再開後のディスパッチでアフィニティに含まれるCPUに移動させる
+	 */
+	spinlock_lock(&next->lock);  /* スレッドのロックを獲得 */
+	next->state = THR_TSTATE_RUN;
+	next->tinfo->cpu = cur_cpu;  /* 動作するCPUを記録 */
+	if ( !bitops_isset(cur_cpu, &next->affinity) )
+		ti_set_delay_dispatch(next->tinfo);  /* 遅延ディスパッチ */
+	spinlock_unlock(&next->lock);  /* スレッドのロックを解放 */
 
 	if ( prev == next ) /* ディスパッチする必要なし  */
 		goto ena_preempt_out;
 
-	if ( prev->state == THR_TSTATE_RUN ) {
-
-		/*  実行中スレッドの場合は, 実行可能に遷移し, レディキューに戻す
-		 *  それ以外の場合は回収処理キューに接続されているか, 待ちキューから
-		 *  参照されている状態にあるので, キュー操作を行わずスイッチする
-		 */
-		prev->state = THR_TSTATE_RUNABLE;  /* 実行中の場合は, 実行可能に遷移 */
-		sched_thread_add(prev);            /* レディキューに戻す             */
-	}
-
 	thr_thread_switch(prev, next);  /* スレッド切り替え */
 
-	cur = ti_get_current_thread();  /* 自スレッドの管理情報を取得 */
-	cur->state = THR_TSTATE_RUN;    /* スレッドの状態を実行中に遷移 */
-
 ena_preempt_out:
 	ti_clr_preempt_active(); /* プリエンプションの許可 */
 
@@ -237,18 +855,399 @@ sched_idlethread_add(void){
 	 */
 	idle_threads[cpu] = thr;  /* アイドルスレッドを登録 */
 }
+
+/**
+   再スケジュールIPIを処理する
+   @param[in] cpu IPIを受信した論理CPUID
+   @note 受信したCPUで動作中のスレッドに遅延ディスパッチを要求し,
+   割込み出口処理で再スケジュールさせる
+   @note 割込みコンテキストから呼び出す
+ */
+void
+sched_resched_ipi_handler(cpu_id cpu){
+	cpu_info        *cinf;
+	sched_queue     *rdq;
+	intrflags     iflags;
+
+	cinf = krn_cpuinfo_get(cpu);  /* CPU情報を参照 */
+	kassert( cinf != NULL );
+	rdq = &cinf->rdq;
+
+	spinlock_lock_disable_intr(&rdq->lock, &iflags); /* レディキューをロック */
+
+	if ( !rdq->resched_pending )
+		goto unlock_out;  /* 他の割込みと共有した要因による呼び出し */
+
+	rdq->resched_pending = false;  /* 以降の再スケジュール要求ではIPIを送信する */
+	++rdq->ipis_received;          /* 受信したIPI数を更新 */
+	rdq->ipi_latency_cycles += hal_get_cpu_cycles() - rdq->ipi_sent_time;
+
+	if ( cinf->cur_ti != NULL )
+		ti_set_delay_dispatch(cinf->cur_ti);  /* 遅延ディスパッチ */
+
+unlock_out:
+	/* レディキューをアンロック   */
+	spinlock_unlock_restore_intr(&rdq->lock, &iflags);
+}
+
+/**
+   公平スケジューリングクラスの優先度に対応する重みを返却する
+   @param[in] prio 優先度
+   @return 重み
+   @note 公平スケジューリングクラス以外の優先度に対しては標準の重み
+   (SCHED_FAIR_NICE0_WEIGHT)を返却する
+ */
+uint32_t
+sched_fair_prio_to_weight(thr_prio prio){
+
+	if ( !SCHED_FAIR_PRIO(prio) )
+		return SCHED_FAIR_NICE0_WEIGHT;
+
+	return fair_weights[ ( prio - SCHED_MAX_FAIR_PRIO ) * SCHED_FAIR_WEIGHT_LEVELS
+	    / SCHED_PRIO_PER_POLICY ];
+}
+
+/**
+   公平スケジューリングクラスの実行中スレッドに1ティック分の仮想実行時間を加算する (内部関数)
+   @param[in] rdq 自CPUのレディキュー
+   @param[in] cur 実行中のスレッド
+   @retval 真 横取りを要求した
+   @retval 偽 実行を継続する
+   @note 仮想実行時間は, 実行時間にベース優先度から求めた重みの逆数を掛けて求める.
+   待ち合わせ中のスレッドの最小仮想実行時間をSCHED_FAIR_GRANULARITY_MS分
+   超えた場合は遅延ディスパッチを要求する
+ */
+static bool
+fair_timer_tick(sched_queue *rdq, thread *cur){
+	bool         preempt;
+	thread         *left;
+	uint64_t         min;
+	intrflags     iflags;
+
+	spinlock_lock_disable_intr(&rdq->lock, &iflags); /* レディキューをロック */
+
+	cur->attr.vruntime += MS_PER_TICKS * SCHED_FAIR_NS_PER_MS * SCHED_FAIR_NICE0_WEIGHT
+		/ sched_fair_prio_to_weight(cur->attr.base_prio);
+
+	/* 最小仮想実行時間を更新する */
+	left = RB_MIN(_sched_fair_tree, &rdq->fair_tree);
+	min = cur->attr.vruntime;
+	if ( ( left != NULL ) && ( min > left->attr.vruntime ) )
+		min = left->attr.vruntime;
+	if ( min > rdq->fair_min_vruntime )
+		rdq->fair_min_vruntime = min;
+
+	preempt = false;
+	if ( ( left != NULL ) && ( cur->attr.vruntime >
+		( left->attr.vruntime + SCHED_FAIR_GRANULARITY_MS * SCHED_FAIR_NS_PER_MS ) ) ) {
+
+		preempt = true;
+		++rdq->fair_preempts;  /* 横取り数を更新 */
+		ti_set_delay_dispatch(cur->tinfo);  /* 遅延ディスパッチ */
+	}
+
+	/* レディキューをアンロック   */
+	spinlock_unlock_restore_intr(&rdq->lock, &iflags);
+
+	return preempt;
+}
+
+/**
+   実行中スレッドのタイムスライスを更新する
+   @retval 真 タイムスライスを使い切った, または, 仮想実行時間の超過により横取りを要求した
+   @retval 偽 タイムスライスが残っている, または, タイムスライスの対象外である
+   @note タイマ割込みから1ティックごとに呼び出す
+   @note ラウンドロビンクラスのスレッドがタイムスライスを使い切った場合,
+   同じ優先度以上の実行可能スレッドがあれば遅延ディスパッチを要求する.
+   横取りされたスレッドはディスパッチ時にレディキューの末尾に戻される
+   @note 公平スケジューリングクラスのスレッドは仮想実行時間を加算し,
+   仮想実行時間の最も小さいスレッドとの差が大きくなった場合に横取りする
+ */
+bool
+sched_timer_tick(void){
+	thread          *cur;
+	cpu_id           cpu;
+	sched_queue     *rdq;
+	singned_cnt_type idx;
+	intrflags     iflags;
+
+	cur = ti_get_current_thread();  /* 実行中のスレッドを参照 */
+	cpu = krn_current_cpu_get();
+
+	if ( cur == idle_threads[cpu] )
+		return false;  /* タイムスライスの対象外 */
+
+	if ( SCHED_FAIR_PRIO(cur->attr.cur_prio) )
+		return fair_timer_tick(cpu_ready_queue(cpu), cur);
+
+	if ( !SCHED_RR_PRIO(cur->attr.cur_prio) )
+		return false;  /* タイムスライスの対象外 */
+
+	if ( cur->attr.slice > 1 ) {
+
+		--cur->attr.slice;  /* タイムスライスを消費する */
+		return false;
+	}
+
+	cur->attr.slice = KC_TIME_SLICE;  /* 次のタイムスライスを割り当てる */
+
+	rdq = cpu_ready_queue(cpu);
+	spinlock_lock_disable_intr(&rdq->lock, &iflags); /* レディキューをロック */
+
+	idx = bitops_ffs(&rdq->bitmap);  /* 最高優先度のキューを得る */
+	if ( ( idx != 0 ) && ( cur->attr.cur_prio >= ( idx - 1 ) ) ) {
+
+		++rdq->slice_expires;  /* 横取り数を更新 */
+		ti_set_delay_dispatch(cur->tinfo);  /* 遅延ディスパッチ */
+	}
+
+	/* レディキューをアンロック   */
+	spinlock_unlock_restore_intr(&rdq->lock, &iflags);
+
+	return true;
+}
+
+/**
+   他のCPUから奪取可能なスレッドがあることを確認する
+   @retval 真 他のCPUのレディキューに自CPUで実行可能なスレッドがある
+   @retval 偽 他のCPUのレディキューに自CPUで実行可能なスレッドがない
+   @note 他のCPUでの実行に限定されたスレッドは奪取できないため数えない
+   @note アイドルスレッドから呼び出し, 真の場合は再スケジュールして奪取する
+ */
+bool
+sched_has_stealable_thread(void){
+	cpu_id     victim;
+	cpu_bitmap   skip;
+
+	bitops_zero(&skip);
+
+	return ( find_busiest_cpu(krn_current_cpu_get(), &skip, &victim) > 0 );
+}
+
+/**
+   2つのCPUのレディキューをロックする (内部関数)
+   @param[in] cpu1 論理CPUID
+   @param[in] cpu2 論理CPUID (cpu1と異なるCPU)
+   @note デッドロックを避けるため, 論理CPUIDの小さいCPUのレディキューから順にロックする
+   @note 割込み禁止状態で呼び出す
+ */
+static void
+lock_ready_queue_pair(cpu_id cpu1, cpu_id cpu2){
+
+	kassert( cpu1 != cpu2 );
+
+	spinlock_lock(&cpu_ready_queue(MIN(cpu1, cpu2))->lock);
+	spinlock_lock(&cpu_ready_queue(MAX(cpu1, cpu2))->lock);
+}
+
+/**
+   2つのCPUのレディキューをアンロックする (内部関数)
+   @param[in] cpu1 論理CPUID
+   @param[in] cpu2 論理CPUID (cpu1と異なるCPU)
+ */
+static void
+unlock_ready_queue_pair(cpu_id cpu1, cpu_id cpu2){
+
+	spinlock_unlock(&cpu_ready_queue(MAX(cpu1, cpu2))->lock);
+	spinlock_unlock(&cpu_ready_queue(MIN(cpu1, cpu2))->lock);
+}
+
+/**
+   レディキュー間の負荷を分散する
+   @return 移動したスレッド数
+   @note 最もスレッド数の多いキューと最も少ないキューとの差が
+   SCHED_REBALANCE_IMBALANCE未満になるまで, 最低優先度のスレッドを移動する
+   @note 移動中のスレッドがどのキューにも接続されていない状態にならないように,
+   移動元と移動先のレディキューのロックを獲得したまま移動し, 移動先のCPUに
+   再スケジュールを要求する
+ */
+obj_cnt_type
+sched_rebalance(void){
+	thread          *thr;
+	bool        send_ipi;
+	bool         aborted;
+	cpu_id           cpu;
+	cpu_id           src;
+	cpu_id           dst;
+	obj_cnt_type      nr;
+	obj_cnt_type     max;
+	obj_cnt_type     min;
+	obj_cnt_type   moved;
+	sched_queue     *rdq;
+	intrflags     iflags;
+
+	for(moved = 0; ; ++moved) {
+
+		/*
+		 * 最もスレッド数の多いキューと最も少ないキューとを探す
+		 */
+		max = 0;
+		min = 0;
+		src = dst = KC_CPUS_NR;
+		FOREACH_ONLINE_CPUS(cpu) {
+
+			nr = cpu_ready_queue(cpu)->nr_threads;
+			if ( ( src == KC_CPUS_NR ) || ( nr > max ) ) {
+
+				max = nr;
+				src = cpu;
+			}
+			if ( ( dst == KC_CPUS_NR ) || ( min > nr ) ) {
+
+				min = nr;
+				dst = cpu;
+			}
+		}
+
+		if ( ( src == KC_CPUS_NR ) || ( SCHED_REBALANCE_IMBALANCE > ( max - min ) ) )
+			break;  /* 負荷の偏りがない */
+
+		/*
+		 * 最低優先度のスレッドを移動する
+		 */
+		krn_cpu_save_and_disable_interrupt(&iflags);  /* 割り込み禁止 */
+		lock_ready_queue_pair(src, dst);
+
+		send_ipi = false;
+		aborted = false;
+		thr = pick_thread_nolock(cpu_ready_queue(src), false, dst);
+		if ( thr != NULL ) {
+
+			spinlock_lock(&thr->lock);  /* スレッドのロックを獲得 */
+			if ( bitops_isset(dst, &thr->affinity) ) {
+
+				rdq = cpu_ready_queue(dst);
+				/* 仮想実行時間を移動先での値に変換する */
+				detach_fair_vruntime_nolock(cpu_ready_queue(src), thr);
+				attach_fair_vruntime_nolock(rdq, thr);
+				enqueue_thread_nolock(rdq, thr);
+				++rdq->migrations;  /* 移動したスレッド数を更新 */
+
+				/* 移動先のCPUに再スケジュールを要求する */
+				if ( dst == krn_current_cpu_get() )
+					ti_set_delay_dispatch(ti_get_current_thread_info());
+				else
+					send_ipi = request_resched_ipi_nolock(rdq);
+			} else {
+
+				/* 取り出した後にアフィニティが変更された場合は移動元に戻し,
+				 * 移動を打ち切る
+				 */
+				enqueue_thread_nolock(cpu_ready_queue(src), thr);
+				aborted = true;
+			}
+			spinlock_unlock(&thr->lock);  /* スレッドのロックを解放 */
+		}
+
+		unlock_ready_queue_pair(src, dst);
+		krn_cpu_restore_interrupt(&iflags); /* 割り込み復元 */
+
+		if ( ( thr == NULL ) || ( aborted ) )
+			break;  /* 他のCPUが先に取り出したか, 移動可能なスレッドがない */
+
+		if ( send_ipi )
+			hal_cpu_send_resched_ipi(krn_cpuinfo_get(dst)); /* IPIを送信 */
+	}
+
+	return moved;
+}
+
+/**
+   レディキューの統計情報を取得する
+   @param[in]  cpu   論理CPUID
+   @param[out] statp 統計情報返却領域
+   @retval     0       正常終了
+   @retval    -EINVAL  CPUIDが不正
+ */
+int
+sched_obtain_queue_stat(cpu_id cpu, sched_queue_stat *statp){
+	sched_queue     *rdq;
+	intrflags     iflags;
+
+	if ( cpu >= KC_CPUS_NR )
+		return -EINVAL;  /* 不正なCPUID */
+
+	rdq = cpu_ready_queue(cpu);
+	spinlock_lock_disable_intr(&rdq->lock, &iflags);
+	statp->nr_threads = rdq->nr_threads;
+	statp->migrations = rdq->migrations;
+	statp->steals = rdq->steals;
+	statp->ipis_sent = rdq->ipis_sent;
+	statp->ipis_coalesced = rdq->ipis_coalesced;
+	statp->ipis_received = rdq->ipis_received;
+	statp->ipi_latency_cycles = rdq->ipi_latency_cycles;
+	statp->slice_expires = rdq->slice_expires;
+	statp->fair_preempts = rdq->fair_preempts;
+	statp->fair_min_vruntime = rdq->fair_min_vruntime;
+	spinlock_unlock_restore_intr(&rdq->lock, &iflags);
+
+	return 0;
+}
+
+/**
+   定期負荷分散のコールアウト (内部関数)
+   @param[in] ctx     割込みコンテキスト
+   @param[in] private 未使用
+   @note レディキュー間の負荷を分散し, 次回のコールアウトを登録する
+ */
+static void
+rebalance_callout_handler(struct _trap_context __unused *ctx, void __unused *private){
+	int rc;
+
+	sched_rebalance();  /* 負荷を分散する */
+
+	rc = tim_callout_add(SCHED_REBALANCE_PERIOD_MS, rebalance_callout_handler, NULL,
+	    &rebalance_callout);
+	if ( rc != 0 )
+		rebalance_callout = NULL;  /* 定期負荷分散を停止する */
+}
+
+/**
+   定期負荷分散を開始する
+   @note コールアウト機構の初期化後に呼び出す
+ */
+void
+sched_rebalance_init(void){
+	int rc;
+
+	rc = tim_callout_add(SCHED_REBALANCE_PERIOD_MS, rebalance_callout_handler, NULL,
+	    &rebalance_callout);
+	kassert( rc == 0 );
+}
+
 /**
    スケジューラの初期化
  */
 void
 sched_init(void){
-	int i;
+	int            i;
+	cpu_id       cpu;
+	sched_queue *rdq;
+
+	for( cpu = 0; KC_CPUS_NR > cpu; ++cpu) {
 
-	spinlock_init(&ready_queue.lock);  /* ロックを初期化       */
-	bitops_zero(&ready_queue.bitmap);  /* ビットマップを初期化 */
-	for( i = 0; SCHED_PRIO_NR > i; ++i) {
+		rdq = cpu_ready_queue(cpu);
+		spinlock_init(&rdq->lock);  /* ロックを初期化       */
+		bitops_zero(&rdq->bitmap);  /* ビットマップを初期化 */
+		rdq->nr_threads = 0;        /* スレッド数を初期化   */
+		/* CPUごとの実行可能なスレッド数を初期化 */
+		memset(&rdq->nr_allowed[0], 0, sizeof(rdq->nr_allowed));
+		rdq->migrations = 0;        /* 統計情報を初期化     */
+		rdq->steals = 0;
+		rdq->resched_pending = false;  /* 再スケジュールIPI情報を初期化 */
+		rdq->ipis_sent = 0;
+		rdq->ipis_coalesced = 0;
+		rdq->ipis_received = 0;
+		rdq->ipi_sent_time = 0;
+		rdq->ipi_latency_cycles = 0;
+		rdq->slice_expires = 0;
+		rdq->fair_preempts = 0;
+		rdq->fair_min_vruntime = 0;
+		RB_INIT(&rdq->fair_tree);   /* 公平スケジューリングツリーを初期化 */
+		for( i = 0; SCHED_FIXED_PRIO_NR > i; ++i) {
 
-		queue_init(&ready_queue.que[i]);  /* レディキューを初期化 */
+			queue_init(&rdq->que[i]);  /* レディキューを初期化 */
+		}
 	}
 
 	sched_idlethread_add();  /* BSP用のアイドルスレッドを生成 */
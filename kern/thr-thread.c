@@ -129,6 +129,8 @@ create_thread_common(tid id, entry_addr entry, void *usp, void *kstktop, thr_pri
 
 	refcnt_init(&thr->refs);    /* 参照カウンタを初期化(スレッド管理ツリーからの参照分) */
 	list_init(&thr->link);      /* スケジューラキューへのリストエントリを初期化         */
+	thr->rdq = NULL;            /* レディキューに接続されていない                       */
+	bitops_fill(&thr->affinity);  /* 全てのCPUで実行可能にする                          */
 	list_init(&thr->proc_link); /* プロセス内のスレッドキューのリストエントリを初期化   */
 	list_init(&thr->children_link);    /* 子スレッド一覧へのリンクを初期化              */
 	queue_init(&thr->children);        /* 子スレッド一覧を初期化                    */
@@ -142,6 +144,8 @@ create_thread_common(tid id, entry_addr entry, void *usp, void *kstktop, thr_pri
 	thr->attr.ini_prio = prio;   /* 初期化時優先度を初期化 */
 	thr->attr.base_prio = prio;  /* ベース優先度を初期化   */
 	thr->attr.cur_prio = prio;   /* 現在の優先度を初期化   */
+	thr->attr.slice = KC_TIME_SLICE;  /* タイムスライスを初期化 */
+	thr->attr.vruntime = 0;           /* 仮想実行時間を初期化   */
 
 	newstk = kstktop;        /* 指定されたカーネルスタックの先頭アドレスをセットする */
 	if ( newstk == NULL ) {  /* スタックを動的に割り当てる場合 */
@@ -626,6 +630,70 @@ thr_thread_switch(thread *prev, thread *next){
 	ti_update_current_cpu();  /* スレッド情報を更新 */
 }
 
+/**
+   スレッドのアフィニティを設定する
+   @param[in] thr  操作対象スレッド
+   @param[in] mask 実行可能なCPUのビットマップ
+   @retval     0      正常終了
+   @retval    -EINVAL 実行可能なオンラインCPUがない
+   @retval    -ESRCH  終了中のスレッドを指定した
+   @note 実行可能なCPU以外のCPUで動作中/実行待ちのスレッドは,
+   実行可能なCPUに移動する
+ */
+int
+thr_set_affinity(thread *thr, cpu_bitmap *mask){
+	int             rc;
+	bool          tref;
+	cpu_id         cpu;
+	intrflags   iflags;
+
+	rc = -EINVAL;
+	FOREACH_ONLINE_CPUS(cpu) {
+
+		if ( bitops_isset(cpu, mask) ) {
+
+			rc = 0;  /* 実行可能なオンラインCPUがある */
+			break;
+		}
+	}
+	if ( rc != 0 )
+		goto error_out;  /* 実行可能なオンラインCPUがない */
+
+	tref = thr_ref_inc(thr);  /* スレッドへの参照を獲得 */
+	if ( !tref ) {
+
+		rc = -ESRCH;  /* 終了中のスレッド */
+		goto error_out;
+	}
+
+	spinlock_lock_disable_intr(&thr->lock, &iflags);
+	bitops_copy(&thr->affinity, mask);  /* アフィニティを更新 */
+	spinlock_unlock_restore_intr(&thr->lock, &iflags);
+
+	sched_thread_migrate(thr);  /* 実行可能なCPUに移動する */
+
+	thr_ref_dec(thr);  /* スレッドへの参照を解放 */
+
+	return 0;
+
+error_out:
+	return rc;
+}
+
+/**
+   スレッドのアフィニティを取得する
+   @param[in]  thr   操作対象スレッド
+   @param[out] maskp 実行可能なCPUのビットマップ返却領域
+ */
+void
+thr_get_affinity(thread *thr, cpu_bitmap *maskp){
+	intrflags   iflags;
+
+	spinlock_lock_disable_intr(&thr->lock, &iflags);
+	bitops_copy(maskp, &thr->affinity);  /* アフィニティを返却 */
+	spinlock_unlock_restore_intr(&thr->lock, &iflags);
+}
+
 /**
    スレッドへの参照を得る
    @param[in] thr スレッド管理情報
@@ -731,17 +799,27 @@ thr_id_release(tid id){
 */
 void
 thr_idle_loop(void __unused *arg){
-	intrflags iflags;
+	intrflags     iflags;
+	obj_cnt_type  filled;
+	bool       compacted;
 
 	krn_cpu_enable_interrupt();                   /* 割込みを許可する */
 
 	for( ; ; ) {
 
+		/* 割込み許可状態で事前クリア済みページプールにページを補充し,
+		 * 要求されたメモリコンパクションを実行する
+		 */
+		filled = pfdb_zero_pool_fill(PFDB_ZERO_POOL_BATCH);
+		compacted = pfdb_compact_background();
+
 		krn_cpu_save_and_disable_interrupt(&iflags);  /* 割込みを禁止する */
 
 		if ( ti_dispatch_delayed() ) 
 			sched_schedule();  /* ディスパッチ要求に従って再スケジュール */
-		else {
+		else if ( sched_has_stealable_thread() )
+			sched_schedule();  /* 他のCPUから実行可能なスレッドを奪取する */
+		else if ( ( filled == 0 ) && !compacted ) {  /* 処理がない場合に休眠する */
 
 			/** 
 			    @note 多くのCPUでは, 割込み禁止状態に遷移した後でCPU休眠命令を
@@ -780,7 +858,7 @@ thr_idlethread_create(cpu_id cpu, thread **thrp){
 		id = THR_TID_AUTO;  /* アイドルスレッドの番号を自動的に割振る */
 
 	rc = create_thread_common(id, (vm_vaddr)thr_idle_loop, NULL, ti->kstack,
-	    SCHED_MIN_RR_PRIO, THR_THRFLAGS_KERNEL, &thr);
+	    SCHED_MIN_PRIO, THR_THRFLAGS_KERNEL, &thr);
 	if ( rc != 0 )
 		goto error_out;
 
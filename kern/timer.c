@@ -138,7 +138,7 @@ tim_callout_cancel(call_out_ent *ent){
 
 free_ent_out:
 
-	slab_kmem_cache_free((void *)cur);  /* コールアウトエントリを解放  */	
+	slab_kmem_cache_free_obj(&callout_ent_cache, (void *)cur);  /* コールアウトエントリを解放  */
 
 	/* 時刻情報のロックを解放 */
 	spinlock_unlock_restore_intr(&g_walltime.lock, &iflags);
@@ -236,7 +236,8 @@ tim_callout_init(void) {
 	/* コールアウトエントリキャッシュを初期化する
 	 */
 	rc = slab_kmem_cache_create(&callout_ent_cache, "call entry cache", 
-	    sizeof(call_out_ent), SLAB_ALIGN_NONE, 0, KMALLOC_NORMAL, NULL, NULL);
+	    sizeof(call_out_ent), SLAB_ALIGN_NONE, 0,
+	    KMALLOC_NORMAL | KM_SFLAGS_MERGEABLE, NULL, NULL);
 	kassert( rc == 0 );
 
 	return;
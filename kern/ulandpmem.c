@@ -229,15 +229,21 @@ tflib_kernlayout_init(void){
  */
 void
 tflib_kernlayout_finalize(void){
-	int            i;
-	int           rc;
-	void *phys_start;
+	int                  i;
+	int                 rc;
+	void       *phys_start;
+	vm_size    kheap_size;
+	early_kernel_heap   st;
 
 	/* ヒープ領域の予約を解除
+	 * 初期化完了後に返却済みの領域を除き, 予約中の領域のみを解除する
 	 */
+	ekheap_stat(&st);
+	kheap_size = (vm_size)((uintptr_t)st.end - (uintptr_t)st.start);
 	hal_kvaddr_to_phys(area[KHEAP_IDX].pmem, &phys_start);
-	pfdb_unmark_phys_range_reserved((vm_paddr)phys_start, 
-	    (vm_paddr)phys_start + uland_minfo.kheap_size - 1);
+	if ( kheap_size > 0 )
+		pfdb_unmark_phys_range_reserved((vm_paddr)phys_start, 
+		    (vm_paddr)phys_start + kheap_size - 1);
 
 	pfdb_free();  /*  ページフレームDBを破棄する  */
 	for(i = 0; AREA_NUM > i; ++i) {
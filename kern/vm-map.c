@@ -13,6 +13,178 @@
 #include <kern/page-if.h>
 #include <kern/vm-if.h>
 
+#define VM_MAP_BULK_PAGES_MAX (256)  /**< 一括して獲得するページ数の上限 (単位:ページ) */
+
+static kmem_cache pv_cache;  /**< 物理->仮想アドレス変換エントリのキャッシュ */
+
+/**
+   無名ページの物理->仮想アドレス変換エントリを登録する (内部関数)
+   @param[in]  pgt        アドレス空間のページテーブル情報
+   @param[in]  vaddr      マップした仮想アドレス
+   @param[in]  pf         マップしたページのページフレーム情報
+   @retval     0          正常終了
+   @retval    -ENOMEM     メモリ不足
+   @note      アドレス空間のロックを獲得した状態で呼び出す
+ */
+static int
+add_pv_entry(vm_pgtbl pgt, vm_vaddr vaddr, page_frame *pf){
+	int               rc;
+	vm_pv_ent        *pv;
+
+	if ( !PAGE_USED_BY_ANON(pf) )
+		return 0;  /* 無名ページ以外は登録しない */
+
+	rc = slab_kmem_cache_alloc(&pv_cache, KMALLOC_NORMAL, (void **)&pv);
+	if ( rc != 0 )
+		return -ENOMEM;  /* メモリ不足 */
+
+	list_init(&pv->link);
+	pv->pgt = pgt;
+	pv->vaddr = vaddr;
+
+	pfdb_page_lock(pf);
+	queue_add(&pf->pv_head, &pv->link);  /* 変換エントリを登録する */
+	pfdb_page_unlock(pf);
+
+	return 0;
+}
+
+/**
+   無名ページの物理->仮想アドレス変換エントリを削除する (内部関数)
+   @param[in]  pgt        アドレス空間のページテーブル情報
+   @param[in]  vaddr      アンマップする仮想アドレス
+   @param[in]  pf         アンマップするページのページフレーム情報
+   @note      アドレス空間のロックを獲得した状態で呼び出す
+ */
+static void
+del_pv_entry(vm_pgtbl pgt, vm_vaddr vaddr, page_frame *pf){
+	list             *lp;
+	vm_pv_ent        *pv;
+
+	if ( !PAGE_USED_BY_ANON(pf) )
+		return;  /* 無名ページ以外は登録されていない */
+
+	pv = NULL;
+	pfdb_page_lock(pf);
+	queue_for_each(lp, &pf->pv_head) {
+
+		pv = container_of(lp, vm_pv_ent, link);
+		if ( ( pv->pgt == pgt ) && ( pv->vaddr == vaddr ) ) {
+
+			queue_del(&pf->pv_head, &pv->link);  /* 変換エントリを削除する */
+			break;
+		}
+		pv = NULL;
+	}
+	pfdb_page_unlock(pf);
+
+	if ( pv != NULL )
+		slab_kmem_cache_free_obj(&pv_cache, pv);  /* 変換エントリを解放する */
+}
+
+/**
+   無名ページを移動する (内部関数)
+   @param[in] src 移動元ページのページフレーム情報
+   @param[in] dst 移動先ページのページフレーム情報
+   @retval    0      正常終了
+   @retval    -EBUSY ページが使用中のため移動できない
+   @note 1つのアドレス空間からのみマップされているページを移動する
+   @note アドレス空間のロックの獲得を待ち合わせずに処理する
+ */
+static int
+migrate_anon_page(page_frame *src, page_frame *dst){
+	int               rc;
+	bool             res;
+	vm_pv_ent        *pv;
+	vm_pgtbl         pgt;
+	vm_vaddr       vaddr;
+	vm_paddr   map_paddr;
+	vm_prot     map_prot;
+	vm_flags   map_flags;
+	vm_size   map_pgsize;
+	vm_paddr   src_paddr;
+	vm_paddr   dst_paddr;
+	void     *src_kvaddr;
+	void     *dst_kvaddr;
+
+	/*
+	 * マップ先のアドレス空間のロックを獲得する
+	 * 変換エントリを削除する際はアドレス空間のロックを獲得してから
+	 * ページのロックを獲得するため, ページのロック獲得中は
+	 * アドレス空間のロックの獲得を試みるのみとする
+	 */
+	pfdb_page_lock(src);
+	if ( queue_is_empty(&src->pv_head) 
+	    || ( queue_ref_top(&src->pv_head) != queue_ref_last(&src->pv_head) ) ) {
+
+		pfdb_page_unlock(src);
+		return -EBUSY;  /* マップされていないか共有されている */
+	}
+	pv = container_of(queue_ref_top(&src->pv_head), vm_pv_ent, link);
+	pgt = pv->pgt;
+	vaddr = pv->vaddr;
+	rc = mutex_try_lock(&pgt->mtx);
+	pfdb_page_unlock(src);
+	if ( rc != 0 )
+		return -EBUSY;  /* アドレス空間を操作中 */
+
+	rc = pfdb_pfn_to_kvaddr(src->pfn, &src_kvaddr);
+	kassert( rc == 0 );
+	rc = pfdb_kvaddr_to_paddr(src_kvaddr, (void *)&src_paddr);
+	kassert( rc == 0 );
+	rc = pfdb_pfn_to_kvaddr(dst->pfn, &dst_kvaddr);
+	kassert( rc == 0 );
+	rc = pfdb_kvaddr_to_paddr(dst_kvaddr, (void *)&dst_paddr);
+	kassert( rc == 0 );
+
+	/* 移動元ページがマップされていることを確認する */
+	rc = hal_pgtbl_extract(pgt, vaddr, &map_paddr, &map_prot, &map_flags,
+	    &map_pgsize);
+	if ( ( rc != 0 ) || ( map_paddr != src_paddr ) || ( map_pgsize != PAGE_SIZE ) ) {
+
+		rc = -EBUSY;
+		goto unlock_out;
+	}
+
+	vm_copy_kmap_page(dst_kvaddr, src_kvaddr);  /* ページの内容をコピーする */
+
+	/*
+	 * 移動元ページをアンマップして移動先ページをマップする
+	 * 移動元ページへの参照はアンマップ時に解放される
+	 */
+	pfdb_page_lock(src);
+	queue_del(&src->pv_head, &pv->link);
+	pfdb_page_unlock(src);
+
+	hal_pgtbl_remove(pgt, vaddr, map_flags, map_pgsize);
+	rc = hal_pgtbl_enter(pgt, vaddr, dst_paddr, map_prot, map_flags, map_pgsize);
+	if ( rc != 0 ) {
+
+		/* 移動元ページを再マップする */
+		res = pfdb_inc_page_use_count(src);
+		kassert( res );
+		rc = hal_pgtbl_enter(pgt, vaddr, src_paddr, map_prot, map_flags, 
+		    map_pgsize);
+		kassert( rc == 0 );  /* アンマップ時に解放したテーブルを再利用できる */
+
+		pfdb_page_lock(src);
+		queue_add(&src->pv_head, &pv->link);
+		pfdb_page_unlock(src);
+		rc = -EBUSY;
+	} else {
+
+		pfdb_page_lock(dst);
+		queue_add(&dst->pv_head, &pv->link);  /* 変換エントリを付け替える */
+		pfdb_page_unlock(dst);
+	}
+	hal_flush_tlb(pgt);  /* TLBをフラッシュする */
+
+unlock_out:
+	mutex_unlock(&pgt->mtx);
+	return rc;
+}
+
+
 /**
    仮想空間からページをアンマップする (内部関数)
    @param[in]  pgt        アドレス空間のページテーブル情報
@@ -37,6 +209,8 @@ vm_unmap_common(vm_pgtbl pgt, vm_vaddr vaddr, vm_flags flags, vm_size size, bool
 	vm_vaddr   sta_vaddr;
 	vm_vaddr   end_vaddr;
 	vm_vaddr   cur_vaddr;
+	void         *kvaddr;
+	page_frame       *pf;
 
 	/* 転送元アドレスと転送先アドレスをページ境界にそろえる
 	 */
@@ -52,7 +226,17 @@ vm_unmap_common(vm_pgtbl pgt, vm_vaddr vaddr, vm_flags flags, vm_size size, bool
 			goto error_out;
 
 		unmap_flags = flags | map_flags; /* アンマップに使用するフラグ値を算出 */
-		
+
+		/* 管理ページの場合は, 物理->仮想アドレス変換エントリを削除する */
+		if ( ( rc == 0 ) && !( unmap_flags & VM_FLAGS_UNMANAGED ) ) {
+
+			rc = pfdb_paddr_to_kvaddr((void *)map_paddr, &kvaddr);
+			kassert( rc == 0 );  /* マネージドページなので成功するはず */
+			rc = pfdb_kvaddr_to_page_frame(kvaddr, &pf);
+			kassert( rc == 0 );
+			del_pv_entry(pgt, cur_vaddr, pf);
+		}
+
 		/* ページをアンマップする
 		 * ページプール内で管理されているページを割り当てている場合は,
 		 * ページを解放する
@@ -69,41 +253,31 @@ error_out:
 }
 
 /**
-   仮想空間にページをマップする  (内部関数)
+   仮想空間に獲得済みのページをマップする  (内部関数)
    @param[in]  pgt        アドレス空間のページテーブル情報
    @param[in]  vaddr      マップする仮想アドレス
    @param[in]  prot       保護属性
    @param[in]  flags      ページ割り当て要否の判断に使用するマップ属性
    @param[in]  pgsize     マップするページサイズ(単位:バイト)
+   @param[in]  kvaddr     マップするページのカーネル仮想アドレス
    @retval     0          正常終了
    @retval    -ENOENT     ページテーブルまたはラージページがマップされていない
    @retval    -ESRCH      ページがマップされていない, ページサイズが大きすぎる
    @note      ページ単位でのアンマップを行う
    @note      アドレス空間のロックを獲得した状態で呼び出す
+   @note      マップに失敗した場合, ページの解放は呼び出し元で行う
  */
 static int
-vm_map_common(vm_pgtbl pgt, vm_vaddr vaddr, vm_prot prot, vm_flags flags, vm_size pgsize){
+vm_map_common(vm_pgtbl pgt, vm_vaddr vaddr, vm_prot prot, vm_flags flags, vm_size pgsize,
+    void *kvaddr){
 	int               rc;
 	vm_paddr       paddr;
-	void         *kvaddr;
-	page_order     order;
 	page_frame       *pf;
 
 	/* 転送元アドレスと転送先アドレスをページ境界にそろえる
 	 */
 	kassert( !addr_not_aligned(vaddr, pgsize) ); /* ページ境界に揃っていることを確認 */
 
-	/* ページオーダを算出する */
-	rc = pgif_calc_page_order((size_t)pgsize, &order);
-	if ( rc != 0 ) 
-		goto error_out;
-
-	/* メモリを獲得する */
-	rc = pgif_get_free_page_cluster(&kvaddr, order, KMALLOC_NORMAL, 
-	    PAGE_USAGE_ANON);
-	if ( rc != 0 ) 
-		goto error_out;
-
 	/* 割り当てたメモリの物理アドレスを求める */
 	rc = pfdb_kvaddr_to_paddr(kvaddr, (void *)&paddr);
 	kassert( rc == 0 );  /* マネージドページなので成功するはず */
@@ -118,6 +292,15 @@ vm_map_common(vm_pgtbl pgt, vm_vaddr vaddr, vm_prot prot, vm_flags flags, vm_siz
 
 	kassert(pfdb_ref_page_use_count(pf) > 0);
 
+	/* 物理->仮想アドレス変換エントリを登録する */
+	rc = add_pv_entry(pgt, vaddr, pf);
+	if ( rc != 0 ) {
+
+		/* ページの解放は呼び出し元で行うため, 非管理ページとしてアンマップする */
+		hal_pgtbl_remove(pgt, vaddr, flags | VM_FLAGS_UNMANAGED, pgsize);
+		goto error_out;
+	}
+
 	return 0;
 
 error_out:
@@ -158,16 +341,35 @@ vm_copy_range(vm_pgtbl dest, vm_pgtbl src, vm_vaddr vaddr, vm_flags flags, vm_si
 	vm_vaddr      cur_cpy;
 	void      *src_kvaddr;
 	void     *dest_kvaddr;
+	void         **stock;
+	obj_cnt_type    batch;
+	obj_cnt_type stock_nr;
+	obj_cnt_type stock_idx;
 
 	/* 転送元アドレスと転送先アドレスをページ境界にそろえる
 	 */
 	sta_vaddr = PAGE_TRUNCATE(vaddr);         /* 開始仮想アドレス */
 	end_vaddr = PAGE_ROUNDUP(vaddr + size);   /* 終了仮想アドレス */
 
+	/* ノーマルページのコピー先ページを一括して獲得するための格納域を獲得する
+	 */
+	batch = MIN( (end_vaddr - sta_vaddr) >> PAGE_SHIFT, VM_MAP_BULK_PAGES_MAX);
+	stock = NULL;
+	if ( batch > 0 ) {
+
+		stock = kmalloc(sizeof(void *) * batch, KMALLOC_NORMAL);
+		if ( stock == NULL ) {
+			
+			rc = -ENOMEM;  /* メモリ不足 */
+			goto error_out;
+		}
+	}
+	stock_nr = stock_idx = 0;
+
 	/*  コピー先アドレス空間のページテーブルmutexを獲得する */
 	rc = mutex_lock(&dest->mtx);	
 	if ( rc != 0 )
-		goto error_out;
+		goto free_stock_out;
 	/*  コピー元アドレス空間のページテーブルmutexを獲得する */
 	if ( dest != src ) {
 
@@ -214,11 +416,33 @@ vm_copy_range(vm_pgtbl dest, vm_pgtbl src, vm_vaddr vaddr, vm_flags flags, vm_si
 			dest_pgsize = PAGE_SIZE << order;  /*  コピー先のページサイズ */
 			kassert( src_pgsize == dest_pgsize );
 
-			/* メモリを獲得する */
-			rc = pgif_get_free_page_cluster(&dest_kvaddr, order, KMALLOC_NORMAL, 
-			    PAGE_USAGE_ANON);
-			if ( rc != 0 ) 
-				goto unmap_out;
+			if ( order == 0 ) {
+
+				/* ノーマルページは残りの領域分をまとめて獲得しておき,
+				 * 順番に使用する. コピー元の内容で上書きするためクリアしない.
+				 */
+				if ( stock_idx == stock_nr ) {
+
+					stock_nr = MIN( (end_vaddr - cur_vaddr) >> PAGE_SHIFT, 
+					    batch);
+					stock_idx = 0;
+					rc = pgif_get_free_pages_bulk(stock, stock_nr, 0,
+					    KMALLOC_NOCLR, PAGE_USAGE_ANON);
+					if ( rc != 0 ) {
+
+						stock_nr = 0;
+						goto unmap_out;
+					}
+				}
+				dest_kvaddr = stock[stock_idx++];
+			} else {
+
+				/* メモリを獲得する */
+				rc = pgif_get_free_page_cluster(&dest_kvaddr, order, 
+				    KMALLOC_NORMAL, PAGE_USAGE_ANON);
+				if ( rc != 0 ) 
+					goto unmap_out;
+			}
 
 			/*  ページの内容をコピーする
 			 *  @note vm_copy_kmap_pageはノーマルページサイズのコピー処理なので
@@ -236,8 +460,12 @@ vm_copy_range(vm_pgtbl dest, vm_pgtbl src, vm_vaddr vaddr, vm_flags flags, vm_si
 		}
 
 		/*  ページをマップする */
-		rc = hal_pgtbl_enter(dest, cur_vaddr, dest_paddr, dest_prot, dest_flags, 
-		    dest_pgsize);
+		if ( dest_flags & VM_FLAGS_UNMANAGED )
+			rc = hal_pgtbl_enter(dest, cur_vaddr, dest_paddr, dest_prot, 
+			    dest_flags, dest_pgsize);
+		else
+			rc = vm_map_common(dest, cur_vaddr, dest_prot, dest_flags, 
+			    dest_pgsize, dest_kvaddr);
 		if ( ( rc != 0 ) && ( ( dest_flags & VM_FLAGS_UNMANAGED ) == 0 ) ) {
 			
 			/* 管理ページを獲得済みの場合は, 獲得したページを解放 */
@@ -254,6 +482,13 @@ vm_copy_range(vm_pgtbl dest, vm_pgtbl src, vm_vaddr vaddr, vm_flags flags, vm_si
 	if ( dest != src )
 		mutex_unlock(&dest->mtx);
 
+	if ( stock != NULL ) {
+
+		/* 使用しなかったページを解放する */
+		pgif_free_pages_bulk(&stock[stock_idx], stock_nr - stock_idx);
+		kfree(stock);  /* 格納域を解放する */
+	}
+
 	return  0;
 
 unmap_out:
@@ -270,6 +505,15 @@ unlock_dest_out:
 	/*  コピー先アドレス空間のページテーブルmutexを解放する */
 	if ( dest != src )
 		mutex_unlock(&dest->mtx);
+
+free_stock_out:
+	if ( stock != NULL ) {
+
+		/* 使用しなかったページを解放する */
+		pgif_free_pages_bulk(&stock[stock_idx], stock_nr - stock_idx);
+		kfree(stock);  /* 格納域を解放する */
+	}
+
 error_out:
 	return rc;
 }
@@ -355,6 +599,11 @@ int
 vm_map_userpage(vm_pgtbl pgt, vm_vaddr vaddr, vm_prot prot, vm_flags flags, 
     vm_size pgsize, vm_size size){
 	int                rc;
+	page_order      order;
+	obj_cnt_type    batch;
+	obj_cnt_type      cnt;
+	obj_cnt_type        i;
+	void          **pages;
 	vm_vaddr    sta_vaddr;
 	vm_vaddr    end_vaddr;
 	vm_vaddr    map_vaddr;
@@ -374,30 +623,86 @@ vm_map_userpage(vm_pgtbl pgt, vm_vaddr vaddr, vm_prot prot, vm_flags flags,
 	if ( end_vaddr < sta_vaddr )
 		return -EINVAL;
 
+	if ( end_vaddr == sta_vaddr )
+		return 0;  /* マップする領域がない */
+
+	/* ページオーダを算出する */
+	rc = pgif_calc_page_order((size_t)pgsize, &order);
+	if ( rc != 0 ) 
+		goto error_out;
+
+	/* 一括して獲得するページ数を算出し, ページアドレスの格納域を獲得する
+	 */
+	batch = MIN(roundup_align(end_vaddr - sta_vaddr, pgsize) / pgsize, 
+	    VM_MAP_BULK_PAGES_MAX);
+	pages = kmalloc(sizeof(void *) * batch, KMALLOC_NORMAL);
+	if ( pages == NULL ) {
+
+		rc = -ENOMEM;  /* メモリ不足 */
+		goto error_out;
+	}
+
 	rc = mutex_lock(&pgt->mtx);	 /*  アドレス空間のページテーブルmutexを獲得する */
 	if ( rc != 0 )
-		goto error_out;
+		goto free_pages_out;
 
 	/*
 	 * 物理ページをマップする
 	 */
+	map_flags = flags & ~( VM_FLAGS_UNMANAGED | VM_FLAGS_SUPERVISOR );
 	for( map_vaddr = sta_vaddr; end_vaddr > map_vaddr; ) {
 
-		map_flags = flags & ~( VM_FLAGS_UNMANAGED | VM_FLAGS_SUPERVISOR );
-		rc = vm_map_common(pgt, map_vaddr, prot, map_flags, pgsize);
+		/* 残りの領域に必要なページをまとめて獲得する */
+		cnt = MIN(roundup_align(end_vaddr - map_vaddr, pgsize) / pgsize, batch);
+		rc = pgif_get_free_pages_bulk(pages, cnt, order, KMALLOC_ZEROED, 
+		    PAGE_USAGE_ANON);
 		if ( rc != 0 )
 			goto unmap_out;
 
-		map_vaddr += pgsize;  /* 次のページへ */
+		for( i = 0; cnt > i; ++i) {
+
+			rc = vm_map_common(pgt, map_vaddr, prot, map_flags, pgsize, pages[i]);
+			if ( rc != 0 ) {
+
+				/* マップしていないページを解放する */
+				pgif_free_pages_bulk(&pages[i], cnt - i);
+				goto unmap_out;
+			}
+
+			map_vaddr += pgsize;  /* 次のページへ */
+		}
 	}
 	mutex_unlock(&pgt->mtx);	 /*  アドレス空間のページテーブルmutexを解放する */
+	kfree(pages);  /* ページアドレスの格納域を解放する */
+
 	return 0;
 
 unmap_out:
 	vm_unmap_common(pgt, sta_vaddr, flags, map_vaddr - sta_vaddr, true);
 	mutex_unlock(&pgt->mtx);	 /*  アドレス空間のページテーブルmutexを解放する */
 
+free_pages_out:
+	kfree(pages);  /* ページアドレスの格納域を解放する */
+
 error_out:
 	return rc;
 }
 
+/**
+   仮想空間のマップ処理を初期化する
+ */
+void
+vm_map_init(void){
+	int rc;
+
+	/* 物理->仮想アドレス変換エントリのキャッシュを初期化する
+	 */
+	rc = slab_kmem_cache_create(&pv_cache, "vm pv cache", sizeof(vm_pv_ent),
+	    SLAB_ALIGN_NONE,  0, KMALLOC_NORMAL | KM_SFLAGS_MERGEABLE, NULL, NULL);
+	kassert( rc == 0 );
+
+	/* 無名ページの移動関数を登録する
+	 */
+	rc = pfdb_register_migrate_handler(PAGE_USAGE_ANON, migrate_anon_page);
+	kassert( rc == 0 );
+}
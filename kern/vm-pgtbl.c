@@ -14,6 +14,7 @@
 #include <kern/vm-if.h>
 
 static kmem_cache pgtbl_cache;  /* ページテーブル情報のキャッシュ */
+static page_color g_pgtbl_color;  /* アドレス空間に割り当てるカラー選択開始位置 */
 
 /**
    ページテーブル用にページを割り当てる
@@ -30,8 +31,10 @@ pgtbl_alloc_pgtbl_page(vm_pgtbl pgt, hal_pte **tblp, vm_paddr *paddrp){
 	void     *paddr;
 
 	/* ページテーブル割り当て
+	 * アドレス空間ごとにカラーを循環させてキャッシュセットの競合を避ける
 	 */
-	rc = pgif_get_free_page(&tbl, KMALLOC_NORMAL, PAGE_USAGE_PGTBL);
+	rc = pgif_get_free_page_color(&tbl, pgif_next_page_color(&pgt->next_color),
+	    KMALLOC_ZEROED, PAGE_USAGE_PGTBL);
 	if ( rc != 0 ) {
 		
 		rc = -ENOMEM;   /* メモリ不足  */
@@ -82,6 +85,8 @@ pgtbl_alloc_pgtbl(vm_pgtbl *pgtp){
 	bitops_zero(&pgt->active);      /* ビットマップを初期化                */
 	mutex_init(&pgt->mtx);          /* ミューテックスの初期化              */
 	statcnt_set(&pgt->nr_pages, 0); /* ページテーブルのページ数を0に初期化 */
+	/* アドレス空間ごとにカラー選択開始位置をずらす */
+	pgt->next_color = pgif_next_page_color(&g_pgtbl_color);
 
 	/* カーネルのページテーブルベースページを割り当てる
 	 */
@@ -156,7 +161,7 @@ pgtbl_free_user_pgtbl(vm_pgtbl pgt){
 
 	mutex_unlock(&pgt->mtx);            /* ミューテックスの解放        */
 
-	slab_kmem_cache_free((void *)pgt);  /* ページテーブル情報を解放    */
+	slab_kmem_cache_free_obj(&pgtbl_cache, (void *)pgt);  /* ページテーブル情報を解放    */
 
 	return ;
 }
@@ -171,6 +176,6 @@ vm_pgtbl_cache_init(void){
 	/* ページテーブルキャッシュを初期化する
 	 */
 	rc = slab_kmem_cache_create(&pgtbl_cache, "pgtbl cache", sizeof(vm_pgtbl_type),
-	    SLAB_ALIGN_NONE,  0, KMALLOC_NORMAL, NULL, NULL);
+	    SLAB_ALIGN_NONE,  0, KMALLOC_NORMAL | KM_SFLAGS_MERGEABLE, NULL, NULL);
 	kassert( rc == 0 );
 }
@@ -95,11 +95,14 @@ wque_is_empty(wque_waitqueue *wque){
  */
 void
 wque_init_wque_entry(wque_entry *ent){
+	thread      *cur;
 	intrflags iflags;
 
-	spinlock_lock_disable_intr(&ent->thr->lock, &iflags); /* スレッドをロック */
+	cur = ti_get_current_thread();  /* 自スレッドの管理情報を取得 */
+
+	spinlock_lock_disable_intr(&cur->lock, &iflags); /* スレッドをロック */
 	init_wque_entry_nolock(ent);              /* スレッドをウエイトキューに追加する */
-	spinlock_unlock_restore_intr(&ent->thr->lock, &iflags); /* スレッドをアンロック */
+	spinlock_unlock_restore_intr(&cur->lock, &iflags); /* スレッドをアンロック */
 }
 
 /**
@@ -89,6 +89,35 @@ ekheap_paddr_to_kvaddr(void *paddr, void **kvaddrp){
 	*kvaddrp = kvaddr;  /*  変換結果を返却する  */
 }
 
+/**
+   初期カーネルヒープの未使用領域を切り離す
+   @param[out] pstartp 切り離した領域の開始物理アドレス返却領域
+   @param[out] pendp   切り離した領域の終了物理アドレス返却領域
+   @return 切り離した領域のサイズ (単位: バイト)
+   @note 現在のヒープポインタを含むページの次のページから終端までを切り離し,
+   以後のヒープの伸長を禁止する
+ */
+vm_size
+ekheap_retire(vm_paddr *pstartp, vm_paddr *pendp){
+	void  *new_end;
+	vm_size   size;
+
+	/*  使用中の領域の終端をページ境界に合わせる  */
+	new_end = (void *)PAGE_ROUNDUP((uintptr_t)ekheap.cur);
+	if ( new_end >= ekheap.end )
+		return 0;  /*  切り離せる領域がない  */
+
+	size = (vm_size)((uintptr_t)ekheap.end - (uintptr_t)new_end);
+
+	/*  切り離す領域の物理アドレスを算出する  */
+	*pstartp = ekheap.pstart + (vm_paddr)((uintptr_t)new_end - (uintptr_t)ekheap.start);
+	*pendp = *pstartp + size;
+
+	ekheap.end = new_end;  /*  ヒープの終端を縮める  */
+
+	return size;
+}
+
 /**
    初期カーネルヒープを初期化する
    @param[in] pstart 開始物理アドレス
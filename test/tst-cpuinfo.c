@@ -31,6 +31,20 @@ cpuinfo1(struct _ktest_stats *sp, void __unused *arg){
 		ktest_pass( sp );
 	else
 		ktest_fail( sp );
+
+	/* 範囲外のCPUはオンラインでない */
+	res = krn_cpuinfo_cpu_is_online(KC_CPUS_NR);
+	if ( !res )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 範囲外のCPUや既にオンラインのCPUはオンラインにできない */
+	if ( ( krn_cpuinfo_online(KC_CPUS_NR) == -EINVAL )
+	    && ( krn_cpuinfo_online(cpu_num) == -EBUSY ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
 	kprintf("dcache-linesize: %x dcache-size: %lu color: %lu\n",
 	    krn_get_cpu_l1_dcache_linesize(), 
 	    krn_get_cpu_dcache_size(),
@@ -69,10 +69,56 @@ pcache1(struct _ktest_stats *sp, void __unused *arg){
 	
 }
 
+/**
+   ページキャッシュのページの移動のテスト
+ */
+static void
+pcache2(struct _ktest_stats *sp, void __unused *arg){
+	int            rc;
+	page_cache    *pc;
+	page_frame    *pf;
+	void     *oldpage;
+	uint8_t      save;
+	obj_cnt_type free_nr;
+
+	rc = pagecache_get(FS_FSIMG_DEVID, 0,  &pc);
+	if ( rc == 0 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 使用中のページは移動できない */
+	pf = pc->pf;
+	oldpage = pc->pc_data;
+	save = *(uint8_t *)oldpage;
+	rc = pfdb_migrate_page(pf);
+	if ( rc == -EBUSY )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+	pagecache_put(pc);
+
+	/* LRU中のページを移動すると別のページに同じ内容が格納される */
+	rc = pfdb_migrate_page(pf);
+	if ( ( rc == 0 ) && ( pc->pf != pf ) && ( pc->pc_data != oldpage ) 
+	    && ( pc->pf->pcachep == pc ) && ( *(uint8_t *)pc->pc_data == save )
+	    && !PAGE_IS_USED(pf) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	pagecache_shrink_pages(1, false, &free_nr);
+	if ( free_nr == 1 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+}
+
 void
 tst_pcache(void){
 
 	ktest_def_test(&tstat_pcache, "pcache1", pcache1, NULL);
+	ktest_def_test(&tstat_pcache, "pcache2", pcache2, NULL);
 	ktest_run(&tstat_pcache);
 }
 
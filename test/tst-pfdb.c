@@ -0,0 +1,908 @@
+/* -*- mode: C; coding:utf-8 -*- */
+/**********************************************************************/
+/*  OS kernel sample                                                  */
+/*  Copyright 2019 Takeharu KATO                                      */
+/*                                                                    */
+/*  test routine                                                      */
+/*                                                                    */
+/**********************************************************************/
+
+#include <klib/freestanding.h>
+#include <kern/kern-common.h>
+#include <kern/page-if.h>
+
+#include <kern/ktest.h>
+
+#define TST_PFDB_PAGES_NR  (PFDB_PCP_HIGH * 2)  /* 獲得ページ数 */
+#define TST_PFDB_KFREE_NR  (1024)               /* kfree計測回数 */
+#define TST_PFDB_KFREE_SIZ (64)                 /* kfree計測オブジェクト長 */
+#define TST_PFDB_MERGE_NR  (512)                /* バディ結合計測ページ数 */
+#define TST_PFDB_MERGE_LOOP (8)                 /* バディ結合計測回数 */
+#define TST_PFDB_CMA_NR    (300)                /* 連続領域のページ数 */
+#define TST_PFDB_CMA_ALIGN (128)                /* 連続領域の境界 (単位:ページ) */
+
+static ktest_stats tstat_pfdb=KTEST_INITIALIZER;
+
+static void *pages[TST_PFDB_PAGES_NR];
+static void *objs[TST_PFDB_KFREE_NR];
+static void *merge_pages[TST_PFDB_MERGE_NR];
+
+/**
+   CPU単位ページキャッシュのテスト
+ */
+static void
+pfdb1(struct _ktest_stats *sp, void __unused *arg){
+	int             rc;
+	int              i;
+	void          *pg1;
+	void          *pg2;
+	page_frame     *pf;
+	pfdb_stat       st;
+	obj_cnt_type  hits;
+	obj_cnt_type drains;
+
+	kcom_obtain_pfdb_stat(&st);
+	if ( ( st.pcp_high == PFDB_PCP_HIGH ) && ( st.pcp_low == PFDB_PCP_LOW )
+	    && ( st.pcp_batch == PFDB_PCP_BATCH ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * 解放したページはCPU単位ページキャッシュに格納され,
+	 * 次の獲得時に再利用される
+	 */
+	rc = pgif_get_free_page(&pg1, KMALLOC_NORMAL, PAGE_USAGE_KERN);
+	if ( rc == 0 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	rc = pfdb_kvaddr_to_page_frame(pg1, &pf);
+	if ( ( rc == 0 ) && PAGE_IS_USED(pf) && !PAGE_IS_PCP(pf) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	kcom_obtain_pfdb_stat(&st);
+	hits = st.pcp_hits;
+
+	pgif_free_page(pg1);
+	if ( !PAGE_IS_USED(pf) && PAGE_IS_PCP(pf) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	rc = pgif_get_free_page(&pg2, KMALLOC_NORMAL, PAGE_USAGE_KERN);
+	if ( ( rc == 0 ) && ( pg1 == pg2 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	kcom_obtain_pfdb_stat(&st);
+	if ( st.pcp_hits == ( hits + 1 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+	pgif_free_page(pg2);
+
+	/*
+	 * 高水位を超えたページはバディプールに返却される
+	 */
+	for(i = 0; TST_PFDB_PAGES_NR > i; ++i) {
+
+		rc = pgif_get_free_page(&pages[i], KMALLOC_NORMAL, PAGE_USAGE_KERN);
+		if ( rc == 0 )
+			ktest_pass( sp );
+		else
+			ktest_fail( sp );
+	}
+
+	kcom_obtain_pfdb_stat(&st);
+	drains = st.pcp_drains;
+
+	for(i = 0; TST_PFDB_PAGES_NR > i; ++i)
+		pgif_free_page(pages[i]);
+
+	kcom_obtain_pfdb_stat(&st);
+	if ( ( st.pcp_drains > drains ) && ( PFDB_PCP_HIGH * KC_CPUS_NR >= st.pcp_pages ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * キャッシュ中のページを全て返却する
+	 */
+	pfdb_pcp_drain_all();
+	kcom_obtain_pfdb_stat(&st);
+	if ( st.pcp_pages == 0 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+}
+
+/**
+   ページの一括獲得/解放のテスト
+ */
+static void
+pfdb2(struct _ktest_stats *sp, void __unused *arg){
+	int             rc;
+	int              i;
+	page_order   order;
+	page_frame     *pf;
+	pfdb_stat   before;
+	pfdb_stat    after;
+
+	for(order = 0; 2 > order; ++order) {
+
+		kcom_obtain_pfdb_stat(&before);
+		rc = pgif_get_free_pages_bulk(pages, TST_PFDB_PAGES_NR, order, 
+		    KMALLOC_NORMAL, PAGE_USAGE_KERN);
+		if ( rc == 0 )
+			ktest_pass( sp );
+		else
+			ktest_fail( sp );
+
+		for(i = 0; TST_PFDB_PAGES_NR > i; ++i) {
+
+			rc = pfdb_kvaddr_to_page_frame(pages[i], &pf);
+			if ( ( rc == 0 ) && PAGE_IS_USED(pf) && ( pf->order == order )
+			    && ( pfdb_ref_page_use_count(pf) == 1 ) 
+			    && ( ( i == 0 ) || ( pages[i - 1] != pages[i] ) ) )
+				ktest_pass( sp );
+			else
+				ktest_fail( sp );
+		}
+
+		kcom_obtain_pfdb_stat(&after);
+		if ( after.kdata_pages == 
+		    ( before.kdata_pages + ( TST_PFDB_PAGES_NR << order ) ) )
+			ktest_pass( sp );
+		else
+			ktest_fail( sp );
+
+		/* 空きページがあるオーダのビットマスクとオーダ別空きページ数が一致する */
+		for(i = 0; PAGE_POOL_MAX_ORDER > i; ++i) {
+
+			if ( ( ( after.free_order_mask & ( ULONG_C(1) << i ) ) != 0 )
+			    == ( after.free_nr[i] > 0 ) )
+				ktest_pass( sp );
+			else
+				ktest_fail( sp );
+		}
+
+		pgif_free_pages_bulk(pages, TST_PFDB_PAGES_NR);
+
+		kcom_obtain_pfdb_stat(&after);
+		if ( after.kdata_pages == before.kdata_pages )
+			ktest_pass( sp );
+		else
+			ktest_fail( sp );
+	}
+
+	/* 不正なオーダ */
+	rc = pgif_get_free_pages_bulk(pages, 1, PAGE_POOL_MAX_ORDER, 
+	    KMALLOC_NORMAL, PAGE_USAGE_KERN);
+	if ( rc == -ESRCH )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+}
+
+/**
+   ページフレーム情報変換のテスト
+ */
+static void
+pfdb3(struct _ktest_stats *sp, void __unused *arg){
+	int             rc;
+	int              i;
+	int            cnt;
+	obj_cnt_type   pfn;
+	page_frame     *pf;
+	page_frame    *pf2;
+	uint64_t     start;
+	uint64_t      cost;
+
+	/*
+	 * ページフレーム番号とページフレーム情報の変換
+	 */
+	rc = pgif_get_free_pages_bulk(pages, TST_PFDB_PAGES_NR, 0, 
+	    KMALLOC_NORMAL, PAGE_USAGE_KERN);
+	if ( rc == 0 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	for(i = 0; TST_PFDB_PAGES_NR > i; ++i) {
+
+		rc = pfdb_kvaddr_to_page_frame(pages[i], &pf);
+		if ( rc == 0 )
+			ktest_pass( sp );
+		else
+			ktest_fail( sp );
+
+		rc = pfdb_kvaddr_to_pfn(pages[i], &pfn);
+		if ( ( rc == 0 ) && ( pf->pfn == pfn ) )
+			ktest_pass( sp );
+		else
+			ktest_fail( sp );
+
+		rc = pfdb_pfn_to_page_frame(pfn, &pf2);
+		if ( ( rc == 0 ) && ( pf == pf2 ) && kcom_is_pfn_valid(pfn) )
+			ktest_pass( sp );
+		else
+			ktest_fail( sp );
+	}
+	pgif_free_pages_bulk(pages, TST_PFDB_PAGES_NR);
+
+	/* 登録されていないページフレーム番号 */
+	pfn = ( PFDB_SECTIONS_NR + 1 ) << PFDB_SECTION_PFN_SHIFT;
+	rc = pfdb_pfn_to_page_frame(pfn, &pf);
+	if ( ( rc == -ESRCH ) && !kcom_is_pfn_valid(pfn) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * kfreeの処理時間を計測する
+	 */
+	for(cnt = 0; TST_PFDB_KFREE_NR > cnt; ++cnt) {
+
+		objs[cnt] = kmalloc(TST_PFDB_KFREE_SIZ, KMALLOC_NORMAL);
+		if ( objs[cnt] == NULL )
+			break;
+	}
+	if ( cnt == TST_PFDB_KFREE_NR )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	start = hal_get_cpu_cycles();
+	for(i = 0; cnt > i; ++i) 
+		kfree(objs[i]);
+	cost = hal_get_cpu_cycles() - start;
+
+	if ( cnt > 0 )
+		kprintf("pfdb3: kfree %d objects: %qu cycles/op\n", 
+		    cnt, cost / cnt);
+}
+
+/**
+   ページフレーム情報のロックとバディ結合性能のテスト
+ */
+static void
+pfdb4(struct _ktest_stats *sp, void __unused *arg){
+	int             rc;
+	int              i;
+	page_frame     *pf;
+	uint64_t     start;
+	uint64_t      cost;
+
+	/*
+	 * ビットロック
+	 */
+	rc = pgif_get_free_page(&pages[0], KMALLOC_NORMAL, PAGE_USAGE_KERN);
+	if ( rc == 0 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	rc = pfdb_kvaddr_to_page_frame(pages[0], &pf);
+	kassert( rc == 0 );
+
+	pfdb_page_lock(pf);
+	if ( PAGE_IS_LOCKED(pf) && PAGE_IS_USED(pf) && PAGE_USED_BY_KERN(pf)
+	    && !pfdb_page_trylock(pf) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	pfdb_page_unlock(pf);
+	if ( !PAGE_IS_LOCKED(pf) && PAGE_IS_USED(pf) && PAGE_USED_BY_KERN(pf) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	if ( pfdb_page_trylock(pf) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+	pfdb_page_unlock(pf);
+
+	pgif_free_page(pages[0]);
+
+	/*
+	 * バディ結合の処理時間を計測する
+	 * (一括解放はCPU単位ページキャッシュを経由せずにバディに返却する)
+	 */
+	for(i = 0, cost = 0; TST_PFDB_MERGE_LOOP > i; ++i) {
+
+		rc = pgif_get_free_pages_bulk(merge_pages, TST_PFDB_MERGE_NR, 0, 
+		    KMALLOC_NOCLR, PAGE_USAGE_KERN);
+		if ( rc != 0 ) {
+
+			ktest_fail( sp );
+			return;
+		}
+
+		start = hal_get_cpu_cycles();
+		pgif_free_pages_bulk(merge_pages, TST_PFDB_MERGE_NR);
+		cost += hal_get_cpu_cycles() - start;
+	}
+	ktest_pass( sp );
+
+	kprintf("pfdb4: page_frame %qu bytes/page, "
+	    "buddy free and merge %qu cycles/page\n", 
+	    (uint64_t)sizeof(page_frame),
+	    cost / ( TST_PFDB_MERGE_NR * TST_PFDB_MERGE_LOOP ) );
+}
+
+/**
+   事前クリア済みページプールのテスト
+ */
+static void
+pfdb5(struct _ktest_stats *sp, void __unused *arg){
+	int             rc;
+	int              i;
+	obj_cnt_type filled;
+	uint8_t         *pg;
+	pfdb_stat   before;
+	pfdb_stat    after;
+
+	/*
+	 * ページを補充するとプール中のページ数が増える
+	 */
+	pfdb_zero_pool_drain();
+	kcom_obtain_pfdb_stat(&before);
+	filled = pfdb_zero_pool_fill(PFDB_ZERO_POOL_BATCH);
+	kcom_obtain_pfdb_stat(&after);
+	if ( ( before.zero_high == PFDB_ZERO_POOL_HIGH ) && ( before.zero_pages == 0 )
+	    && ( filled == PFDB_ZERO_POOL_BATCH ) 
+	    && ( after.zero_pages == filled ) 
+	    && ( after.zero_fills == ( before.zero_fills + filled ) )
+	    && ( after.nr_free_pages == before.nr_free_pages ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * 事前クリア済みページを獲得する
+	 */
+	rc = pgif_get_free_page((void **)&pg, KMALLOC_ZEROED, PAGE_USAGE_KERN);
+	kcom_obtain_pfdb_stat(&before);
+	if ( ( rc == 0 ) && ( before.zero_hits == ( after.zero_hits + 1 ) )
+	    && ( before.zero_pages == ( after.zero_pages - 1 ) ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	for(i = 0; PAGE_SIZE > i; ++i)
+		if ( pg[i] != 0 )
+			break;
+	if ( i == PAGE_SIZE )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+	memset(pg, 0xa5, PAGE_SIZE);  /* 解放後の再利用時のクリアを確認する */
+	pgif_free_page(pg);
+
+	/*
+	 * プール中のページを返却する
+	 */
+	pfdb_zero_pool_drain();
+	kcom_obtain_pfdb_stat(&after);
+	if ( ( after.zero_pages == 0 ) 
+	    && ( after.nr_free_pages == before.nr_free_pages + 1 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * プールが空の場合は通常の獲得処理でクリアしたページを獲得する
+	 */
+	rc = pgif_get_free_page((void **)&pg, KMALLOC_ZEROED, PAGE_USAGE_KERN);
+	kcom_obtain_pfdb_stat(&before);
+	if ( ( rc == 0 ) && ( before.zero_misses == ( after.zero_misses + 1 ) ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	for(i = 0; PAGE_SIZE > i; ++i)
+		if ( pg[i] != 0 )
+			break;
+	if ( i == PAGE_SIZE )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+	pgif_free_page(pg);
+}
+
+/**
+   メモリコンパクションのテスト
+ */
+static void
+pfdb6(struct _ktest_stats *sp, void __unused *arg){
+	int             rc;
+	page_frame     *pf;
+	pfdb_stat   before;
+	pfdb_stat    after;
+
+	/* 不正なオーダ */
+	if ( ( pfdb_compact_memory(0) == -EINVAL ) 
+	    && ( pfdb_compact_memory(PAGE_POOL_MAX_ORDER) == -EINVAL ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * 空きページがある場合はページを移動せずに成功する
+	 */
+	kcom_obtain_pfdb_stat(&before);
+	rc = pfdb_compact_memory(KC_KSTACK_ORDER + 1);
+	kcom_obtain_pfdb_stat(&after);
+	if ( ( rc == 0 ) && ( after.compact_runs == ( before.compact_runs + 1 ) )
+	    && ( after.compact_success == ( before.compact_success + 1 ) )
+	    && ( after.migrated_pages == before.migrated_pages ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * バックグラウンドでの実行要求
+	 */
+	if ( !pfdb_compact_background() )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	pfdb_compact_request(KC_KSTACK_ORDER);
+	kcom_obtain_pfdb_stat(&before);
+	if ( pfdb_compact_background() && !pfdb_compact_background() )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+	kcom_obtain_pfdb_stat(&after);
+	if ( ( after.compact_bg_runs == ( before.compact_bg_runs + 1 ) )
+	    && ( after.compact_runs == ( before.compact_runs + 1 ) ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 移動できないページ */
+	rc = pgif_get_free_page(&pages[0], KMALLOC_NORMAL, PAGE_USAGE_KERN);
+	kassert( rc == 0 );
+	rc = pfdb_kvaddr_to_page_frame(pages[0], &pf);
+	kassert( rc == 0 );
+	if ( pfdb_migrate_page(pf) == -EBUSY )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+	pgif_free_page(pages[0]);
+}
+
+static void
+pfdb7(struct _ktest_stats *sp, void __unused *arg){
+	int                   rc;
+	void               *head;
+	void                  *p;
+	pfdb_stat             st;
+	pgif_reclaim_stat before;
+	pgif_reclaim_stat  after;
+
+	/*
+	 * 水位の設定
+	 */
+	kcom_obtain_pfdb_stat(&st);
+	if ( ( st.wmark_min >= PFDB_WMARK_MIN_PAGES ) && ( st.wmark_low > st.wmark_min )
+	    && ( st.wmark_high > st.wmark_low ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	pfdb_pcp_drain_all();
+	if ( pfdb_watermark_update() == PFDB_WMARK_OK )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * 最低水位を下回るまでページを獲得する
+	 * 獲得したページの先頭に直前に獲得したページのアドレスを格納して
+	 * リストを構成する
+	 */
+	pgif_reclaim_obtain_stat(&before);
+	head = NULL;
+	while( pfdb_watermark_level() != PFDB_WMARK_UNDER_MIN ) {
+
+		rc = pgif_get_free_page(&p, KMALLOC_ATOMIC|KMALLOC_NOCLR, PAGE_USAGE_KERN);
+		if ( rc != 0 )
+			break;
+		*(void **)p = head;
+		head = p;
+	}
+	pgif_reclaim_obtain_stat(&after);
+	if ( ( pfdb_watermark_level() == PFDB_WMARK_UNDER_MIN )
+	    && ( after.requests > before.requests ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 待ち合わせ可能な獲得処理では直接回収を行う */
+	rc = pgif_get_free_page(&p, KMALLOC_NORMAL, PAGE_USAGE_KERN);
+	pgif_reclaim_obtain_stat(&after);
+	if ( ( rc == 0 ) && ( after.direct_runs == ( before.direct_runs + 1 ) ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+	if ( rc == 0 )
+		pgif_free_page(p);
+
+	/*
+	 * ページを解放すると高水位以上に戻る
+	 */
+	while( head != NULL ) {
+
+		p = head;
+		head = *(void **)p;
+		pgif_free_page(p);
+	}
+	pfdb_pcp_drain_all();
+	if ( pfdb_watermark_update() == PFDB_WMARK_OK )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+}
+
+/**
+   連続メモリ領域のテスト
+ */
+static void
+pfdb8(struct _ktest_stats *sp, void __unused *arg){
+	int                rc;
+	obj_cnt_type        i;
+	obj_cnt_type       nr;
+	obj_cnt_type      pfn;
+	obj_cnt_type     pfn2;
+	void            *head;
+	void               *p;
+	void            *anon;
+	page_frame        *pf;
+	pfdb_stat      before;
+	pfdb_stat       after;
+
+	kcom_obtain_pfdb_stat(&before);
+	if ( ( before.cma_pages == PFDB_CMA_PAGES ) && ( before.cma_free == PFDB_CMA_PAGES )
+	    && ( before.cma_lent == 0 ) && ( before.cma_allocated == 0 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 設定済み */
+	if ( pfdb_cma_init(PFDB_CMA_PAGES) == -EEXIST )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 不正なページ数, 境界 */
+	if ( ( pgif_get_contig_pages(&p, 0, 0, KMALLOC_NORMAL, PAGE_USAGE_KERN) == -EINVAL )
+	    && ( pgif_get_contig_pages(&p, 1, 3, KMALLOC_NORMAL, PAGE_USAGE_KERN) == -EINVAL )
+	    && ( pgif_get_contig_pages(&p, PFDB_CMA_PAGES + 1, 0, KMALLOC_NORMAL,
+		    PAGE_USAGE_KERN) == -ENOMEM ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * 2のべき乗でないページ数の連続領域を境界に揃えて獲得する
+	 */
+	nr = TST_PFDB_CMA_NR;
+	rc = pgif_get_contig_pages(&p, nr, TST_PFDB_CMA_ALIGN, KMALLOC_NORMAL, 
+	    PAGE_USAGE_KERN);
+	if ( rc == 0 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	rc = pfdb_kvaddr_to_pfn(p, &pfn);
+	kassert( rc == 0 );
+	for(i = 1; nr > i; ++i) {
+
+		rc = pfdb_kvaddr_to_pfn((void *)( (uintptr_t)p + ( i << PAGE_SHIFT ) ), &pfn2);
+		if ( ( rc != 0 ) || ( pfn2 != ( pfn + i ) ) )
+			break;
+	}
+	if ( ( i == nr ) && ( ( pfn % TST_PFDB_CMA_ALIGN ) == 0 )
+	    && ( *(uint64_t *)( (uintptr_t)p + ( ( nr - 1 ) << PAGE_SHIFT ) ) == 0 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	kcom_obtain_pfdb_stat(&after);
+	if ( ( after.cma_allocated == nr ) && ( after.cma_free == ( PFDB_CMA_PAGES - nr ) )
+	    && ( after.cma_allocs == ( before.cma_allocs + 1 ) ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	pgif_free_contig_pages(p, nr);
+	kcom_obtain_pfdb_stat(&after);
+	if ( ( after.cma_allocated == 0 ) && ( after.cma_free == PFDB_CMA_PAGES ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * 空きページが低水位を下回ると移動可能なページを連続メモリ領域から貸し出す
+	 */
+	pfdb_pcp_drain_all();
+	head = NULL;
+	while( pfdb_watermark_level() == PFDB_WMARK_OK ) {
+
+		rc = pgif_get_free_page(&p, KMALLOC_ATOMIC|KMALLOC_NOCLR, PAGE_USAGE_KERN);
+		if ( rc != 0 )
+			break;
+		*(void **)p = head;
+		head = p;
+	}
+
+	rc = pgif_get_free_page(&anon, KMALLOC_ATOMIC, PAGE_USAGE_ANON);
+	kassert( rc == 0 );
+	rc = pfdb_kvaddr_to_page_frame(anon, &pf);
+	kassert( rc == 0 );
+	kcom_obtain_pfdb_stat(&after);
+	if ( PAGE_IS_CMA(pf) && ( after.cma_lent == 1 )
+	    && ( after.cma_lends == ( before.cma_lends + 1 ) ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 移動可能でないページは連続メモリ領域から貸し出さない */
+	rc = pgif_get_free_page(&p, KMALLOC_ATOMIC|KMALLOC_NOCLR, PAGE_USAGE_KERN);
+	kassert( rc == 0 );
+	rc = pfdb_kvaddr_to_page_frame(p, &pf);
+	kassert( rc == 0 );
+	if ( !PAGE_IS_CMA(pf) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+	*(void **)p = head;
+	head = p;
+
+	while( head != NULL ) {
+
+		p = head;
+		head = *(void **)p;
+		pgif_free_page(p);
+	}
+	pfdb_pcp_drain_all();
+	pfdb_watermark_update();
+
+	/* マップされていない無名ページは移動できないため獲得に失敗する */
+	kcom_obtain_pfdb_stat(&before);
+	rc = pgif_get_contig_pages(&p, PFDB_CMA_PAGES, 0, KMALLOC_NORMAL, PAGE_USAGE_KERN);
+	kcom_obtain_pfdb_stat(&after);
+	if ( ( rc == -ENOMEM ) && ( after.cma_fails == ( before.cma_fails + 1 ) )
+	    && ( after.cma_free == ( PFDB_CMA_PAGES - 1 ) ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 貸し出したページを返却すると領域全体を獲得できる */
+	pgif_free_page(anon);
+	rc = pgif_get_contig_pages(&p, PFDB_CMA_PAGES, 0, KMALLOC_NOCLR, PAGE_USAGE_KERN);
+	kcom_obtain_pfdb_stat(&after);
+	if ( ( rc == 0 ) && ( after.cma_lent == 0 ) && ( after.cma_free == 0 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+	if ( rc == 0 )
+		pgif_free_contig_pages(p, PFDB_CMA_PAGES);
+
+	kcom_obtain_pfdb_stat(&after);
+	if ( after.cma_free == PFDB_CMA_PAGES )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+}
+
+/**
+   カラー別ページ獲得のテスト
+ */
+static void
+pfdb9(struct _ktest_stats *sp, void __unused *arg){
+	int                rc;
+	page_color      color;
+	page_color     cursor;
+	obj_cnt_type      pfn;
+	pfdb_stat      before;
+	pfdb_stat       after;
+
+	/* 不正なカラー */
+	if ( pgif_get_free_page_color(&pages[0], PFDB_COLOR_NR, KMALLOC_NORMAL,
+		PAGE_USAGE_KERN) == -EINVAL )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * 各カラーについて指定したカラーのページを獲得できる
+	 */
+	kcom_obtain_pfdb_stat(&before);
+	for(color = 0; PFDB_COLOR_NR > color; ++color) {
+
+		rc = pgif_get_free_page_color(&pages[color], color, KMALLOC_NORMAL,
+		    PAGE_USAGE_KERN);
+		kassert( rc == 0 );
+		rc = pfdb_kvaddr_to_pfn(pages[color], &pfn);
+		kassert( rc == 0 );
+		if ( PFDB_PFN_TO_COLOR(pfn) == color )
+			ktest_pass( sp );
+		else
+			ktest_fail( sp );
+	}
+	kcom_obtain_pfdb_stat(&after);
+	if ( after.color_hits == ( before.color_hits + PFDB_COLOR_NR ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+	for(color = 0; PFDB_COLOR_NR > color; ++color)
+		pgif_free_page(pages[color]);
+
+	/*
+	 * 事前クリア済みページの獲得を要求した場合は事前クリア済みページを優先する
+	 */
+	pfdb_zero_pool_drain();
+	pfdb_zero_pool_fill(1);
+	kcom_obtain_pfdb_stat(&before);
+	rc = pgif_get_free_page_color(&pages[0], 0, KMALLOC_ZEROED, PAGE_USAGE_KERN);
+	kcom_obtain_pfdb_stat(&after);
+	if ( ( rc == 0 ) && ( after.zero_hits == ( before.zero_hits + 1 ) )
+	    && ( after.color_hits == before.color_hits ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+	if ( rc == 0 )
+		pgif_free_page(pages[0]);
+
+	/*
+	 * カラー選択位置は循環する
+	 */
+	cursor = PFDB_COLOR_NR - 1;
+	if ( ( pgif_next_page_color(&cursor) == ( PFDB_COLOR_NR - 1 ) )
+	    && ( pgif_next_page_color(&cursor) == 0 )
+	    && ( pgif_next_page_color(&cursor) == 1 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * プール中のページを返却する
+	 */
+	pfdb_color_pool_drain();
+	kcom_obtain_pfdb_stat(&after);
+	if ( after.color_pages == 0 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+}
+
+static pgif_shrinker tst_shrinker;   /* テスト用縮小処理 */
+static obj_cnt_type tst_shrink_objs;  /* テスト用縮小処理の回収可能数 */
+static obj_cnt_type tst_shrink_nr;    /* テスト用縮小処理に渡された回収数 */
+static int tst_shrink_reason;         /* テスト用縮小処理に渡された契機 */
+
+/**
+   テスト用縮小処理: 回収可能なオブジェクト数を返却する
+   @param[in] private 未使用
+   @return 回収可能なオブジェクト数
+ */
+static obj_cnt_type
+tst_shrinker_count(void __unused *private){
+
+	return tst_shrink_objs;
+}
+
+/**
+   テスト用縮小処理: 引数を記録する
+   @param[in] nr      回収数
+   @param[in] reason  縮小処理の契機
+   @param[in] private 未使用
+   @return 解放したページ数 (常に0)
+ */
+static obj_cnt_type
+tst_shrinker_scan(obj_cnt_type nr, int reason, void __unused *private){
+
+	tst_shrink_nr = nr;
+	tst_shrink_reason = reason;
+
+	return 0;
+}
+
+/**
+   縮小処理登録と定期回収のテスト
+ */
+static void
+pfdb10(struct _ktest_stats *sp, void __unused *arg){
+	pgif_reclaim_stat before;
+	pgif_reclaim_stat  after;
+
+	tst_shrinker.name = "tst-shrinker";
+	tst_shrinker.count = tst_shrinker_count;
+	tst_shrinker.scan = tst_shrinker_scan;
+	tst_shrinker.private = NULL;
+	pgif_shrinker_register(&tst_shrinker);
+
+	/* 回収可能なオブジェクトがなければ回収関数は呼ばれない */
+	tst_shrink_objs = 0;
+	pgif_reclaim_obtain_stat(&before);
+	pgif_reclaim_periodic();
+	pgif_reclaim_obtain_stat(&after);
+	if ( ( tst_shrinker.runs == 0 )
+	    && ( after.periodic_runs == ( before.periodic_runs + 1 ) ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 定期回収では回収可能な全オブジェクトを対象に回収関数が呼ばれる */
+	tst_shrink_objs = PGIF_RECLAIM_BATCH * 2;
+	tst_shrink_nr = 0;
+	tst_shrink_reason = PGIF_SHRINK_PRESSURE;
+	pgif_reclaim_periodic();
+	if ( ( tst_shrinker.runs == 1 ) && ( tst_shrink_nr == tst_shrink_objs )
+	    && ( tst_shrink_reason == PGIF_SHRINK_PERIODIC ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 登録を抹消した縮小処理は呼ばれない */
+	pgif_shrinker_unregister(&tst_shrinker);
+	pgif_reclaim_periodic();
+	if ( tst_shrinker.runs == 1 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+}
+
+/**
+   初期カーネルヒープ返却のテスト
+ */
+static void
+pfdb11(struct _ktest_stats *sp, void __unused *arg){
+	early_kernel_heap st;
+
+	/* 初期化完了後, 初期カーネルヒープは使用中の領域までに縮められている */
+	ekheap_stat(&st);
+	if ( st.end == (void *)PAGE_ROUNDUP((uintptr_t)st.cur) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 返却後は初期カーネルヒープを伸長できない */
+	if ( ekheap_sbrk(PAGE_SIZE) == EARLY_KHEAP_SBRK_FAILED )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 返却済みの領域は再度返却されない */
+	if ( pfdb_release_early_heap() == 0 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+}
+
+void
+tst_pfdb(void){
+
+	ktest_def_test(&tstat_pfdb, "pfdb1", pfdb1, NULL);
+	ktest_def_test(&tstat_pfdb, "pfdb2", pfdb2, NULL);
+	ktest_def_test(&tstat_pfdb, "pfdb3", pfdb3, NULL);
+	ktest_def_test(&tstat_pfdb, "pfdb4", pfdb4, NULL);
+	ktest_def_test(&tstat_pfdb, "pfdb5", pfdb5, NULL);
+	ktest_def_test(&tstat_pfdb, "pfdb6", pfdb6, NULL);
+	ktest_def_test(&tstat_pfdb, "pfdb7", pfdb7, NULL);
+	ktest_def_test(&tstat_pfdb, "pfdb8", pfdb8, NULL);
+	ktest_def_test(&tstat_pfdb, "pfdb9", pfdb9, NULL);
+	ktest_def_test(&tstat_pfdb, "pfdb10", pfdb10, NULL);
+	ktest_def_test(&tstat_pfdb, "pfdb11", pfdb11, NULL);
+	ktest_run(&tstat_pfdb);
+}
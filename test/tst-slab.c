@@ -0,0 +1,838 @@
+/* -*- mode: C; coding:utf-8 -*- */
+/**********************************************************************/
+/*  OS kernel sample                                                  */
+/*  Copyright 2019 Takeharu KATO                                      */
+/*                                                                    */
+/*  test routine                                                      */
+/*                                                                    */
+/**********************************************************************/
+
+#include <klib/freestanding.h>
+#include <kern/kern-common.h>
+#include <kern/page-if.h>
+#include <kern/thr-preempt.h>
+
+#include <kern/ktest.h>
+
+#define TST_SLAB_OBJ_SIZE   (64)    /* 小さなオブジェクトのサイズ */
+#define TST_SLAB_LARGE_SIZE (2048)  /* 大きなオブジェクトのサイズ */
+#define TST_SLAB_OBJS_NR    (SLAB_MAGAZINE_SIZE_INIT * 3)  /* 獲得オブジェクト数 */
+#define TST_SLAB_BULK_MAX   (256)   /* 一括獲得オブジェクト数の上限 */
+#define TST_SLAB_CTOR_MAGIC (0x5a5aa5a5c3c33c3cULL)  /* 構築済み状態を表す値 */
+
+static ktest_stats tstat_slab=KTEST_INITIALIZER;
+
+/** 断片化計測用の要求サイズ (カーネル内で多用される構造体長を含む) */
+static size_t tst_kmalloc_sizes[]={
+	sizeof(kmem_bufctl), sizeof(slab), sizeof(slab_magazine), sizeof(kmem_cache),
+	24, 40, 72, 80, 100, 136, 160, 200, 264, 300, 320, 400, 520, 700,
+};
+#define TST_SLAB_KMALLOC_NR  (sizeof(tst_kmalloc_sizes) / sizeof(size_t))
+
+static kmem_cache tst_cache;
+static kmem_cache tst_large_cache;
+static kmem_cache tst_bulk_cache;
+static kmem_cache tst_alias_cache;
+static void *objs[TST_SLAB_OBJS_NR];
+static void *bulk_objs[TST_SLAB_BULK_MAX];
+static obj_cnt_type tst_ctor_cnt;  /* コンストラクタ呼び出し回数 */
+static obj_cnt_type tst_dtor_cnt;  /* デストラクタ呼び出し回数 */
+
+/**
+   テスト用コンストラクタ
+   @param[in] obj オブジェクト
+   @param[in] siz オブジェクトサイズ
+ */
+static void
+tst_slab_ctor(void *obj, size_t __unused siz){
+
+	*(uint64_t *)obj = TST_SLAB_CTOR_MAGIC;  /* 構築済み状態を記録する */
+	++tst_ctor_cnt;
+}
+
+/**
+   テスト用デストラクタ
+   @param[in] obj オブジェクト
+   @param[in] siz オブジェクトサイズ
+ */
+static void
+tst_slab_dtor(void *obj, size_t __unused siz){
+
+	kassert( *(uint64_t *)obj == TST_SLAB_CTOR_MAGIC );  /* 構築済み状態である */
+	++tst_dtor_cnt;
+}
+
+/**
+   マガジンからの獲得回数の総和を得る
+   @param[in] cache カーネルメモリキャッシュ
+   @return マガジンからの獲得回数
+ */
+static obj_cnt_type
+magazine_hits(kmem_cache *cache){
+	cpu_id             cpu;
+	obj_cnt_type      hits;
+
+	for(cpu = 0, hits = 0; KC_CPUS_NR > cpu; ++cpu)
+		hits += cache->cpu_cache[cpu].hits;
+
+	return hits;
+}
+
+/**
+   CPU単位マガジンのテスト
+ */
+static void
+slab1(struct _ktest_stats *sp, void __unused *arg){
+	int                rc;
+	obj_cnt_type        i;
+	obj_cnt_type     hits;
+	void           *obj1;
+	void           *obj2;
+
+	rc = slab_kmem_cache_create(&tst_cache, "tst-slab", TST_SLAB_OBJ_SIZE,
+	    SLAB_ALIGN_NONE, 0, KMALLOC_NORMAL, NULL, NULL);
+	if ( rc == 0 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	rc = slab_kmem_cache_create(&tst_large_cache, "tst-slab-large",
+	    TST_SLAB_LARGE_SIZE, SLAB_ALIGN_NONE, 0, KMALLOC_NORMAL, NULL, NULL);
+	if ( rc == 0 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* オブジェクトサイズに応じてマガジンの初期容量を決める */
+	if ( ( tst_cache.mag_size == SLAB_MAGAZINE_SIZE_INIT )
+	    && ( tst_large_cache.mag_size == SLAB_MAGAZINE_SIZE_MIN ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * 解放したオブジェクトはマガジンから再利用される
+	 */
+	rc = slab_kmem_cache_alloc(&tst_cache, KMALLOC_NORMAL, &obj1);
+	kassert( rc == 0 );
+	slab_kmem_cache_free(obj1);
+	hits = magazine_hits(&tst_cache);
+	rc = slab_kmem_cache_alloc(&tst_cache, KMALLOC_NORMAL, &obj2);
+	kassert( rc == 0 );
+	if ( ( obj1 == obj2 ) && ( magazine_hits(&tst_cache) == ( hits + 1 ) ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+	slab_kmem_cache_free(obj2);
+
+	/*
+	 * 満杯になったマガジンはデポに格納される
+	 */
+	for(i = 0; TST_SLAB_OBJS_NR > i; ++i) {
+
+		rc = slab_kmem_cache_alloc(&tst_cache, KMALLOC_NORMAL, &objs[i]);
+		kassert( rc == 0 );
+	}
+	for(i = 0; TST_SLAB_OBJS_NR > i; ++i)
+		slab_kmem_cache_free(objs[i]);
+	if ( tst_cache.nr_mag_full > 0 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* デポの満杯のマガジンから獲得できる */
+	hits = magazine_hits(&tst_cache);
+	for(i = 0; TST_SLAB_OBJS_NR > i; ++i) {
+
+		rc = slab_kmem_cache_alloc(&tst_cache, KMALLOC_NORMAL, &objs[i]);
+		kassert( rc == 0 );
+	}
+	if ( magazine_hits(&tst_cache) == ( hits + TST_SLAB_OBJS_NR ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+	for(i = 0; TST_SLAB_OBJS_NR > i; ++i)
+		slab_kmem_cache_free(objs[i]);
+
+	/*
+	 * 強制解放時はマガジン中のオブジェクトを返却してSLABを解放する
+	 */
+	slab_kmem_cache_reap(&tst_cache, SLAB_REAP_FORCE);
+	if ( ( tst_cache.nr_mag_full == 0 ) && ( tst_cache.nr_mag_empty == 0 )
+	    && ( tst_cache.cpu_cache[ti_current_cpu_get()].loaded == NULL )
+	    && queue_is_empty(&tst_cache.partial) && queue_is_empty(&tst_cache.full)
+	    && ( tst_cache.slab_count == 0 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	slab_kmem_cache_destroy(&tst_cache);
+	slab_kmem_cache_destroy(&tst_large_cache);
+}
+
+/**
+   2のべき乗のサイズ区分でのサイズを得る
+   @param[in] size 要求サイズ
+   @return 2のべき乗のサイズ区分でのサイズ
+ */
+static size_t
+pow2_class_size(size_t size){
+	size_t siz;
+
+	for(siz = SLAB_PREALLOC_MIN; size > siz; siz <<= 1);
+
+	return siz;
+}
+
+/**
+   kmallocのサイズ区分のテスト
+ */
+static void
+slab2(struct _ktest_stats *sp, void __unused *arg){
+	unsigned int            i;
+	uint64_t              req;
+	uint64_t             pow2;
+	void                   *m;
+	void *ms[TST_SLAB_KMALLOC_NR];
+	slab_kmalloc_stat  before;
+	slab_kmalloc_stat   after;
+
+	/*
+	 * サイズ区分の選択
+	 */
+	if ( ( slab_kmalloc_class_size(0) == 8 )
+	    && ( slab_kmalloc_class_size(1) == 8 )
+	    && ( slab_kmalloc_class_size(72) == 96 )
+	    && ( slab_kmalloc_class_size(96) == 96 )
+	    && ( slab_kmalloc_class_size(97) == 128 )
+	    && ( slab_kmalloc_class_size(129) == 192 )
+	    && ( slab_kmalloc_class_size(257) == 384 )
+	    && ( slab_kmalloc_class_size(385) == 512 )
+	    && ( slab_kmalloc_class_size(513) == 1024 )
+	    && ( slab_kmalloc_class_size(SLAB_PREALLOC_MAX) == SLAB_PREALLOC_MAX )
+	    && ( slab_kmalloc_class_size(SLAB_PREALLOC_MAX + 1) 
+		== ( SLAB_PREALLOC_MAX * 2 ) )
+	    && ( slab_kmalloc_class_size(PAGE_SIZE << PAGE_POOL_MAX_ORDER) == 0 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 格納可能なページオーダを越える要求 */
+	m = kmalloc(PAGE_SIZE << PAGE_POOL_MAX_ORDER, KMALLOC_NORMAL);
+	if ( m == NULL )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * 内部断片化を計測する
+	 * SLAB伸長時のバッファ制御情報の獲得を計測に含めないように
+	 * 事前に同じ要求を発行しておく
+	 */
+	for(i = 0; TST_SLAB_KMALLOC_NR > i; ++i)
+		ms[i] = kmalloc(tst_kmalloc_sizes[i], KMALLOC_NORMAL);
+	for(i = 0; TST_SLAB_KMALLOC_NR > i; ++i)
+		kfree(ms[i]);
+
+	slab_kmalloc_obtain_stat(&before);
+	for(i = 0, req = 0, pow2 = 0; TST_SLAB_KMALLOC_NR > i; ++i) {
+
+		ms[i] = kmalloc(tst_kmalloc_sizes[i], KMALLOC_NORMAL);
+		kassert( ms[i] != NULL );
+		req += tst_kmalloc_sizes[i];
+		pow2 += pow2_class_size(tst_kmalloc_sizes[i]);
+	}
+	slab_kmalloc_obtain_stat(&after);
+	for(i = 0; TST_SLAB_KMALLOC_NR > i; ++i)
+		kfree(ms[i]);
+
+	if ( ( after.allocated - before.allocated ) >= req )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 中間のサイズ区分により未使用領域が減る */
+	if ( ( pow2 - req ) > ( after.wasted - before.wasted ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	kprintf("slab2: workload wasted %qu/%qu bytes (power-of-two classes: %qu/%qu)\n",
+	    after.wasted - before.wasted, after.allocated - before.allocated,
+	    pow2 - req, pow2);
+	kprintf("slab2: since boot wasted %qu/%qu bytes\n",
+	    after.wasted, after.allocated);
+	for(i = 0; SLAB_PREALLOC_CACHE_NR > i; ++i) {
+
+		if ( after.allocs[i] > 0 )
+			kprintf("slab2: kmalloc-%qu allocs=%qu requested=%qu\n",
+			    (uint64_t)after.size[i], (uint64_t)after.allocs[i],
+			    after.requested[i]);
+	}
+}
+
+/**
+   ページ単位のkmallocのテスト
+ */
+static void
+slab3(struct _ktest_stats *sp, void __unused *arg){
+	int                rc;
+	void               *m;
+	page_frame        *pf;
+	slab_kmalloc_stat before;
+	slab_kmalloc_stat after;
+
+	/*
+	 * 最大サイズを越える要求はページ単位で割り当てる
+	 */
+	slab_kmalloc_obtain_stat(&before);
+	m = kmalloc(SLAB_PREALLOC_MAX + 1, KMALLOC_NORMAL);
+	slab_kmalloc_obtain_stat(&after);
+	if ( ( m != NULL ) && PAGE_ALIGNED((uintptr_t)m)
+	    && ( after.large_allocs == ( before.large_allocs + 1 ) )
+	    && ( after.large_pages == 
+		( before.large_pages + ( slab_kmalloc_class_size(SLAB_PREALLOC_MAX + 1)
+		    >> PAGE_SHIFT ) ) ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* ページオーダが先頭ページに記録されている */
+	rc = pfdb_kvaddr_to_page_frame(m, &pf);
+	kassert( rc == 0 );
+	if ( ( PAGE_SIZE << pf->order ) == slab_kmalloc_class_size(SLAB_PREALLOC_MAX + 1) 
+	    && !PAGE_USED_BY_SLAB(pf) && PAGE_USED_BY_KERN(pf) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 領域はクリアされている */
+	if ( ( ((uint8_t *)m)[0] == 0 ) && ( ((uint8_t *)m)[SLAB_PREALLOC_MAX] == 0 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * kfreeでページを解放する
+	 */
+	kfree(m);
+	slab_kmalloc_obtain_stat(&after);
+	if ( after.large_pages == before.large_pages )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+}
+
+/**
+   オブジェクトの一括獲得/解放のテスト
+ */
+static void
+slab4(struct _ktest_stats *sp, void __unused *arg){
+	int                rc;
+	obj_cnt_type        i;
+	obj_cnt_type        j;
+	obj_cnt_type       nr;
+	bool               ok;
+
+	/* SLABの状態を確認するためマガジン層を使用しないキャッシュを生成する */
+	rc = slab_kmem_cache_create(&tst_bulk_cache, "tst-slab-bulk", TST_SLAB_OBJ_SIZE,
+	    SLAB_ALIGN_NONE, 0, KMALLOC_NORMAL|KM_SFLAGS_NO_MAGAZINE,
+	    tst_slab_ctor, NULL);
+	if ( ( rc == 0 ) && ( tst_bulk_cache.sflags & KM_SFLAGS_NO_MAGAZINE ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * 複数のSLABにまたがるオブジェクトを一括して獲得する
+	 */
+	nr = tst_bulk_cache.objs_per_slab * 2 + 3;
+	kassert( TST_SLAB_BULK_MAX >= nr );
+	tst_ctor_cnt = 0;
+	rc = slab_kmem_cache_alloc_bulk(&tst_bulk_cache, KMALLOC_NORMAL, nr, &bulk_objs[0]);
+	if ( ( rc == 0 ) && ( tst_ctor_cnt == ( tst_bulk_cache.objs_per_slab * 3 ) ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 獲得したオブジェクトは互いに異なり, 構築済み状態である */
+	for(i = 0, ok = true; nr > i; ++i) {
+
+		if ( *(uint64_t *)bulk_objs[i] != TST_SLAB_CTOR_MAGIC )
+			ok = false;
+		for(j = i + 1; nr > j; ++j)
+			if ( bulk_objs[i] == bulk_objs[j] )
+				ok = false;
+	}
+	if ( ok )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 2つのSLABを使い切り, 3つ目のSLABを使用中にする */
+	if ( ( tst_bulk_cache.slab_count == 3 )
+	    && ( queue_is_empty(&tst_bulk_cache.free) )
+	    && ( !queue_is_empty(&tst_bulk_cache.full) )
+	    && ( !queue_is_empty(&tst_bulk_cache.partial) ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * 一括して解放すると全てのSLABが空きSLABになる
+	 */
+	slab_kmem_cache_free_bulk(&tst_bulk_cache, nr, &bulk_objs[0]);
+	if ( queue_is_empty(&tst_bulk_cache.full)
+	    && queue_is_empty(&tst_bulk_cache.partial)
+	    && ( !queue_is_empty(&tst_bulk_cache.free) ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	slab_kmem_cache_reap(&tst_bulk_cache, SLAB_REAP_FORCE);
+	if ( tst_bulk_cache.slab_count == 0 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	slab_kmem_cache_destroy(&tst_bulk_cache);
+
+	/*
+	 * マガジン層を使用するキャッシュでも一括獲得/解放できる
+	 */
+	rc = slab_kmem_cache_create(&tst_bulk_cache, "tst-slab-bulk", TST_SLAB_OBJ_SIZE,
+	    SLAB_ALIGN_NONE, 0, KMALLOC_NORMAL, NULL, NULL);
+	kassert( rc == 0 );
+	rc = slab_kmem_cache_alloc_bulk(&tst_bulk_cache, KMALLOC_NORMAL, nr, &bulk_objs[0]);
+	kassert( rc == 0 );
+	slab_kmem_cache_free_bulk(&tst_bulk_cache, nr, &bulk_objs[0]);
+	rc = slab_kmem_cache_alloc_bulk(&tst_bulk_cache, KMALLOC_NORMAL, nr, &bulk_objs[0]);
+	if ( ( rc == 0 ) && ( magazine_hits(&tst_bulk_cache) > 0 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+	slab_kmem_cache_free_bulk(&tst_bulk_cache, nr, &bulk_objs[0]);
+	slab_kmem_cache_reap(&tst_bulk_cache, SLAB_REAP_FORCE);
+	if ( tst_bulk_cache.slab_count == 0 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	slab_kmem_cache_destroy(&tst_bulk_cache);
+}
+
+/**
+   ロックを用いない空きオブジェクトリストのテスト
+ */
+static void
+slab5(struct _ktest_stats *sp, void __unused *arg){
+	int                rc;
+	obj_cnt_type        i;
+	slab           *sinfo;
+	page_frame        *pf;
+	atomic64_val     head;
+	atomic64_val   before;
+	atomic64_val    after;
+	void             *obj;
+
+	/*
+	 * 先頭情報からアドレスと更新世代を復元できる
+	 */
+	obj = (void *)&tst_bulk_cache;
+	if ( ( SLAB_FREELIST_NODE(SLAB_FREELIST_MAKE(0xffff, obj)) == obj )
+	    && ( SLAB_FREELIST_TAG(SLAB_FREELIST_MAKE(0xffff, obj)) == 0xffff )
+	    && ( SLAB_FREELIST_NODE(SLAB_FREELIST_MAKE(1, NULL)) == NULL ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	rc = slab_kmem_cache_create(&tst_bulk_cache, "tst-slab-freelist",
+	    TST_SLAB_OBJ_SIZE, SLAB_ALIGN_NONE, 0, KMALLOC_NORMAL|KM_SFLAGS_NO_MAGAZINE,
+	    NULL, NULL);
+	kassert( rc == 0 );
+
+	rc = slab_kmem_cache_alloc(&tst_bulk_cache, KMALLOC_NORMAL, &obj);
+	kassert( rc == 0 );
+	rc = pfdb_kvaddr_to_page_frame(obj, &pf);
+	kassert( rc == 0 );
+	sinfo = pf->slabp;
+	kassert( tst_bulk_cache.objs_per_slab > TST_SLAB_OBJS_NR );
+
+	/*
+	 * 一括返却/一括獲得は1回の更新で行われ, 更新ごとに世代が進む
+	 */
+	for(i = 0; TST_SLAB_OBJS_NR > i; ++i) {
+
+		rc = slab_kmem_cache_alloc(&tst_bulk_cache, KMALLOC_NORMAL, &objs[i]);
+		kassert( rc == 0 );
+	}
+	head = before = atomic64_read(&sinfo->objects);
+	slab_kmem_cache_free_bulk(&tst_bulk_cache, TST_SLAB_OBJS_NR, &objs[0]);
+	after = atomic64_read(&sinfo->objects);
+	if ( SLAB_FREELIST_TAG(after) == ( SLAB_FREELIST_TAG(before) + 1 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	before = after;
+	rc = slab_kmem_cache_alloc_bulk(&tst_bulk_cache, KMALLOC_NORMAL, TST_SLAB_OBJS_NR,
+	    &objs[0]);
+	after = atomic64_read(&sinfo->objects);
+	if ( ( rc == 0 )
+	    && ( SLAB_FREELIST_TAG(after) == ( SLAB_FREELIST_TAG(before) + 1 ) )
+	    && ( SLAB_FREELIST_NODE(after) == SLAB_FREELIST_NODE(head) ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	slab_kmem_cache_free_bulk(&tst_bulk_cache, TST_SLAB_OBJS_NR, &objs[0]);
+	slab_kmem_cache_free(obj);
+	slab_kmem_cache_reap(&tst_bulk_cache, SLAB_REAP_FORCE);
+	if ( tst_bulk_cache.slab_count == 0 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	slab_kmem_cache_destroy(&tst_bulk_cache);
+}
+
+/**
+   キャッシュ名が一致するキャッシュを探す
+   @param[in] cache カーネルメモリキャッシュ
+   @param[in] arg   探索するキャッシュ
+   @retval    1     一致した
+   @retval    0     一致しなかった
+ */
+static int
+find_cache(kmem_cache *cache, void *arg){
+
+	return ( cache == (kmem_cache *)arg ) ? 1 : 0;
+}
+
+/**
+   処理中のキャッシュの破棄を試みる
+   @param[in] cache カーネルメモリキャッシュ
+   @param[in] arg   破棄するキャッシュ
+   @retval    1     破棄を取りやめた
+   @retval    0     破棄対象のキャッシュでないか, 破棄した
+ */
+static int
+destroy_walked_cache(kmem_cache *cache, void *arg){
+
+	if ( cache != (kmem_cache *)arg )
+		return 0;
+
+	return ( slab_kmem_cache_destroy(cache) == -EBUSY ) ? 1 : 0;
+}
+
+/**
+   キャッシュ統計情報のテスト
+ */
+static void
+slab6(struct _ktest_stats *sp, void __unused *arg){
+	int                   rc;
+	obj_cnt_type           i;
+	slab_kmem_cache_stat  st;
+
+	rc = slab_kmem_cache_create(&tst_bulk_cache, "tst-slab-stat", TST_SLAB_OBJ_SIZE,
+	    SLAB_ALIGN_NONE, 0, KMALLOC_NORMAL, NULL, NULL);
+	kassert( rc == 0 );
+
+	/* 生成したキャッシュは管理情報に登録される */
+	if ( slab_kmem_cache_foreach(find_cache, &tst_bulk_cache) == 1 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * 獲得/解放に応じて統計情報が更新される
+	 */
+	for(i = 0; TST_SLAB_OBJS_NR > i; ++i) {
+
+		rc = slab_kmem_cache_alloc(&tst_bulk_cache, KMALLOC_NORMAL, &objs[i]);
+		kassert( rc == 0 );
+	}
+	slab_kmem_cache_obtain_stat(&tst_bulk_cache, &st);
+	if ( ( st.allocs == TST_SLAB_OBJS_NR ) && ( st.frees == 0 )
+	    && ( st.active_objs == TST_SLAB_OBJS_NR ) && ( st.grows == st.nr_slabs )
+	    && ( st.nr_slabs > 0 ) && ( st.total_objs >= TST_SLAB_OBJS_NR )
+	    && ( ( st.nr_full + st.nr_partial + st.nr_free ) == st.nr_slabs ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	for(i = 0; TST_SLAB_OBJS_NR > i; ++i)
+		slab_kmem_cache_free(objs[i]);
+	slab_kmem_cache_obtain_stat(&tst_bulk_cache, &st);
+	if ( ( st.frees == TST_SLAB_OBJS_NR ) && ( st.active_objs == 0 )
+	    && ( st.magazine_objs > 0 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	slab_kmem_cache_show_info();
+
+	/* 強制解放でマガジンとSLABが解放される */
+	slab_kmem_cache_reap(&tst_bulk_cache, SLAB_REAP_FORCE);
+	slab_kmem_cache_obtain_stat(&tst_bulk_cache, &st);
+	if ( ( st.nr_slabs == 0 ) && ( st.reaps == st.grows ) && ( st.magazine_objs == 0 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 管理情報をたどる処理が参照中のキャッシュは破棄しない */
+	if ( ( slab_kmem_cache_foreach(destroy_walked_cache, &tst_bulk_cache) == 1 )
+	    && ( slab_kmem_cache_foreach(find_cache, &tst_bulk_cache) == 1 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 破棄したキャッシュは管理情報から取り除かれる */
+	rc = slab_kmem_cache_destroy(&tst_bulk_cache);
+	if ( ( rc == 0 ) && ( slab_kmem_cache_foreach(find_cache, &tst_bulk_cache) == 0 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+}
+
+/**
+   空きSLABの定期回収のテスト
+ */
+static void
+slab7(struct _ktest_stats *sp, void __unused *arg){
+	int                rc;
+	int                 i;
+	void             *obj;
+	obj_cnt_type  free_nr;
+
+	rc = slab_kmem_cache_create(&tst_bulk_cache, "tst-slab-aged", TST_SLAB_OBJ_SIZE,
+	    SLAB_ALIGN_NONE, 0, KMALLOC_NORMAL|KM_SFLAGS_NO_MAGAZINE, NULL, NULL);
+	kassert( rc == 0 );
+
+	rc = slab_kmem_cache_alloc(&tst_bulk_cache, KMALLOC_NORMAL, &obj);
+	kassert( rc == 0 );
+	slab_kmem_cache_free(obj);
+
+	/*
+	 * 空きSLABは定期回収を所定の回数経るまで保持される
+	 */
+	for(i = 0; ( SLAB_REAP_IDLE_PASSES - 1 ) > i; ++i)
+		slab_kmem_cache_reap(&tst_bulk_cache, SLAB_REAP_AGED);
+	if ( tst_bulk_cache.slab_count == 1 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 再利用されたSLABは世代が更新される */
+	rc = slab_kmem_cache_alloc(&tst_bulk_cache, KMALLOC_NORMAL, &obj);
+	kassert( rc == 0 );
+	slab_kmem_cache_free(obj);
+	for(i = 0; ( SLAB_REAP_IDLE_PASSES - 1 ) > i; ++i)
+		slab_kmem_cache_reap(&tst_bulk_cache, SLAB_REAP_AGED);
+	if ( tst_bulk_cache.slab_count == 1 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	free_nr = slab_kmem_cache_reap(&tst_bulk_cache, SLAB_REAP_AGED);
+	if ( ( tst_bulk_cache.slab_count == 0 )
+	    && ( free_nr == ( ULONG_C(1) << tst_bulk_cache.order ) ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * 空きページ不足時の回収では空きSLABを即座に解放する
+	 */
+	rc = slab_kmem_cache_alloc(&tst_bulk_cache, KMALLOC_NORMAL, &obj);
+	kassert( rc == 0 );
+	slab_kmem_cache_free(obj);
+	slab_reap_all_caches(SLAB_REAP_NORMAL);
+	if ( tst_bulk_cache.slab_count == 0 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	slab_kmem_cache_destroy(&tst_bulk_cache);
+}
+
+/**
+   構築済みオブジェクトキャッシュのテスト
+ */
+static void
+slab8(struct _ktest_stats *sp, void __unused *arg){
+	int                rc;
+	void            *obj1;
+	void            *obj2;
+
+	tst_ctor_cnt = 0;
+	tst_dtor_cnt = 0;
+	rc = slab_kmem_cache_create(&tst_bulk_cache, "tst-slab-ctor", TST_SLAB_OBJ_SIZE,
+	    SLAB_ALIGN_NONE, 0, KMALLOC_NORMAL, tst_slab_ctor, tst_slab_dtor);
+	kassert( rc == 0 );
+
+	/*
+	 * コンストラクタはSLAB作成時に全オブジェクトに対して呼ばれる
+	 */
+	rc = slab_kmem_cache_alloc(&tst_bulk_cache, KMALLOC_NORMAL, &obj1);
+	if ( ( rc == 0 ) && ( tst_ctor_cnt == tst_bulk_cache.objs_per_slab )
+	    && ( *(uint64_t *)obj1 == TST_SLAB_CTOR_MAGIC ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * 解放時にデストラクタは呼ばれず, 再獲得時にコンストラクタ呼び出しや
+	 * メモリのクリアは行われない
+	 */
+	((uint8_t *)obj1)[TST_SLAB_OBJ_SIZE - 1] = 0xa5;  /* 構築処理が初期化しない領域 */
+	slab_kmem_cache_free(obj1);
+	rc = slab_kmem_cache_alloc(&tst_bulk_cache, KMALLOC_NORMAL, &obj2);
+	if ( ( rc == 0 ) && ( obj1 == obj2 ) && ( tst_dtor_cnt == 0 )
+	    && ( tst_ctor_cnt == tst_bulk_cache.objs_per_slab )
+	    && ( ((uint8_t *)obj2)[TST_SLAB_OBJ_SIZE - 1] == 0xa5 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+	slab_kmem_cache_free(obj2);
+
+	/*
+	 * デストラクタはSLAB解放時に全オブジェクトに対して呼ばれる
+	 */
+	slab_kmem_cache_reap(&tst_bulk_cache, SLAB_REAP_FORCE);
+	if ( ( tst_bulk_cache.slab_count == 0 )
+	    && ( tst_dtor_cnt == tst_bulk_cache.objs_per_slab ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	slab_kmem_cache_destroy(&tst_bulk_cache);
+}
+
+/**
+   互換キャッシュ統合のテスト
+ */
+static void
+slab9(struct _ktest_stats *sp, void __unused *arg){
+	int                   rc;
+	obj_cnt_type           i;
+	obj_cnt_type     aliases;
+	stat_cnt_val  pool_allocs;
+	slab_kmem_cache_stat   st1;
+	slab_kmem_cache_stat   st2;
+	slab_kmem_cache_stat  pool;
+	void                 *obj;
+
+	/*
+	 * 配置情報が事前割当て済みキャッシュと一致するキャッシュはエイリアスになる
+	 */
+	rc = slab_kmem_cache_create(&tst_bulk_cache, "tst-slab-alias1", TST_SLAB_OBJ_SIZE,
+	    SLAB_ALIGN_NONE, 0, KMALLOC_NORMAL | KM_SFLAGS_MERGEABLE, NULL, NULL);
+	kassert( rc == 0 );
+	rc = slab_kmem_cache_create(&tst_alias_cache, "tst-slab-alias2", TST_SLAB_OBJ_SIZE,
+	    SLAB_ALIGN_NONE, 0, KMALLOC_NORMAL | KM_SFLAGS_MERGEABLE, NULL, NULL);
+	kassert( rc == 0 );
+
+	slab_kmem_cache_obtain_stat(&tst_bulk_cache, &st1);
+	slab_kmem_cache_obtain_stat(&tst_alias_cache, &st2);
+	if ( ( tst_bulk_cache.merged != NULL ) && ( tst_bulk_cache.merged == tst_alias_cache.merged )
+	    && ( st1.alias_of != NULL ) && ( strcmp(st1.alias_of, "kmalloc-64") == 0 )
+	    && ( st2.alias_of != NULL ) && ( tst_bulk_cache.merged->nr_aliases >= 2 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * エイリアスは統合先のSLABを共有し, 統計情報はエイリアスごとに計上される
+	 */
+	slab_kmem_cache_obtain_stat(tst_bulk_cache.merged, &pool);
+	pool_allocs = pool.allocs;
+	for(i = 0; TST_SLAB_OBJS_NR > i; ++i) {
+
+		rc = slab_kmem_cache_alloc(( i & 1 ) ? &tst_alias_cache : &tst_bulk_cache,
+		    KMALLOC_NORMAL, &objs[i]);
+		kassert( rc == 0 );
+		kassert( ((uint8_t *)objs[i])[0] == 0 );
+	}
+	slab_kmem_cache_obtain_stat(&tst_bulk_cache, &st1);
+	slab_kmem_cache_obtain_stat(&tst_alias_cache, &st2);
+	slab_kmem_cache_obtain_stat(tst_bulk_cache.merged, &pool);
+	if ( ( st1.allocs == ( TST_SLAB_OBJS_NR / 2 ) ) && ( st2.allocs == ( TST_SLAB_OBJS_NR / 2 ) )
+	    && ( ( pool.allocs - pool_allocs ) >= TST_SLAB_OBJS_NR )
+	    && ( st1.nr_slabs == 0 ) && ( st2.nr_slabs == 0 ) && ( pool.nr_slabs > 0 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	slab_kmem_cache_show_info();
+
+	/* 使用中のオブジェクトがあるエイリアスは破棄しない */
+	aliases = tst_alias_cache.merged->nr_aliases;
+	rc = slab_kmem_cache_destroy(&tst_alias_cache);
+	if ( ( rc == -EBUSY ) && ( tst_alias_cache.merged == tst_bulk_cache.merged )
+	    && ( tst_bulk_cache.merged->nr_aliases == aliases )
+	    && ( slab_kmem_cache_foreach(find_cache, &tst_alias_cache) == 1 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	for(i = 0; TST_SLAB_OBJS_NR > i; ++i)
+		slab_kmem_cache_free_obj(( i & 1 ) ? &tst_alias_cache : &tst_bulk_cache, objs[i]);
+	slab_kmem_cache_obtain_stat(&tst_bulk_cache, &st1);
+	slab_kmem_cache_obtain_stat(&tst_alias_cache, &st2);
+	if ( ( st1.frees == ( TST_SLAB_OBJS_NR / 2 ) ) && ( st1.active_objs == 0 )
+	    && ( st2.frees == ( TST_SLAB_OBJS_NR / 2 ) ) && ( st2.active_objs == 0 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	if ( ( slab_kmem_cache_destroy(&tst_alias_cache) == 0 )
+	    && ( slab_kmem_cache_destroy(&tst_bulk_cache) == 0 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * コンストラクタを持つキャッシュは統合しない
+	 */
+	rc = slab_kmem_cache_create(&tst_bulk_cache, "tst-slab-noalias", TST_SLAB_OBJ_SIZE,
+	    SLAB_ALIGN_NONE, 0, KMALLOC_NORMAL | KM_SFLAGS_MERGEABLE, tst_slab_ctor, NULL);
+	kassert( rc == 0 );
+	rc = slab_kmem_cache_alloc(&tst_bulk_cache, KMALLOC_NORMAL, &obj);
+	kassert( rc == 0 );
+	slab_kmem_cache_obtain_stat(&tst_bulk_cache, &st1);
+	if ( ( tst_bulk_cache.merged == NULL ) && ( st1.alias_of == NULL )
+	    && ( st1.nr_slabs > 0 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 使用中のオブジェクトがあるキャッシュは破棄せず, 登録を抹消しない */
+	rc = slab_kmem_cache_destroy(&tst_bulk_cache);
+	if ( ( rc == -EBUSY ) && ( slab_kmem_cache_foreach(find_cache, &tst_bulk_cache) == 1 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	slab_kmem_cache_free(obj);
+	rc = slab_kmem_cache_destroy(&tst_bulk_cache);
+	if ( ( rc == 0 ) && ( slab_kmem_cache_foreach(find_cache, &tst_bulk_cache) == 0 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+}
+
+void
+tst_slab(void){
+
+	ktest_def_test(&tstat_slab, "slab1", slab1, NULL);
+	ktest_def_test(&tstat_slab, "slab2", slab2, NULL);
+	ktest_def_test(&tstat_slab, "slab3", slab3, NULL);
+	ktest_def_test(&tstat_slab, "slab4", slab4, NULL);
+	ktest_def_test(&tstat_slab, "slab5", slab5, NULL);
+	ktest_def_test(&tstat_slab, "slab6", slab6, NULL);
+	ktest_def_test(&tstat_slab, "slab7", slab7, NULL);
+	ktest_def_test(&tstat_slab, "slab8", slab8, NULL);
+	ktest_def_test(&tstat_slab, "slab9", slab9, NULL);
+	ktest_run(&tstat_slab);
+}
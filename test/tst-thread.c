@@ -102,10 +102,732 @@ thread1(struct _ktest_stats *sp, void __unused *arg){
 	return;
 }
 
+/**
+   CPU単位レディキューのテスト
+ */
+static void
+thread2(struct _ktest_stats *sp, void __unused *arg){
+	int                rc;
+	cpu_id            cpu;
+	thread           *thr;
+	thr_wait_res      res;
+	sched_queue_stat  before;
+	sched_queue_stat   after;
+
+	/* 不正なCPUIDの統計情報は取得できない */
+	rc = sched_obtain_queue_stat(KC_CPUS_NR, &before);
+	if ( rc == -EINVAL )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * スレッドは最後に動作したCPUのレディキューに追加される
+	 */
+	cpu = krn_current_cpu_get();
+	rc = sched_obtain_queue_stat(cpu, &before);
+	kassert( rc == 0 );
+
+	rc = thr_thread_create(THR_TID_AUTO, (entry_addr )thread_test, NULL, NULL, 
+			       SCHED_MIN_USER_PRIO, THR_THRFLAGS_KERNEL, &thr);
+	kassert( rc == 0 );
+	sched_thread_add(thr);
+
+	sched_obtain_queue_stat(cpu, &after);
+	if ( ( thr->rdq == &krn_cpuinfo_get(cpu)->rdq )
+	    && ( after.nr_threads == ( before.nr_threads + 1 ) ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* オンラインCPUが1つの場合は負荷分散でスレッドを移動しない */
+	if ( ( krn_cpuinfo_cpu_is_online(cpu + 1) ) || ( sched_rebalance() == 0 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	rc = thr_thread_wait(&res);
+	kassert( rc == 0 );
+
+	/* 実行されたスレッドはレディキューから取り除かれる */
+	sched_obtain_queue_stat(cpu, &after);
+	if ( after.nr_threads == before.nr_threads )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+}
+
+#if !defined(CONFIG_HAL)
+#if KC_CPUS_NR > 1
+/**
+   再スケジュールIPIのテスト
+   @note 擬似的な2つ目のCPUを登録するため, 複数のCPUを扱う構成でのみ実行する
+ */
+static void
+thread3(struct _ktest_stats *sp, void __unused *arg){
+	int                rc;
+	int                 i;
+	cpu_id            cpu;
+	thread       *thrs[2];
+	thr_wait_res      res;
+	obj_cnt_type    moved;
+	sched_queue_stat  before;
+	sched_queue_stat   after;
+
+	/* 擬似的な2つ目のCPUを登録し, オンラインにする */
+	rc = krn_cpuinfo_cpu_register(1, &cpu);
+	kassert( rc == 0 );
+	rc = krn_cpuinfo_online(cpu);
+	kassert( rc == 0 );
+
+	rc = sched_obtain_queue_stat(cpu, &before);
+	kassert( rc == 0 );
+
+	/*
+	 * 他のCPUのキューへの追加時にIPIを送信し, 受信前の追加では送信を抑止する
+	 */
+	for( i = 0; 2 > i; ++i) {
+
+		rc = thr_thread_create(THR_TID_AUTO, (entry_addr )thread_test, NULL, NULL,
+		    SCHED_MIN_USER_PRIO, THR_THRFLAGS_KERNEL, &thrs[i]);
+		kassert( rc == 0 );
+		thrs[i]->tinfo->cpu = cpu;  /* 2つ目のCPUで動作したスレッドとする */
+		sched_thread_add(thrs[i]);
+	}
+
+	sched_obtain_queue_stat(cpu, &after);
+	if ( ( thrs[0]->rdq == &krn_cpuinfo_get(cpu)->rdq )
+	    && ( after.ipis_sent == ( before.ipis_sent + 1 ) )
+	    && ( after.ipis_coalesced == ( before.ipis_coalesced + 1 ) ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 受信側でIPIを処理すると以降の追加で再度IPIを送信する */
+	if ( x64_deliver_pending_ipis() == 1 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	sched_obtain_queue_stat(cpu, &after);
+	if ( after.ipis_received == ( before.ipis_received + 1 ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	kprintf("resched ipi: sent=%lu coalesced=%lu received=%lu latency=%lu cycles\n",
+	    after.ipis_sent, after.ipis_coalesced, after.ipis_received,
+	    after.ipi_latency_cycles / after.ipis_received);
+
+	/* 受信待ちのIPIがなければ何もしない */
+	if ( x64_deliver_pending_ipis() == 0 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 他のCPUのキューに追加したスレッドは奪取して実行される */
+	for( i = 0; 2 > i; ++i) {
+
+		rc = thr_thread_wait(&res);
+		if ( rc == 0 )
+			ktest_pass( sp );
+		else
+			ktest_fail( sp );
+	}
+
+	/*
+	 * 負荷分散で移動したスレッドは移動先のキューに接続され,
+	 * 移動先のCPUにIPIを送信する
+	 */
+	sched_obtain_queue_stat(cpu, &before);
+	for( i = 0; 2 > i; ++i) {
+
+		rc = thr_thread_create(THR_TID_AUTO, (entry_addr )thread_test, NULL, NULL,
+		    SCHED_MIN_USER_PRIO, THR_THRFLAGS_KERNEL, &thrs[i]);
+		kassert( rc == 0 );
+		sched_thread_add(thrs[i]);
+	}
+
+	moved = sched_rebalance();
+	sched_obtain_queue_stat(cpu, &after);
+	if ( ( moved == 1 )
+	    && ( ( thrs[0]->rdq == &krn_cpuinfo_get(cpu)->rdq )
+		|| ( thrs[1]->rdq == &krn_cpuinfo_get(cpu)->rdq ) )
+	    && ( after.migrations == ( before.migrations + 1 ) )
+	    && ( after.ipis_sent == ( before.ipis_sent + 1 ) ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+	x64_deliver_pending_ipis();  /* 2つ目のCPUでIPIを処理する */
+
+	for( i = 0; 2 > i; ++i) {
+
+		rc = thr_thread_wait(&res);
+		if ( rc == 0 )
+			ktest_pass( sp );
+		else
+			ktest_fail( sp );
+	}
+}
+
+#endif  /*  KC_CPUS_NR > 1  */
+
+#define TST_BENCH_THREADS_NR  (4)                   /**< CPUバウンドスレッド数     */
+#define TST_BENCH_TICKS       (KC_TIME_SLICE * 4)   /**< 各スレッドの実行ティック数 */
+
+/**
+   CPUバウンドスレッドの計測情報
+ */
+typedef struct _tst_bench_worker{
+	uint64_t           last;  /**< 最後に実行したティック       */
+	uint64_t       max_wait;  /**< 最大実行待ちティック数       */
+	uint64_t     total_wait;  /**< 実行待ちティック数の累計     */
+	obj_cnt_type    samples;  /**< 計測回数                     */
+}tst_bench_worker;
+
+static uint64_t                               tst_bench_ticks;  /**< 経過ティック数 */
+static int                                     tst_bench_next;  /**< 次に割り当てる計測情報 */
+static tst_bench_worker tst_bench_workers[TST_BENCH_THREADS_NR];  /**< 計測情報     */
+
+/**
+   CPUバウンドスレッド
+   @param[in] arg 未使用
+   @note 起動順に計測情報を割り当てる
+   @note タイマ割込みのない環境のため, 1ティック分の処理ごとに
+   タイマ割込みの処理と割込み出口でのディスパッチを模擬する
+ */
+static void
+cpu_bound_thread(void __unused *arg){
+	int                 i;
+	uint64_t         wait;
+	tst_bench_worker   *w;
+
+	w = &tst_bench_workers[tst_bench_next++];  /* 計測情報を割り当てる */
+	for( i = 0; TST_BENCH_TICKS > i; ++i) {
+
+		/* 前回実行してから他のスレッドが消費したティック数 */
+		wait = tst_bench_ticks - w->last;
+		if ( wait > w->max_wait )
+			w->max_wait = wait;
+		w->total_wait += wait;
+		++w->samples;
+
+		w->last = ++tst_bench_ticks;  /* 1ティック分処理する */
+
+		sched_timer_tick();      /* タイムスライスを更新 */
+		sched_delay_disptach();  /* 割込み出口処理 */
+	}
+
+	thr_thread_exit(0);
+}
+
+/**
+   CPUバウンドスレッドの実行待ち時間を計測する
+   @param[in]  prio      スレッドの優先度
+   @param[out] max_waitp 最大実行待ちティック数返却領域
+   @param[out] avg_waitp 平均実行待ちティック数返却領域
+ */
+static void
+run_cpu_bound_bench(thr_prio prio, uint64_t *max_waitp, uint64_t *avg_waitp){
+	int                 rc;
+	int                  i;
+	thread            *thr;
+	thr_wait_res       res;
+	uint64_t      max_wait;
+	uint64_t    total_wait;
+	obj_cnt_type   samples;
+
+	tst_bench_ticks = 0;
+	tst_bench_next = 0;
+	memset(&tst_bench_workers[0], 0, sizeof(tst_bench_workers));
+
+	for( i = 0; TST_BENCH_THREADS_NR > i; ++i) {
+
+		rc = thr_thread_create(THR_TID_AUTO, (entry_addr )cpu_bound_thread,
+		    NULL, NULL, prio, THR_THRFLAGS_KERNEL, &thr);
+		kassert( rc == 0 );
+		sched_thread_add(thr);
+	}
+
+	for( i = 0; TST_BENCH_THREADS_NR > i; ++i) {
+
+		rc = thr_thread_wait(&res);
+		kassert( rc == 0 );
+	}
+
+	max_wait = 0;
+	total_wait = 0;
+	samples = 0;
+	for( i = 0; TST_BENCH_THREADS_NR > i; ++i) {
+
+		if ( tst_bench_workers[i].max_wait > max_wait )
+			max_wait = tst_bench_workers[i].max_wait;
+		total_wait += tst_bench_workers[i].total_wait;
+		samples += tst_bench_workers[i].samples;
+	}
+
+	*max_waitp = max_wait;
+	*avg_waitp = total_wait / samples;
+}
+
+/**
+   タイムスライスによるラウンドロビンのテスト
+ */
+static void
+thread4(struct _ktest_stats *sp, void __unused *arg){
+	cpu_id                cpu;
+	uint64_t          rr_max;
+	uint64_t          rr_avg;
+	uint64_t        fcfs_max;
+	uint64_t        fcfs_avg;
+	sched_queue_stat  before;
+	sched_queue_stat   after;
+
+	cpu = krn_current_cpu_get();
+	sched_obtain_queue_stat(cpu, &before);
+
+	/* ラウンドロビンクラスではタイムスライスごとに横取りする */
+	run_cpu_bound_bench(SCHED_MAX_RR_PRIO, &rr_max, &rr_avg);
+	sched_obtain_queue_stat(cpu, &after);
+	if ( ( rr_max == ( ( TST_BENCH_THREADS_NR - 1 ) * KC_TIME_SLICE ) )
+	    && ( after.slice_expires > before.slice_expires ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* FCFSクラスでは横取りしない */
+	run_cpu_bound_bench(SCHED_MAX_FCFS_PRIO, &fcfs_max, &fcfs_avg);
+	if ( fcfs_max == ( ( TST_BENCH_THREADS_NR - 1 ) * TST_BENCH_TICKS ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	kprintf("cpu-bound x%d wait ticks: rr(max=%lu avg=%lu) fcfs(max=%lu avg=%lu)\n",
+	    TST_BENCH_THREADS_NR, rr_max, rr_avg, fcfs_max, fcfs_avg);
+}
+
+#if KC_CPUS_NR > 1
+/**< 移動元と移動先の最小仮想実行時間の差 */
+#define TST_FAIR_MIGRATE_GAP  ( SCHED_FAIR_NS_PER_MS * 1000 )
+
+/**
+   CPUアフィニティのテスト
+   @note thread3で2つ目のCPUをオンラインにした後に実行する
+ */
+static void
+thread5(struct _ktest_stats *sp, void __unused *arg){
+	int                rc;
+	cpu_id            cpu;
+	cpu_id          other;
+	cpu_id        offline;
+	thread           *thr;
+	thr_wait_res      res;
+	cpu_bitmap       mask;
+	uint64_t          lag;
+	sched_queue      *crq;
+	sched_queue      *orq;
+	sched_queue_stat  before;
+	sched_queue_stat   after;
+
+	cpu = krn_current_cpu_get();
+	other = cpu + 1;
+	kassert( krn_cpuinfo_cpu_is_online(other) );
+
+	rc = thr_thread_create(THR_TID_AUTO, (entry_addr )thread_test, NULL, NULL,
+	    SCHED_MIN_USER_PRIO, THR_THRFLAGS_KERNEL, &thr);
+	kassert( rc == 0 );
+
+	/* 生成直後のスレッドは全てのCPUで実行可能 */
+	thr_get_affinity(thr, &mask);
+	if ( bitops_isset(cpu, &mask) && bitops_isset(other, &mask) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 実行可能なオンラインCPUを含まないアフィニティは設定できない */
+	bitops_zero(&mask);
+	rc = thr_set_affinity(thr, &mask);
+	if ( rc == -EINVAL )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* オフラインのCPUを探す */
+	for( offline = 0; KC_CPUS_NR > offline; ++offline)
+		if ( !krn_cpuinfo_cpu_is_online(offline) )
+			break;
+
+	if ( KC_CPUS_NR > offline ) {  /* オフラインのCPUがある場合 */
+
+		bitops_set(offline, &mask);  /* オフラインのCPU */
+		rc = thr_set_affinity(thr, &mask);
+		if ( rc == -EINVAL )
+			ktest_pass( sp );
+		else
+			ktest_fail( sp );
+	}
+
+	/*
+	 * 実行可能なCPUのレディキューに追加する
+	 */
+	bitops_zero(&mask);
+	bitops_set(other, &mask);
+	rc = thr_set_affinity(thr, &mask);
+	if ( rc == 0 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	thr_get_affinity(thr, &mask);
+	if ( ( !bitops_isset(cpu, &mask) ) && ( bitops_isset(other, &mask) ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 移動時の仮想実行時間の補正を確認するため, 2つ目のCPUの
+	 * 最小仮想実行時間を進めておく
+	 */
+	orq = &krn_cpuinfo_get(other)->rdq;
+	crq = &krn_cpuinfo_get(cpu)->rdq;
+	if ( crq->fair_min_vruntime > orq->fair_min_vruntime )
+		orq->fair_min_vruntime = crq->fair_min_vruntime;
+	orq->fair_min_vruntime += TST_FAIR_MIGRATE_GAP;
+	lag = 5 * SCHED_FAIR_NS_PER_MS;
+	thr->attr.vruntime = orq->fair_min_vruntime + lag;
+
+	sched_thread_add(thr);
+	if ( ( thr->rdq == orq ) && ( thr->attr.vruntime == ( orq->fair_min_vruntime + lag ) ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+	x64_deliver_pending_ipis();  /* 2つ目のCPUでIPIを処理する */
+
+	/* 他のCPUでの実行に限定されたスレッドは奪取対象にならない */
+	if ( !sched_has_stealable_thread() )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* アフィニティに含まれるCPUで待っているスレッドは移動しない */
+	sched_obtain_queue_stat(cpu, &before);
+	bitops_set(cpu, &mask);
+	rc = thr_set_affinity(thr, &mask);
+	sched_obtain_queue_stat(cpu, &after);
+	if ( ( rc == 0 ) && ( thr->rdq == &krn_cpuinfo_get(other)->rdq )
+	    && ( after.migrations == before.migrations ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 自CPUでの実行を許可されたスレッドは奪取対象になる */
+	if ( sched_has_stealable_thread() )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* アフィニティから外れたCPUで待っているスレッドは移動する */
+	bitops_clr(other, &mask);
+	rc = thr_set_affinity(thr, &mask);
+	sched_obtain_queue_stat(cpu, &after);
+	if ( ( rc == 0 ) && ( thr->rdq == crq )
+	    && ( after.migrations == ( before.migrations + 1 ) ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* 移動したスレッドは移動元の最小仮想実行時間との差を保って移動先に配置される */
+	if ( thr->attr.vruntime == ( crq->fair_min_vruntime + lag ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	rc = thr_thread_wait(&res);
+	if ( rc == 0 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+}
+
+#endif  /*  KC_CPUS_NR > 1  */
+
+#define TST_FAIR_THREADS_NR  (3)                    /**< 公平性計測用スレッド数     */
+#define TST_FAIR_TICKS       (KC_TIME_SLICE * 60)   /**< 公平性計測の総ティック数   */
+#define TST_WAKE_HOGS_NR     (3)                    /**< CPUバウンドスレッド数      */
+#define TST_WAKE_PERIOD      (KC_TIME_SLICE / 2 + 2)  /**< 起床要求の周期 (単位:ティック) */
+#define TST_WAKE_TICKS       (KC_TIME_SLICE * 30)   /**< 起床遅延計測の総ティック数 */
+
+/**< 公平性計測用スレッドの優先度 */
+static const thr_prio tst_fair_prios[TST_FAIR_THREADS_NR] = {
+	SCHED_FAIR_NICE0_PRIO, SCHED_FAIR_NICE0_PRIO, SCHED_FAIR_NICE0_PRIO + 8 };
+static thread     *tst_fair_thrs[TST_FAIR_THREADS_NR];  /**< 公平性計測用スレッド */
+static uint64_t    tst_fair_runs[TST_FAIR_THREADS_NR];  /**< 実行したティック数   */
+
+/**
+   起床遅延の計測情報
+ */
+typedef struct _tst_wake_bench{
+	spinlock                  lock;  /**< 計測情報のロック         */
+	struct _wque_waitqueue    wque;  /**< 起床待ちキュー           */
+	bool                 requested;  /**< 起床要求あり             */
+	bool                      done;  /**< 計測終了                 */
+	uint64_t             wake_tick;  /**< 起床要求時のティック     */
+	uint64_t           max_latency;  /**< 最大起床遅延ティック数   */
+	uint64_t         total_latency;  /**< 起床遅延ティック数の累計 */
+	obj_cnt_type           samples;  /**< 計測回数                 */
+}tst_wake_bench;
+
+static tst_wake_bench tst_wake;  /**< 起床遅延の計測情報 */
+
+/**
+   公平性計測用のCPUバウンドスレッド
+   @param[in] arg 未使用
+   @note 総ティック数に達するまで1ティック分の処理を繰り返し,
+   自スレッドが実行したティック数を記録する
+ */
+static void
+fair_bound_thread(void __unused *arg){
+	int                 i;
+	thread           *cur;
+
+	cur = ti_get_current_thread();
+	for( i = 0; tst_fair_thrs[i] != cur; ++i);  /* 計測情報を探す */
+
+	while( TST_FAIR_TICKS > tst_bench_ticks ) {
+
+		++tst_fair_runs[i];
+		++tst_bench_ticks;       /* 1ティック分処理する */
+
+		sched_timer_tick();      /* 仮想実行時間を更新 */
+		sched_delay_disptach();  /* 割込み出口処理 */
+	}
+
+	thr_thread_exit(0);
+}
+
+/**
+   起床遅延計測用スレッドを起床する
+   @param[in] done 計測を終了する場合は真
+ */
+static void
+wake_interactive_thread(bool done){
+	intrflags iflags;
+
+	spinlock_lock_disable_intr(&tst_wake.lock, &iflags);
+	if ( done )
+		tst_wake.done = true;  /* 計測を終了する */
+	else if ( !tst_wake.requested ) {
+
+		tst_wake.requested = true;
+		tst_wake.wake_tick = tst_bench_ticks;  /* 起床要求時刻を記録 */
+	}
+	wque_wakeup(&tst_wake.wque, WQUE_RELEASED);
+	spinlock_unlock_restore_intr(&tst_wake.lock, &iflags);
+}
+
+/**
+   起床遅延計測用のCPUバウンドスレッド
+   @param[in] arg 未使用
+   @note 割込みによる起床を模擬し, TST_WAKE_PERIODティックごとに
+   対話型スレッドを起床する
+ */
+static void
+wake_hog_thread(void __unused *arg){
+
+	while( TST_WAKE_TICKS > tst_bench_ticks ) {
+
+		if ( ( ++tst_bench_ticks % TST_WAKE_PERIOD ) == 0 )
+			wake_interactive_thread(false);  /* 対話型スレッドを起床する */
+
+		sched_timer_tick();      /* タイムスライスを更新 */
+		sched_delay_disptach();  /* 割込み出口処理 */
+	}
+	wake_interactive_thread(true);  /* 計測を終了する */
+
+	thr_thread_exit(0);
+}
+
+/**
+   起床遅延計測用の対話型スレッド
+   @param[in] arg 未使用
+   @note 起床要求から実行されるまでに経過したティック数を記録する
+ */
+static void
+wake_interactive_thread_main(void __unused *arg){
+	bool         done;
+	uint64_t  latency;
+	intrflags  iflags;
+
+	do{
+
+		krn_cpu_save_and_disable_interrupt(&iflags);
+		spinlock_lock(&tst_wake.lock);
+
+		while( ( !tst_wake.requested ) && ( !tst_wake.done ) )
+			wque_wait_on_queue_with_spinlock(&tst_wake.wque, &tst_wake.lock);
+
+		if ( tst_wake.requested ) {
+
+			latency = tst_bench_ticks - tst_wake.wake_tick;
+			if ( latency > tst_wake.max_latency )
+				tst_wake.max_latency = latency;
+			tst_wake.total_latency += latency;
+			++tst_wake.samples;
+			tst_wake.requested = false;
+		}
+		done = tst_wake.done;
+
+		spinlock_unlock(&tst_wake.lock);
+		krn_cpu_restore_interrupt(&iflags);
+	}while( !done );
+
+	thr_thread_exit(0);
+}
+
+/**
+   CPUバウンドスレッド実行中の対話型スレッドの起床遅延を計測する
+   @param[in]  prio     スレッドの優先度
+   @param[out] maxp     最大起床遅延ティック数返却領域
+   @param[out] avgp     平均起床遅延ティック数返却領域
+ */
+static void
+run_wakeup_bench(thr_prio prio, uint64_t *maxp, uint64_t *avgp){
+	int                 rc;
+	int                  i;
+	thread            *thr;
+	thr_wait_res       res;
+
+	tst_bench_ticks = 0;
+	memset(&tst_wake, 0, sizeof(tst_wake));
+	spinlock_init(&tst_wake.lock);
+	wque_init_wait_queue(&tst_wake.wque);
+
+	rc = thr_thread_create(THR_TID_AUTO, (entry_addr )wake_interactive_thread_main,
+	    NULL, NULL, prio, THR_THRFLAGS_KERNEL, &thr);
+	kassert( rc == 0 );
+	sched_thread_add(thr);
+
+	for( i = 0; TST_WAKE_HOGS_NR > i; ++i) {
+
+		rc = thr_thread_create(THR_TID_AUTO, (entry_addr )wake_hog_thread,
+		    NULL, NULL, prio, THR_THRFLAGS_KERNEL, &thr);
+		kassert( rc == 0 );
+		sched_thread_add(thr);
+	}
+
+	for( i = 0; ( TST_WAKE_HOGS_NR + 1 ) > i; ++i) {
+
+		rc = thr_thread_wait(&res);
+		kassert( rc == 0 );
+	}
+
+	kassert( tst_wake.samples > 0 );
+	*maxp = tst_wake.max_latency;
+	*avgp = tst_wake.total_latency / tst_wake.samples;
+}
+
+/**
+   公平スケジューリングクラスのテスト
+ */
+static void
+thread6(struct _ktest_stats *sp, void __unused *arg){
+	int                 rc;
+	int                  i;
+	cpu_id             cpu;
+	thr_wait_res       res;
+	uint64_t      expected;
+	uint64_t        weight;
+	uint64_t      fair_max;
+	uint64_t      fair_avg;
+	uint64_t        rr_max;
+	uint64_t        rr_avg;
+	sched_queue_stat  before;
+	sched_queue_stat   after;
+
+	/* 重みはベース優先度が高いほど大きい */
+	if ( ( sched_fair_prio_to_weight(SCHED_FAIR_NICE0_PRIO) == SCHED_FAIR_NICE0_WEIGHT )
+	    && ( sched_fair_prio_to_weight(SCHED_MAX_FAIR_PRIO)
+		> sched_fair_prio_to_weight(SCHED_FAIR_NICE0_PRIO) )
+	    && ( sched_fair_prio_to_weight(SCHED_FAIR_NICE0_PRIO)
+		> sched_fair_prio_to_weight(SCHED_MIN_FAIR_PRIO) ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * 重みに比例してCPU時間を分配する
+	 */
+	cpu = krn_current_cpu_get();
+	sched_obtain_queue_stat(cpu, &before);
+
+	tst_bench_ticks = 0;
+	memset(&tst_fair_runs[0], 0, sizeof(tst_fair_runs));
+	weight = 0;
+	for( i = 0; TST_FAIR_THREADS_NR > i; ++i) {
+
+		rc = thr_thread_create(THR_TID_AUTO, (entry_addr )fair_bound_thread,
+		    NULL, NULL, tst_fair_prios[i], THR_THRFLAGS_KERNEL, &tst_fair_thrs[i]);
+		kassert( rc == 0 );
+		weight += sched_fair_prio_to_weight(tst_fair_prios[i]);
+	}
+	for( i = 0; TST_FAIR_THREADS_NR > i; ++i)
+		sched_thread_add(tst_fair_thrs[i]);
+	for( i = 0; TST_FAIR_THREADS_NR > i; ++i) {
+
+		rc = thr_thread_wait(&res);
+		kassert( rc == 0 );
+	}
+
+	sched_obtain_queue_stat(cpu, &after);
+	if ( after.fair_preempts > before.fair_preempts )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	for( i = 0; TST_FAIR_THREADS_NR > i; ++i) {
+
+		expected = TST_FAIR_TICKS * sched_fair_prio_to_weight(tst_fair_prios[i])
+			/ weight;
+		kprintf("fair share[%d] weight=%u ticks=%lu expected=%lu\n", i,
+		    sched_fair_prio_to_weight(tst_fair_prios[i]), tst_fair_runs[i], expected);
+		/* 誤差は総ティック数の5%以内 */
+		if ( ( tst_fair_runs[i] + TST_FAIR_TICKS / 20 >= expected )
+		    && ( expected + TST_FAIR_TICKS / 20 >= tst_fair_runs[i] ) )
+			ktest_pass( sp );
+		else
+			ktest_fail( sp );
+	}
+
+	/*
+	 * 起床したスレッドはCPUバウンドスレッドより先に実行される
+	 */
+	run_wakeup_bench(SCHED_FAIR_NICE0_PRIO, &fair_max, &fair_avg);
+	run_wakeup_bench(SCHED_MAX_RR_PRIO, &rr_max, &rr_avg);
+	if ( ( 1 >= fair_max ) && ( rr_max > fair_max ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	kprintf("wakeup latency ticks with %d hogs: fair(max=%lu avg=%lu) "
+	    "rr(max=%lu avg=%lu)\n", TST_WAKE_HOGS_NR, fair_max, fair_avg,
+	    rr_max, rr_avg);
+}
+#endif  /*  !CONFIG_HAL  */
+
 void
 tst_thread(void){
 
 	ktest_def_test(&tstat_thread, "thread1", thread1, NULL);
+	ktest_def_test(&tstat_thread, "thread2", thread2, NULL);
+#if !defined(CONFIG_HAL)
+#if KC_CPUS_NR > 1
+	ktest_def_test(&tstat_thread, "thread3", thread3, NULL);
+#endif  /*  KC_CPUS_NR > 1  */
+	ktest_def_test(&tstat_thread, "thread4", thread4, NULL);
+#if KC_CPUS_NR > 1
+	ktest_def_test(&tstat_thread, "thread5", thread5, NULL);
+#endif  /*  KC_CPUS_NR > 1  */
+	ktest_def_test(&tstat_thread, "thread6", thread6, NULL);
+#endif  /*  !CONFIG_HAL  */
 	ktest_run(&tstat_thread);
 }
 
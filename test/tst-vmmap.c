@@ -84,10 +84,97 @@ vmmap1(struct _ktest_stats *sp, void __unused *arg){
 	pgtbl_free_user_pgtbl(pgt1);
 }
 
+/**
+   無名ページの移動のテスト
+ */
+static void
+vmmap2(struct _ktest_stats *sp, void __unused *arg){
+	int               rc;
+	vm_pgtbl         pgt;
+	vm_paddr  old_paddr;
+	vm_paddr  new_paddr;
+	vm_prot         prot;
+	vm_flags       flags;
+	vm_size       pgsize;
+	uint64_t     *kvaddr;
+	page_frame       *pf;
+	pfdb_stat     before;
+	pfdb_stat      after;
+
+	rc = pgtbl_alloc_user_pgtbl(&pgt);
+	if ( rc == 0 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	rc = vm_map_userpage(pgt, USER_VMA_ADDR, VM_PROT_READ|VM_PROT_WRITE,
+	    VM_FLAGS_USER, PAGE_SIZE, PAGE_SIZE);
+	if ( rc == 0 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	rc = hal_pgtbl_extract(pgt, USER_VMA_ADDR, &old_paddr, &prot, &flags, &pgsize);
+	kassert( rc == 0 );
+	rc = pfdb_paddr_to_kvaddr((void *)old_paddr, (void **)&kvaddr);
+	kassert( rc == 0 );
+	rc = pfdb_kvaddr_to_page_frame(kvaddr, &pf);
+	kassert( rc == 0 );
+	*kvaddr = 0xdeadbeef;
+
+	/* 物理->仮想アドレス変換エントリが登録されている */
+	if ( PAGE_USED_BY_ANON(pf) && !queue_is_empty(&pf->pv_head) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/*
+	 * ページを移動すると別の物理ページに同じ内容がマップされる
+	 */
+	kcom_obtain_pfdb_stat(&before);
+	rc = pfdb_migrate_page(pf);
+	kcom_obtain_pfdb_stat(&after);
+	if ( ( rc == 0 ) && ( after.migrated_pages == ( before.migrated_pages + 1 ) ) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	rc = hal_pgtbl_extract(pgt, USER_VMA_ADDR, &new_paddr, &prot, &flags, &pgsize);
+	kassert( rc == 0 );
+	rc = pfdb_paddr_to_kvaddr((void *)new_paddr, (void **)&kvaddr);
+	kassert( rc == 0 );
+	if ( ( new_paddr != old_paddr ) && ( *kvaddr == 0xdeadbeef ) 
+	    && !PAGE_IS_USED(pf) )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	rc = vm_unmap(pgt, USER_VMA_ADDR, VM_FLAGS_USER, PAGE_SIZE);
+	if ( rc == 0 )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+
+	/* マップされていない無名ページは移動できない */
+	rc = pgif_get_free_page((void **)&kvaddr, KMALLOC_NORMAL, PAGE_USAGE_ANON);
+	kassert( rc == 0 );
+	rc = pfdb_kvaddr_to_page_frame(kvaddr, &pf);
+	kassert( rc == 0 );
+	rc = pfdb_migrate_page(pf);
+	if ( rc == -EBUSY )
+		ktest_pass( sp );
+	else
+		ktest_fail( sp );
+	pgif_free_page(kvaddr);
+
+	pgtbl_free_user_pgtbl(pgt);
+}
+
 void
 tst_vmmap(void){
 
 	ktest_def_test(&tstat_vmmap, "vmmap1", vmmap1, NULL);
+	ktest_def_test(&tstat_vmmap, "vmmap2", vmmap2, NULL);
 	ktest_run(&tstat_vmmap);
 }
 